@@ -0,0 +1,1454 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits_bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/*
+	Throughput benchmarks for quickfits.
+
+	quickfits_bench [-dir directory] [-map imsize] [-ncc n] [-nvis n] [-nif n] [-nchan n] [-nant n]
+		[-threads n] [-reps n] [-seed n] [-only substring] [-o results.json]
+
+	Synthetic maps and FITAB UV files of the given sizes are written to directory (default $TMPDIR or /tmp)
+	and every benchmark is run reps times, each in its own process so its peak resident set size is its own.
+	Results (best time of the repetitions) are written as JSON, one object per benchmark :
+	{"name", "seconds", "bytes", "rows", "mb_per_s", "rows_per_s", "peak_rss_kb", "status"}
+	Benchmarks of alternative read paths also check (untimed) that they give exactly what the serial reader does,
+	and report status BENCH_MISMATCH if not. So does the UV writer, whose output is read back.
+*/
+
+#define BENCH_MISMATCH -2	// output differs from the serial reader
+
+typedef struct bench_ctx_tag{
+	bench_sizes sizes;
+	int nthreads;
+	char dir[FLEN_FILENAME];
+	char map[FLEN_FILENAME];	// synthetic files, made once
+	char uv[FLEN_FILENAME];
+	char uv_gz[FLEN_FILENAME];
+	char scratch[FLEN_FILENAME];	// for output, and copies of the inputs for benchmarks that change them
+	long long map_bytes;	// file sizes
+	long long uv_bytes;
+}bench_ctx;
+
+typedef struct bench_result_tag{
+	double seconds;
+	long long bytes;	// data moved by one run, for MB/s
+	long long rows;	// pixels rows, visibilities, clean components or files, for rows/s
+	int status;
+	struct timespec start;
+}bench_result;
+
+typedef void (*bench_fn)(bench_ctx* ctx, bench_result* r);
+
+static void timer_start(bench_result* r)
+{
+	clock_gettime(CLOCK_MONOTONIC, &r[0].start);
+}
+
+static void timer_stop(bench_result* r)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	r[0].seconds = (end.tv_sec - r[0].start.tv_sec) + 1.0E-9*(end.tv_nsec - r[0].start.tv_nsec);
+}
+
+static long long file_size(const char* filename)
+{
+	struct stat st;
+
+	if(stat(filename, &st))
+	{
+		return(0);
+	}
+	return(st.st_size);
+}
+
+static void drop_cache(const char* filename)
+{
+	int fd;
+
+	fd = open(filename, O_RDONLY);	// push the file out of the page cache, so the next read comes from the disk
+	if(fd >= 0)
+	{
+		fdatasync(fd);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+}
+
+static int copy_file(const char* from, const char* to)
+{
+	FILE* in;
+	FILE* out;
+	char buffer[1<<16];
+	size_t n;
+	int status;
+
+	in = fopen(from, "rb");
+	out = fopen(to, "wb");
+	status = (in == NULL || out == NULL) ? FILE_NOT_OPENED : 0;
+	while(status == 0 && (n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+	{
+		if(fwrite(buffer, 1, n, out) != n)
+		{
+			status = WRITE_ERROR;
+		}
+	}
+	if(in != NULL)
+	{
+		fclose(in);
+	}
+	if(out != NULL && fclose(out))
+	{
+		status = WRITE_ERROR;
+	}
+	return(status);
+}
+
+static int gzip_file(const char* from, const char* to)
+{
+	FILE* in;
+	gzFile out;
+	char buffer[1<<16];
+	size_t n;
+	int status;
+
+	in = fopen(from, "rb");
+	out = gzopen(to, "wb6");
+	status = (in == NULL || out == NULL) ? FILE_NOT_OPENED : 0;
+	while(status == 0 && (n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+	{
+		if(gzwrite(out, buffer, n) != (int)(n))
+		{
+			status = WRITE_ERROR;
+		}
+	}
+	if(in != NULL)
+	{
+		fclose(in);
+	}
+	if(out != NULL && gzclose(out) != Z_OK)
+	{
+		status = WRITE_ERROR;
+	}
+	return(status);
+}
+
+static double* alloc_map(bench_ctx* ctx, fitsinfo_map* fitsi, double** ccx, double** ccy, double** ccv)
+{
+	// header and arrays for reading the synthetic map
+
+	bench_map_info(ctx[0].sizes, fitsi);
+	quickfits_read_map_header(ctx[0].map, fitsi);
+	*ccx = malloc((fitsi[0].ncc+1)*sizeof(double));
+	*ccy = malloc((fitsi[0].ncc+1)*sizeof(double));
+	*ccv = malloc((fitsi[0].ncc+1)*sizeof(double));
+	return(malloc(fitsi[0].imsize_ra*fitsi[0].imsize_dec*sizeof(double)));
+}
+
+static void free_map(double* tarr, double* ccx, double* ccy, double* ccv)
+{
+	free(tarr);
+	free(ccx);
+	free(ccy);
+	free(ccv);
+}
+
+static int compare_map(bench_ctx* ctx, fitsinfo_map fitsi, const double* tarr, const double* ccx, const double* ccy, const double* ccv)
+{
+	// read the map again with the serial reader and check the image and clean components are byte for byte the same
+
+	fitsinfo_map serial_fitsi;
+	double *starr, *sccx, *sccy, *sccv;
+	int status;
+
+	starr = alloc_map(ctx, &serial_fitsi, &sccx, &sccy, &sccv);
+	status = quickfits_read_map(ctx[0].map, serial_fitsi, starr, sccx, sccy, sccv);
+	if(status == 0 && (memcmp(starr, tarr, fitsi.imsize_ra*fitsi.imsize_dec*sizeof(double)) || memcmp(sccx, ccx, fitsi.ncc*sizeof(double))
+		|| memcmp(sccy, ccy, fitsi.ncc*sizeof(double)) || memcmp(sccv, ccv, fitsi.ncc*sizeof(double))))
+	{
+		status = BENCH_MISMATCH;
+	}
+	free_map(starr, sccx, sccy, sccv);
+	return(status);
+}
+
+static void make_map_array(bench_ctx* ctx, fitsinfo_map* fitsi, double** tarr)
+{
+	// the synthetic map in memory, for the benchmarks that write maps
+
+	double *ccx, *ccy, *ccv;
+
+	*tarr = alloc_map(ctx, fitsi, &ccx, &ccy, &ccv);
+	quickfits_read_map(ctx[0].map, *fitsi, *tarr, ccx, ccy, ccv);
+	free(ccx);
+	free(ccy);
+	free(ccv);
+}
+
+static void alloc_uv(bench_ctx* ctx, fitsinfo_uv* fitsi, double** u, double** v, double** tvis, double** if_array)
+{
+	quickfits_read_uv_header(ctx[0].uv, fitsi);
+	*u = malloc(fitsi[0].nvis*sizeof(double));
+	*v = malloc(fitsi[0].nvis*sizeof(double));
+	*tvis = malloc(fitsi[0].nvis*12*fitsi[0].nif*fitsi[0].nchan*sizeof(double));
+	*if_array = malloc(fitsi[0].nif*sizeof(double));
+}
+
+static void free_uv(double* u, double* v, double* tvis, double* if_array)
+{
+	free(u);
+	free(v);
+	free(tvis);
+	free(if_array);
+}
+
+static int compare_uv(bench_ctx* ctx, fitsinfo_uv fitsi, const double* u, const double* v, const double* tvis, const double* if_array)
+{
+	// read the file again with the serial reader and check the arrays are byte for byte the same
+
+	fitsinfo_uv serial_fitsi;
+	double *su, *sv, *stvis, *sif_array;
+	int status;
+
+	alloc_uv(ctx, &serial_fitsi, &su, &sv, &stvis, &sif_array);
+	status = quickfits_read_uv_data(ctx[0].uv, serial_fitsi, su, sv, stvis, sif_array);
+	if(status == 0 && (serial_fitsi.nvis != fitsi.nvis || memcmp(su, u, fitsi.nvis*sizeof(double)) || memcmp(sv, v, fitsi.nvis*sizeof(double))
+		|| memcmp(stvis, tvis, fitsi.nvis*12*fitsi.nif*fitsi.nchan*sizeof(double)) || memcmp(sif_array, if_array, fitsi.nif*sizeof(double))))
+	{
+		status = BENCH_MISMATCH;
+	}
+	free_uv(su, sv, stvis, sif_array);
+	return(status);
+}
+
+static int read_back_uv(bench_ctx* ctx, const char* filename, fitsinfo_uv fitsi)
+{
+	// read a file written from the UV file's data with the serial readers and check it gives the same data back
+
+	fitsinfo_uv back;
+	double *u, *v, *tvis, *if_array;
+	int status;
+
+	memset(&back, 0, sizeof(fitsinfo_uv));
+	status = quickfits_read_uv_header(filename, &back);
+	if(status != 0)
+	{
+		return(status);
+	}
+	if(back.nvis != fitsi.nvis || back.nif != fitsi.nif || back.nchan != fitsi.nchan || back.freq != fitsi.freq)
+	{
+		return(BENCH_MISMATCH);
+	}
+
+	u = malloc(back.nvis*sizeof(double));
+	v = malloc(back.nvis*sizeof(double));
+	tvis = malloc(back.nvis*12*back.nif*back.nchan*sizeof(double));
+	if_array = malloc(back.nif*sizeof(double));
+	status = quickfits_read_uv_data(filename, back, u, v, tvis, if_array);
+	if(status == 0)
+	{
+		status = compare_uv(ctx, back, u, v, tvis, if_array);
+	}
+	free_uv(u, v, tvis, if_array);
+	return(status);
+}
+
+static int compare_map_header(bench_ctx* ctx, const fitsinfo_map* fitsi)
+{
+	// read the header again with cfitsio and check every field is the same (fitsi must have been cleared first)
+
+	fitsinfo_map serial_fitsi;
+	int status;
+
+	memset(&serial_fitsi, 0, sizeof(fitsinfo_map));
+	serial_fitsi.cc_table_version = fitsi[0].cc_table_version;
+	status = quickfits_read_map_header(ctx[0].map, &serial_fitsi);
+	if(status == 0 && memcmp(&serial_fitsi, fitsi, sizeof(fitsinfo_map)))
+	{
+		status = BENCH_MISMATCH;
+	}
+	return(status);
+}
+
+static int compare_uv_header(bench_ctx* ctx, const fitsinfo_uv* fitsi)
+{
+	// as compare_map_header, for the UV header
+
+	fitsinfo_uv serial_fitsi;
+	int status;
+
+	memset(&serial_fitsi, 0, sizeof(fitsinfo_uv));
+	status = quickfits_read_uv_header(ctx[0].uv, &serial_fitsi);
+	if(status == 0 && memcmp(&serial_fitsi, fitsi, sizeof(fitsinfo_uv)))
+	{
+		status = BENCH_MISMATCH;
+	}
+	return(status);
+}
+
+static long long uv_bytes(fitsinfo_uv fitsi)
+{
+	return(fitsi.nvis*(2+12LL*fitsi.nif*fitsi.nchan)*sizeof(double));
+}
+
+/* map benchmarks */
+
+static void bench_read_map_header(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_map fitsi;
+
+	fitsi.cc_table_version = 1;
+	timer_start(r);
+	r[0].status = quickfits_read_map_header(ctx[0].map, &fitsi);
+	timer_stop(r);
+	r[0].rows = 1;
+}
+
+static void bench_scan_map_header(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_map fitsi;
+
+	memset(&fitsi, 0, sizeof(fitsinfo_map));
+	fitsi.cc_table_version = 1;
+	timer_start(r);
+	r[0].status = quickfits_scan_map_header(ctx[0].map, &fitsi);
+	timer_stop(r);
+	if(r[0].status == 0)
+	{
+		r[0].status = compare_map_header(ctx, &fitsi);
+	}
+	r[0].rows = 1;
+}
+
+static void bench_scan_map_headers(bench_ctx* ctx, bench_result* r)
+{
+	const char* names[256];
+	fitsinfo_map fitsi[256];
+	int status[256];
+	int i;
+
+	memset(fitsi, 0, sizeof(fitsi));
+	for(i=0;i<256;i++)
+	{
+		names[i] = ctx[0].map;
+		fitsi[i].cc_table_version = 1;
+	}
+	timer_start(r);
+	r[0].status = quickfits_scan_map_headers(256, names, fitsi, status, ctx[0].nthreads);
+	timer_stop(r);
+	for(i=0;i<256 && r[0].status==0;i++)
+	{
+		r[0].status = compare_map_header(ctx, &fitsi[i]);
+	}
+	r[0].rows = 256;
+}
+
+static int compare_cutouts(bench_ctx* ctx, int n, const long long* x0, const long long* y0, long long nx, long long ny, const double* cutouts)
+{
+	// check the cutouts (read through the I/O engine, io_uring where available) against the map read serially.
+	// Pixels off the edge are NaN.
+
+	fitsinfo_map fitsi;
+	double *tarr, *ccx, *ccy, *ccv;
+	double value;
+	long long x, y;
+	int status, i;
+
+	tarr = alloc_map(ctx, &fitsi, &ccx, &ccy, &ccv);
+	status = quickfits_read_map(ctx[0].map, fitsi, tarr, ccx, ccy, ccv);
+	for(i=0;i<n && status==0;i++)
+	{
+		for(y=0;y<ny && status==0;y++)
+		{
+			for(x=0;x<nx;x++)
+			{
+				value = (x0[i]+x < fitsi.imsize_ra && y0[i]+y < fitsi.imsize_dec) ? tarr[(y0[i]+y)*fitsi.imsize_ra + x0[i]+x] : NAN;
+				if( !(cutouts[(i*ny+y)*nx+x] == value || (isnan(value) && isnan(cutouts[(i*ny+y)*nx+x]))) )
+				{
+					status = BENCH_MISMATCH;
+					break;
+				}
+			}
+		}
+	}
+	free_map(tarr, ccx, ccy, ccv);
+	return(status);
+}
+
+static void bench_read_map_cutouts(bench_ctx* ctx, bench_result* r)
+{
+	// 4096 32 x 32 cutouts spread over the map, one read per cutout row
+
+	const char** names;
+	long long *x0, *y0;
+	double* cutouts;
+	int* status;
+	int i;
+
+	names = malloc(4096*sizeof(char*));
+	x0 = malloc(4096*sizeof(long long));
+	y0 = malloc(4096*sizeof(long long));
+	cutouts = malloc(4096*32*32*sizeof(double));
+	status = malloc(4096*sizeof(int));
+	for(i=0;i<4096;i++)
+	{
+		names[i] = ctx[0].map;
+		x0[i] = (i*7919LL) % ctx[0].sizes.imsize;
+		y0[i] = (i*104729LL) % ctx[0].sizes.imsize;
+	}
+	timer_start(r);
+	r[0].status = quickfits_read_map_cutouts(4096, names, x0, y0, 32, 32, cutouts, status, NULL);
+	timer_stop(r);
+	if(r[0].status == 0)
+	{
+		r[0].status = compare_cutouts(ctx, 4096, x0, y0, 32, 32, cutouts);
+	}
+	r[0].bytes = 4096LL*32*32*sizeof(double);
+	r[0].rows = 4096LL*32;
+	free(names);
+	free(x0);
+	free(y0);
+	free(cutouts);
+	free(status);
+}
+
+static void bench_read_map(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_map fitsi;
+	double *tarr, *ccx, *ccy, *ccv;
+
+	tarr = alloc_map(ctx, &fitsi, &ccx, &ccy, &ccv);
+	timer_start(r);
+	r[0].status = quickfits_read_map(ctx[0].map, fitsi, tarr, ccx, ccy, ccv);
+	timer_stop(r);
+	r[0].bytes = (fitsi.imsize_ra*fitsi.imsize_dec + 3*fitsi.ncc)*sizeof(double);
+	r[0].rows = fitsi.imsize_dec;
+	free_map(tarr, ccx, ccy, ccv);
+}
+
+static void bench_read_map_direct(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_map fitsi;
+	double *tarr, *ccx, *ccy, *ccv;
+
+	tarr = alloc_map(ctx, &fitsi, &ccx, &ccy, &ccv);
+	quickfits_set_direct_io(true, 0, false);
+	timer_start(r);
+	r[0].status = quickfits_read_map(ctx[0].map, fitsi, tarr, ccx, ccy, ccv);
+	timer_stop(r);
+	quickfits_set_direct_io(false, 0, false);
+	if(r[0].status == 0)
+	{
+		r[0].status = compare_map(ctx, fitsi, tarr, ccx, ccy, ccv);
+	}
+	r[0].bytes = (fitsi.imsize_ra*fitsi.imsize_dec + 3*fitsi.ncc)*sizeof(double);
+	r[0].rows = fitsi.imsize_dec;
+	free_map(tarr, ccx, ccy, ccv);
+}
+
+static void bench_read_map_stats(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_map fitsi;
+	quickfits_stats stats;
+	double *tarr, *ccx, *ccy, *ccv;
+
+	tarr = alloc_map(ctx, &fitsi, &ccx, &ccy, &ccv);
+	timer_start(r);
+	r[0].status = quickfits_read_map_stats(ctx[0].map, fitsi, tarr, ccx, ccy, ccv, &stats);
+	timer_stop(r);
+	r[0].bytes = (fitsi.imsize_ra*fitsi.imsize_dec + 3*fitsi.ncc)*sizeof(double);
+	r[0].rows = fitsi.imsize_dec;
+	free_map(tarr, ccx, ccy, ccv);
+}
+
+static void bench_read_cc_table(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_map fitsi;
+	double *tarr, *ccx, *ccy, *ccv;
+
+	tarr = alloc_map(ctx, &fitsi, &ccx, &ccy, &ccv);
+	timer_start(r);
+	r[0].status = quickfits_read_cc_table(ctx[0].map, fitsi, ccx, ccy, ccv);
+	timer_stop(r);
+	r[0].bytes = 3*fitsi.ncc*sizeof(double);
+	r[0].rows = fitsi.ncc;
+	free_map(tarr, ccx, ccy, ccv);
+}
+
+static void bench_alloc_read_map(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_map fitsi;
+	quickfits_arena arena;
+	double *tarr, *ccx, *ccy, *ccv;
+
+	quickfits_arena_init(&arena, 0);
+	fitsi.cc_table_version = 1;
+	timer_start(r);
+	r[0].status = quickfits_alloc_read_map(ctx[0].map, &fitsi, &arena, &tarr, &ccx, &ccy, &ccv);
+	timer_stop(r);
+	r[0].bytes = (fitsi.imsize_ra*fitsi.imsize_dec + 3*fitsi.ncc)*sizeof(double);
+	r[0].rows = fitsi.imsize_dec;
+	quickfits_arena_free(&arena);
+}
+
+static void bench_write_map(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_map fitsi;
+	double* tarr;
+
+	make_map_array(ctx, &fitsi, &tarr);
+	timer_start(r);
+	r[0].status = quickfits_write_map(ctx[0].scratch, tarr, fitsi, "QUICKFITS BENCHMARK");
+	timer_stop(r);
+	r[0].bytes = fitsi.imsize_ra*fitsi.imsize_dec*sizeof(double);
+	r[0].rows = fitsi.imsize_dec;
+	free(tarr);
+}
+
+static void bench_write_map_template(bench_ctx* ctx, bench_result* r)
+{
+	// the same map as write_map, from a template built for a slightly different one
+
+	fitsinfo_map fitsi;
+	quickfits_map_template* tmpl;
+	double* tarr;
+
+	make_map_array(ctx, &fitsi, &tarr);
+	fitsi.freq *= 1.01;
+	r[0].status = quickfits_map_template_build(&tmpl, fitsi, "QUICKFITS BENCHMARK");
+	fitsi.freq /= 1.01;
+	if(r[0].status == 0)
+	{
+		timer_start(r);
+		r[0].status = quickfits_write_map_template(ctx[0].scratch, tarr, fitsi, tmpl);
+		timer_stop(r);
+		quickfits_map_template_free(tmpl);
+	}
+	r[0].bytes = fitsi.imsize_ra*fitsi.imsize_dec*sizeof(double);
+	r[0].rows = fitsi.imsize_dec;
+	free(tarr);
+}
+
+static void bench_write_map_checksums(bench_ctx* ctx, bench_result* r)
+{
+	quickfits_set_checksums(true);
+	bench_write_map(ctx, r);
+	quickfits_set_checksums(false);
+}
+
+static void bench_verify_checksums(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_map fitsi;
+	double* tarr;
+	int dataok, hduok;
+
+	make_map_array(ctx, &fitsi, &tarr);
+	quickfits_set_checksums(true);
+	quickfits_write_map(ctx[0].scratch, tarr, fitsi, "QUICKFITS BENCHMARK");
+	quickfits_set_checksums(false);
+	free(tarr);
+
+	timer_start(r);
+	r[0].status = quickfits_verify_checksums(ctx[0].scratch, ctx[0].nthreads, &dataok, &hduok);
+	timer_stop(r);
+	if(r[0].status == 0 && (dataok != 1 || hduok != 1))
+	{
+		r[0].status = -1;	// the sums written don't match the data
+	}
+	r[0].bytes = file_size(ctx[0].scratch);
+	r[0].rows = fitsi.imsize_dec;
+}
+
+static void bench_map_writer(bench_ctx* ctx, bench_result* r)
+{
+	quickfits_map_writer writer;
+	fitsinfo_map fitsi;
+	double* tarr;
+	long long j;
+
+	make_map_array(ctx, &fitsi, &tarr);
+	timer_start(r);
+	r[0].status = quickfits_map_writer_open(&writer, ctx[0].scratch, fitsi, 0, "QUICKFITS BENCHMARK");
+	for(j=0;j<fitsi.imsize_dec && r[0].status==0;j++)	// a row at a time, growing the cube as it goes
+	{
+		r[0].status = quickfits_map_writer_append(&writer, &tarr[j*fitsi.imsize_ra], fitsi.imsize_ra);
+	}
+	if(r[0].status == 0)
+	{
+		r[0].status = quickfits_map_writer_close(&writer, 0, NULL, NULL, NULL);
+	}
+	timer_stop(r);
+	r[0].bytes = fitsi.imsize_ra*fitsi.imsize_dec*sizeof(double);
+	r[0].rows = fitsi.imsize_dec;
+	free(tarr);
+}
+
+static void bench_map_stream(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_map fitsi;
+	const char* inputs[2];
+
+	bench_map_info(ctx[0].sizes, &fitsi);
+	quickfits_read_map_header(ctx[0].map, &fitsi);
+	inputs[0] = ctx[0].map;
+	inputs[1] = ctx[0].map;
+	timer_start(r);
+	r[0].status = quickfits_map_stream(2, inputs, ctx[0].scratch, fitsi, "QUICKFITS BENCHMARK", quickfits_kernel_add, NULL, 0, ctx[0].nthreads);
+	timer_stop(r);
+	r[0].bytes = 3*fitsi.imsize_ra*fitsi.imsize_dec*sizeof(double);
+	r[0].rows = fitsi.imsize_dec;
+}
+
+static void bench_write_map_preview(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_map fitsi;
+	double* tarr;
+
+	make_map_array(ctx, &fitsi, &tarr);
+	timer_start(r);
+	r[0].status = quickfits_write_map_preview(ctx[0].scratch, tarr, fitsi, "QUICKFITS BENCHMARK", 4, QUICKFITS_PREVIEW_MEAN, ctx[0].nthreads);
+	timer_stop(r);
+	r[0].bytes = fitsi.imsize_ra*fitsi.imsize_dec*sizeof(double);
+	r[0].rows = fitsi.imsize_dec;
+	free(tarr);
+}
+
+static void bench_read_map_preview(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_map fitsi;
+	double* tarr;
+	long long nx, ny;
+
+	make_map_array(ctx, &fitsi, &tarr);
+	quickfits_write_map_preview(ctx[0].scratch, tarr, fitsi, "QUICKFITS BENCHMARK", 4, QUICKFITS_PREVIEW_MEAN, ctx[0].nthreads);
+	timer_start(r);
+	r[0].status = quickfits_read_map_preview(ctx[0].scratch, 2, &nx, &ny, tarr);
+	timer_stop(r);
+	r[0].bytes = nx*ny*sizeof(double);
+	r[0].rows = ny;
+	free(tarr);
+}
+
+static void bench_checksum_doubles(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_map fitsi;
+	double* tarr;
+
+	make_map_array(ctx, &fitsi, &tarr);
+	timer_start(r);
+	quickfits_checksum_doubles(tarr, fitsi.imsize_ra*fitsi.imsize_dec, ctx[0].nthreads);
+	timer_stop(r);
+	r[0].bytes = fitsi.imsize_ra*fitsi.imsize_dec*sizeof(double);
+	r[0].rows = fitsi.imsize_dec;
+	free(tarr);
+}
+
+static void bench_stats_add(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_map fitsi;
+	quickfits_stats stats;
+	double* tarr;
+
+	make_map_array(ctx, &fitsi, &tarr);
+	quickfits_stats_init(&stats);
+	timer_start(r);
+	quickfits_stats_add(&stats, tarr, fitsi.imsize_ra*fitsi.imsize_dec);
+	timer_stop(r);
+	r[0].bytes = fitsi.imsize_ra*fitsi.imsize_dec*sizeof(double);
+	r[0].rows = fitsi.imsize_dec;
+	free(tarr);
+}
+
+static void bench_memfile(bench_ctx* ctx, bench_result* r)
+{
+	quickfits_memfile mem;
+	fitsinfo_map fitsi;
+	double *tarr, *ccx, *ccy, *ccv;
+	char name[FLEN_FILENAME];
+
+	make_map_array(ctx, &fitsi, &tarr);
+	mem.buffer = NULL;
+	mem.size = 0;
+	mem.mem_realloc = realloc;
+	quickfits_memfile_register("bench", &mem);
+	sprintf(name,"%sbench",QUICKFITS_MEMFILE_PREFIX);
+	ccx = malloc(sizeof(double));
+	ccy = malloc(sizeof(double));
+	ccv = malloc(sizeof(double));
+	fitsi.have_beam = false;
+	fitsi.cc_table_version = -1;
+
+	timer_start(r);	// write a map to memory and read it back
+	r[0].status = quickfits_write_map(name, tarr, fitsi, "QUICKFITS BENCHMARK");
+	if(r[0].status == 0)
+	{
+		r[0].status = quickfits_read_map(name, fitsi, tarr, ccx, ccy, ccv);
+	}
+	timer_stop(r);
+	r[0].bytes = 2*fitsi.imsize_ra*fitsi.imsize_dec*sizeof(double);
+	r[0].rows = 2*fitsi.imsize_dec;
+
+	quickfits_memfile_unregister("bench");
+	free(mem.buffer);
+	free_map(tarr, ccx, ccy, ccv);
+}
+
+static void bench_shm_map(bench_ctx* ctx, bench_result* r)
+{
+	quickfits_shm_map publisher, reader;
+	char name[FLEN_FILENAME];
+
+	sprintf(name,"quickfits_bench_%d",(int)(getpid()));
+	timer_start(r);
+	r[0].status = quickfits_shm_publish_map(name, ctx[0].map, 1, &publisher);
+	if(r[0].status == 0)
+	{
+		r[0].status = quickfits_shm_attach_map(name, &reader);
+		if(r[0].status == 0)
+		{
+			quickfits_shm_detach_map(&reader);
+		}
+		quickfits_shm_detach_map(&publisher);
+	}
+	timer_stop(r);
+	r[0].bytes = ctx[0].sizes.imsize*ctx[0].sizes.imsize*sizeof(double);
+	r[0].rows = ctx[0].sizes.imsize;
+}
+
+static void bench_build_hdu_dir(bench_ctx* ctx, bench_result* r)
+{
+	fitshdu_dir dir;
+
+	timer_start(r);
+	r[0].status = quickfits_build_hdu_dir(ctx[0].uv, &dir);
+	timer_stop(r);
+	if(r[0].status == 0)
+	{
+		r[0].rows = dir.nhdu;
+		quickfits_free_hdu_dir(&dir);
+	}
+}
+
+static void bench_catalogue(bench_ctx* ctx, bench_result* r)
+{
+	fitscat cat;
+	fitscat_query query;
+	long long matches[16];
+
+	timer_start(r);
+	r[0].status = quickfits_catalogue_build(ctx[0].scratch, ctx[0].dir, ctx[0].nthreads);
+	if(r[0].status == 0)
+	{
+		r[0].status = quickfits_catalogue_open(ctx[0].scratch, &cat);
+	}
+	if(r[0].status == 0)
+	{
+		quickfits_catalogue_query_init(&query);
+		sprintf(query.object,"BENCHSRC");
+		r[0].rows = quickfits_catalogue_query(cat, query, matches, 16);
+		quickfits_catalogue_close(&cat);
+	}
+	timer_stop(r);
+}
+
+/* UV benchmarks */
+
+static void bench_read_uv_header(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_uv fitsi;
+
+	timer_start(r);
+	r[0].status = quickfits_read_uv_header(ctx[0].uv, &fitsi);
+	timer_stop(r);
+	r[0].rows = 1;
+}
+
+static void bench_scan_uv_header(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_uv fitsi;
+
+	memset(&fitsi, 0, sizeof(fitsinfo_uv));
+	timer_start(r);
+	r[0].status = quickfits_scan_uv_header(ctx[0].uv, &fitsi);
+	timer_stop(r);
+	if(r[0].status == 0)
+	{
+		r[0].status = compare_uv_header(ctx, &fitsi);
+	}
+	r[0].rows = 1;
+}
+
+static void bench_scan_uv_header_gz(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_uv fitsi;
+
+	memset(&fitsi, 0, sizeof(fitsinfo_uv));
+	timer_start(r);
+	r[0].status = quickfits_scan_uv_header(ctx[0].uv_gz, &fitsi);
+	timer_stop(r);
+	if(r[0].status == 0)
+	{
+		r[0].status = compare_uv_header(ctx, &fitsi);
+	}
+	r[0].rows = 1;
+}
+
+static void bench_scan_uv_headers(bench_ctx* ctx, bench_result* r)
+{
+	const char* names[256];
+	fitsinfo_uv fitsi[256];
+	int status[256];
+	int i;
+
+	memset(fitsi, 0, sizeof(fitsi));
+	for(i=0;i<256;i++)
+	{
+		names[i] = ctx[0].uv;
+	}
+	timer_start(r);
+	r[0].status = quickfits_scan_uv_headers(256, names, fitsi, status, ctx[0].nthreads);
+	timer_stop(r);
+	for(i=0;i<256 && r[0].status==0;i++)
+	{
+		r[0].status = compare_uv_header(ctx, &fitsi[i]);
+	}
+	r[0].rows = 256;
+}
+
+static void bench_read_uv_data(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_uv fitsi;
+	double *u, *v, *tvis, *if_array;
+
+	alloc_uv(ctx, &fitsi, &u, &v, &tvis, &if_array);
+	timer_start(r);
+	r[0].status = quickfits_read_uv_data(ctx[0].uv, fitsi, u, v, tvis, if_array);
+	timer_stop(r);
+	r[0].bytes = uv_bytes(fitsi);
+	r[0].rows = fitsi.nvis;
+	free_uv(u, v, tvis, if_array);
+}
+
+static void bench_read_uv_data_parallel(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_uv fitsi;
+	double *u, *v, *tvis, *if_array;
+
+	alloc_uv(ctx, &fitsi, &u, &v, &tvis, &if_array);
+	timer_start(r);
+	r[0].status = quickfits_read_uv_data_parallel(ctx[0].uv, fitsi, u, v, tvis, if_array, ctx[0].nthreads);
+	timer_stop(r);
+	if(r[0].status == 0)
+	{
+		r[0].status = compare_uv(ctx, fitsi, u, v, tvis, if_array);
+	}
+	r[0].bytes = uv_bytes(fitsi);
+	r[0].rows = fitsi.nvis;
+	free_uv(u, v, tvis, if_array);
+}
+
+static void bench_read_uv_data_direct(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_uv fitsi;
+	double *u, *v, *tvis, *if_array;
+
+	alloc_uv(ctx, &fitsi, &u, &v, &tvis, &if_array);
+	quickfits_set_direct_io(true, 0, false);
+	timer_start(r);
+	r[0].status = quickfits_read_uv_data(ctx[0].uv, fitsi, u, v, tvis, if_array);
+	timer_stop(r);
+	quickfits_set_direct_io(false, 0, false);
+	if(r[0].status == 0)
+	{
+		r[0].status = compare_uv(ctx, fitsi, u, v, tvis, if_array);
+	}
+	r[0].bytes = uv_bytes(fitsi);
+	r[0].rows = fitsi.nvis;
+	free_uv(u, v, tvis, if_array);
+}
+
+static void bench_read_uv_data_cold(bench_ctx* ctx, bench_result* r)
+{
+	drop_cache(ctx[0].uv);
+	bench_read_uv_data(ctx, r);
+}
+
+static void bench_read_uv_data_prefetch(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_uv fitsi;
+	double *u, *v, *tvis, *if_array;
+
+	alloc_uv(ctx, &fitsi, &u, &v, &tvis, &if_array);
+	drop_cache(ctx[0].uv);
+	timer_start(r);
+	r[0].status = quickfits_prefetch(ctx[0].uv, QUICKFITS_PREFETCH_HEADERS | QUICKFITS_PREFETCH_UV, 0, 0);
+	quickfits_prefetch_wait();
+	if(r[0].status == 0)
+	{
+		r[0].status = quickfits_read_uv_data(ctx[0].uv, fitsi, u, v, tvis, if_array);
+	}
+	timer_stop(r);
+	r[0].bytes = uv_bytes(fitsi);
+	r[0].rows = fitsi.nvis;
+	free_uv(u, v, tvis, if_array);
+}
+
+static void bench_read_uv_data_stats(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_uv fitsi;
+	double *u, *v, *tvis, *if_array;
+	quickfits_stats *amp, *weight;
+
+	alloc_uv(ctx, &fitsi, &u, &v, &tvis, &if_array);
+	amp = malloc(4*fitsi.nif*sizeof(quickfits_stats));
+	weight = malloc(4*fitsi.nif*sizeof(quickfits_stats));
+	timer_start(r);
+	r[0].status = quickfits_read_uv_data_stats(ctx[0].uv, fitsi, u, v, tvis, if_array, amp, weight);
+	timer_stop(r);
+	r[0].bytes = uv_bytes(fitsi);
+	r[0].rows = fitsi.nvis;
+	free_uv(u, v, tvis, if_array);
+	free(amp);
+	free(weight);
+}
+
+static void bench_read_uv_data_lambda(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_uv fitsi;
+	double *u, *v, *tvis, *if_array;
+
+	alloc_uv(ctx, &fitsi, &u, &v, &tvis, &if_array);
+	free(u);
+	free(v);
+	u = malloc(fitsi.nvis*fitsi.nif*fitsi.nchan*sizeof(double));
+	v = malloc(fitsi.nvis*fitsi.nif*fitsi.nchan*sizeof(double));
+	timer_start(r);
+	r[0].status = quickfits_read_uv_data_lambda(ctx[0].uv, fitsi, true, u, v, tvis, if_array);
+	timer_stop(r);
+	r[0].bytes = uv_bytes(fitsi);
+	r[0].rows = fitsi.nvis;
+	free_uv(u, v, tvis, if_array);
+}
+
+static void bench_alloc_read_uv_data(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_uv fitsi;
+	quickfits_arena arena;
+	double *u, *v, *tvis, *if_array;
+
+	quickfits_arena_init(&arena, 0);
+	timer_start(r);
+	r[0].status = quickfits_alloc_read_uv_data(ctx[0].uv, &fitsi, &arena, &u, &v, &tvis, &if_array);
+	timer_stop(r);
+	r[0].bytes = uv_bytes(fitsi);
+	r[0].rows = fitsi.nvis;
+	quickfits_arena_free(&arena);
+}
+
+static void bench_read_uv_data_sorted(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_uv fitsi;
+	double *u, *v, *tvis, *if_array;
+	long long* perm;
+
+	alloc_uv(ctx, &fitsi, &u, &v, &tvis, &if_array);
+	perm = malloc(fitsi.nvis*sizeof(long long));
+	timer_start(r);
+	r[0].status = quickfits_read_uv_data_sorted(ctx[0].uv, fitsi, 1.0E-4, 2048, ctx[0].nthreads, u, v, tvis, if_array, perm);
+	timer_stop(r);
+	if(r[0].status == 0)	// back in file order, it should be what the serial reader gives
+	{
+		r[0].status = quickfits_unsort_uv(fitsi, perm, u, v, tvis);
+	}
+	if(r[0].status == 0)
+	{
+		r[0].status = compare_uv(ctx, fitsi, u, v, tvis, if_array);
+	}
+	r[0].bytes = uv_bytes(fitsi);
+	r[0].rows = fitsi.nvis;
+	free_uv(u, v, tvis, if_array);
+	free(perm);
+}
+
+static void bench_sort_unsort_uv(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_uv fitsi;
+	double *u, *v, *tvis, *if_array;
+	long long* perm;
+
+	alloc_uv(ctx, &fitsi, &u, &v, &tvis, &if_array);
+	perm = malloc(fitsi.nvis*sizeof(long long));
+	quickfits_read_uv_data(ctx[0].uv, fitsi, u, v, tvis, if_array);
+	timer_start(r);
+	r[0].status = quickfits_sort_uv_cells(fitsi, 1.0E-4, 2048, ctx[0].nthreads, u, v, tvis, perm);
+	if(r[0].status == 0)
+	{
+		r[0].status = quickfits_unsort_uv(fitsi, perm, u, v, tvis);
+	}
+	timer_stop(r);
+	if(r[0].status == 0)
+	{
+		r[0].status = compare_uv(ctx, fitsi, u, v, tvis, if_array);
+	}
+	r[0].bytes = 2*uv_bytes(fitsi);
+	r[0].rows = 2*fitsi.nvis;
+	free_uv(u, v, tvis, if_array);
+	free(perm);
+}
+
+static void bench_overwrite_uv_data(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_uv fitsi;
+	double *u, *v, *tvis, *if_array;
+
+	alloc_uv(ctx, &fitsi, &u, &v, &tvis, &if_array);
+	quickfits_read_uv_data(ctx[0].uv, fitsi, u, v, tvis, if_array);
+	r[0].status = copy_file(ctx[0].uv, ctx[0].scratch);
+	if(r[0].status == 0)
+	{
+		timer_start(r);
+		r[0].status = quickfits_overwrite_uv_data(ctx[0].scratch, fitsi, u, v, tvis);
+		timer_stop(r);
+	}
+	r[0].bytes = uv_bytes(fitsi);
+	r[0].rows = fitsi.nvis;
+	free_uv(u, v, tvis, if_array);
+}
+
+static void bench_uv_writer(bench_ctx* ctx, bench_result* r)
+{
+	quickfits_uv_writer writer;
+	fitsinfo_uv fitsi;
+	double *u, *v, *tvis, *if_array;
+	int status;
+
+	alloc_uv(ctx, &fitsi, &u, &v, &tvis, &if_array);
+	quickfits_read_uv_data(ctx[0].uv, fitsi, u, v, tvis, if_array);
+	timer_start(r);
+	r[0].status = quickfits_uv_writer_open(&writer, ctx[0].scratch, fitsi, fitsi.nvis);
+	if(r[0].status == 0)
+	{
+		r[0].status = quickfits_uv_writer_append(&writer, fitsi.nvis, u, v, NULL, NULL, NULL, NULL, tvis);
+		status = quickfits_uv_writer_close(&writer, if_array, ctx[0].sizes.nant, NULL, NULL, NULL, NULL);
+		r[0].status = (r[0].status == 0) ? status : r[0].status;
+	}
+	timer_stop(r);
+	if(r[0].status == 0)
+	{
+		r[0].status = read_back_uv(ctx, ctx[0].scratch, fitsi);
+	}
+	r[0].bytes = uv_bytes(fitsi);
+	r[0].rows = fitsi.nvis;
+	free_uv(u, v, tvis, if_array);
+}
+
+static void bench_merge_uv(bench_ctx* ctx, bench_result* r)
+{
+	// the UV file merged with itself in time order
+
+	const char* names[2];
+	fitsinfo_uv fitsi;
+
+	names[0] = ctx[0].uv;
+	names[1] = ctx[0].uv;
+	bench_uv_info(ctx[0].sizes, &fitsi);
+	timer_start(r);
+	r[0].status = quickfits_merge_uv(2, names, ctx[0].scratch, true);
+	timer_stop(r);
+	r[0].bytes = 2*uv_bytes(fitsi);
+	r[0].rows = 2*fitsi.nvis;
+}
+
+static void bench_replace_ant_info(bench_ctx* ctx, bench_result* r)
+{
+	double *rdterm, *ldterm;
+	long long i, n;
+
+	n = 2LL*ctx[0].sizes.nant*ctx[0].sizes.nif;
+	rdterm = malloc(n*sizeof(double));
+	ldterm = malloc(n*sizeof(double));
+	for(i=0;i<n;i++)
+	{
+		rdterm[i] = 0.01*i;
+		ldterm[i] = -0.01*i;
+	}
+	r[0].status = copy_file(ctx[0].uv, ctx[0].scratch);
+	if(r[0].status == 0)
+	{
+		timer_start(r);
+		r[0].status = quickfits_replace_ant_info(ctx[0].scratch, rdterm, ldterm);
+		timer_stop(r);
+	}
+	r[0].rows = ctx[0].sizes.nant;
+	free(rdterm);
+	free(ldterm);
+}
+
+static void bench_read_ant_table(bench_ctx* ctx, bench_result* r)
+{
+	quickfits_antenna_table table;
+
+	timer_start(r);
+	r[0].status = quickfits_read_ant_table(ctx[0].uv, 0, &table);
+	timer_stop(r);
+	r[0].rows = table.nant;
+	quickfits_free_ant_table(&table);
+}
+
+static void bench_apply_dterms(bench_ctx* ctx, bench_result* r)
+{
+	// one D-term per antenna and IF, applied to the scratch copy
+
+	quickfits_dterm* dterms;
+	const char* names[1];
+	int a, f, n;
+
+	n = ctx[0].sizes.nant*ctx[0].sizes.nif;
+	dterms = malloc(n*sizeof(quickfits_dterm));
+	for(a=0;a<ctx[0].sizes.nant;a++)
+	{
+		for(f=0;f<ctx[0].sizes.nif;f++)
+		{
+			dterms[a*ctx[0].sizes.nif+f].antenna = a+1;
+			dterms[a*ctx[0].sizes.nif+f].if_num = f+1;
+			dterms[a*ctx[0].sizes.nif+f].rdterm[0] = 0.01*a;
+			dterms[a*ctx[0].sizes.nif+f].rdterm[1] = 0.001*f;
+			dterms[a*ctx[0].sizes.nif+f].ldterm[0] = -0.01*a;
+			dterms[a*ctx[0].sizes.nif+f].ldterm[1] = -0.001*f;
+		}
+	}
+	names[0] = ctx[0].scratch;
+	r[0].status = copy_file(ctx[0].uv, ctx[0].scratch);
+	if(r[0].status == 0)
+	{
+		timer_start(r);
+		r[0].status = quickfits_apply_dterms(1, names, n, dterms, NULL, 1);
+		timer_stop(r);
+	}
+	r[0].rows = n;
+	free(dterms);
+}
+
+static void bench_gunzip(bench_ctx* ctx, bench_result* r)
+{
+	timer_start(r);
+	r[0].status = quickfits_gunzip(ctx[0].uv_gz, ctx[0].scratch, ctx[0].nthreads);
+	timer_stop(r);
+	r[0].bytes = ctx[0].uv_bytes;
+	r[0].rows = ctx[0].sizes.nvis;
+}
+
+static void bench_read_uv_data_gz(bench_ctx* ctx, bench_result* r)
+{
+	fitsinfo_uv fitsi;
+	double *u, *v, *tvis, *if_array;
+
+	alloc_uv(ctx, &fitsi, &u, &v, &tvis, &if_array);
+	timer_start(r);
+	r[0].status = quickfits_read_uv_data(ctx[0].uv_gz, fitsi, u, v, tvis, if_array);
+	timer_stop(r);
+	r[0].bytes = uv_bytes(fitsi);
+	r[0].rows = fitsi.nvis;
+	free_uv(u, v, tvis, if_array);
+}
+
+typedef struct bench_entry_tag{
+	const char* name;
+	bench_fn fn;
+}bench_entry;
+
+static const bench_entry benchmarks[] = {
+	{"read_map_header", bench_read_map_header},
+	{"scan_map_header", bench_scan_map_header},
+	{"scan_map_headers", bench_scan_map_headers},
+	{"read_map", bench_read_map},
+	{"read_map_direct", bench_read_map_direct},
+	{"read_map_cutouts", bench_read_map_cutouts},
+	{"read_map_stats", bench_read_map_stats},
+	{"read_cc_table", bench_read_cc_table},
+	{"alloc_read_map", bench_alloc_read_map},
+	{"write_map", bench_write_map},
+	{"write_map_template", bench_write_map_template},
+	{"write_map_checksums", bench_write_map_checksums},
+	{"verify_checksums", bench_verify_checksums},
+	{"map_writer", bench_map_writer},
+	{"map_stream_add", bench_map_stream},
+	{"write_map_preview", bench_write_map_preview},
+	{"read_map_preview", bench_read_map_preview},
+	{"checksum_doubles", bench_checksum_doubles},
+	{"stats_add", bench_stats_add},
+	{"memfile_write_read_map", bench_memfile},
+	{"shm_publish_attach_map", bench_shm_map},
+	{"build_hdu_dir", bench_build_hdu_dir},
+	{"catalogue_build_query", bench_catalogue},
+	{"read_uv_header", bench_read_uv_header},
+	{"scan_uv_header", bench_scan_uv_header},
+	{"scan_uv_headers", bench_scan_uv_headers},
+	{"scan_uv_header_gz", bench_scan_uv_header_gz},
+	{"read_uv_data", bench_read_uv_data},
+	{"read_uv_data_parallel", bench_read_uv_data_parallel},
+	{"read_uv_data_direct", bench_read_uv_data_direct},
+	{"read_uv_data_cold", bench_read_uv_data_cold},
+	{"read_uv_data_prefetch", bench_read_uv_data_prefetch},
+	{"read_uv_data_stats", bench_read_uv_data_stats},
+	{"read_uv_data_lambda", bench_read_uv_data_lambda},
+	{"alloc_read_uv_data", bench_alloc_read_uv_data},
+	{"read_uv_data_sorted", bench_read_uv_data_sorted},
+	{"sort_unsort_uv", bench_sort_unsort_uv},
+	{"overwrite_uv_data", bench_overwrite_uv_data},
+	{"uv_writer", bench_uv_writer},
+	{"merge_uv", bench_merge_uv},
+	{"replace_ant_info", bench_replace_ant_info},
+	{"read_ant_table", bench_read_ant_table},
+	{"apply_dterms", bench_apply_dterms},
+	{"gunzip", bench_gunzip},
+	{"read_uv_data_gz", bench_read_uv_data_gz},
+	{NULL, NULL}
+};
+
+static int run_benchmark(bench_ctx* ctx, const bench_entry* entry, int reps, bench_result* best, long* peak_rss_kb)
+{
+	// Run a benchmark reps times in a child process, keeping the fastest run, and get the child's peak RSS
+
+	bench_result r;
+	struct rusage usage;
+	int fds[2], rep, wstatus;
+	pid_t pid;
+
+	memset(best, 0, sizeof(bench_result));
+	*peak_rss_kb = 0;
+	if(pipe(fds))
+	{
+		return(-1);
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	pid = fork();
+	if(pid < 0)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		return(-1);
+	}
+	if(pid == 0)
+	{
+		close(fds[0]);
+		for(rep=0;rep<reps;rep++)
+		{
+			memset(&r, 0, sizeof(bench_result));
+			entry[0].fn(ctx, &r);
+			if(rep == 0 || r.status != 0 || r.seconds < best[0].seconds)
+			{
+				*best = r;
+			}
+			if(r.status != 0)
+			{
+				break;
+			}
+		}
+		if(write(fds[1], best, sizeof(bench_result)) != sizeof(bench_result))
+		{
+			_exit(1);
+		}
+		_exit(0);
+	}
+
+	close(fds[1]);
+	if(read(fds[0], best, sizeof(bench_result)) != sizeof(bench_result))
+	{
+		best[0].status = -1;
+	}
+	close(fds[0]);
+	if(wait4(pid, &wstatus, 0, &usage) == pid)
+	{
+		*peak_rss_kb = usage.ru_maxrss;
+		if(!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0)
+		{
+			best[0].status = -1;
+		}
+	}
+	return(0);
+}
+
+static int usage()
+{
+	printf("Usage : quickfits_bench [-dir directory] [-map imsize] [-ncc n] [-nvis n] [-nif n] [-nchan n] [-nant n]\n");
+	printf("                        [-threads n] [-reps n] [-seed n] [-only substring] [-o results.json]\n");
+	return(1);
+}
+
+int main(int argc, char** argv)
+{
+	bench_ctx ctx;
+	bench_result r;
+	FILE* out;
+	const char* only;
+	const char* outname;
+	const char* tmpdir;
+	long peak_rss_kb;
+	int reps, arg, i, first, failures;
+
+	memset(&ctx, 0, sizeof(bench_ctx));
+	ctx.sizes.imsize = 2048;
+	ctx.sizes.ncc = 10000;
+	ctx.sizes.nvis = 200000;
+	ctx.sizes.nif = 4;
+	ctx.sizes.nchan = 16;
+	ctx.sizes.nant = 10;
+	ctx.sizes.seed = 1;
+	ctx.nthreads = 0;
+	reps = 3;
+	only = NULL;
+	outname = NULL;
+	tmpdir = getenv("TMPDIR");
+	snprintf(ctx.dir, FLEN_FILENAME, "%s/quickfits_bench", (tmpdir != NULL) ? tmpdir : "/tmp");
+
+	for(arg=1;arg<argc;arg++)
+	{
+		if(arg+1 >= argc)
+		{
+			return(usage());
+		}
+		if(!strcmp(argv[arg],"-dir"))
+		{
+			snprintf(ctx.dir, FLEN_FILENAME, "%s", argv[++arg]);
+		}
+		else if(!strcmp(argv[arg],"-map"))
+		{
+			ctx.sizes.imsize = atoll(argv[++arg]);
+		}
+		else if(!strcmp(argv[arg],"-ncc"))
+		{
+			ctx.sizes.ncc = atoll(argv[++arg]);
+		}
+		else if(!strcmp(argv[arg],"-nvis"))
+		{
+			ctx.sizes.nvis = atoll(argv[++arg]);
+		}
+		else if(!strcmp(argv[arg],"-nif"))
+		{
+			ctx.sizes.nif = atoi(argv[++arg]);
+		}
+		else if(!strcmp(argv[arg],"-nchan"))
+		{
+			ctx.sizes.nchan = atoi(argv[++arg]);
+		}
+		else if(!strcmp(argv[arg],"-nant"))
+		{
+			ctx.sizes.nant = atoi(argv[++arg]);
+		}
+		else if(!strcmp(argv[arg],"-threads"))
+		{
+			ctx.nthreads = atoi(argv[++arg]);
+		}
+		else if(!strcmp(argv[arg],"-reps"))
+		{
+			reps = atoi(argv[++arg]);
+		}
+		else if(!strcmp(argv[arg],"-seed"))
+		{
+			ctx.sizes.seed = atoi(argv[++arg]);
+		}
+		else if(!strcmp(argv[arg],"-only"))
+		{
+			only = argv[++arg];
+		}
+		else if(!strcmp(argv[arg],"-o"))
+		{
+			outname = argv[++arg];
+		}
+		else
+		{
+			return(usage());
+		}
+	}
+	if(reps < 1 || ctx.sizes.imsize < 1 || ctx.sizes.nvis < 1 || ctx.sizes.nif < 1 || ctx.sizes.nchan < 1)
+	{
+		return(usage());
+	}
+
+	if(snprintf(ctx.map, FLEN_FILENAME, "%s/bench_map.fits", ctx.dir) >= FLEN_FILENAME
+		|| snprintf(ctx.uv, FLEN_FILENAME, "%s/bench_uv.fits", ctx.dir) >= FLEN_FILENAME
+		|| snprintf(ctx.uv_gz, FLEN_FILENAME, "%s/bench_uv.fits.gz", ctx.dir) >= FLEN_FILENAME
+		|| snprintf(ctx.scratch, FLEN_FILENAME, "%s_scratch.fits", ctx.dir) >= FLEN_FILENAME)	// outside the directory, so it isn't catalogued
+	{
+		fprintf(stderr, "quickfits_bench : directory name %s is too long\n", ctx.dir);
+		return(1);
+	}
+	mkdir(ctx.dir, 0777);	// the synthetic files go in their own directory, which is also what the catalogue benchmark indexes
+
+	fprintf(stderr, "quickfits_bench : generating %lld x %lld map and %lld x %d x %d UV file in %s\n", ctx.sizes.imsize, ctx.sizes.imsize, ctx.sizes.nvis, ctx.sizes.nif, ctx.sizes.nchan, ctx.dir);
+	if(bench_make_map(ctx.map, ctx.sizes) || bench_make_uv(ctx.uv, ctx.sizes) || gzip_file(ctx.uv, ctx.uv_gz))
+	{
+		fprintf(stderr, "quickfits_bench : error generating synthetic data\n");
+		return(1);
+	}
+	ctx.map_bytes = file_size(ctx.map);
+	ctx.uv_bytes = file_size(ctx.uv);
+
+	out = stdout;
+	if(outname != NULL && (out = fopen(outname, "w")) == NULL)
+	{
+		fprintf(stderr, "quickfits_bench : cannot write %s\n", outname);
+		return(1);
+	}
+
+	fprintf(out, "{\n  \"sizes\": {\"imsize\": %lld, \"ncc\": %lld, \"nvis\": %lld, \"nif\": %d, \"nchan\": %d, \"nant\": %d, \"seed\": %u},\n", ctx.sizes.imsize, ctx.sizes.ncc, ctx.sizes.nvis, ctx.sizes.nif, ctx.sizes.nchan, ctx.sizes.nant, ctx.sizes.seed);
+	fprintf(out, "  \"threads\": %d, \"reps\": %d, \"map_file_bytes\": %lld, \"uv_file_bytes\": %lld,\n  \"results\": [\n", ctx.nthreads, reps, ctx.map_bytes, ctx.uv_bytes);
+
+	first = 1;
+	failures = 0;
+	for(i=0;benchmarks[i].name!=NULL;i++)
+	{
+		if(only != NULL && strstr(benchmarks[i].name, only) == NULL)
+		{
+			continue;
+		}
+		fprintf(stderr, "quickfits_bench : %s\n", benchmarks[i].name);
+		if(run_benchmark(&ctx, &benchmarks[i], reps, &r, &peak_rss_kb))
+		{
+			r.status = -1;
+		}
+		if(r.status != 0)
+		{
+			failures++;
+		}
+
+		fprintf(out, "%s    {\"name\": \"%s\", \"seconds\": %.9f, \"bytes\": %lld, \"rows\": %lld, ", first ? "" : ",\n", benchmarks[i].name, r.seconds, r.bytes, r.rows);
+		fprintf(out, "\"mb_per_s\": %.3f, \"rows_per_s\": %.3f, \"peak_rss_kb\": %ld, \"status\": %d}", (r.seconds > 0) ? r.bytes/r.seconds/1.0E6 : 0.0, (r.seconds > 0) ? r.rows/r.seconds : 0.0, peak_rss_kb, r.status);
+		first = 0;
+	}
+	fprintf(out, "\n  ]\n}\n");
+
+	if(out != stdout)
+	{
+		fclose(out);
+	}
+	remove(ctx.scratch);
+
+	return(failures != 0);
+}
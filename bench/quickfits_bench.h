@@ -0,0 +1,40 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+
+/*
+	Synthetic data for the quickfits benchmarks (quickfits_bench_gen.c). The same seed always gives the same files.
+*/
+
+#ifndef quickfits_bench_defined
+	#define quickfits_bench_defined
+
+	struct bench_sizes_tag;
+	typedef struct bench_sizes_tag{
+		long long imsize;	// maps are imsize x imsize
+		long long ncc;	// clean components
+		long long nvis;	// UV rows
+		int nif;
+		int nchan;
+		int nant;
+		unsigned int seed;
+	}bench_sizes;
+
+#endif
+
+void bench_map_info(bench_sizes sizes, fitsinfo_map* fitsi);
+void bench_uv_info(bench_sizes sizes, fitsinfo_uv* fitsi);
+double bench_random(unsigned long long* state);
+int bench_make_map(const char* filename, bench_sizes sizes);
+int bench_make_uv(const char* filename, bench_sizes sizes);
@@ -0,0 +1,248 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits_bench.h"
+#include <stdlib.h>
+
+#define BENCH_ROWS 4096	// UV rows generated and written at a time
+
+double bench_random(unsigned long long* state)
+{
+/*
+	Uniform deviate in [0,1) from a 64 bit linear congruential generator, so the files are the same on every platform
+*/
+	*state = (*state)*6364136223846793005ULL + 1442695040888963407ULL;
+	return((double)((*state) >> 11)/9007199254740992.0);
+}
+
+void bench_map_info(bench_sizes sizes, fitsinfo_map* fitsi)
+{
+/*
+	Header of the synthetic maps : a 1 mas cell VLBI style map with a restoring beam and a CC table
+*/
+	memset(fitsi, 0, sizeof(fitsinfo_map));
+	fitsi[0].imsize_ra = sizes.imsize;
+	fitsi[0].imsize_dec = sizes.imsize;
+	fitsi[0].cell_ra = 1.0/3600000.0;
+	fitsi[0].cell_dec = 1.0/3600000.0;
+	fitsi[0].ra = 187.70593075;
+	fitsi[0].dec = 12.39112331;
+	fitsi[0].centre_shift[0] = sizes.imsize/2 + 1;
+	fitsi[0].centre_shift[1] = sizes.imsize/2 + 1;
+	fitsi[0].stokes = 1.0;
+	fitsi[0].freq = 15.0E9;
+	fitsi[0].freq_delta = 32.0E6;
+	sprintf(fitsi[0].object,"BENCHSRC");
+	sprintf(fitsi[0].observer,"QUICKFITS");
+	sprintf(fitsi[0].telescope,"VLBA");
+	fitsi[0].equinox = 2000.0;
+	sprintf(fitsi[0].date_obs,"2014-01-01");
+	fitsi[0].bmaj = 5.0*fitsi[0].cell_ra;
+	fitsi[0].bmin = 2.0*fitsi[0].cell_ra;
+	fitsi[0].bpa = -10.0;
+	fitsi[0].have_beam = true;
+	fitsi[0].niter = sizes.ncc;
+	fitsi[0].ncc = sizes.ncc;
+	fitsi[0].cc_table_version = 1;
+}
+
+void bench_uv_info(bench_sizes sizes, fitsinfo_uv* fitsi)
+{
+/*
+	Header of the synthetic UV files, as quickfits_read_uv_header will read it back
+*/
+	memset(fitsi, 0, sizeof(fitsinfo_uv));
+	fitsi[0].nvis = sizes.nvis;
+	fitsi[0].ra = 187.70593075;
+	fitsi[0].dec = 12.39112331;
+	fitsi[0].nif = sizes.nif;
+	fitsi[0].nchan = sizes.nchan;
+	fitsi[0].chan_width = 500000;
+	fitsi[0].central_chan = 1;
+	fitsi[0].freq = 15.0E9;
+	sprintf(fitsi[0].object,"BENCHSRC");
+	sprintf(fitsi[0].observer,"QUICKFITS");
+	sprintf(fitsi[0].telescope,"VLBA");
+	fitsi[0].equinox = 2000.0;
+	sprintf(fitsi[0].date_obs,"2014-01-01");
+}
+
+int bench_make_map(const char* filename, bench_sizes sizes)
+{
+/*
+	Write a synthetic map (a few gaussians on noise) with AIPS CG and CC tables, a row at a time
+*/
+	quickfits_map_writer writer;
+	fitsinfo_map fitsi;
+	unsigned long long state;
+	double* row;
+	double* ccx;
+	double* ccy;
+	double* ccv;
+	double dx, dy;
+	long long i, j;
+	int status;
+
+	bench_map_info(sizes, &fitsi);
+	state = sizes.seed;
+
+	row = malloc(sizes.imsize*sizeof(double));
+	ccx = malloc((sizes.ncc+1)*sizeof(double));
+	ccy = malloc((sizes.ncc+1)*sizeof(double));
+	ccv = malloc((sizes.ncc+1)*sizeof(double));
+	if(row == NULL || ccx == NULL || ccy == NULL || ccv == NULL)
+	{
+		printf("ERROR : bench_make_map --> Error allocating memory\n");
+		free(row);
+		free(ccx);
+		free(ccy);
+		free(ccv);
+		return(MEMORY_ALLOCATION);
+	}
+
+	status = quickfits_map_writer_open(&writer, filename, fitsi, 1, "QUICKFITS BENCHMARK MAP");
+	for(j=0;j<sizes.imsize && status==0;j++)
+	{
+		for(i=0;i<sizes.imsize;i++)
+		{
+			dx = (double)(i - sizes.imsize/2)/8.0;
+			dy = (double)(j - sizes.imsize/2)/5.0;
+			row[i] = exp(-0.5*(dx*dx + dy*dy)) + 1.0E-3*(bench_random(&state) - 0.5);
+		}
+		status = quickfits_map_writer_append(&writer, row, sizes.imsize);
+	}
+
+	for(i=0;i<sizes.ncc;i++)
+	{
+		ccx[i] = (bench_random(&state) - 0.5)*20.0*fitsi.cell_ra;
+		ccy[i] = (bench_random(&state) - 0.5)*20.0*fitsi.cell_dec;
+		ccv[i] = 1.0E-3*bench_random(&state);
+	}
+	if(status == 0)
+	{
+		status = quickfits_map_writer_close(&writer, sizes.ncc, ccx, ccy, ccv);
+	}
+
+	free(row);
+	free(ccx);
+	free(ccy);
+	free(ccv);
+	return(status);
+}
+
+int bench_make_uv(const char* filename, bench_sizes sizes)
+{
+/*
+	Write a synthetic FITAB style UV file with quickfits_uv_writer : an empty primary HDU, then an AIPS UV table
+	(UU---SIN, VV---SIN, WW---SIN, DATE, BASELINE, INTTIM, VISIBILITIES) followed by AIPS FQ and AIPS AN tables.
+	u,v trace out baseline tracks of an nant element array, the visibilities are a point source with noise.
+*/
+	quickfits_uv_writer writer;
+	fitsinfo_uv fitsi;
+	unsigned long long state;
+	double* cols[6];
+	double* vis;
+	double* stabxyz;
+	double* polcal;
+	long long row, nrows, i, k, row_elements, nbaselines;
+	int status, err, a1, a2, nant;
+	double h, len, angle;
+
+	bench_uv_info(sizes, &fitsi);
+	status = 0;
+	nant = (sizes.nant < 2) ? 2 : sizes.nant;
+	nbaselines = (long long)(nant)*(nant-1)/2;
+	row_elements = 12LL*sizes.nif*sizes.nchan;
+
+	for(k=0;k<6;k++)
+	{
+		cols[k] = malloc(BENCH_ROWS*sizeof(double));
+		status = (cols[k] == NULL) ? MEMORY_ALLOCATION : status;
+	}
+	vis = malloc(BENCH_ROWS*row_elements*sizeof(double));
+	stabxyz = malloc(3*nant*sizeof(double));
+	polcal = malloc(2LL*nant*sizes.nif*sizeof(double));
+	if(status != 0 || vis == NULL || stabxyz == NULL || polcal == NULL)
+	{
+		printf("ERROR : bench_make_uv --> Error allocating memory\n");
+		status = MEMORY_ALLOCATION;
+	}
+
+	if(status == 0)
+	{
+		status = quickfits_uv_writer_open(&writer, filename, fitsi, sizes.nvis);
+	}
+	if(status == 0)
+	{
+		state = sizes.seed;
+		for(row=0;row<sizes.nvis && status==0;row+=BENCH_ROWS)
+		{
+			nrows = (sizes.nvis-row < BENCH_ROWS) ? sizes.nvis-row : BENCH_ROWS;
+			for(i=0;i<nrows;i++)
+			{
+				k = (row+i)%nbaselines;	// baselines cycle within each integration
+				a1 = 1;
+				while(k >= nant - a1)
+				{
+					k -= nant - a1;
+					a1++;
+				}
+				a2 = a1 + 1 + k;
+				h = 2.0*M_PI*(double)((row+i)/nbaselines)/8640.0;	// 10 s integrations, in radians of hour angle
+				len = 1.0E-2*(a2 - a1)*(1.0 + a1)/nant;	// light seconds
+				angle = 0.5*a1 + 0.3*a2;
+				cols[0][i] = len*cos(h + angle);
+				cols[1][i] = 0.6*len*sin(h + angle);
+				cols[2][i] = 0.1*len*sin(h);
+				cols[3][i] = 2456658.5 + (double)((row+i)/nbaselines)*10.0/86400.0;
+				cols[4][i] = 256*a1 + a2;
+				cols[5][i] = 10.0;
+				for(k=0;k<row_elements;k+=3)
+				{
+					vis[i*row_elements+k] = (float)(((k/3)%4 < 2 ? 1.0 : 0.0) + 0.1*(bench_random(&state) - 0.5));	// as stored
+					vis[i*row_elements+k+1] = (float)(0.1*(bench_random(&state) - 0.5));
+					vis[i*row_elements+k+2] = 1.0;
+				}
+			}
+			status = quickfits_uv_writer_append(&writer, nrows, cols[0], cols[1], cols[2], cols[3], cols[4], cols[5], vis);
+		}
+
+		state = sizes.seed + 1;
+		for(i=0;i<nant;i++)
+		{
+			for(k=0;k<3;k++)
+			{
+				stabxyz[3*i+k] = (bench_random(&state) - 0.5)*1.0E7;
+			}
+			for(k=0;k<2*sizes.nif;k++)
+			{
+				polcal[2*sizes.nif*i+k] = 0.01*(bench_random(&state) - 0.5);
+			}
+		}
+		err = quickfits_uv_writer_close(&writer, NULL, nant, NULL, stabxyz, polcal, polcal);
+		status = (status == 0) ? err : status;
+		if(status != 0)
+		{
+			printf("ERROR : bench_make_uv --> Error writing %s, error = %d\n",filename,status);
+		}
+	}
+
+	for(k=0;k<6;k++)
+	{
+		free(cols[k]);
+	}
+	free(vis);
+	free(stabxyz);
+	free(polcal);
+	return(status);
+}
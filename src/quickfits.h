@@ -22,8 +22,8 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 	
 	struct fitsinfo_map_tag;	// Use a tag so you can pass stucts as fitsinfo_map etc.,  rather than struct fitsinfo_map
 	typedef struct fitsinfo_map_tag{
-		int imsize_ra;
-		int imsize_dec;
+		long long imsize_ra;
+		long long imsize_dec;
 		double cell_ra;
 		double cell_dec;
 		double ra;
@@ -46,13 +46,13 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 		bool have_beam;
 		int niter;
 		
-		int ncc;
+		long long ncc;
 		int cc_table_version;
 	}fitsinfo_map;
 	
 	struct fitsinfo_uv_tag;
 	typedef struct fitsinfo_uv_tag{
-		int nvis;
+		long long nvis;
 		double ra;
 		double dec;
 		int nif;
@@ -67,8 +67,223 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 		double equinox;
 		char date_obs[FLEN_VALUE];
 	}fitsinfo_uv;
-	
-	
+
+	#define QUICKFITS_BLOCK_SIZE 2880	// FITS header and data units are padded to multiples of this
+
+	struct fitshdu_tag;
+	typedef struct fitshdu_tag{
+		int hdutype;	// IMAGE_HDU, ASCII_TBL or BINARY_TBL
+		char extname[FLEN_VALUE];
+		int extver;
+		long long header_offset;	// byte offset of the first header block
+		long long data_offset;	// byte offset of the data unit
+		long long data_size;	// size of the data unit in bytes, not including padding
+	}fitshdu;
+
+	struct fitshdu_dir_tag;
+	typedef struct fitshdu_dir_tag{	// every HDU in a file, so extensions can be found without searching
+		int nhdu;
+		fitshdu* hdus;	// hdus[i] is HDU number i+1
+		long long file_size;	// size and modification time (nanoseconds) of the file when the directory was built
+		long long mtime;
+	}fitshdu_dir;
+
+	#define QUICKFITS_ALIGNMENT 64	// alignment of arena allocations (a cache line)
+
+	struct quickfits_arena_tag;
+	typedef struct quickfits_arena_tag{	// bump allocator for the arrays filled in by the quickfits_alloc_read functions
+		void* blocks;	// list of blocks, most recent first
+		char* base;	// start of free space in the most recent block
+		size_t size;	// usable size of the most recent block
+		size_t used;
+		size_t total_used;	// bytes handed out from all blocks since the last reset
+	}quickfits_arena;
+
+	struct quickfits_stats_tag;
+	typedef struct quickfits_stats_tag{	// statistics of the finite values in an array (quickfits_stats_init, then quickfits_stats_add)
+		long long n;	// number of finite values
+		long long nnan;	// number of NaN or infinite values (blanked pixels, flagged visibilities)
+		double min;
+		double max;
+		double sum;
+		double mean;
+		double m2;	// sum of squared deviations from the mean
+		double rms;	// root mean square, sqrt(sum of squares/n)
+		double sigma;	// standard deviation
+	}quickfits_stats;
+
+	#define QUICKFITS_PREVIEW_MEAN 1	// pooling used to build preview pyramids
+	#define QUICKFITS_PREVIEW_MAX 2
+
+	#define QUICKFITS_MEMFILE_PREFIX "qfmem://"	// file names starting with this refer to registered memory files
+
+	struct quickfits_memfile_tag;
+	typedef struct quickfits_memfile_tag{	// a FITS file held in a caller-owned buffer
+		void* buffer;
+		size_t size;	// size of the FITS file in buffer (updated when the file is written)
+		void* (*mem_realloc)(void* p, size_t newsize);	// used to grow buffer when writing (e.g. realloc), NULL for a fixed buffer
+	}quickfits_memfile;
+
+	struct quickfits_shm_map_tag;
+	typedef struct quickfits_shm_map_tag{	// a map in a POSIX shared memory segment, shared by the processes on a node
+		fitsinfo_map fitsi;
+		const double* tarr;	// imsize_ra*imsize_dec pixels
+		const double* cc_xarray;	// ncc clean components (NULL if there are none)
+		const double* cc_yarray;
+		const double* cc_varray;
+		char name[FLEN_FILENAME];	// segment name
+		void* control;	// reference count and header (read/write)
+		size_t control_size;
+		void* data;	// arrays (read only once published)
+		size_t data_size;
+	}quickfits_shm_map;
+
+	#define QUICKFITS_CAT_MAP 1
+	#define QUICKFITS_CAT_UV 2
+
+	struct fitscat_entry_tag;
+	typedef struct fitscat_entry_tag{
+		int type;	// QUICKFITS_CAT_MAP or QUICKFITS_CAT_UV
+		int nhdu;
+		long long first_hdu;	// index of the first of this file's HDUs in the catalogue HDU table
+		long long path_offset;	// offset of the file name in the catalogue string table
+		long long file_size;
+		long long mtime;	// modification time, nanoseconds since the epoch
+		union{
+			fitsinfo_map map;
+			fitsinfo_uv uv;
+		}info;
+	}fitscat_entry;
+
+	struct fitscat_tag;
+	typedef struct fitscat_tag{	// an open (memory mapped) catalogue
+		void* base;
+		size_t size;
+		long long nentries;
+		const fitscat_entry* entries;
+		const fitshdu* hdus;
+		const long long* dec_index;	// entries in order of increasing declination
+		const char* strings;
+	}fitscat;
+
+	struct fitscat_query_tag;
+	typedef struct fitscat_query_tag{	// set up with quickfits_catalogue_query_init, which matches everything
+		int type;	// QUICKFITS_CAT_MAP, QUICKFITS_CAT_UV or 0 for either
+		char object[FLEN_VALUE];	// case insensitive, empty for any
+		char telescope[FLEN_VALUE];
+		double ra;	// cone search, all in degrees. radius <= 0 for no cone.
+		double dec;
+		double radius;
+		double freq_min;	// Hz, freq_max <= 0 for no upper limit
+		double freq_max;
+		char date_min[FLEN_VALUE];	// DATE-OBS range (inclusive), empty for no limit
+		char date_max[FLEN_VALUE];
+	}fitscat_query;
+
+	struct quickfits_checksum_tag;
+	typedef struct quickfits_checksum_tag{	// running FITS checksum of a data unit written a piece at a time
+		unsigned long sum;	// ones complement sum of the complete blocks so far
+		int fill;	// bytes in the partial block
+		unsigned char block[QUICKFITS_BLOCK_SIZE];
+	}quickfits_checksum;
+
+	struct quickfits_map_writer_tag;
+	typedef struct quickfits_map_writer_tag{	// a map or cube being written a piece at a time (quickfits_map_writer_open)
+		fitsfile* fptr;
+		char filename[FLEN_FILENAME];
+		fitsinfo_map fitsi;
+		long long nplanes;	// planes given to quickfits_map_writer_open (0 if the cube grows as needed)
+		long long planes_allocated;	// current NAXIS3
+		long long plane_pixels;
+		long long pixels_written;
+		quickfits_checksum checksum;	// of the pixels written so far (if quickfits_set_checksums is on)
+	}quickfits_map_writer;
+
+	struct quickfits_uv_writer_tag;
+	typedef struct quickfits_uv_writer_tag{	// a UV file being written a block of visibilities at a time (quickfits_uv_writer_open)
+		fitsfile* fptr;
+		char filename[FLEN_FILENAME];
+		fitsinfo_uv fitsi;
+		long long nvis;	// visibilities given to quickfits_uv_writer_open (0 if the table grows as needed)
+		long long rows_allocated;	// current NAXIS2
+		long long rows_written;
+		long long row_elements;	// 12*nif*nchan
+		long long row_bytes;
+		unsigned char* rows;	// encoded rows waiting to be written
+		long long rows_buffered;
+		long long buffer_rows;
+		quickfits_checksum checksum;	// of the rows written so far (if quickfits_set_checksums is on)
+	}quickfits_uv_writer;
+
+	struct quickfits_antenna_table_tag;
+	typedef struct quickfits_antenna_table_tag{	// an AIPS AN table (quickfits_read_ant_table)
+		int extver;
+		int nant;	// NAXIS2
+		int nif;	// NO_IF
+		int npcal;	// NOPCAL, D-term values per IF (2 : Re, Im)
+		long long pcal_repeat;	// values per antenna in POLCALA and POLCALB (npcal*nif)
+		char poltype[FLEN_VALUE];
+		char** names;	// ANNAME, without trailing blanks
+		char* name_storage;
+		int* nosta;	// station numbers, as used in the baseline numbers
+		double* stabxyz;	// nant*3, metres
+		double* rdterm;	// nant*pcal_repeat POLCALA
+		double* ldterm;	// nant*pcal_repeat POLCALB
+	}quickfits_antenna_table;
+
+	struct quickfits_dterm_tag;
+	typedef struct quickfits_dterm_tag{	// a D-term solution for quickfits_apply_dterms
+		int antenna;	// NOSTA
+		int if_num;	// from 1, or 0 for every IF
+		double rdterm[2];	// Re, Im
+		double ldterm[2];
+	}quickfits_dterm;
+
+	#define QUICKFITS_PREFETCH_HEADERS 1	// parts of a file quickfits_prefetch can load
+	#define QUICKFITS_PREFETCH_IMAGE 2
+	#define QUICKFITS_PREFETCH_UV 4
+	#define QUICKFITS_PREFETCH_CC 8
+
+	#define QUICKFITS_PHASE_OPEN 0	// phases of a call timed by the instrumentation (quickfits_set_instrumentation)
+	#define QUICKFITS_PHASE_HDU_MOVE 1
+	#define QUICKFITS_PHASE_KEYWORDS 2
+	#define QUICKFITS_PHASE_READ 3
+	#define QUICKFITS_PHASE_WRITE 4
+	#define QUICKFITS_PHASE_CONVERT 5	// work on the data once read (statistics, scaling, folding)
+	#define QUICKFITS_PHASE_CLOSE 6
+	#define QUICKFITS_NPHASES 7
+	#define QUICKFITS_MAX_APIS 64	// functions counted separately by quickfits_get_api_stats
+
+	struct quickfits_io_stats_tag;
+	typedef struct quickfits_io_stats_tag{	// totals from quickfits_get_io_stats
+		long long phase_calls[QUICKFITS_NPHASES];
+		long long phase_ns[QUICKFITS_NPHASES];	// nanoseconds
+		long long bytes_read;	// bytes of values read from, or written to, cfitsio
+		long long bytes_written;
+		long long hdu_moves;
+		long long keyword_reads;
+	}quickfits_io_stats;
+
+	struct quickfits_api_stats_tag;
+	typedef struct quickfits_api_stats_tag{
+		char name[FLEN_VALUE];
+		long long calls;
+		long long ns;	// total time in the function, nanoseconds
+	}quickfits_api_stats;
+
+	typedef void (*quickfits_error_handler)(const char* message, void* arg);	// for quickfits_set_error_handler
+
+	typedef int (*quickfits_record_consumer)(const unsigned char* records, long long nrecords, long long first_record, void* arg);	// for quickfits_read_records
+
+	struct quickfits_map_template_tag;
+	typedef struct quickfits_map_template_tag quickfits_map_template;	// header and beam table cards formatted once (quickfits_map_template_build)
+
+	struct quickfits_io_engine_tag;
+	typedef struct quickfits_io_engine_tag quickfits_io_engine;	// many reads in flight at once (quickfits_io_engine_open)
+	typedef void (*quickfits_read_callback)(int status, const unsigned char* data, long long nread, void* arg);	// for quickfits_io_submit
+
+	typedef void (*quickfits_strip_kernel)(int ninputs, const double** inputs, double* output, long long npix, long long first_pixel, void* arg);	// for quickfits_map_stream
+
 #endif
 
 
@@ -77,10 +292,131 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 int quickfits_write_map(const char* filename , double* array, fitsinfo_map fitsi, char* history);
 int quickfits_read_uv_header(const char* filename, fitsinfo_uv* fitsi);
 int quickfits_read_uv_data(const char* filename, fitsinfo_uv fitsi, double* u_array, double* v_array, double* tvis, double* if_array);
+int quickfits_read_uv_data_parallel(const char* filename, fitsinfo_uv fitsi, double* u_array, double* v_array, double* tvis, double* if_array, int nthreads);
+int quickfits_read_uv_data_lambda(const char* filename, fitsinfo_uv fitsi, bool fold, double* u_lambda, double* v_lambda, double* tvis, double* if_array);
+int quickfits_sort_uv_cells(fitsinfo_uv fitsi, double cell_size, int grid_size, int nthreads, double* u_array, double* v_array, double* tvis, long long* perm);
+int quickfits_unsort_uv(fitsinfo_uv fitsi, const long long* perm, double* u_array, double* v_array, double* tvis);
+int quickfits_read_uv_data_sorted(const char* filename, fitsinfo_uv fitsi, double cell_size, int grid_size, int nthreads, double* u_array, double* v_array, double* tvis, double* if_array, long long* perm);
 int quickfits_overwrite_uv_data(const char* filename, fitsinfo_uv fitsi, double* u, double* v, double* tvis);
 int quickfits_replace_ant_info(const char* filename, double* rdterm, double* ldterm);
 int quickfits_read_cc_table(const char* filename , fitsinfo_map fitsi , double* cc_xarray, double* cc_yarray, double* cc_varray);
 int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi);
 int quickfits_read_map(const char* filename, fitsinfo_map fitsi , double* tarr , double* cc_xarray, double* cc_yarray, double* cc_varray);
-
-
+int quickfits_create_map_hdu(fitsfile* fptr, fitsinfo_map fitsi, long long nplanes, char* history, int* status);
+int quickfits_write_beam_table(fitsfile* fptr, const char* filename, fitsinfo_map fitsi, int* status);
+int quickfits_map_writer_open(quickfits_map_writer* writer, const char* filename, fitsinfo_map fitsi, long long nplanes, char* history);
+int quickfits_map_writer_append(quickfits_map_writer* writer, const double* pixels, long long npix);
+int quickfits_map_writer_close(quickfits_map_writer* writer, long long ncc, const double* cc_xarray, const double* cc_yarray, const double* cc_varray);
+void quickfits_set_checksums(bool enable);
+bool quickfits_checksums_enabled(void);
+unsigned long quickfits_checksum_merge(unsigned long sum1, unsigned long sum2);
+unsigned long quickfits_checksum_blocks(const unsigned char* data, long long nblocks, unsigned long sum);
+void quickfits_checksum_init(quickfits_checksum* ck);
+void quickfits_checksum_add(quickfits_checksum* ck, const void* bytes, long long nbytes);
+void quickfits_checksum_add_doubles(quickfits_checksum* ck, const double* values, long long n);
+unsigned long quickfits_checksum_finish(quickfits_checksum* ck);
+unsigned long quickfits_checksum_doubles(const double* values, long long n, int nthreads);
+int quickfits_write_datasum(fitsfile* fptr, unsigned long datasum, int* status);
+int quickfits_verify_checksums(const char* filename, int nthreads, int* dataok, int* hduok);
+int quickfits_map_stream(int ninputs, const char** infiles, const char* outfile, fitsinfo_map fitsi, char* history, quickfits_strip_kernel kernel, void* arg, long long strip_rows, int nthreads);
+void quickfits_kernel_add(int ninputs, const double** inputs, double* output, long long npix, long long first_pixel, void* arg);
+void quickfits_kernel_subtract(int ninputs, const double** inputs, double* output, long long npix, long long first_pixel, void* arg);
+void quickfits_kernel_multiply(int ninputs, const double** inputs, double* output, long long npix, long long first_pixel, void* arg);
+void quickfits_kernel_divide(int ninputs, const double** inputs, double* output, long long npix, long long first_pixel, void* arg);
+void quickfits_kernel_scale(int ninputs, const double** inputs, double* output, long long npix, long long first_pixel, void* arg);
+int quickfits_write_map_preview(const char* filename , double* array, fitsinfo_map fitsi, char* history, int nlevels, int pooling, int nthreads);
+int quickfits_read_map_preview(const char* filename, int level, long long* nx, long long* ny, double* tarr);
+int quickfits_read_map_stats(const char* filename, fitsinfo_map fitsi , double* tarr , double* cc_xarray, double* cc_yarray, double* cc_varray, quickfits_stats* plane_stats);
+int quickfits_read_uv_data_stats(const char* filename, fitsinfo_uv fitsi, double* u_array, double* v_array, double* tvis, double* if_array, quickfits_stats* amp_stats, quickfits_stats* weight_stats);
+void quickfits_stats_init(quickfits_stats* stats);
+void quickfits_stats_merge(quickfits_stats* stats, quickfits_stats part);
+void quickfits_stats_add(quickfits_stats* stats, const double* values, long long n);
+void quickfits_stats_add_vis(quickfits_stats* amp_stats, quickfits_stats* weight_stats, const double* tvis, long long nvis, int nif, int nchan);
+int quickfits_element_count(int ndims, const long long* dims, long long* nelements);
+int quickfits_scan_hdu(int fd, long long offset, fitshdu* hdu, char** cards, int* ncards);
+int quickfits_scan_ext(int fd, int hdutype, const char* extname, int extver, fitshdu* hdu, char** cards, int* ncards);
+int quickfits_read_card(const char* cards, int ncards, const char* keyname, int datatype, void* value, int* status);
+int quickfits_scan_col(const char* cards, int ncards, const char* colname, int* colnum, long long* byte_offset, char* tform_code, long long* repeat, int* status);
+int quickfits_scan_map_header(const char* filename , fitsinfo_map* fitsi);
+int quickfits_scan_uv_header(const char* filename, fitsinfo_uv* fitsi);
+int quickfits_pread_map_header(const char* filename, fitsinfo_map* fitsi);
+int quickfits_pread_uv_header(const char* filename, fitsinfo_uv* fitsi);
+int quickfits_scan_map_headers(int nfiles, const char** filenames, fitsinfo_map* fitsi, int* status, int nthreads);
+int quickfits_scan_uv_headers(int nfiles, const char** filenames, fitsinfo_uv* fitsi, int* status, int nthreads);
+int quickfits_parallel_for(long long n, int nthreads, void (*body)(long long i, void* arg), void* arg);
+int quickfits_cfitsio_threads(int nthreads);
+int quickfits_catalogue_build(const char* catname, const char* dirname, int nthreads);
+int quickfits_catalogue_open(const char* catname, fitscat* cat);
+int quickfits_catalogue_close(fitscat* cat);
+void quickfits_catalogue_query_init(fitscat_query* query);
+long long quickfits_catalogue_query(fitscat cat, fitscat_query query, long long* matches, long long maxmatches);
+const char* quickfits_catalogue_filename(fitscat cat, long long i);
+int quickfits_build_hdu_dir(const char* filename, fitshdu_dir* dir);
+int quickfits_get_hdu_dir(const char* filename, fitshdu_dir* dir);
+int quickfits_save_hdu_dir(const char* filename, fitshdu_dir dir);
+void quickfits_free_hdu_dir(fitshdu_dir* dir);
+int quickfits_find_hdu(fitshdu_dir dir, int hdutype, const char* extname, int extver);
+void quickfits_set_hdu_dir_persist(bool persist);
+int quickfits_movnam_hdu(fitsfile* fptr, const char* filename, int hdutype, char* extname, int extver, int* status);
+int quickfits_arena_init(quickfits_arena* arena, size_t size);
+void* quickfits_arena_alloc(quickfits_arena* arena, size_t nbytes);
+void quickfits_arena_reset(quickfits_arena* arena);
+void quickfits_arena_free(quickfits_arena* arena);
+int quickfits_alloc_read_map(const char* filename, fitsinfo_map* fitsi, quickfits_arena* arena, double** tarr, double** cc_xarray, double** cc_yarray, double** cc_varray);
+int quickfits_alloc_read_uv_data(const char* filename, fitsinfo_uv* fitsi, quickfits_arena* arena, double** u_array, double** v_array, double** tvis, double** if_array);
+int quickfits_memfile_register(const char* name, quickfits_memfile* mem);
+int quickfits_memfile_unregister(const char* name);
+quickfits_memfile* quickfits_memfile_lookup(const char* filename);
+int quickfits_memfile_save(quickfits_memfile mem, const char* filename);
+int quickfits_open_file(fitsfile** fptr, const char* filename, int iomode, int* status);
+int quickfits_create_file(fitsfile** fptr, const char* filename, int* status);
+int quickfits_close_file(fitsfile* fptr, int* status);
+int quickfits_open_owned_memfile(fitsfile** fptr, const char* filename, void* buffer, size_t size, int* status);
+int quickfits_gunzip(const char* gzname, const char* outname, int nthreads);
+int quickfits_open_gz_file(fitsfile** fptr, const char* filename, int* status);
+int quickfits_gz_headers(int fd, int max_hdus, const char* extname, int* header_fd);
+int quickfits_shm_publish_map(const char* shmname, const char* filename, int cc_table_version, quickfits_shm_map* shm);
+int quickfits_shm_attach_map(const char* shmname, quickfits_shm_map* shm);
+int quickfits_shm_detach_map(quickfits_shm_map* shm);
+void quickfits_set_instrumentation(bool enable);
+bool quickfits_instrumentation_enabled(void);
+long long quickfits_trace_start(void);
+void quickfits_trace_api(const char* name, long long start);
+void quickfits_trace_phase(int phase, long long start);
+void quickfits_count_io(long long bytes_read, long long bytes_written, long long hdu_moves, long long keyword_reads);
+void quickfits_get_io_stats(quickfits_io_stats* stats);
+int quickfits_get_api_stats(quickfits_api_stats* apis, int maxapis);
+void quickfits_reset_io_stats(void);
+int quickfits_trace_open(const char* filename);
+int quickfits_trace_close(void);
+void quickfits_set_error_handler(quickfits_error_handler handler, void* arg);
+void quickfits_error(const char* format, ...);
+const char* quickfits_last_error(void);
+int quickfits_prefetch(const char* filename, int what, long long first_row, long long nrows);
+void quickfits_prefetch_wait(void);
+int quickfits_tform_width(char tform_code);
+int quickfits_decode_column(const unsigned char* rows, long long nrows, long long row_bytes, long long byte_offset, char tform_code, long long repeat, double scale, double zero, double* values);
+int quickfits_encode_column(unsigned char* rows, long long nrows, long long row_bytes, long long byte_offset, char tform_code, long long repeat, const double* values);
+void quickfits_set_direct_io(bool enable, long long block_size, bool use_o_direct);
+bool quickfits_direct_io_enabled(void);
+bool quickfits_direct_io_file(const char* filename);
+int quickfits_read_uv_rows(const char* filename, fitsinfo_uv fitsi, double* u_array, double* v_array, double* tvis, double* if_array, int nthreads, bool* fallback);
+int quickfits_read_records(const char* filename, long long offset, long long nrecords, long long record_bytes, quickfits_record_consumer consume, void* arg);
+int quickfits_io_engine_open(quickfits_io_engine** engine, int queue_depth, long long buffer_bytes, bool use_io_uring);
+bool quickfits_io_engine_uses_io_uring(const quickfits_io_engine* engine);
+int quickfits_io_submit(quickfits_io_engine* engine, int fd, long long offset, long long nbytes, quickfits_read_callback callback, void* arg);
+int quickfits_io_wait(quickfits_io_engine* engine);
+void quickfits_io_engine_close(quickfits_io_engine* engine);
+int quickfits_read_map_cutouts(int nfiles, const char** filenames, const long long* x0, const long long* y0, long long nx, long long ny, double* cutouts, int* status, quickfits_io_engine* engine);
+int quickfits_uv_writer_open(quickfits_uv_writer* writer, const char* filename, fitsinfo_uv fitsi, long long nvis);
+int quickfits_uv_writer_append(quickfits_uv_writer* writer, long long nrows, const double* u, const double* v, const double* w, const double* date, const double* baseline, const double* inttim, const double* tvis);
+int quickfits_uv_writer_close(quickfits_uv_writer* writer, const double* if_array, int nant, const char** annames, const double* stabxyz, const double* rdterm, const double* ldterm);
+int quickfits_merge_uv(int nfiles, const char** filenames, const char* outfile, bool sort_by_time);
+int quickfits_read_ant_table(const char* filename, int extver, quickfits_antenna_table* table);
+int quickfits_read_ant_hdu(fitsfile* fptr, quickfits_antenna_table* table, int* status);
+void quickfits_free_ant_table(quickfits_antenna_table* table);
+int quickfits_write_ant_table(const char* filename, const quickfits_antenna_table* table);
+int quickfits_apply_dterms(int nfiles, const char** filenames, int ndterms, const quickfits_dterm* dterms, int* status, int nthreads);
+int quickfits_map_template_build(quickfits_map_template** tmpl, fitsinfo_map fitsi, char* history);
+void quickfits_map_template_free(quickfits_map_template* tmpl);
+int quickfits_write_map_template(const char* filename, double* array, fitsinfo_map fitsi, const quickfits_map_template* tmpl);
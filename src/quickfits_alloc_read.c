@@ -0,0 +1,132 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdint.h>
+
+int quickfits_alloc_read_map(const char* filename, fitsinfo_map* fitsi, quickfits_arena* arena, double** tarr, double** cc_xarray, double** cc_yarray, double** cc_varray)
+{
+/*
+	Read the header of a FITS map, allocate arrays of the right size from an arena and read the map into them
+ 
+	INPUTS:
+		const char* filename : c string = name of FITS file to be read
+		fitsi[0].cc_table_version : Version of CC table to read (negative for none)
+		quickfits_arena* arena : arena to allocate the arrays from
+	OUTPUTS:
+		fitsi : header information, as from quickfits_read_map_header
+		tarr : imsize_ra*imsize_dec pixel values
+		cc_xarray, cc_yarray, cc_varray : ncc clean components (NULL if there are none)
+ 
+	RETURN:
+		0 on success. The arrays are released by resetting or freeing the arena.
+*/
+	int status;
+	long long npix;
+	long long dims[2];
+
+	*tarr = NULL;
+	*cc_xarray = NULL;
+	*cc_yarray = NULL;
+	*cc_varray = NULL;
+
+	status = quickfits_read_map_header(filename, fitsi);
+	if(status == BAD_HDU_NUM && fitsi[0].ncc == 0)	// no CC table, which is fine for a map
+	{
+		status = 0;
+	}
+	if(status != 0)
+	{
+		return(status);
+	}
+
+	dims[0] = fitsi[0].imsize_ra;
+	dims[1] = fitsi[0].imsize_dec;
+	if(quickfits_element_count(2, dims, &npix) || npix > (long long)(SIZE_MAX/sizeof(double)))
+	{
+		quickfits_error("ERROR : quickfits_alloc_read_map --> Image size %lld x %lld is too large\n",fitsi[0].imsize_ra,fitsi[0].imsize_dec);
+		return(NUM_OVERFLOW);
+	}
+
+	*tarr = quickfits_arena_alloc(arena, npix*sizeof(double));
+	if(fitsi[0].ncc > 0)
+	{
+		*cc_xarray = quickfits_arena_alloc(arena, fitsi[0].ncc*sizeof(double));
+		*cc_yarray = quickfits_arena_alloc(arena, fitsi[0].ncc*sizeof(double));
+		*cc_varray = quickfits_arena_alloc(arena, fitsi[0].ncc*sizeof(double));
+	}
+
+	if( *tarr == NULL || (fitsi[0].ncc > 0 && (*cc_xarray == NULL || *cc_yarray == NULL || *cc_varray == NULL)) )
+	{
+		quickfits_error("ERROR : quickfits_alloc_read_map --> Error allocating memory for %s\n",filename);
+		return(MEMORY_ALLOCATION);
+	}
+
+	return(quickfits_read_map(filename, fitsi[0], *tarr, *cc_xarray, *cc_yarray, *cc_varray));
+}
+
+int quickfits_alloc_read_uv_data(const char* filename, fitsinfo_uv* fitsi, quickfits_arena* arena, double** u_array, double** v_array, double** tvis, double** if_array)
+{
+/*
+	Read the header of a UV FITS file, allocate arrays of the right size from an arena and read the data into them
+ 
+	INPUTS:
+		const char* filename : c string = name of FITS file to be read
+		quickfits_arena* arena : arena to allocate the arrays from
+	OUTPUTS:
+		fitsi : header information, as from quickfits_read_uv_header
+		u_array, v_array : nvis u and v coordinates
+		tvis : nvis*12*nif*nchan visibilities
+		if_array : nif IF frequency offsets
+ 
+	RETURN:
+		0 on success. The arrays are released by resetting or freeing the arena.
+*/
+	int status;
+	long long nvis_elements;
+	long long dims[4];
+
+	*u_array = NULL;
+	*v_array = NULL;
+	*tvis = NULL;
+	*if_array = NULL;
+
+	status = quickfits_read_uv_header(filename, fitsi);
+	if(status != 0)
+	{
+		return(status);
+	}
+
+	dims[0] = fitsi[0].nvis;
+	dims[1] = 12;
+	dims[2] = fitsi[0].nif;
+	dims[3] = fitsi[0].nchan;
+	if(quickfits_element_count(4, dims, &nvis_elements) || nvis_elements > (long long)(SIZE_MAX/sizeof(double)))
+	{
+		quickfits_error("ERROR : quickfits_alloc_read_uv_data --> Too many visibilities to read (%lld x 12 x %d x %d)\n",fitsi[0].nvis,fitsi[0].nif,fitsi[0].nchan);
+		return(NUM_OVERFLOW);
+	}
+
+	*u_array = quickfits_arena_alloc(arena, fitsi[0].nvis*sizeof(double));
+	*v_array = quickfits_arena_alloc(arena, fitsi[0].nvis*sizeof(double));
+	*tvis = quickfits_arena_alloc(arena, nvis_elements*sizeof(double));
+	*if_array = quickfits_arena_alloc(arena, fitsi[0].nif*sizeof(double));
+
+	if(*u_array == NULL || *v_array == NULL || *tvis == NULL || *if_array == NULL)
+	{
+		quickfits_error("ERROR : quickfits_alloc_read_uv_data --> Error allocating memory for %s\n",filename);
+		return(MEMORY_ALLOCATION);
+	}
+
+	return(quickfits_read_uv_data(filename, fitsi[0], *u_array, *v_array, *tvis, *if_array));
+}
@@ -0,0 +1,498 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+typedef struct dterm_file_tag{
+	const char* name;
+	int index;	// in the list given to quickfits_apply_dterms
+	int first;	// index of the first entry with the same name
+}dterm_file;
+
+typedef struct dterm_job_tag{
+	const char** filenames;
+	const int* unique;	// indices of the files to update, each name once
+	int ndterms;
+	const quickfits_dterm* dterms;
+	int* status;
+	int nfailed;
+	pthread_mutex_t lock;
+}dterm_job;
+
+static int pcal_columns(fitsfile* fptr, int* cols, long long* repeat, int* status)
+{
+	// POLCALA and POLCALB column numbers and their (common) number of values per antenna
+
+	char* names[] = {"POLCALA", "POLCALB"};
+	long long width;
+	int k, typecode;
+
+	for(k=0;k<2;k++)
+	{
+		fits_get_colnum(fptr,CASEINSEN,names[k],&cols[k],status);
+		fits_get_coltypell(fptr, cols[k], &typecode, &repeat[k], &width, status);
+	}
+	if(*status == 0 && repeat[0] != repeat[1])
+	{
+		*status = BAD_TFORM;
+	}
+	return(*status);
+}
+
+int quickfits_read_ant_hdu(fitsfile* fptr, quickfits_antenna_table* table, int* status)
+{
+/*
+	Read the AIPS AN table in the current HDU of an open file, as quickfits_read_ant_table. (table.extver is left 0.)
+ 
+	RETURN:
+		*status (cfitsio convention), table is left empty if it isn't 0
+*/
+	char comment[FLEN_VALUE];
+	char s_null[]="";
+	char stabxyz_name[]="STABXYZ";
+	char anname_name[]="ANNAME";
+	char nosta_name[]="NOSTA";
+	double d_null=0;
+	int i_null=0;
+	long long naxis2, repeat[2];
+	int colnum, anynull, i, cols[2];
+
+	memset(table, 0, sizeof(quickfits_antenna_table));
+	if(*status != 0)
+	{
+		return(*status);
+	}
+
+	fits_read_key(fptr,TLONGLONG,"NAXIS2",&naxis2,comment,status);
+	fits_read_key(fptr,TINT,"NO_IF",&table[0].nif,comment,status);
+	table[0].npcal = 2;
+	fits_read_key(fptr,TINT,"NOPCAL",&table[0].npcal,comment,status);
+	if(*status == KEY_NO_EXIST)
+	{
+		*status = 0;	// NOPCAL is optional
+	}
+	fits_read_key(fptr,TSTRING,"POLTYPE",table[0].poltype,comment,status);
+	if(*status == KEY_NO_EXIST)
+	{
+		*status = 0;
+	}
+	table[0].nant = naxis2;
+
+	repeat[0] = 0;
+	if(*status == 0 && pcal_columns(fptr, cols, repeat, status) == COL_NOT_FOUND)	// a table without D-terms
+	{
+		*status = 0;
+		cols[0] = 0;
+		repeat[0] = 0;
+	}
+	table[0].pcal_repeat = repeat[0];
+
+	table[0].names = malloc((table[0].nant+1)*sizeof(char*));
+	table[0].name_storage = malloc((table[0].nant+1)*FLEN_VALUE);
+	table[0].nosta = malloc((table[0].nant+1)*sizeof(int));
+	table[0].stabxyz = malloc((3LL*table[0].nant+1)*sizeof(double));
+	table[0].rdterm = calloc(table[0].nant*table[0].pcal_repeat + 1, sizeof(double));
+	table[0].ldterm = calloc(table[0].nant*table[0].pcal_repeat + 1, sizeof(double));
+	if(*status == 0 && (table[0].names == NULL || table[0].name_storage == NULL || table[0].nosta == NULL || table[0].stabxyz == NULL || table[0].rdterm == NULL || table[0].ldterm == NULL))
+	{
+		*status = MEMORY_ALLOCATION;
+	}
+
+	if(*status == 0 && table[0].nant > 0)	// whole columns at a time
+	{
+		for(i=0;i<table[0].nant;i++)
+		{
+			table[0].names[i] = &table[0].name_storage[i*FLEN_VALUE];
+		}
+		fits_get_colnum(fptr,CASEINSEN,anname_name,&colnum,status);
+		fits_read_col(fptr, TSTRING, colnum, 1, 1, table[0].nant, s_null, table[0].names, &anynull, status);
+		fits_get_colnum(fptr,CASEINSEN,stabxyz_name,&colnum,status);
+		fits_read_col(fptr, TDOUBLE, colnum, 1, 1, 3LL*table[0].nant, &d_null, table[0].stabxyz, &anynull, status);
+		fits_get_colnum(fptr,CASEINSEN,nosta_name,&colnum,status);
+		fits_read_col(fptr, TINT, colnum, 1, 1, table[0].nant, &i_null, table[0].nosta, &anynull, status);
+		if(cols[0] > 0 && table[0].pcal_repeat > 0)
+		{
+			fits_read_col(fptr, TDOUBLE, cols[0], 1, 1, table[0].nant*table[0].pcal_repeat, &d_null, table[0].rdterm, &anynull, status);
+			fits_read_col(fptr, TDOUBLE, cols[1], 1, 1, table[0].nant*table[0].pcal_repeat, &d_null, table[0].ldterm, &anynull, status);
+		}
+		for(i=0;i<table[0].nant && *status==0;i++)	// trailing blanks are padding
+		{
+			colnum = strlen(table[0].names[i]);
+			while(colnum > 0 && table[0].names[i][colnum-1] == ' ')
+			{
+				table[0].names[i][--colnum] = '\0';
+			}
+		}
+	}
+	if(*status != 0)
+	{
+		quickfits_free_ant_table(table);
+	}
+	return(*status);
+}
+
+static int read_ant_table(const char* filename, int extver, quickfits_antenna_table* table)
+{
+	fitsfile *fptr;
+
+	char extname[]="AIPS AN ";
+	int status;
+
+	status = 0;
+	memset(table, 0, sizeof(quickfits_antenna_table));
+
+	if ( quickfits_open_file(&fptr,filename, READONLY, &status) )
+	{
+		quickfits_error("ERROR : quickfits_read_ant_table --> Error opening FITS file, error = %d\n",status);
+		return(status);
+	}
+	if (quickfits_movnam_hdu(fptr,filename,BINARY_TBL,extname,extver,&status))
+	{
+		quickfits_error("ERROR : quickfits_read_ant_table --> Error locating AIPS antenna table extension, error = %d\n",status);
+		quickfits_close_file(fptr, &status);
+		return(status);
+	}
+
+	if(quickfits_read_ant_hdu(fptr, table, &status))
+	{
+		quickfits_error("ERROR : quickfits_read_ant_table --> Error reading antenna table, error = %d\n",status);
+	}
+	table[0].extver = extver;
+
+	quickfits_close_file(fptr, &status);
+	return(status);
+}
+
+int quickfits_read_ant_table(const char* filename, int extver, quickfits_antenna_table* table)
+{
+/*
+	Read an AIPS AN antenna table, sized from the table itself (NAXIS2 antennas, NO_IF IFs and the TFORM repeat of
+	POLCALA/POLCALB), so any number of antennas and IFs is read in full.
+ 
+	INPUTS:
+		const char* filename : name of FITS file to be read
+		int extver : version of the table (0 for the first)
+	OUTPUTS:
+		table : the antennas, free with quickfits_free_ant_table. rdterm and ldterm hold pcal_repeat values for each
+			antenna in turn, npcal (normally 2 : Re, Im) for each IF.
+ 
+	RETURN:
+		0 on success
+*/
+	long long start;
+	int status;
+
+	start = quickfits_trace_start();
+	status = read_ant_table(filename, extver, table);
+	quickfits_trace_api("quickfits_read_ant_table", start);
+
+	return(status);
+}
+
+void quickfits_free_ant_table(quickfits_antenna_table* table)
+{
+	free(table[0].names);
+	free(table[0].name_storage);
+	free(table[0].nosta);
+	free(table[0].stabxyz);
+	free(table[0].rdterm);
+	free(table[0].ldterm);
+	table[0].names = NULL;
+	table[0].name_storage = NULL;
+	table[0].nosta = NULL;
+	table[0].stabxyz = NULL;
+	table[0].rdterm = NULL;
+	table[0].ldterm = NULL;
+	table[0].nant = 0;
+}
+
+static int write_ant_table(const char* filename, const quickfits_antenna_table* table)
+{
+	fitsfile *fptr;
+
+	char extname[]="AIPS AN ";
+	char comment[FLEN_VALUE];
+	char stabxyz_name[]="STABXYZ";
+	long long naxis2, repeat[2];
+	int status, colnum, cols[2];
+
+	status = 0;
+	if ( quickfits_open_file(&fptr,filename, READWRITE, &status) )
+	{
+		quickfits_error("ERROR : quickfits_write_ant_table --> Error opening FITS file, error = %d\n",status);
+		return(status);
+	}
+	if (quickfits_movnam_hdu(fptr,filename,BINARY_TBL,extname,table[0].extver,&status))
+	{
+		quickfits_error("ERROR : quickfits_write_ant_table --> Error locating AIPS antenna table extension, error = %d\n",status);
+		quickfits_close_file(fptr, &status);
+		return(status);
+	}
+
+	fits_read_key(fptr,TLONGLONG,"NAXIS2",&naxis2,comment,&status);
+	pcal_columns(fptr, cols, repeat, &status);
+	if(status == 0 && (naxis2 != table[0].nant || repeat[0] != table[0].pcal_repeat))
+	{
+		quickfits_error("ERROR : quickfits_write_ant_table --> Table has %lld antennas of %lld D-term values, not %d of %lld\n",naxis2,repeat[0],table[0].nant,table[0].pcal_repeat);
+		status = BAD_DIMEN;
+	}
+
+	if(status == 0 && table[0].nant > 0)	// one write per column
+	{
+		fits_get_colnum(fptr,CASEINSEN,stabxyz_name,&colnum,&status);
+		fits_write_col(fptr, TDOUBLE, colnum, 1, 1, 3LL*table[0].nant, table[0].stabxyz, &status);
+		fits_write_col(fptr, TDOUBLE, cols[0], 1, 1, table[0].nant*table[0].pcal_repeat, table[0].rdterm, &status);
+		fits_write_col(fptr, TDOUBLE, cols[1], 1, 1, table[0].nant*table[0].pcal_repeat, table[0].ldterm, &status);
+		fits_update_key(fptr, TSTRING, "POLTYPE", (char*) table[0].poltype, NULL, &status);	// keeping the comment
+	}
+	if(status == 0 && quickfits_checksums_enabled())
+	{
+		fits_write_chksum(fptr, &status);
+	}
+	if(status != 0)
+	{
+		quickfits_error("ERROR : quickfits_write_ant_table --> Error writing antenna table, error = %d\n",status);
+	}
+
+	quickfits_close_file(fptr, &status);
+	return(status);
+}
+
+int quickfits_write_ant_table(const char* filename, const quickfits_antenna_table* table)
+{
+/*
+	Write the station positions, D-terms and POLTYPE of an antenna table read with quickfits_read_ant_table back to
+	an AN table of the same size (in the same or another file), one write per column.
+ 
+	INPUTS:
+		const char* filename : name of FITS file to be changed
+		table : the antennas, written to the AN table with version table.extver
+ 
+	RETURN:
+		0 on success, BAD_DIMEN if the table in the file has a different number of antennas or D-terms
+*/
+	long long start;
+	int status;
+
+	start = quickfits_trace_start();
+	status = write_ant_table(filename, table);
+	quickfits_trace_api("quickfits_write_ant_table", start);
+
+	return(status);
+}
+
+static int apply_dterms(const char* filename, int ndterms, const quickfits_dterm* dterms)
+{
+	// read both D-term columns whole, patch them and write them back
+
+	fitsfile *fptr;
+
+	char extname[]="AIPS AN ";
+	char comment[]="UVFILL";
+	char key_comment[FLEN_VALUE];
+	char poltype[]="VLBI    ";	// as quickfits_replace_ant_info
+	char nosta_name[]="NOSTA";
+	double d_null=0;
+	int i_null=0;
+	long long naxis2, repeat[2], base, first_if, last_if, f;
+	double* rd;
+	double* ld;
+	int* nosta;
+	int status, colnum, anynull, cols[2], nif, npcal, i, row;
+
+	status = 0;
+	naxis2 = 0;
+	nif = 0;
+	repeat[0] = 0;
+	if ( quickfits_open_file(&fptr,filename, READWRITE, &status) )
+	{
+		return(status);
+	}
+	if (quickfits_movnam_hdu(fptr,filename,BINARY_TBL,extname,0,&status))
+	{
+		quickfits_close_file(fptr, &status);
+		return(status);
+	}
+
+	fits_read_key(fptr,TLONGLONG,"NAXIS2",&naxis2,key_comment,&status);
+	fits_read_key(fptr,TINT,"NO_IF",&nif,key_comment,&status);
+	pcal_columns(fptr, cols, repeat, &status);
+	npcal = (status == 0 && nif > 0) ? repeat[0]/nif : 0;
+
+	nosta = malloc((naxis2+1)*sizeof(int));
+	rd = malloc((naxis2*repeat[0]+1)*sizeof(double));
+	ld = malloc((naxis2*repeat[0]+1)*sizeof(double));
+	if(status == 0 && (nosta == NULL || rd == NULL || ld == NULL))
+	{
+		status = MEMORY_ALLOCATION;
+	}
+	fits_get_colnum(fptr,CASEINSEN,nosta_name,&colnum,&status);
+	fits_read_col(fptr, TINT, colnum, 1, 1, naxis2, &i_null, nosta, &anynull, &status);
+	fits_read_col(fptr, TDOUBLE, cols[0], 1, 1, naxis2*repeat[0], &d_null, rd, &anynull, &status);
+	fits_read_col(fptr, TDOUBLE, cols[1], 1, 1, naxis2*repeat[0], &d_null, ld, &anynull, &status);
+
+	for(i=0;i<ndterms && status==0 && npcal>=2;i++)
+	{
+		for(row=0;row<naxis2 && nosta[row]!=dterms[i].antenna;row++);
+		if(row == naxis2 || dterms[i].if_num > nif)	// not in this file
+		{
+			continue;
+		}
+		first_if = (dterms[i].if_num > 0) ? dterms[i].if_num-1 : 0;
+		last_if = (dterms[i].if_num > 0) ? dterms[i].if_num : nif;
+		for(f=first_if;f<last_if;f++)
+		{
+			base = row*repeat[0] + f*npcal;
+			rd[base] = dterms[i].rdterm[0];
+			rd[base+1] = dterms[i].rdterm[1];
+			ld[base] = dterms[i].ldterm[0];
+			ld[base+1] = dterms[i].ldterm[1];
+		}
+	}
+
+	fits_write_col(fptr, TDOUBLE, cols[0], 1, 1, naxis2*repeat[0], rd, &status);
+	fits_write_col(fptr, TDOUBLE, cols[1], 1, 1, naxis2*repeat[0], ld, &status);
+	fits_update_key(fptr, TSTRING, "POLTYPE", poltype, comment, &status);
+	if(status == 0 && quickfits_checksums_enabled())
+	{
+		fits_write_chksum(fptr, &status);
+	}
+
+	free(nosta);
+	free(rd);
+	free(ld);
+	quickfits_close_file(fptr, &status);
+	return(status);
+}
+
+static int compare_files(const void* a, const void* b)
+{
+	const dterm_file* fa = (const dterm_file*)(a);
+	const dterm_file* fb = (const dterm_file*)(b);
+	int c;
+
+	c = strcmp(fa[0].name, fb[0].name);
+	if(c == 0)
+	{
+		c = (fa[0].index > fb[0].index) - (fa[0].index < fb[0].index);
+	}
+	return(c);
+}
+
+static void apply_file(long long k, void* arg)
+{
+	dterm_job* job = (dterm_job*)(arg);
+	int status, i;
+
+	i = job[0].unique[k];
+	status = apply_dterms(job[0].filenames[i], job[0].ndterms, job[0].dterms);
+	if(job[0].status != NULL)
+	{
+		job[0].status[i] = status;
+	}
+	if(status != 0)
+	{
+		quickfits_error("ERROR : quickfits_apply_dterms --> Error updating antenna table of %s, error = %d\n",job[0].filenames[i],status);
+		pthread_mutex_lock(&job[0].lock);
+		job[0].nfailed++;
+		pthread_mutex_unlock(&job[0].lock);
+	}
+}
+
+int quickfits_apply_dterms(int nfiles, const char** filenames, int ndterms, const quickfits_dterm* dterms, int* status, int nthreads)
+{
+/*
+	Apply a set of D-term solutions to the AN tables of many UV files in parallel. Each file is opened once, and both
+	D-term columns are read, patched and written back whole. POLTYPE is set to VLBI, as quickfits_replace_ant_info does.
+ 
+	INPUTS:
+		int nfiles : number of files
+		const char** filenames : names of the files to be changed
+		int ndterms : number of solutions
+		dterms : the solutions, each for one antenna (NOSTA, as in the baseline numbers) and one IF (or every IF).
+			Solutions for antennas or IFs a file doesn't have are skipped for that file.
+		int nthreads : number of threads to use (0 to use one per processor). One is used unless cfitsio is reentrant.
+			A file named more than once is only updated once.
+	OUTPUTS:
+		status : (optional, may be NULL) nfiles return values, 0 for each file updated
+ 
+	RETURN:
+		Number of files which could not be updated (0 on success).
+*/
+	dterm_job job;
+	dterm_file* files;
+	int* unique;
+	long long start;
+	int i, nunique;
+
+	if(nfiles <= 0)
+	{
+		return(0);
+	}
+	start = quickfits_trace_start();
+	files = malloc(nfiles*sizeof(dterm_file));
+	unique = malloc(nfiles*sizeof(int));
+	if(files == NULL || unique == NULL)
+	{
+		quickfits_error("ERROR : quickfits_apply_dterms --> Unable to allocate memory for %d files\n",nfiles);
+		free(files);
+		free(unique);
+		for(i=0;i<nfiles && status!=NULL;i++)
+		{
+			status[i] = MEMORY_ALLOCATION;
+		}
+		return(nfiles);
+	}
+
+	for(i=0;i<nfiles;i++)	// two threads mustn't write the same table
+	{
+		files[i].name = filenames[i];
+		files[i].index = i;
+	}
+	qsort(files, nfiles, sizeof(dterm_file), compare_files);
+	nunique = 0;
+	for(i=0;i<nfiles;i++)
+	{
+		if(i > 0 && !strcmp(files[i].name, files[i-1].name))
+		{
+			files[i].first = files[i-1].first;
+		}
+		else
+		{
+			files[i].first = files[i].index;
+			unique[nunique++] = files[i].index;
+		}
+	}
+
+	job.filenames = filenames;
+	job.unique = unique;
+	job.ndterms = ndterms;
+	job.dterms = dterms;
+	job.status = status;
+	job.nfailed = 0;
+	pthread_mutex_init(&job.lock, NULL);
+	quickfits_parallel_for(nunique, quickfits_cfitsio_threads(nthreads), apply_file, &job);
+	pthread_mutex_destroy(&job.lock);
+
+	for(i=0;i<nfiles && status!=NULL;i++)	// repeats get the result of the first
+	{
+		status[files[i].index] = status[files[i].first];
+	}
+	free(files);
+	free(unique);
+	quickfits_trace_api("quickfits_apply_dterms", start);
+
+	return(job.nfailed);
+}
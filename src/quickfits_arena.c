@@ -0,0 +1,179 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#define HUGE_PAGE_SIZE (2*1024*1024)	// blocks at least this big are mapped separately and backed by transparent huge pages
+
+typedef struct arena_block_tag{	// sits at the start of every block, padded to QUICKFITS_ALIGNMENT
+	struct arena_block_tag* next;
+	size_t size;	// total size of the block, including this header
+	bool mapped;	// from mmap rather than posix_memalign
+}arena_block;
+
+#define BLOCK_HEADER_SIZE (((sizeof(arena_block)+QUICKFITS_ALIGNMENT-1)/QUICKFITS_ALIGNMENT)*QUICKFITS_ALIGNMENT)
+
+static int add_block(quickfits_arena* arena, size_t size)
+{
+	arena_block* block;
+	void* mem;
+	bool mapped;
+
+	size += BLOCK_HEADER_SIZE;
+	mapped = (size >= HUGE_PAGE_SIZE);
+
+	if(mapped)
+	{
+		size = ((size+HUGE_PAGE_SIZE-1)/HUGE_PAGE_SIZE)*HUGE_PAGE_SIZE;
+		mem = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(mem == MAP_FAILED)
+		{
+			return(MEMORY_ALLOCATION);
+		}
+#ifdef MADV_HUGEPAGE
+		madvise(mem, size, MADV_HUGEPAGE);	// only a hint - fine if THP is switched off
+#endif
+	}
+	else
+	{
+		if(posix_memalign(&mem, QUICKFITS_ALIGNMENT, size) != 0)
+		{
+			return(MEMORY_ALLOCATION);
+		}
+	}
+
+	block = (arena_block*)(mem);
+	block[0].next = (arena_block*)(arena[0].blocks);
+	block[0].size = size;
+	block[0].mapped = mapped;
+
+	arena[0].blocks = block;
+	arena[0].base = (char*)(mem) + BLOCK_HEADER_SIZE;
+	arena[0].size = size - BLOCK_HEADER_SIZE;
+	arena[0].used = 0;
+	return(0);
+}
+
+static void free_blocks(quickfits_arena* arena)
+{
+	arena_block* block;
+	arena_block* next;
+
+	for(block=(arena_block*)(arena[0].blocks); block!=NULL; block=next)
+	{
+		next = block[0].next;
+		if(block[0].mapped)
+		{
+			munmap(block, block[0].size);
+		}
+		else
+		{
+			free(block);
+		}
+	}
+	arena[0].blocks = NULL;
+	arena[0].base = NULL;
+	arena[0].size = 0;
+	arena[0].used = 0;
+}
+
+int quickfits_arena_init(quickfits_arena* arena, size_t size)
+{
+/*
+	Set up an arena for quickfits_arena_alloc
+ 
+	INPUTS:
+		size_t size : bytes to reserve up front (0 to wait for the first allocation)
+ 
+	RETURN:
+		0 on success.
+*/
+	arena[0].blocks = NULL;
+	arena[0].base = NULL;
+	arena[0].size = 0;
+	arena[0].used = 0;
+	arena[0].total_used = 0;
+
+	if(size > 0)
+	{
+		return(add_block(arena, size));
+	}
+	return(0);
+}
+
+void* quickfits_arena_alloc(quickfits_arena* arena, size_t nbytes)
+{
+/*
+	Allocate nbytes from an arena. The memory is aligned to QUICKFITS_ALIGNMENT bytes and stays valid
+	until the arena is reset or freed. Returns NULL if there isn't enough memory.
+*/
+	void* mem;
+	size_t size;
+
+	nbytes = ((nbytes+QUICKFITS_ALIGNMENT-1)/QUICKFITS_ALIGNMENT)*QUICKFITS_ALIGNMENT;
+	if(nbytes == 0)
+	{
+		nbytes = QUICKFITS_ALIGNMENT;
+	}
+
+	if(arena[0].blocks == NULL || arena[0].size - arena[0].used < nbytes)
+	{
+		size = (2*arena[0].size > nbytes) ? 2*arena[0].size : nbytes;	// grow geometrically for many small allocations
+		if(add_block(arena, size) != 0)
+		{
+			return(NULL);
+		}
+	}
+
+	mem = arena[0].base + arena[0].used;
+	arena[0].used += nbytes;
+	arena[0].total_used += nbytes;
+	return(mem);
+}
+
+void quickfits_arena_reset(quickfits_arena* arena)
+{
+/*
+	Release everything allocated from an arena so the memory can be used again, e.g. for the next file of the same shape.
+	If more than one block was needed, they are replaced by a single block big enough for all of them,
+	so the next round of allocations of the same size reuses the same pages without any new page faults.
+*/
+	arena_block* block;
+	size_t total_used;
+
+	block = (arena_block*)(arena[0].blocks);
+	total_used = arena[0].total_used;
+	arena[0].total_used = 0;
+
+	if(block == NULL)
+	{
+		return;
+	}
+
+	if(block[0].next != NULL)
+	{
+		free_blocks(arena);
+		add_block(arena, total_used);	// if this fails, the arena simply starts again from empty
+		return;
+	}
+
+	arena[0].used = 0;
+}
+
+void quickfits_arena_free(quickfits_arena* arena)
+{
+	free_blocks(arena);
+	arena[0].total_used = 0;
+}
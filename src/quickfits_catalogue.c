@@ -0,0 +1,724 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define _GNU_SOURCE	// for strcasecmp and struct stat nanosecond times
+#include "quickfits.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define CATALOGUE_MAGIC "QFITSCAT"
+#define CATALOGUE_VERSION 1
+#define CATALOGUE_ALIGN 64
+
+typedef struct catalogue_header_tag{
+	char magic[8];
+	int version;
+	int entry_size;	// guards against reading a catalogue written with a different struct layout
+	long long nentries;
+	long long nhdus;
+	long long strings_size;
+	long long entries_offset;
+	long long hdus_offset;
+	long long dec_index_offset;
+	long long strings_offset;
+}catalogue_header;
+
+typedef struct catalogue_file_tag{	// one file found while building a catalogue
+	char* path;
+	long long file_size;
+	long long mtime;
+	bool rescan;	// true if the file is new or has changed since the last build
+	int status;	// 0 if the file is to be catalogued
+	fitscat_entry entry;
+	fitshdu* hdus;
+	const fitshdu* old_hdus;	// HDU table from the previous catalogue, if the file is unchanged
+}catalogue_file;
+
+typedef struct catalogue_list_tag{
+	catalogue_file* files;
+	long long nfiles;
+	long long capacity;
+}catalogue_list;
+
+typedef struct catalogue_dec_tag{
+	double dec;
+	long long index;
+}catalogue_dec;
+
+static int compare_decs(const void* a, const void* b)
+{
+	double da = ((const catalogue_dec*)(a))->dec;
+	double db = ((const catalogue_dec*)(b))->dec;
+
+	return( (da > db) - (da < db) );
+}
+
+static long long align_up(long long offset)
+{
+	return( ((offset + CATALOGUE_ALIGN - 1)/CATALOGUE_ALIGN)*CATALOGUE_ALIGN );
+}
+
+static int walk_directory(const char* dirname, catalogue_list* list)
+{
+	// recursively add every regular file below dirname to the list. Symbolic links are not followed.
+
+	DIR* dir;
+	struct dirent* ent;
+	struct stat st;
+	char* path;
+	catalogue_file* temp;
+	int status;
+
+	dir = opendir(dirname);
+	if(dir == NULL)
+	{
+		return(FILE_NOT_OPENED);
+	}
+
+	status=0;
+	while( status == 0 && (ent = readdir(dir)) != NULL )
+	{
+		if( !strcmp(ent->d_name,".") || !strcmp(ent->d_name,"..") )
+		{
+			continue;
+		}
+
+		path = malloc(strlen(dirname)+strlen(ent->d_name)+2);
+		if(path == NULL)
+		{
+			status = MEMORY_ALLOCATION;
+			break;
+		}
+		sprintf(path,"%s/%s",dirname,ent->d_name);
+
+		if(lstat(path,&st) != 0)
+		{
+			free(path);
+			continue;
+		}
+
+		if(S_ISDIR(st.st_mode))
+		{
+			walk_directory(path, list);	// unreadable subdirectories are skipped
+			free(path);
+			continue;
+		}
+		if(!S_ISREG(st.st_mode))
+		{
+			free(path);
+			continue;
+		}
+
+		if(list[0].nfiles == list[0].capacity)
+		{
+			list[0].capacity = (list[0].capacity > 0) ? 2*list[0].capacity : 1024;
+			temp = realloc(list[0].files, list[0].capacity*sizeof(catalogue_file));
+			if(temp == NULL)
+			{
+				free(path);
+				status = MEMORY_ALLOCATION;
+				break;
+			}
+			list[0].files = temp;
+		}
+
+		memset(&list[0].files[list[0].nfiles], 0, sizeof(catalogue_file));
+		list[0].files[list[0].nfiles].path = path;
+		list[0].files[list[0].nfiles].file_size = st.st_size;
+		list[0].files[list[0].nfiles].mtime = (long long)(st.st_mtim.tv_sec)*1000000000LL + st.st_mtim.tv_nsec;
+		list[0].nfiles++;
+	}
+
+	closedir(dir);
+	return(status);
+}
+
+static int compare_files(const void* a, const void* b)
+{
+	return( strcmp( ((const catalogue_file*)(a))->path, ((const catalogue_file*)(b))->path ) );
+}
+
+static void scan_file(long long i, void* arg)
+{
+	// list the HDUs of a file and read the map or UV header, depending on what it contains
+
+	catalogue_file* file = ((catalogue_file**)(arg))[i];
+	fitshdu hdu;
+	fitshdu* temp;
+	long long offset;
+	int fd, status, capacity;
+	bool have_uv, have_cc;
+
+	file[0].status = FILE_NOT_OPENED;
+	fd = open(file[0].path, O_RDONLY);
+	if(fd < 0)
+	{
+		return;
+	}
+
+	capacity=0;
+	have_uv=false;
+	have_cc=false;
+	offset=0;
+	while(true)
+	{
+		status = quickfits_scan_hdu(fd, offset, &hdu, NULL, NULL);
+		if(status != 0)
+		{
+			break;
+		}
+
+		if(file[0].entry.nhdu == capacity)
+		{
+			capacity = (capacity > 0) ? 2*capacity : 8;
+			temp = realloc(file[0].hdus, capacity*sizeof(fitshdu));
+			if(temp == NULL)
+			{
+				status = MEMORY_ALLOCATION;
+				break;
+			}
+			file[0].hdus = temp;
+		}
+		file[0].hdus[file[0].entry.nhdu++] = hdu;
+
+		if(hdu.hdutype == BINARY_TBL && !strcmp(hdu.extname,"AIPS UV"))
+		{
+			have_uv = true;
+		}
+		if(!strcmp(hdu.extname,"AIPS CC"))
+		{
+			have_cc = true;
+		}
+		offset = hdu.data_offset + ((hdu.data_size+QUICKFITS_BLOCK_SIZE-1)/QUICKFITS_BLOCK_SIZE)*QUICKFITS_BLOCK_SIZE;
+	}
+	close(fd);
+
+	if(file[0].entry.nhdu == 0 || (status != END_OF_FILE && status != NO_END))	// not FITS, or truncated
+	{
+		file[0].status = (file[0].entry.nhdu == 0) ? status : READ_ERROR;
+		return;
+	}
+
+	if(have_uv)
+	{
+		file[0].entry.type = QUICKFITS_CAT_UV;
+		file[0].status = quickfits_pread_uv_header(file[0].path, &file[0].entry.info.uv);	// NO_SIMPLE is read after the parallel pass
+	}
+	else if(file[0].hdus[0].data_size > 0)
+	{
+		file[0].entry.type = QUICKFITS_CAT_MAP;
+		file[0].entry.info.map.cc_table_version = have_cc ? 0 : -1;
+		file[0].status = quickfits_pread_map_header(file[0].path, &file[0].entry.info.map);
+	}
+	else
+	{
+		file[0].status = NOT_IMAGE;
+	}
+}
+
+static int write_catalogue(const char* catname, catalogue_list* list)
+{
+	// write the catalogued files (in path order) to a temporary file, then move it into place
+
+	catalogue_header header;
+	fitscat_entry entry;
+	long long i, nentries, nhdus, strings_size, hdu_index, path_offset;
+	long long* dec_index;
+	catalogue_dec* dec_order;
+	long long k;
+	char* tmpname;
+	FILE* fp;
+	int status;
+	char pad[CATALOGUE_ALIGN];
+
+	nentries=0;
+	nhdus=0;
+	strings_size=0;
+	for(i=0;i<list[0].nfiles;i++)
+	{
+		if(list[0].files[i].status == 0)
+		{
+			nentries++;
+			nhdus += list[0].files[i].entry.nhdu;
+			strings_size += strlen(list[0].files[i].path)+1;
+		}
+	}
+
+	memset(&header,0,sizeof(header));
+	memcpy(header.magic,CATALOGUE_MAGIC,8);
+	header.version = CATALOGUE_VERSION;
+	header.entry_size = sizeof(fitscat_entry);
+	header.nentries = nentries;
+	header.nhdus = nhdus;
+	header.strings_size = strings_size;
+	header.entries_offset = align_up(sizeof(header));
+	header.hdus_offset = align_up(header.entries_offset + nentries*sizeof(fitscat_entry));
+	header.dec_index_offset = align_up(header.hdus_offset + nhdus*sizeof(fitshdu));
+	header.strings_offset = align_up(header.dec_index_offset + nentries*sizeof(long long));
+
+	// declination index, for cone searches
+
+	dec_order = malloc((nentries+1)*sizeof(catalogue_dec));
+	dec_index = malloc((nentries+1)*sizeof(long long));
+	if(dec_order == NULL || dec_index == NULL)
+	{
+		free(dec_order);
+		free(dec_index);
+		return(MEMORY_ALLOCATION);
+	}
+	k=0;
+	for(i=0;i<list[0].nfiles;i++)
+	{
+		if(list[0].files[i].status == 0)
+		{
+			dec_order[k].dec = (list[0].files[i].entry.type == QUICKFITS_CAT_MAP) ? list[0].files[i].entry.info.map.dec : list[0].files[i].entry.info.uv.dec;
+			dec_order[k].index = k;
+			k++;
+		}
+	}
+	qsort(dec_order, nentries, sizeof(catalogue_dec), compare_decs);
+	for(i=0;i<nentries;i++)
+	{
+		dec_index[i] = dec_order[i].index;
+	}
+	free(dec_order);
+
+	tmpname = malloc(strlen(catname)+32);
+	if(tmpname == NULL)
+	{
+		free(dec_index);
+		return(MEMORY_ALLOCATION);
+	}
+	sprintf(tmpname,"%s.tmp%d",catname,(int)(getpid()));
+
+	fp = fopen(tmpname,"wb");
+	if(fp == NULL)
+	{
+		free(tmpname);
+		free(dec_index);
+		return(FILE_NOT_CREATED);
+	}
+
+	memset(pad,0,sizeof(pad));
+	status=0;
+	fwrite(&header,sizeof(header),1,fp);
+	fwrite(pad,header.entries_offset-sizeof(header),1,fp);
+
+	hdu_index=0;
+	path_offset=0;
+	for(i=0;i<list[0].nfiles;i++)
+	{
+		if(list[0].files[i].status == 0)
+		{
+			entry = list[0].files[i].entry;
+			entry.first_hdu = hdu_index;
+			entry.path_offset = path_offset;
+			entry.file_size = list[0].files[i].file_size;
+			entry.mtime = list[0].files[i].mtime;
+			fwrite(&entry,sizeof(entry),1,fp);
+			hdu_index += entry.nhdu;
+			path_offset += strlen(list[0].files[i].path)+1;
+		}
+	}
+	fwrite(pad,header.hdus_offset-(header.entries_offset+nentries*sizeof(fitscat_entry)),1,fp);
+
+	for(i=0;i<list[0].nfiles;i++)
+	{
+		if(list[0].files[i].status == 0)
+		{
+			fwrite( list[0].files[i].rescan ? list[0].files[i].hdus : list[0].files[i].old_hdus, sizeof(fitshdu), list[0].files[i].entry.nhdu, fp );
+		}
+	}
+	fwrite(pad,header.dec_index_offset-(header.hdus_offset+nhdus*sizeof(fitshdu)),1,fp);
+
+	fwrite(dec_index,sizeof(long long),nentries,fp);
+	fwrite(pad,header.strings_offset-(header.dec_index_offset+nentries*sizeof(long long)),1,fp);
+
+	for(i=0;i<list[0].nfiles;i++)
+	{
+		if(list[0].files[i].status == 0)
+		{
+			fwrite(list[0].files[i].path,strlen(list[0].files[i].path)+1,1,fp);
+		}
+	}
+
+	if(ferror(fp))
+	{
+		status = WRITE_ERROR;
+	}
+	if(fclose(fp) != 0)
+	{
+		status = WRITE_ERROR;
+	}
+	if(status == 0 && rename(tmpname,catname) != 0)
+	{
+		status = WRITE_ERROR;
+	}
+	if(status != 0)
+	{
+		remove(tmpname);
+	}
+
+	free(tmpname);
+	free(dec_index);
+	return(status);
+}
+
+int quickfits_catalogue_build(const char* catname, const char* dirname, int nthreads)
+{
+/*
+	Build or refresh a binary catalogue of the FITS maps and UV files below a directory.
+	If the catalogue already exists, only files which are new or whose size or modification time has changed are read again.
+ 
+	INPUTS:
+		const char* catname : name of the catalogue file
+		const char* dirname : directory to catalogue (searched recursively, symbolic links are not followed)
+		int nthreads : number of threads to use when reading headers (0 to use one per processor)
+ 
+	RETURN:
+		0 on success.
+*/
+	catalogue_list list;
+	catalogue_file** rescan;
+	long long nrescan, i, lo, hi, mid;
+	fitscat old;
+	bool have_old;
+	const char* old_path;
+	int status, cmp;
+
+	list.files = NULL;
+	list.nfiles = 0;
+	list.capacity = 0;
+
+	status = walk_directory(dirname, &list);
+	if(status != 0)
+	{
+		quickfits_error("ERROR : quickfits_catalogue_build --> Error reading directory %s, error = %d\n",dirname,status);
+		for(i=0;i<list.nfiles;i++)
+		{
+			free(list.files[i].path);
+		}
+		free(list.files);
+		return(status);
+	}
+	qsort(list.files, list.nfiles, sizeof(catalogue_file), compare_files);
+
+	// reuse the entries of unchanged files. The old catalogue is sorted by path.
+
+	have_old = (access(catname,F_OK) == 0 && quickfits_catalogue_open(catname,&old) == 0);
+
+	rescan = malloc((list.nfiles+1)*sizeof(catalogue_file*));
+	if(rescan == NULL)
+	{
+		status = MEMORY_ALLOCATION;
+	}
+
+	nrescan=0;
+	for(i=0;i<list.nfiles && status==0;i++)
+	{
+		list.files[i].rescan = true;
+		if(have_old)
+		{
+			lo=0;
+			hi=old.nentries-1;
+			while(lo<=hi)
+			{
+				mid = (lo+hi)/2;
+				old_path = quickfits_catalogue_filename(old,mid);
+				cmp = strcmp(old_path,list.files[i].path);
+				if(cmp == 0)
+				{
+					if(old.entries[mid].file_size == list.files[i].file_size && old.entries[mid].mtime == list.files[i].mtime)
+					{
+						list.files[i].rescan = false;
+						list.files[i].status = 0;
+						list.files[i].entry = old.entries[mid];
+						list.files[i].old_hdus = &old.hdus[old.entries[mid].first_hdu];
+					}
+					break;
+				}
+				if(cmp < 0)
+				{
+					lo = mid+1;
+				}
+				else
+				{
+					hi = mid-1;
+				}
+			}
+		}
+		if(list.files[i].rescan)
+		{
+			rescan[nrescan++] = &list.files[i];
+		}
+	}
+
+	if(status == 0)
+	{
+		quickfits_parallel_for(nrescan, nthreads, scan_file, rescan);
+		for(i=0;i<nrescan;i++)	// anything left for cfitsio, one at a time on this thread
+		{
+			if(rescan[i][0].status == NO_SIMPLE && rescan[i][0].entry.type == QUICKFITS_CAT_UV)
+			{
+				rescan[i][0].status = quickfits_read_uv_header(rescan[i][0].path, &rescan[i][0].entry.info.uv);
+			}
+			else if(rescan[i][0].status == NO_SIMPLE && rescan[i][0].entry.type == QUICKFITS_CAT_MAP)
+			{
+				rescan[i][0].status = quickfits_read_map_header(rescan[i][0].path, &rescan[i][0].entry.info.map);
+			}
+		}
+		status = write_catalogue(catname, &list);
+		if(status != 0)
+		{
+			quickfits_error("ERROR : quickfits_catalogue_build --> Error writing catalogue %s, error = %d\n",catname,status);
+		}
+	}
+
+	if(have_old)
+	{
+		quickfits_catalogue_close(&old);
+	}
+	for(i=0;i<list.nfiles;i++)
+	{
+		free(list.files[i].path);
+		free(list.files[i].hdus);
+	}
+	free(list.files);
+	free(rescan);
+
+	return(status);
+}
+
+int quickfits_catalogue_open(const char* catname, fitscat* cat)
+{
+/*
+	Memory map a catalogue written by quickfits_catalogue_build
+ 
+	INPUTS:
+		const char* catname : name of the catalogue file
+	OUTPUTS:
+		cat : the open catalogue. Release with quickfits_catalogue_close.
+ 
+	RETURN:
+		0 on success.
+*/
+	int fd;
+	struct stat st;
+	const catalogue_header* header;
+
+	memset(cat,0,sizeof(fitscat));
+
+	fd = open(catname, O_RDONLY);
+	if(fd < 0)
+	{
+		quickfits_error("ERROR : quickfits_catalogue_open --> Error opening catalogue %s\n",catname);
+		return(FILE_NOT_OPENED);
+	}
+	if(fstat(fd,&st) != 0 || st.st_size < (off_t)(sizeof(catalogue_header)))
+	{
+		close(fd);
+		quickfits_error("ERROR : quickfits_catalogue_open --> %s is not a quickfits catalogue\n",catname);
+		return(READ_ERROR);
+	}
+
+	cat[0].size = st.st_size;
+	cat[0].base = mmap(NULL, cat[0].size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(cat[0].base == MAP_FAILED)
+	{
+		cat[0].base = NULL;
+		quickfits_error("ERROR : quickfits_catalogue_open --> Error mapping catalogue %s\n",catname);
+		return(READ_ERROR);
+	}
+
+	header = (const catalogue_header*)(cat[0].base);
+	if( memcmp(header[0].magic,CATALOGUE_MAGIC,8) || header[0].version != CATALOGUE_VERSION || header[0].entry_size != sizeof(fitscat_entry)
+		|| header[0].strings_offset + header[0].strings_size > (long long)(cat[0].size) )
+	{
+		quickfits_error("ERROR : quickfits_catalogue_open --> %s is not a compatible quickfits catalogue\n",catname);
+		quickfits_catalogue_close(cat);
+		return(READ_ERROR);
+	}
+
+	cat[0].nentries = header[0].nentries;
+	cat[0].entries = (const fitscat_entry*)((const char*)(cat[0].base) + header[0].entries_offset);
+	cat[0].hdus = (const fitshdu*)((const char*)(cat[0].base) + header[0].hdus_offset);
+	cat[0].dec_index = (const long long*)((const char*)(cat[0].base) + header[0].dec_index_offset);
+	cat[0].strings = (const char*)(cat[0].base) + header[0].strings_offset;
+
+	return(0);
+}
+
+int quickfits_catalogue_close(fitscat* cat)
+{
+	if(cat[0].base != NULL)
+	{
+		munmap(cat[0].base, cat[0].size);
+	}
+	memset(cat,0,sizeof(fitscat));
+	return(0);
+}
+
+const char* quickfits_catalogue_filename(fitscat cat, long long i)
+{
+	return( cat.strings + cat.entries[i].path_offset );
+}
+
+void quickfits_catalogue_query_init(fitscat_query* query)
+{
+	memset(query,0,sizeof(fitscat_query));	// zero type, radius and freq_max, and empty strings match everything
+}
+
+static bool entry_matches(const fitscat_entry* entry, const fitscat_query* query)
+{
+	const char* object;
+	const char* telescope;
+	const char* date_obs;
+	double ra, dec, freq, d2r, hav;
+
+	if(query[0].type != 0 && query[0].type != entry[0].type)
+	{
+		return(false);
+	}
+
+	if(entry[0].type == QUICKFITS_CAT_MAP)
+	{
+		object = entry[0].info.map.object;
+		telescope = entry[0].info.map.telescope;
+		date_obs = entry[0].info.map.date_obs;
+		ra = entry[0].info.map.ra;
+		dec = entry[0].info.map.dec;
+		freq = entry[0].info.map.freq;
+	}
+	else
+	{
+		object = entry[0].info.uv.object;
+		telescope = entry[0].info.uv.telescope;
+		date_obs = entry[0].info.uv.date_obs;
+		ra = entry[0].info.uv.ra;
+		dec = entry[0].info.uv.dec;
+		freq = entry[0].info.uv.freq;
+	}
+
+	if( (query[0].object[0] != '\0' && strcasecmp(object,query[0].object))
+		|| (query[0].telescope[0] != '\0' && strcasecmp(telescope,query[0].telescope)) )
+	{
+		return(false);
+	}
+
+	if( freq < query[0].freq_min || (query[0].freq_max > 0 && freq > query[0].freq_max) )
+	{
+		return(false);
+	}
+
+	if( (query[0].date_min[0] != '\0' && strcmp(date_obs,query[0].date_min) < 0)
+		|| (query[0].date_max[0] != '\0' && strcmp(date_obs,query[0].date_max) > 0) )
+	{
+		return(false);
+	}
+
+	if(query[0].radius > 0)	// haversine formula, stable for small separations
+	{
+		d2r = M_PI/180.0;
+		hav = pow(sin(0.5*d2r*(dec-query[0].dec)),2) + cos(d2r*dec)*cos(d2r*query[0].dec)*pow(sin(0.5*d2r*(ra-query[0].ra)),2);
+		if( 2.0*asin(sqrt(fmin(1.0,hav))) > d2r*query[0].radius )
+		{
+			return(false);
+		}
+	}
+
+	return(true);
+}
+
+long long quickfits_catalogue_query(fitscat cat, fitscat_query query, long long* matches, long long maxmatches)
+{
+/*
+	Find the catalogue entries matching all of the conditions in a query
+ 
+	INPUTS:
+		fitscat cat : open catalogue
+		fitscat_query query : conditions to match, set up with quickfits_catalogue_query_init
+		long long maxmatches : size of matches
+	OUTPUTS:
+		matches : indices of up to maxmatches matching entries. In catalogue (path) order,
+			or in order of declination for cone searches.
+ 
+	RETURN:
+		Total number of matching entries (which may be more than maxmatches).
+*/
+	long long i, lo, hi, mid, nmatches, k;
+	double dec_min, dec;
+
+	nmatches=0;
+
+	if(query.radius <= 0)
+	{
+		for(i=0;i<cat.nentries;i++)
+		{
+			if(entry_matches(&cat.entries[i],&query))
+			{
+				if(nmatches < maxmatches)
+				{
+					matches[nmatches] = i;
+				}
+				nmatches++;
+			}
+		}
+		return(nmatches);
+	}
+
+	// cone search : only look at entries inside the declination band
+
+	dec_min = query.dec - query.radius;
+	lo=0;
+	hi=cat.nentries;
+	while(lo<hi)
+	{
+		mid = (lo+hi)/2;
+		k = cat.dec_index[mid];
+		dec = (cat.entries[k].type == QUICKFITS_CAT_MAP) ? cat.entries[k].info.map.dec : cat.entries[k].info.uv.dec;
+		if(dec < dec_min)
+		{
+			lo = mid+1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	for(i=lo;i<cat.nentries;i++)
+	{
+		k = cat.dec_index[i];
+		dec = (cat.entries[k].type == QUICKFITS_CAT_MAP) ? cat.entries[k].info.map.dec : cat.entries[k].info.uv.dec;
+		if(dec > query.dec + query.radius)
+		{
+			break;
+		}
+		if(entry_matches(&cat.entries[k],&query))
+		{
+			if(nmatches < maxmatches)
+			{
+				matches[nmatches] = k;
+			}
+			nmatches++;
+		}
+	}
+	return(nmatches);
+}
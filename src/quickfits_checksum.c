@@ -0,0 +1,489 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define CHECKSUM_TASK_BLOCKS 256	// blocks summed per parallel task
+
+static bool write_checksums = false;
+
+typedef struct checksum_task_tag{	// a range of blocks of one HDU (header or data)
+	int hdu;
+	bool header;
+	long long offset;
+	long long nblocks;
+	unsigned long sum;
+	int status;
+}checksum_task;
+
+typedef struct checksum_job_tag{
+	int fd;
+	checksum_task* tasks;
+	const double* values;	// for quickfits_checksum_doubles
+	long long nvalues;
+}checksum_job;
+
+void quickfits_set_checksums(bool enable)
+{
+/*
+	Turn on (or off) writing DATASUM and CHECKSUM keywords. When on, quickfits_write_map, the map writer,
+	quickfits_map_stream, quickfits_write_map_preview and quickfits_overwrite_uv_data compute the data sums as the
+	data are written, so the files never have to be read back.
+*/
+	write_checksums = enable;
+}
+
+bool quickfits_checksums_enabled(void)
+{
+	return(write_checksums);
+}
+
+static unsigned long fold_sum(uint64_t hi, uint64_t lo)
+{
+	// end around carry, as in cfitsio's ffcsum
+
+	uint64_t hicarry, locarry;
+
+	hicarry = hi >> 16;
+	locarry = lo >> 16;
+	while(hicarry | locarry)
+	{
+		hi = (hi & 0xFFFF) + locarry;
+		lo = (lo & 0xFFFF) + hicarry;
+		hicarry = hi >> 16;
+		locarry = lo >> 16;
+	}
+	return((unsigned long)((hi << 16) + lo));
+}
+
+unsigned long quickfits_checksum_merge(unsigned long sum1, unsigned long sum2)
+{
+/*
+	Ones complement sum of two checksums, so parts of a data unit can be summed separately (even in parallel) and combined
+*/
+	return(fold_sum((uint64_t)(sum1 >> 16) + (sum2 >> 16), (uint64_t)(sum1 & 0xFFFF) + (sum2 & 0xFFFF)));
+}
+
+unsigned long quickfits_checksum_blocks(const unsigned char* data, long long nblocks, unsigned long sum)
+{
+/*
+	Add whole 2880 byte blocks (big endian, as in the file) to a 32 bit ones complement FITS checksum.
+	Gives the same result as cfitsio's ffcsum. The inner loop has no carries to propagate, so it vectorises.
+ 
+	INPUTS:
+		data : nblocks*QUICKFITS_BLOCK_SIZE bytes
+		sum : checksum so far (0 to start)
+	RETURN:
+		updated checksum
+*/
+	const unsigned char* block;
+	uint64_t hi, lo;
+	long long j;
+	int i;
+
+	hi = (sum >> 16);
+	lo = (sum & 0xFFFF);
+	for(j=0;j<nblocks;j++)
+	{
+		block = &data[j*QUICKFITS_BLOCK_SIZE];
+		for(i=0;i<QUICKFITS_BLOCK_SIZE;i+=4)
+		{
+			hi += ((uint32_t)(block[i]) << 8) | block[i+1];
+			lo += ((uint32_t)(block[i+2]) << 8) | block[i+3];
+		}
+		sum = fold_sum(hi, lo);
+		hi = (sum >> 16);
+		lo = (sum & 0xFFFF);
+	}
+	return(sum);
+}
+
+void quickfits_checksum_init(quickfits_checksum* ck)
+{
+/*
+	Start a checksum of a data unit that is produced a piece at a time
+*/
+	ck[0].sum = 0;
+	ck[0].fill = 0;
+}
+
+void quickfits_checksum_add(quickfits_checksum* ck, const void* bytes, long long nbytes)
+{
+/*
+	Add bytes (big endian, as they will be in the file) to a running checksum
+*/
+	const unsigned char* data = (const unsigned char*)(bytes);
+	long long nblocks, n;
+
+	if(ck[0].fill > 0)	// top up the partial block first
+	{
+		n = QUICKFITS_BLOCK_SIZE - ck[0].fill;
+		n = (nbytes < n) ? nbytes : n;
+		memcpy(&ck[0].block[ck[0].fill], data, n);
+		ck[0].fill += n;
+		data += n;
+		nbytes -= n;
+		if(ck[0].fill == QUICKFITS_BLOCK_SIZE)
+		{
+			ck[0].sum = quickfits_checksum_blocks(ck[0].block, 1, ck[0].sum);
+			ck[0].fill = 0;
+		}
+	}
+
+	nblocks = nbytes/QUICKFITS_BLOCK_SIZE;
+	ck[0].sum = quickfits_checksum_blocks(data, nblocks, ck[0].sum);
+	data += nblocks*QUICKFITS_BLOCK_SIZE;
+	nbytes -= nblocks*QUICKFITS_BLOCK_SIZE;
+
+	if(nbytes > 0)
+	{
+		memcpy(ck[0].block, data, nbytes);
+		ck[0].fill = nbytes;
+	}
+}
+
+static void to_big_endian(const double* values, long long n, unsigned char* bytes)
+{
+	uint64_t word;
+	long long i;
+
+	for(i=0;i<n;i++)
+	{
+		memcpy(&word, &values[i], 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		word = __builtin_bswap64(word);
+#endif
+		memcpy(&bytes[8*i], &word, 8);
+	}
+}
+
+void quickfits_checksum_add_doubles(quickfits_checksum* ck, const double* values, long long n)
+{
+/*
+	Add values to a running checksum as they are stored in a BITPIX = -64 image or a D column
+*/
+	unsigned char bytes[QUICKFITS_BLOCK_SIZE];
+	long long i, nchunk;
+
+	for(i=0;i<n;i+=nchunk)
+	{
+		nchunk = (n-i < QUICKFITS_BLOCK_SIZE/8) ? n-i : QUICKFITS_BLOCK_SIZE/8;
+		to_big_endian(&values[i], nchunk, bytes);
+		quickfits_checksum_add(ck, bytes, 8*nchunk);
+	}
+}
+
+unsigned long quickfits_checksum_finish(quickfits_checksum* ck)
+{
+/*
+	Finish a running checksum, padding the last block with zeros as in the file
+ 
+	RETURN:
+		the data sum, for DATASUM
+*/
+	if(ck[0].fill > 0)
+	{
+		memset(&ck[0].block[ck[0].fill], 0, QUICKFITS_BLOCK_SIZE - ck[0].fill);
+		ck[0].sum = quickfits_checksum_blocks(ck[0].block, 1, ck[0].sum);
+		ck[0].fill = 0;
+	}
+	return(ck[0].sum);
+}
+
+static void sum_doubles(long long task, void* arg)
+{
+	checksum_job* job = (checksum_job*)(arg);
+	quickfits_checksum ck;
+	long long first, n;
+
+	first = task*CHECKSUM_TASK_BLOCKS*(QUICKFITS_BLOCK_SIZE/8);	// tasks start on block boundaries
+	n = CHECKSUM_TASK_BLOCKS*(QUICKFITS_BLOCK_SIZE/8);
+	if(n > job[0].nvalues - first)
+	{
+		n = job[0].nvalues - first;
+	}
+
+	quickfits_checksum_init(&ck);
+	quickfits_checksum_add_doubles(&ck, &job[0].values[first], n);
+	job[0].tasks[task].sum = quickfits_checksum_finish(&ck);
+}
+
+unsigned long quickfits_checksum_doubles(const double* values, long long n, int nthreads)
+{
+/*
+	Data sum of a BITPIX = -64 image holding n values, computed in parallel from the array in memory
+*/
+	checksum_job job;
+	unsigned long sum;
+	long long ntasks, i;
+	quickfits_checksum ck;
+
+	ntasks = (n + CHECKSUM_TASK_BLOCKS*(QUICKFITS_BLOCK_SIZE/8) - 1)/(CHECKSUM_TASK_BLOCKS*(QUICKFITS_BLOCK_SIZE/8));
+	job.tasks = malloc(ntasks*sizeof(checksum_task));
+	if(job.tasks == NULL)	// just do it here
+	{
+		quickfits_checksum_init(&ck);
+		quickfits_checksum_add_doubles(&ck, values, n);
+		return(quickfits_checksum_finish(&ck));
+	}
+	job.values = values;
+	job.nvalues = n;
+
+	quickfits_parallel_for(ntasks, nthreads, sum_doubles, &job);
+
+	sum = 0;
+	for(i=0;i<ntasks;i++)
+	{
+		sum = quickfits_checksum_merge(sum, job.tasks[i].sum);
+	}
+	free(job.tasks);
+
+	return(sum);
+}
+
+int quickfits_write_datasum(fitsfile* fptr, unsigned long datasum, int* status)
+{
+/*
+	Write the DATASUM keyword of the current HDU from a data sum computed while writing it, then
+	CHECKSUM (cfitsio only needs to sum the header). Call after the last change to the HDU.
+	The comments are the ones fits_write_chksum writes.
+*/
+	char value[FLEN_VALUE];
+	char date[FLEN_VALUE];
+	char comment[FLEN_COMMENT];
+	int timeref;
+
+	sprintf(value,"%lu",datasum);
+	fits_get_system_time(date, &timeref, status);
+	snprintf(comment, sizeof(comment), "data unit checksum updated %s", date);
+	fits_update_key(fptr, TSTRING, "DATASUM", value, comment, status);
+	fits_update_chksum(fptr, status);
+
+	return(*status);
+}
+
+static void sum_task(long long task, void* arg)
+{
+	checksum_job* job = (checksum_job*)(arg);
+	checksum_task* t = &job[0].tasks[task];
+	unsigned char* buff;
+	long long nbytes, done;
+	ssize_t nread;
+
+	nbytes = t[0].nblocks*QUICKFITS_BLOCK_SIZE;
+	buff = malloc(nbytes);
+	if(buff == NULL)
+	{
+		t[0].status = MEMORY_ALLOCATION;
+		return;
+	}
+
+	done = 0;
+	while(done < nbytes)
+	{
+		nread = pread(job[0].fd, buff+done, nbytes-done, t[0].offset+done);
+		if(nread <= 0)
+		{
+			break;
+		}
+		done += nread;
+	}
+	if(done < nbytes)	// a short last block (which is invalid FITS) is zero padded
+	{
+		memset(buff+done, 0, nbytes-done);
+	}
+
+	t[0].sum = quickfits_checksum_blocks(buff, t[0].nblocks, 0);
+	t[0].status = 0;
+	free(buff);
+}
+
+static void verify_result(int* dataok, int* hduok, const char* checksum, const char* datasum, unsigned long datasum_found, unsigned long hdusum)
+{
+	// combine the result for one HDU with the others, as fits_verify_chksum reports them: 1 good, 0 no keyword, -1 bad
+
+	unsigned long stored;
+
+	if(datasum[0] == '\0')
+	{
+		*dataok = (*dataok < 0) ? *dataok : 0;
+	}
+	else
+	{
+		stored = strtoul(datasum, NULL, 10);
+		if(stored != datasum_found && !((stored == 0 || stored == 0xFFFFFFFF) && (datasum_found == 0 || datasum_found == 0xFFFFFFFF)))
+		{
+			*dataok = -1;
+		}
+	}
+
+	if(checksum[0] == '\0')
+	{
+		*hduok = (*hduok < 0) ? *hduok : 0;
+	}
+	else if(hdusum != 0 && hdusum != 0xFFFFFFFF)
+	{
+		*hduok = -1;
+	}
+}
+
+int quickfits_verify_checksums(const char* filename, int nthreads, int* dataok, int* hduok)
+{
+/*
+	Check the DATASUM and CHECKSUM keywords of every HDU in a file. The blocks of the file are read with pread and
+	summed in parallel. Files that aren't plain FITS on disk (memory files, compressed files) are checked by cfitsio.
+ 
+	INPUTS:
+		const char* filename : file to check
+		int nthreads : number of threads to use (0 to use one per processor)
+	OUTPUTS:
+		dataok : 1 if every DATASUM is correct, 0 if some HDU has no DATASUM (and none are wrong), -1 if any is wrong
+		hduok : the same for CHECKSUM
+ 
+	RETURN:
+		0 if the file could be checked
+*/
+	fitshdu_dir dir;
+	fitshdu hdu;
+	checksum_job job;
+	fitsfile* fptr;
+	char** checksums;
+	char** datasums;
+	char* cards;
+	unsigned long* datasum_found;
+	unsigned long* hdusum;
+	long long ntasks, nblocks, i, j;
+	int status, tstatus, ncards, nhdu, data_status, hdu_status;
+
+	*dataok = 1;
+	*hduok = 1;
+	status = 0;
+
+	if(quickfits_get_hdu_dir(filename, &dir) != 0)	// let cfitsio do it
+	{
+		if(quickfits_open_file(&fptr, filename, READONLY, &status))
+		{
+			return(status);
+		}
+		fits_get_num_hdus(fptr, &nhdu, &status);
+		for(i=1;i<=nhdu && status==0;i++)
+		{
+			fits_movabs_hdu(fptr, i, NULL, &status);
+			fits_verify_chksum(fptr, &data_status, &hdu_status, &status);
+			*dataok = (data_status < *dataok) ? data_status : *dataok;
+			*hduok = (hdu_status < *hduok) ? hdu_status : *hduok;
+		}
+		quickfits_close_file(fptr, &status);
+		return(status);
+	}
+
+	job.fd = open(filename, O_RDONLY);
+	if(job.fd < 0)
+	{
+		quickfits_free_hdu_dir(&dir);
+		return(FILE_NOT_OPENED);
+	}
+
+	ntasks = 0;	// one task per header, and the data in groups of blocks
+	for(i=0;i<dir.nhdu;i++)
+	{
+		nblocks = (dir.hdus[i].data_size + QUICKFITS_BLOCK_SIZE - 1)/QUICKFITS_BLOCK_SIZE;
+		ntasks += 1 + (nblocks + CHECKSUM_TASK_BLOCKS - 1)/CHECKSUM_TASK_BLOCKS;
+	}
+	job.tasks = malloc(ntasks*sizeof(checksum_task));
+	checksums = calloc(dir.nhdu, sizeof(char*));
+	datasums = calloc(dir.nhdu, sizeof(char*));
+	datasum_found = calloc(dir.nhdu, sizeof(unsigned long));
+	hdusum = calloc(dir.nhdu, sizeof(unsigned long));
+	if(job.tasks == NULL || checksums == NULL || datasums == NULL || datasum_found == NULL || hdusum == NULL)
+	{
+		status = MEMORY_ALLOCATION;
+	}
+
+	ntasks = 0;
+	for(i=0;i<dir.nhdu && status==0;i++)
+	{
+		checksums[i] = calloc(2, FLEN_VALUE);
+		if(checksums[i] == NULL)
+		{
+			status = MEMORY_ALLOCATION;
+			break;
+		}
+		datasums[i] = checksums[i] + FLEN_VALUE;
+		if(quickfits_scan_hdu(job.fd, dir.hdus[i].header_offset, &hdu, &cards, &ncards) == 0)
+		{
+			tstatus = 0;
+			quickfits_read_card(cards, ncards, "CHECKSUM", TSTRING, checksums[i], &tstatus);
+			tstatus = 0;
+			quickfits_read_card(cards, ncards, "DATASUM", TSTRING, datasums[i], &tstatus);
+			free(cards);
+		}
+
+		job.tasks[ntasks].hdu = i;
+		job.tasks[ntasks].header = true;
+		job.tasks[ntasks].offset = dir.hdus[i].header_offset;
+		job.tasks[ntasks].nblocks = (dir.hdus[i].data_offset - dir.hdus[i].header_offset)/QUICKFITS_BLOCK_SIZE;
+		ntasks++;
+
+		nblocks = (dir.hdus[i].data_size + QUICKFITS_BLOCK_SIZE - 1)/QUICKFITS_BLOCK_SIZE;
+		for(j=0;j<nblocks;j+=CHECKSUM_TASK_BLOCKS)
+		{
+			job.tasks[ntasks].hdu = i;
+			job.tasks[ntasks].header = false;
+			job.tasks[ntasks].offset = dir.hdus[i].data_offset + j*QUICKFITS_BLOCK_SIZE;
+			job.tasks[ntasks].nblocks = (nblocks-j < CHECKSUM_TASK_BLOCKS) ? nblocks-j : CHECKSUM_TASK_BLOCKS;
+			ntasks++;
+		}
+	}
+
+	if(status == 0)
+	{
+		quickfits_parallel_for(ntasks, nthreads, sum_task, &job);
+
+		for(i=0;i<ntasks;i++)
+		{
+			if(job.tasks[i].status != 0)
+			{
+				status = job.tasks[i].status;
+			}
+			if(!job.tasks[i].header)
+			{
+				datasum_found[job.tasks[i].hdu] = quickfits_checksum_merge(datasum_found[job.tasks[i].hdu], job.tasks[i].sum);
+			}
+			hdusum[job.tasks[i].hdu] = quickfits_checksum_merge(hdusum[job.tasks[i].hdu], job.tasks[i].sum);
+		}
+		for(i=0;i<dir.nhdu;i++)
+		{
+			verify_result(dataok, hduok, checksums[i], datasums[i], datasum_found[i], hdusum[i]);
+		}
+	}
+
+	close(job.fd);
+	for(i=0;i<dir.nhdu && checksums!=NULL;i++)
+	{
+		free(checksums[i]);
+	}
+	free(checksums);
+	free(datasums);
+	free(datasum_found);
+	free(hdusum);
+	free(job.tasks);
+	quickfits_free_hdu_dir(&dir);
+
+	return(status);
+}
@@ -0,0 +1,221 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdint.h>
+
+/*
+	Decoding of big endian binary table columns read straight from a file, giving the same values as fits_read_col
+	with TDOUBLE output and no null checking: value*TSCAL + TZERO, with NaNs in floating point columns passed through.
+*/
+
+static double get_e(const unsigned char* p)
+{
+	uint32_t u;
+	float f;
+
+	memcpy(&u, p, 4);
+	u = __builtin_bswap32(u);
+	memcpy(&f, &u, 4);
+	return((double)(f));
+}
+
+static double get_d(const unsigned char* p)
+{
+	uint64_t u;
+	double d;
+
+	memcpy(&u, p, 8);
+	u = __builtin_bswap64(u);
+	memcpy(&d, &u, 8);
+	return(d);
+}
+
+static double get_i(const unsigned char* p)
+{
+	return((double)((int16_t)((p[0] << 8) | p[1])));
+}
+
+static double get_j(const unsigned char* p)
+{
+	uint32_t u;
+
+	memcpy(&u, p, 4);
+	return((double)((int32_t)(__builtin_bswap32(u))));
+}
+
+static double get_k(const unsigned char* p)
+{
+	uint64_t u;
+
+	memcpy(&u, p, 8);
+	return((double)((int64_t)(__builtin_bswap64(u))));
+}
+
+static double get_b(const unsigned char* p)
+{
+	return((double)(p[0]));
+}
+
+int quickfits_tform_width(char tform_code)
+{
+/*
+	Bytes per element of a binary table column that quickfits_decode_column can decode, 0 for any other type
+*/
+	switch(tform_code)
+	{
+		case 'B': return(1);
+		case 'I': return(2);
+		case 'J': case 'E': return(4);
+		case 'K': case 'D': return(8);
+		default: return(0);
+	}
+}
+
+static void put_e(double value, unsigned char* p)
+{
+	uint32_t u;
+	float f;
+
+	f = (float)(value);	// as fits_write_col for an unscaled E column
+	memcpy(&u, &f, 4);
+	u = __builtin_bswap32(u);
+	memcpy(p, &u, 4);
+}
+
+static void put_d(double value, unsigned char* p)
+{
+	uint64_t u;
+
+	memcpy(&u, &value, 8);
+	u = __builtin_bswap64(u);
+	memcpy(p, &u, 8);
+}
+
+int quickfits_encode_column(unsigned char* rows, long long nrows, long long row_bytes, long long byte_offset, char tform_code, long long repeat, const double* values)
+{
+/*
+	The reverse of quickfits_decode_column for unscaled floating point columns : put doubles into one column of
+	a block of rows as fits_write_col would write them, leaving the other columns alone
+ 
+	INPUTS:
+		long long byte_offset, char tform_code, long long repeat : column position, type and length, as from quickfits_scan_col
+		const double* values : nrows*repeat values, row by row
+	OUTPUTS:
+		rows : nrows rows of row_bytes bytes (NAXIS1)
+ 
+	RETURN:
+		0 on success, BAD_TFORM for types other than E and D
+*/
+	unsigned char* p;
+	const double* in;
+	long long row, k;
+
+	if(tform_code != 'E' && tform_code != 'D')
+	{
+		return(BAD_TFORM);
+	}
+
+	for(row=0;row<nrows;row++)
+	{
+		p = &rows[row*row_bytes + byte_offset];
+		in = &values[row*repeat];
+		if(tform_code == 'E')
+		{
+			for(k=0;k<repeat;k++)
+			{
+				put_e(in[k], &p[4*k]);
+			}
+		}
+		else
+		{
+			for(k=0;k<repeat;k++)
+			{
+				put_d(in[k], &p[8*k]);
+			}
+		}
+	}
+
+	return(0);
+}
+
+int quickfits_decode_column(const unsigned char* rows, long long nrows, long long row_bytes, long long byte_offset, char tform_code, long long repeat, double scale, double zero, double* values)
+{
+/*
+	Convert one column of a block of binary table rows, as they are in the file, to doubles
+ 
+	INPUTS:
+		const unsigned char* rows : nrows rows of row_bytes bytes (NAXIS1)
+		long long byte_offset, char tform_code, long long repeat : column position, type and length, as from quickfits_scan_col
+		double scale, zero : TSCALn and TZEROn (1 and 0 if not given)
+	OUTPUTS:
+		values : nrows*repeat values, row by row
+ 
+	RETURN:
+		0 on success, BAD_TFORM for types other than B, I, J, K, E and D
+*/
+	double (*get)(const unsigned char* p);
+	const unsigned char* p;
+	double* out;
+	long long row, k;
+	int width;
+
+	switch(tform_code)
+	{
+		case 'B': get = get_b; break;
+		case 'I': get = get_i; break;
+		case 'J': get = get_j; break;
+		case 'K': get = get_k; break;
+		case 'E': get = get_e; break;
+		case 'D': get = get_d; break;
+		default: return(BAD_TFORM);
+	}
+	width = quickfits_tform_width(tform_code);
+
+	for(row=0;row<nrows;row++)	// the type is fixed for the whole loop, so the compiler can hoist the call out of it in each case
+	{
+		p = &rows[row*row_bytes + byte_offset];
+		out = &values[row*repeat];
+		if(tform_code == 'E')
+		{
+			for(k=0;k<repeat;k++)
+			{
+				out[k] = get_e(&p[4*k]);
+			}
+		}
+		else if(tform_code == 'D')
+		{
+			for(k=0;k<repeat;k++)
+			{
+				out[k] = get_d(&p[8*k]);
+			}
+		}
+		else
+		{
+			for(k=0;k<repeat;k++)
+			{
+				out[k] = get(&p[width*k]);
+			}
+		}
+
+		if(scale != 1.0 || zero != 0.0)	// as cfitsio, which only scales when it has to
+		{
+			for(k=0;k<repeat;k++)
+			{
+				out[k] = out[k]*scale + zero;
+			}
+		}
+	}
+
+	return(0);
+}
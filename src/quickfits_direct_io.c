@@ -0,0 +1,336 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define _GNU_SOURCE	// for O_DIRECT
+#include "quickfits.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DIRECT_ALIGN 4096	// offsets, sizes and buffer addresses for O_DIRECT are multiples of this
+#define DIRECT_DEFAULT_BLOCK (8<<20)
+
+typedef struct block_buffer_tag{
+	unsigned char* base;	// headroom (for a record split across blocks) followed by the block
+	unsigned char* data;
+	long long nread;
+	int status;
+	bool filled;
+}block_buffer;
+
+typedef struct block_stream_tag{
+	int fd;
+	long long position;	// next file offset to read
+	long long end;
+	long long block;
+	block_buffer buffers[2];
+	bool stop;
+	bool finished;	// the reader thread has read the whole range (or been stopped) and won't fill another buffer
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+}block_stream;
+
+static bool direct_io = false;
+static long long direct_block = DIRECT_DEFAULT_BLOCK;
+static bool direct_odirect = false;
+
+void quickfits_set_direct_io(bool enable, long long block_size, bool use_o_direct)
+{
+/*
+	Read the data units of uncompressed files on disk in large blocks, double buffered and handed straight to the decode
+	kernels, instead of through cfitsio's buffers (headers are still read with cfitsio). Used by quickfits_read_map,
+	quickfits_read_uv_data and quickfits_read_uv_data_parallel when on.
+ 
+	INPUTS:
+		bool enable : true to use large block reads
+		long long block_size : bytes per read (0 for the default, 8 MB). Rounded up to a multiple of 4096.
+		bool use_o_direct : bypass the page cache with O_DIRECT where the file system allows it
+*/
+	if(block_size <= 0)
+	{
+		block_size = DIRECT_DEFAULT_BLOCK;
+	}
+	__atomic_store_n(&direct_block, ((block_size + DIRECT_ALIGN - 1)/DIRECT_ALIGN)*DIRECT_ALIGN, __ATOMIC_RELAXED);
+	__atomic_store_n(&direct_odirect, use_o_direct, __ATOMIC_RELAXED);
+	__atomic_store_n(&direct_io, enable, __ATOMIC_RELAXED);
+}
+
+bool quickfits_direct_io_enabled(void)
+{
+	return(__atomic_load_n(&direct_io, __ATOMIC_RELAXED));
+}
+
+bool quickfits_direct_io_file(const char* filename)
+{
+/*
+	True if large block reads are on and filename is an uncompressed file on disk that can be read directly
+*/
+	struct stat st;
+	size_t len;
+
+	if(!quickfits_direct_io_enabled() || quickfits_memfile_lookup(filename) != NULL)
+	{
+		return(false);
+	}
+	len = strlen(filename);
+	if(len > 3 && !strcmp(filename+len-3,".gz"))
+	{
+		return(false);
+	}
+	return(stat(filename, &st) == 0 && S_ISREG(st.st_mode));
+}
+
+static void fill_block(block_stream* stream, block_buffer* buffer)
+{
+	// read the next block of the range (short at the end of the file)
+
+	long long n, done, want;
+
+	want = stream[0].end - stream[0].position;
+	if(want > stream[0].block)
+	{
+		want = stream[0].block;
+	}
+	want = ((want + DIRECT_ALIGN - 1)/DIRECT_ALIGN)*DIRECT_ALIGN;	// O_DIRECT reads whole aligned blocks
+
+	buffer[0].status = 0;
+	for(done=0;done<want;done+=n)
+	{
+		n = pread(stream[0].fd, buffer[0].data+done, want-done, stream[0].position+done);
+		if(n < 0 && errno == EINTR)
+		{
+			n = 0;
+			continue;
+		}
+		if(n < 0)
+		{
+			buffer[0].status = READ_ERROR;
+			break;
+		}
+		if(n == 0)	// end of file
+		{
+			break;
+		}
+	}
+	buffer[0].nread = done;
+	stream[0].position += want;
+}
+
+static void* reader_thread(void* arg)
+{
+	// keep the buffer the consumer isn't using full
+
+	block_stream* stream = (block_stream*)(arg);
+	block_buffer* buffer;
+	int k;
+
+	for(k=0;;k++)
+	{
+		buffer = &stream[0].buffers[k%2];
+		pthread_mutex_lock(&stream[0].lock);
+		while(buffer[0].filled && !stream[0].stop)
+		{
+			pthread_cond_wait(&stream[0].changed, &stream[0].lock);
+		}
+		if(stream[0].stop || stream[0].position >= stream[0].end)
+		{
+			stream[0].finished = true;
+			pthread_cond_broadcast(&stream[0].changed);
+			pthread_mutex_unlock(&stream[0].lock);
+			break;
+		}
+		pthread_mutex_unlock(&stream[0].lock);
+
+		fill_block(stream, buffer);
+
+		pthread_mutex_lock(&stream[0].lock);
+		buffer[0].filled = true;
+		pthread_cond_broadcast(&stream[0].changed);
+		pthread_mutex_unlock(&stream[0].lock);
+	}
+	return(NULL);
+}
+
+int quickfits_read_records(const char* filename, long long offset, long long nrecords, long long record_bytes, quickfits_record_consumer consume, void* arg)
+{
+/*
+	Stream fixed size records (table rows, pixels) from a byte range of a file in large blocks, as set by
+	quickfits_set_direct_io. One block is read on a second thread while the records of the last are consumed.
+ 
+	INPUTS:
+		const char* filename : uncompressed file on disk
+		long long offset : file offset of the first record
+		long long nrecords, record_bytes : number and size of the records
+		consume : called in order with each run of whole records, as they are in the file. A record split across two
+			blocks is put back together first. A non-zero return stops the read and is returned.
+		arg : passed through to consume
+ 
+	RETURN:
+		0 on success
+*/
+	block_stream stream;
+	block_buffer* buffer;
+	block_buffer* next;
+	pthread_t thread;
+	unsigned char* records;
+	long long start, skip, headroom, avail, nfull, carry, done;
+	int k, status, flags;
+	bool threaded;
+
+	if(nrecords <= 0)
+	{
+		return(0);
+	}
+
+	flags = O_RDONLY;
+	if(__atomic_load_n(&direct_odirect, __ATOMIC_RELAXED))
+	{
+		flags |= O_DIRECT;
+	}
+	stream.fd = open(filename, flags);
+	if(stream.fd < 0 && (flags & O_DIRECT))	// file system without O_DIRECT
+	{
+		stream.fd = open(filename, O_RDONLY);
+	}
+	if(stream.fd < 0)
+	{
+		quickfits_error("ERROR : quickfits_read_records --> Error opening %s\n",filename);
+		return(FILE_NOT_OPENED);
+	}
+
+	start = (offset/DIRECT_ALIGN)*DIRECT_ALIGN;
+	skip = offset - start;
+	stream.position = start;
+	stream.end = offset + nrecords*record_bytes;
+	stream.block = __atomic_load_n(&direct_block, __ATOMIC_RELAXED);
+	if(stream.block < record_bytes)
+	{
+		stream.block = ((record_bytes + DIRECT_ALIGN - 1)/DIRECT_ALIGN)*DIRECT_ALIGN;
+	}
+	headroom = ((record_bytes + DIRECT_ALIGN - 1)/DIRECT_ALIGN)*DIRECT_ALIGN;
+	stream.stop = false;
+	stream.finished = false;
+	posix_fadvise(stream.fd, start, stream.end - start, POSIX_FADV_SEQUENTIAL);
+
+	status = 0;
+	for(k=0;k<2;k++)
+	{
+		stream.buffers[k].filled = false;
+		stream.buffers[k].base = NULL;
+		if(posix_memalign((void**)&stream.buffers[k].base, DIRECT_ALIGN, headroom + stream.block))
+		{
+			stream.buffers[k].base = NULL;
+			status = MEMORY_ALLOCATION;
+		}
+		stream.buffers[k].data = stream.buffers[k].base + headroom;
+	}
+	if(status != 0)
+	{
+		free(stream.buffers[0].base);
+		free(stream.buffers[1].base);
+		close(stream.fd);
+		return(status);
+	}
+
+	pthread_mutex_init(&stream.lock, NULL);
+	pthread_cond_init(&stream.changed, NULL);
+	threaded = (pthread_create(&thread, NULL, reader_thread, &stream) == 0);	// otherwise read each block here as it's needed
+
+	carry = 0;
+	done = 0;
+	for(k=0;done<nrecords && status==0;k++)
+	{
+		buffer = &stream.buffers[k%2];
+		next = &stream.buffers[(k+1)%2];
+		if(threaded)
+		{
+			pthread_mutex_lock(&stream.lock);
+			while(!buffer[0].filled && !stream.finished)
+			{
+				pthread_cond_wait(&stream.changed, &stream.lock);
+			}
+			if(!buffer[0].filled)	// the file ended inside the range, in the last block read
+			{
+				buffer[0].nread = 0;
+				buffer[0].status = 0;
+			}
+			pthread_mutex_unlock(&stream.lock);
+		}
+		else
+		{
+			fill_block(&stream, buffer);
+		}
+
+		status = buffer[0].status;
+		avail = buffer[0].nread;
+		records = buffer[0].data;
+		if(k == 0)
+		{
+			records += skip;
+			avail -= skip;
+		}
+		records -= carry;	// the start of a split record was copied in front of the block
+		avail += carry;
+		if(status == 0 && avail < record_bytes)
+		{
+			status = READ_ERROR;	// the file ends early
+		}
+
+		nfull = avail/record_bytes;
+		if(nfull > nrecords - done)
+		{
+			nfull = nrecords - done;
+		}
+		if(status == 0)
+		{
+			status = consume(records, nfull, done, arg);
+		}
+		done += nfull;
+		carry = avail - nfull*record_bytes;
+		if(done == nrecords)
+		{
+			carry = 0;
+		}
+		if(carry > 0)	// only the headroom of the other buffer is touched, which the reader never writes
+		{
+			memcpy(next[0].data - carry, records + nfull*record_bytes, carry);
+		}
+
+		if(threaded)
+		{
+			pthread_mutex_lock(&stream.lock);
+			buffer[0].filled = false;
+			pthread_cond_broadcast(&stream.changed);
+			pthread_mutex_unlock(&stream.lock);
+		}
+	}
+
+	if(threaded)
+	{
+		pthread_mutex_lock(&stream.lock);
+		stream.stop = true;
+		pthread_cond_broadcast(&stream.changed);
+		pthread_mutex_unlock(&stream.lock);
+		pthread_join(thread, NULL);
+	}
+	pthread_mutex_destroy(&stream.lock);
+	pthread_cond_destroy(&stream.changed);
+	free(stream.buffers[0].base);
+	free(stream.buffers[1].base);
+	close(stream.fd);
+
+	return(status);
+}
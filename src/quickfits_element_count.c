@@ -0,0 +1,48 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+
+int quickfits_element_count(int ndims, const long long* dims, long long* nelements)
+{
+/*
+	Multiply array dimensions together, checking for overflow
+ 
+	INPUTS:
+		int ndims : number of dimensions
+		const long long* dims : ndims dimensions (e.g. nvis, 12, nif, nchan)
+	OUTPUTS:
+		nelements : product of the dimensions (unchanged on error)
+ 
+	RETURN:
+		0 on success, BAD_DIMEN for a negative dimension, NUM_OVERFLOW if the product doesn't fit in a long long.
+*/
+	long long count;
+	int i;
+
+	count = 1;
+	for(i=0;i<ndims;i++)
+	{
+		if(dims[i] < 0)
+		{
+			return(BAD_DIMEN);
+		}
+		if(__builtin_mul_overflow(count, dims[i], &count))
+		{
+			return(NUM_OVERFLOW);
+		}
+	}
+
+	*nelements = count;
+	return(0);
+}
@@ -0,0 +1,913 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define _GNU_SOURCE	// for memfd_create
+#include "quickfits.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#define GZ_CHUNK (1<<20)	// compressed bytes read at a time when inflating a single stream
+#define GZ_BUFFER (4<<20)	// size of each output buffer in the single stream pipeline
+#define GZ_NBUFFERS 4	// output buffers in flight (bounds the memory used whatever the file size)
+#define GZ_MEMBERS_PER_TASK 64	// BGZF members (at most 64 kB each) inflated per parallel task
+#define GZ_HEADER_CHUNK (1<<16)	// compressed bytes read at a time when only the headers are wanted
+
+typedef struct gz_member_tag{	// one member of a block-compressed (BGZF) file
+	long long in_offset;
+	long long out_offset;
+	unsigned int in_size;
+	unsigned int out_size;
+}gz_member;
+
+typedef struct gz_members_tag{
+	int in_fd;
+	int out_fd;
+	unsigned char* out_buffer;	// inflate into memory instead of out_fd if not NULL
+	long long nmembers;
+	gz_member* members;
+	int status;	// first error seen by any thread
+	pthread_mutex_t lock;
+}gz_members;
+
+typedef struct gz_pipe_tag{	// output side of the single stream pipeline
+	int fd;
+	char* buffers[GZ_NBUFFERS];
+	size_t fill[GZ_NBUFFERS];
+	int head;	// buffer being filled by the inflater
+	int tail;	// next buffer to be written
+	int count;	// buffers waiting to be written
+	bool done;
+	int status;
+	long long offset;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+}gz_pipe;
+
+static int read_full(int fd, void* buff, size_t nbytes, long long offset)
+{
+	size_t done;
+	ssize_t nread;
+
+	done = 0;
+	while(done < nbytes)
+	{
+		nread = pread(fd, (char*) buff + done, nbytes - done, offset + done);
+		if(nread < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(nread <= 0)
+		{
+			return(READ_ERROR);
+		}
+		done += nread;
+	}
+	return(0);
+}
+
+static int write_full(int fd, const void* buff, size_t nbytes, long long offset)
+{
+	size_t done;
+	ssize_t nwritten;
+
+	done = 0;
+	while(done < nbytes)
+	{
+		nwritten = pwrite(fd, (const char*) buff + done, nbytes - done, offset + done);
+		if(nwritten < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(nwritten <= 0)
+		{
+			return(WRITE_ERROR);
+		}
+		done += nwritten;
+	}
+	return(0);
+}
+
+static long long index_bgzf(int fd, long long file_size, gz_member** members)
+{
+	// List the members of a BGZF file, whose headers give the compressed size of each member and whose
+	// trailers give the uncompressed size, so the members can be inflated independently.
+	// Returns the number of members, or -1 if the file is not BGZF.
+
+	unsigned char head[18];
+	unsigned char isize[4];
+	gz_member* list;
+	gz_member* bigger;
+	long long n, nalloc, offset, out_offset;
+	unsigned int bsize;
+
+	n = 0;
+	nalloc = 1024;
+	list = malloc(nalloc*sizeof(gz_member));
+	offset = 0;
+	out_offset = 0;
+
+	while(list != NULL && offset < file_size)
+	{
+		// 1f 8b 08, FEXTRA set, XLEN = 6 with a single "BC" subfield of length 2 holding BSIZE = member size - 1
+		if( offset + 18 > file_size || read_full(fd, head, 18, offset) != 0 || head[0] != 0x1f || head[1] != 0x8b || head[2] != 8
+			|| !(head[3] & 4) || head[10] != 6 || head[11] != 0 || head[12] != 'B' || head[13] != 'C' || head[14] != 2 || head[15] != 0 )
+		{
+			break;
+		}
+		bsize = head[16] + (head[17] << 8) + 1;
+		if( bsize < 26 || offset + bsize > file_size || read_full(fd, isize, 4, offset + bsize - 4) != 0 )
+		{
+			break;
+		}
+
+		if(n == nalloc)
+		{
+			nalloc *= 2;
+			bigger = realloc(list, nalloc*sizeof(gz_member));
+			if(bigger == NULL)
+			{
+				break;
+			}
+			list = bigger;
+		}
+		list[n].in_offset = offset;
+		list[n].in_size = bsize;
+		list[n].out_offset = out_offset;
+		list[n].out_size = isize[0] + (isize[1] << 8) + (isize[2] << 16) + ((unsigned int) isize[3] << 24);
+		if(list[n].out_size > 65536)	// BGZF members never hold more than 64 kB
+		{
+			break;
+		}
+		out_offset += list[n].out_size;
+		offset += bsize;
+		n++;
+	}
+
+	if(list == NULL || offset != file_size || n == 0)
+	{
+		free(list);
+		return(-1);
+	}
+
+	*members = list;
+	return(n);
+}
+
+static void inflate_members(long long task, void* arg)
+{
+	gz_members* job = (gz_members*)(arg);
+	unsigned char* in;
+	unsigned char* out;
+	long long i, first, last;
+	z_stream strm;
+	bool direct;
+	int status, zstatus;
+
+	first = task*GZ_MEMBERS_PER_TASK;
+	last = first + GZ_MEMBERS_PER_TASK;
+	if(last > job[0].nmembers)
+	{
+		last = job[0].nmembers;
+	}
+
+	in = malloc(65536);
+	out = malloc(65536);
+	memset(&strm, 0, sizeof(z_stream));
+	status = 0;
+	if(in == NULL || out == NULL || inflateInit2(&strm, 16+MAX_WBITS) != Z_OK)	// expect a gzip wrapper, which checks the CRC
+	{
+		status = MEMORY_ALLOCATION;
+	}
+
+	for(i=first;i<last && status==0 && job[0].status==0;i++)
+	{
+		if(read_full(job[0].in_fd, in, job[0].members[i].in_size, job[0].members[i].in_offset) != 0)
+		{
+			status = READ_ERROR;
+			break;
+		}
+		direct = (job[0].out_buffer != NULL && job[0].members[i].out_size > 0);	// straight to its place in memory
+		inflateReset(&strm);
+		strm.next_in = in;
+		strm.avail_in = job[0].members[i].in_size;
+		strm.next_out = direct ? job[0].out_buffer + job[0].members[i].out_offset : out;
+		strm.avail_out = direct ? job[0].members[i].out_size : 65536;
+		zstatus = inflate(&strm, Z_FINISH);
+		if(zstatus != Z_STREAM_END || strm.total_out != job[0].members[i].out_size)
+		{
+			status = DATA_DECOMPRESSION_ERR;
+			break;
+		}
+		if(!direct && job[0].members[i].out_size > 0)
+		{
+			status = write_full(job[0].out_fd, out, job[0].members[i].out_size, job[0].members[i].out_offset);
+		}
+	}
+
+	if(in != NULL && out != NULL)
+	{
+		inflateEnd(&strm);
+	}
+	free(in);
+	free(out);
+
+	if(status != 0)
+	{
+		pthread_mutex_lock(&job[0].lock);
+		if(job[0].status == 0)
+		{
+			job[0].status = status;
+		}
+		pthread_mutex_unlock(&job[0].lock);
+	}
+}
+
+static void* pipe_writer(void* arg)
+{
+	gz_pipe* pipe = (gz_pipe*)(arg);
+	bool failed;
+	int status, i;
+
+	while(true)
+	{
+		pthread_mutex_lock(&pipe[0].lock);
+		while(pipe[0].count == 0 && !pipe[0].done)
+		{
+			pthread_cond_wait(&pipe[0].cond, &pipe[0].lock);
+		}
+		if(pipe[0].count == 0)
+		{
+			pthread_mutex_unlock(&pipe[0].lock);
+			break;
+		}
+		i = pipe[0].tail;
+		failed = (pipe[0].status != 0);
+		pthread_mutex_unlock(&pipe[0].lock);
+
+		status = 0;
+		if(!failed)	// after an error, just drain the queue
+		{
+			status = write_full(pipe[0].fd, pipe[0].buffers[i], pipe[0].fill[i], pipe[0].offset);
+		}
+		pipe[0].offset += pipe[0].fill[i];
+
+		pthread_mutex_lock(&pipe[0].lock);
+		if(status != 0)
+		{
+			pipe[0].status = status;
+		}
+		pipe[0].tail = (pipe[0].tail+1)%GZ_NBUFFERS;
+		pipe[0].count--;
+		pthread_cond_broadcast(&pipe[0].cond);
+		pthread_mutex_unlock(&pipe[0].lock);
+	}
+	return(NULL);
+}
+
+static int pipe_queue(gz_pipe* pipe, bool threaded)
+{
+	// hand the buffer being filled to the writer and wait for a free one
+
+	int status;
+
+	if(!threaded)
+	{
+		status = write_full(pipe[0].fd, pipe[0].buffers[0], pipe[0].fill[0], pipe[0].offset);
+		pipe[0].offset += pipe[0].fill[0];
+		pipe[0].fill[0] = 0;
+		return(status);
+	}
+
+	pthread_mutex_lock(&pipe[0].lock);
+	pipe[0].head = (pipe[0].head+1)%GZ_NBUFFERS;
+	pipe[0].count++;
+	pthread_cond_broadcast(&pipe[0].cond);
+	while(pipe[0].count == GZ_NBUFFERS)
+	{
+		pthread_cond_wait(&pipe[0].cond, &pipe[0].lock);
+	}
+	pipe[0].fill[pipe[0].head] = 0;
+	status = pipe[0].status;
+	pthread_mutex_unlock(&pipe[0].lock);
+
+	return(status);
+}
+
+static int inflate_stream(int in_fd, int out_fd)
+{
+	// Inflate one or more concatenated gzip members in order, overlapping inflation with writing the output.
+
+	gz_pipe pipe;
+	pthread_t writer;
+	bool threaded;
+	unsigned char* in;
+	z_stream strm;
+	long long in_offset;
+	ssize_t nread;
+	int status, zstatus, i, nbuffers;
+
+	memset(&pipe, 0, sizeof(gz_pipe));
+	pipe.fd = out_fd;
+	pthread_mutex_init(&pipe.lock, NULL);
+	pthread_cond_init(&pipe.cond, NULL);
+
+	in = malloc(GZ_CHUNK);
+	nbuffers = 0;
+	for(i=0;i<GZ_NBUFFERS;i++)
+	{
+		pipe.buffers[i] = malloc(GZ_BUFFER);
+		if(pipe.buffers[i] != NULL)
+		{
+			nbuffers++;
+		}
+	}
+	memset(&strm, 0, sizeof(z_stream));
+	if(in == NULL || pipe.buffers[0] == NULL || inflateInit2(&strm, 16+MAX_WBITS) != Z_OK)
+	{
+		free(in);
+		for(i=0;i<GZ_NBUFFERS;i++)
+		{
+			free(pipe.buffers[i]);
+		}
+		return(MEMORY_ALLOCATION);
+	}
+
+	threaded = (nbuffers == GZ_NBUFFERS && pthread_create(&writer, NULL, pipe_writer, &pipe) == 0);	// otherwise write in this thread
+	posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	status = 0;
+	in_offset = 0;
+	zstatus = Z_OK;
+	while(status == 0)
+	{
+		if(strm.avail_in == 0)
+		{
+			nread = pread(in_fd, in, GZ_CHUNK, in_offset);
+			if(nread < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if(nread < 0)
+			{
+				status = READ_ERROR;
+				break;
+			}
+			if(nread == 0)
+			{
+				if(zstatus != Z_STREAM_END)	// truncated file
+				{
+					status = DATA_DECOMPRESSION_ERR;
+				}
+				break;
+			}
+			in_offset += nread;
+			strm.next_in = in;
+			strm.avail_in = nread;
+		}
+
+		if(zstatus == Z_STREAM_END)	// start of another member, or trailing padding which gzip also ignores
+		{
+			if(strm.next_in[0] != 0x1f)
+			{
+				break;
+			}
+			inflateReset(&strm);
+		}
+
+		strm.next_out = (unsigned char*) pipe.buffers[pipe.head] + pipe.fill[pipe.head];
+		strm.avail_out = GZ_BUFFER - pipe.fill[pipe.head];
+		zstatus = inflate(&strm, Z_NO_FLUSH);
+		if(zstatus != Z_OK && zstatus != Z_STREAM_END && zstatus != Z_BUF_ERROR)
+		{
+			status = DATA_DECOMPRESSION_ERR;
+			break;
+		}
+		pipe.fill[pipe.head] = GZ_BUFFER - strm.avail_out;
+
+		if(pipe.fill[pipe.head] == GZ_BUFFER)
+		{
+			status = pipe_queue(&pipe, threaded);
+		}
+	}
+
+	if(status == 0 && pipe.fill[pipe.head] > 0)
+	{
+		status = pipe_queue(&pipe, threaded);
+	}
+
+	if(threaded)
+	{
+		pthread_mutex_lock(&pipe.lock);
+		pipe.done = true;
+		pthread_cond_broadcast(&pipe.cond);
+		pthread_mutex_unlock(&pipe.lock);
+		pthread_join(writer, NULL);
+		if(status == 0)
+		{
+			status = pipe.status;
+		}
+	}
+
+	inflateEnd(&strm);
+	free(in);
+	for(i=0;i<GZ_NBUFFERS;i++)
+	{
+		free(pipe.buffers[i]);
+	}
+	pthread_mutex_destroy(&pipe.lock);
+	pthread_cond_destroy(&pipe.cond);
+
+	return(status);
+}
+
+static int gunzip_fd(int in_fd, int out_fd, int nthreads)
+{
+	struct stat st;
+	gz_members job;
+	long long ntasks;
+
+	if(fstat(in_fd, &st) != 0)
+	{
+		return(READ_ERROR);
+	}
+
+	job.nmembers = index_bgzf(in_fd, st.st_size, &job.members);
+	if(job.nmembers < 0)
+	{
+		return(inflate_stream(in_fd, out_fd));	// ordinary gzip - member boundaries aren't known without inflating
+	}
+
+	job.in_fd = in_fd;
+	job.out_fd = out_fd;
+	job.out_buffer = NULL;
+	job.status = 0;
+	pthread_mutex_init(&job.lock, NULL);
+
+	if(job.members[job.nmembers-1].out_offset + job.members[job.nmembers-1].out_size > 0
+		&& ftruncate(out_fd, job.members[job.nmembers-1].out_offset + job.members[job.nmembers-1].out_size) != 0)	// let the threads write anywhere
+	{
+		job.status = WRITE_ERROR;
+	}
+	if(job.status == 0)
+	{
+		ntasks = (job.nmembers + GZ_MEMBERS_PER_TASK - 1)/GZ_MEMBERS_PER_TASK;
+		quickfits_parallel_for(ntasks, nthreads, inflate_members, &job);
+	}
+
+	pthread_mutex_destroy(&job.lock);
+	free(job.members);
+	return(job.status);
+}
+
+static int inflate_stream_mem(int in_fd, long long file_size, unsigned char** buffer, size_t* size)
+{
+	// Inflate one or more concatenated gzip members into a buffer that grows as needed, starting from
+	// the size in the last member's trailer (the whole file if there is only one member).
+
+	unsigned char isize[4];
+	unsigned char* in;
+	unsigned char* out;
+	unsigned char* bigger;
+	z_stream strm;
+	size_t nalloc, used;
+	long long in_offset;
+	ssize_t nread;
+	int status, zstatus;
+
+	nalloc = 0;
+	if(file_size >= 18 && read_full(in_fd, isize, 4, file_size-4) == 0)
+	{
+		nalloc = isize[0] + (isize[1] << 8) + (isize[2] << 16) + ((size_t) isize[3] << 24);
+	}
+	if(nalloc < (size_t)(file_size))
+	{
+		nalloc = file_size;
+	}
+	nalloc += QUICKFITS_BLOCK_SIZE;	// so the end of the stream is seen without growing the buffer
+
+	in = malloc(GZ_CHUNK);
+	out = malloc(nalloc);
+	memset(&strm, 0, sizeof(z_stream));
+	if(in == NULL || out == NULL || inflateInit2(&strm, 16+MAX_WBITS) != Z_OK)
+	{
+		free(in);
+		free(out);
+		return(MEMORY_ALLOCATION);
+	}
+
+	posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	status = 0;
+	in_offset = 0;
+	used = 0;
+	zstatus = Z_OK;
+	while(status == 0)
+	{
+		if(strm.avail_in == 0)
+		{
+			nread = pread(in_fd, in, GZ_CHUNK, in_offset);
+			if(nread < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if(nread < 0)
+			{
+				status = READ_ERROR;
+				break;
+			}
+			if(nread == 0)
+			{
+				if(zstatus != Z_STREAM_END)	// truncated file
+				{
+					status = DATA_DECOMPRESSION_ERR;
+				}
+				break;
+			}
+			in_offset += nread;
+			strm.next_in = in;
+			strm.avail_in = nread;
+		}
+
+		if(zstatus == Z_STREAM_END)	// start of another member, or trailing padding which gzip also ignores
+		{
+			if(strm.next_in[0] != 0x1f)
+			{
+				break;
+			}
+			inflateReset(&strm);
+		}
+
+		if(used == nalloc)
+		{
+			bigger = realloc(out, 2*nalloc);
+			if(bigger == NULL)
+			{
+				status = MEMORY_ALLOCATION;
+				break;
+			}
+			out = bigger;
+			nalloc *= 2;
+		}
+
+		strm.next_out = out + used;
+		strm.avail_out = (nalloc - used > UINT_MAX) ? UINT_MAX : nalloc - used;
+		zstatus = inflate(&strm, Z_NO_FLUSH);
+		if(zstatus != Z_OK && zstatus != Z_STREAM_END && zstatus != Z_BUF_ERROR)
+		{
+			status = DATA_DECOMPRESSION_ERR;
+			break;
+		}
+		used = strm.next_out - out;
+	}
+
+	inflateEnd(&strm);
+	free(in);
+	if(status != 0)
+	{
+		free(out);
+		return(status);
+	}
+
+	*buffer = out;
+	*size = used;
+	return(0);
+}
+
+static int gunzip_mem(int in_fd, int nthreads, unsigned char** buffer, size_t* size)
+{
+	// as gunzip_fd, inflating into a new buffer (free when done) rather than a file
+
+	struct stat st;
+	gz_members job;
+	long long ntasks;
+	size_t total;
+
+	if(fstat(in_fd, &st) != 0)
+	{
+		return(READ_ERROR);
+	}
+
+	job.nmembers = index_bgzf(in_fd, st.st_size, &job.members);
+	if(job.nmembers < 0)
+	{
+		return(inflate_stream_mem(in_fd, st.st_size, buffer, size));
+	}
+
+	total = job.members[job.nmembers-1].out_offset + job.members[job.nmembers-1].out_size;
+	job.in_fd = in_fd;
+	job.out_fd = -1;
+	job.out_buffer = malloc((total > 0) ? total : 1);
+	job.status = (job.out_buffer == NULL) ? MEMORY_ALLOCATION : 0;
+	pthread_mutex_init(&job.lock, NULL);
+
+	if(job.status == 0)
+	{
+		ntasks = (job.nmembers + GZ_MEMBERS_PER_TASK - 1)/GZ_MEMBERS_PER_TASK;
+		quickfits_parallel_for(ntasks, nthreads, inflate_members, &job);
+	}
+
+	pthread_mutex_destroy(&job.lock);
+	free(job.members);
+	if(job.status != 0)
+	{
+		free(job.out_buffer);
+		return(job.status);
+	}
+
+	*buffer = job.out_buffer;
+	*size = total;
+	return(0);
+}
+
+int quickfits_gunzip(const char* gzname, const char* outname, int nthreads)
+{
+/*
+	Decompress a gzip file using several threads.
+	Block-compressed files (BGZF, as written by bgzip) are inflated a group of members per thread,
+	each written straight to its place in the output. Other gzip files (including multi-member ones) are
+	inflated as one stream, with the output written by a second thread. Memory use is bounded in both cases.
+ 
+	INPUTS:
+		const char* gzname : gzip file
+		const char* outname : file to write (replaced if it exists)
+		int nthreads : number of threads to use (0 to use one per processor)
+ 
+	RETURN:
+		0 on success, otherwise a cfitsio error code
+*/
+	int in_fd, out_fd, status;
+
+	in_fd = open(gzname, O_RDONLY);
+	if(in_fd < 0)
+	{
+		quickfits_error("ERROR : quickfits_gunzip --> Unable to open %s\n",gzname);
+		return(FILE_NOT_OPENED);
+	}
+	out_fd = open(outname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(out_fd < 0)
+	{
+		quickfits_error("ERROR : quickfits_gunzip --> Unable to create %s\n",outname);
+		close(in_fd);
+		return(FILE_NOT_CREATED);
+	}
+
+	status = gunzip_fd(in_fd, out_fd, nthreads);
+	close(in_fd);
+	if(close(out_fd) != 0 && status == 0)
+	{
+		status = WRITE_ERROR;
+	}
+	if(status != 0)
+	{
+		quickfits_error("ERROR : quickfits_gunzip --> Error decompressing %s, error = %d\n",gzname,status);
+	}
+
+	return(status);
+}
+
+int quickfits_open_gz_file(fitsfile** fptr, const char* filename, int* status)
+{
+/*
+	Open a gzip compressed FITS file read-only by decompressing it into memory (a group of members per thread
+	for BGZF files) and handing the buffer to cfitsio's memory driver, instead of letting cfitsio inflate the
+	whole file in one thread. The buffer is freed by quickfits_close_file.
+	Used by quickfits_open_file for names ending in .gz.
+ 
+	RETURN:
+		cfitsio status, as for fits_open_file
+*/
+	unsigned char* buffer;
+	size_t size;
+	int in_fd;
+
+	if(*status)
+	{
+		return(*status);
+	}
+
+	in_fd = open(filename, O_RDONLY);
+	if(in_fd < 0)
+	{
+		quickfits_error("ERROR : quickfits_open_gz_file --> Unable to open %s\n",filename);
+		*status = FILE_NOT_OPENED;
+		return(*status);
+	}
+
+	*status = gunzip_mem(in_fd, 0, &buffer, &size);
+	close(in_fd);
+	if(*status != 0)
+	{
+		quickfits_error("ERROR : quickfits_open_gz_file --> Error decompressing %s, error = %d\n",filename,*status);
+		return(*status);
+	}
+
+	return(quickfits_open_owned_memfile(fptr, filename, buffer, size, status));	// takes the buffer, even on failure
+}
+
+static bool header_end(const char* block)
+{
+	// true if the header block holds the END card
+
+	int i;
+
+	for(i=0;i<QUICKFITS_BLOCK_SIZE/80;i++)
+	{
+		if(!strncmp(&block[80*i],"END     ",8))
+		{
+			return(true);
+		}
+	}
+	return(false);
+}
+
+static bool extname_match(const char* a, const char* b)
+{
+	// EXTNAME comparison as fits_movnam_hdu does it : case and trailing blanks are ignored
+
+	int alen, blen;
+
+	for(alen=strlen(a);alen>0 && a[alen-1]==' ';alen--);
+	for(blen=strlen(b);blen>0 && b[blen-1]==' ';blen--);
+	return(alen == blen && !strncasecmp(a,b,alen));
+}
+
+int quickfits_gz_headers(int fd, int max_hdus, const char* extname, int* header_fd)
+{
+/*
+	Inflate a gzip compressed FITS file only as far as the headers wanted, copying each header (and the first block
+	of each data unit, which holds the first rows of a table) to an anonymous memory file at its uncompressed offset.
+	The rest of each data unit is inflated but not kept, so the pread header scanners (quickfits_scan_hdu,
+	quickfits_scan_ext) can read the memory file as if it were the uncompressed file, without a full decompression
+	to disk or memory.
+ 
+	INPUTS:
+		int fd : the compressed file, open for reading
+		int max_hdus : stop after this many HDUs (0 for no limit)
+		const char* extname : stop after the header of the extension with this EXTNAME (NULL for no limit)
+	OUTPUTS:
+		header_fd : the memory file. Close when done.
+ 
+	RETURN:
+		0 on success, NO_SIMPLE if fd is not a gzip compressed FITS file.
+*/
+	unsigned char magic[2];
+	unsigned char* in;
+	unsigned char* out;
+	char block[QUICKFITS_BLOCK_SIZE];
+	z_stream strm;
+	fitshdu hdu;
+	long long in_offset, pos, hdu_start, keep_until, next_hdu;
+	size_t avail, used, n;
+	ssize_t nread;
+	int status, zstatus, nhdus, block_fill, mfd;
+	bool in_header, last, done;
+
+	*header_fd = -1;
+	if(read_full(fd, magic, 2, 0) != 0 || magic[0] != 0x1f || magic[1] != 0x8b)
+	{
+		return(NO_SIMPLE);
+	}
+
+	mfd = memfd_create("quickfits_gz_headers", MFD_CLOEXEC);
+	in = malloc(GZ_HEADER_CHUNK);
+	out = malloc(GZ_HEADER_CHUNK);
+	memset(&strm, 0, sizeof(z_stream));
+	if(mfd < 0 || in == NULL || out == NULL || inflateInit2(&strm, 16+MAX_WBITS) != Z_OK)
+	{
+		if(mfd >= 0)
+		{
+			close(mfd);
+		}
+		free(in);
+		free(out);
+		return(NO_SIMPLE);	// leave it to cfitsio
+	}
+
+	status = 0;
+	in_offset = 0;
+	zstatus = Z_OK;
+	pos = 0;	// uncompressed offset of the block being collected, or of the next byte while skipping data
+	block_fill = 0;
+	hdu_start = 0;
+	keep_until = 0;
+	next_hdu = 0;
+	nhdus = 0;
+	in_header = false;
+	last = false;
+	done = false;
+	while(status == 0 && !done)
+	{
+		if(strm.avail_in == 0)
+		{
+			nread = pread(fd, in, GZ_HEADER_CHUNK, in_offset);
+			if(nread < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if(nread <= 0)
+			{
+				status = (nread < 0 || nhdus == 0) ? DATA_DECOMPRESSION_ERR : 0;	// the headers end with the stream
+				break;
+			}
+			in_offset += nread;
+			strm.next_in = in;
+			strm.avail_in = nread;
+		}
+
+		if(zstatus == Z_STREAM_END)	// start of another member, or trailing padding
+		{
+			if(strm.next_in[0] != 0x1f)
+			{
+				break;
+			}
+			inflateReset(&strm);
+		}
+
+		strm.next_out = out;
+		strm.avail_out = GZ_HEADER_CHUNK;
+		zstatus = inflate(&strm, Z_NO_FLUSH);
+		if(zstatus != Z_OK && zstatus != Z_STREAM_END && zstatus != Z_BUF_ERROR)
+		{
+			status = DATA_DECOMPRESSION_ERR;
+			break;
+		}
+		avail = GZ_HEADER_CHUNK - strm.avail_out;
+
+		for(used=0;used<avail && status==0 && !done;used+=n)
+		{
+			if(!in_header && pos >= keep_until && pos < next_hdu)	// the rest of a data unit
+			{
+				n = (avail-used < (size_t)(next_hdu-pos)) ? avail-used : (size_t)(next_hdu-pos);
+				pos += n;
+				continue;
+			}
+
+			n = (avail-used < (size_t)(QUICKFITS_BLOCK_SIZE-block_fill)) ? avail-used : (size_t)(QUICKFITS_BLOCK_SIZE-block_fill);
+			memcpy(&block[block_fill], &out[used], n);
+			block_fill += n;
+			if(block_fill < QUICKFITS_BLOCK_SIZE)
+			{
+				continue;
+			}
+
+			if(!in_header && pos == next_hdu)
+			{
+				if(strncmp(block, (pos == 0) ? "SIMPLE  =" : "XTENSION=", 9))	// anything after the last HDU is ignored
+				{
+					status = (pos == 0) ? NO_SIMPLE : 0;
+					done = true;
+					break;
+				}
+				in_header = true;
+				hdu_start = pos;
+			}
+			if(in_header || pos < keep_until)
+			{
+				status = write_full(mfd, block, QUICKFITS_BLOCK_SIZE, pos);
+			}
+			if(status == 0 && in_header && header_end(block))
+			{
+				in_header = false;
+				status = quickfits_scan_hdu(mfd, hdu_start, &hdu, NULL, NULL);
+				nhdus++;
+				keep_until = hdu.data_offset + ((hdu.data_size > 0) ? QUICKFITS_BLOCK_SIZE : 0);
+				next_hdu = hdu.data_offset + ((hdu.data_size+QUICKFITS_BLOCK_SIZE-1)/QUICKFITS_BLOCK_SIZE)*QUICKFITS_BLOCK_SIZE;
+				last = (max_hdus > 0 && nhdus == max_hdus) || (extname != NULL && extname_match(hdu.extname, extname));
+			}
+			pos += QUICKFITS_BLOCK_SIZE;
+			block_fill = 0;
+			done = last && !in_header && pos >= keep_until;	// stop once the last HDU's first data block is kept
+		}
+	}
+
+	inflateEnd(&strm);
+	free(in);
+	free(out);
+
+	if(status != 0)
+	{
+		close(mfd);
+		return(status);
+	}
+	*header_fd = mfd;
+	return(0);
+}
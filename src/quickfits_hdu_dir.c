@@ -0,0 +1,443 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define HDU_DIR_MAGIC "QFITSHDU"
+#define HDU_DIR_VERSION 1
+#define HDU_DIR_SUFFIX ".qfidx"	// persisted directories are kept next to the FITS file
+#define HDU_DIR_CACHE_SIZE 64	// number of files whose directories are remembered
+
+typedef struct hdu_dir_header_tag{
+	char magic[8];
+	int version;
+	int nhdu;
+	long long file_size;
+	long long mtime;
+}hdu_dir_header;
+
+typedef struct hdu_dir_cache_tag{
+	char filename[FLEN_FILENAME];	// empty for an unused slot
+	long long file_size;	// the file when the entry was made
+	long long mtime;
+	int status;	// from quickfits_build_hdu_dir, so files without a directory (e.g. gzip files) aren't scanned again
+	fitshdu_dir dir;
+}hdu_dir_cache;
+
+static hdu_dir_cache cache[HDU_DIR_CACHE_SIZE];
+static int cache_next = 0;	// next cache slot to reuse
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool persist_dirs = false;
+
+static int file_stamp(const char* filename, long long* file_size, long long* mtime)
+{
+	struct stat st;
+
+	if(stat(filename,&st) != 0 || !S_ISREG(st.st_mode))
+	{
+		return(FILE_NOT_OPENED);
+	}
+	*file_size = st.st_size;
+	*mtime = (long long)(st.st_mtim.tv_sec)*1000000000LL + st.st_mtim.tv_nsec;
+	return(0);
+}
+
+static int load_hdu_dir(const char* filename, long long file_size, long long mtime, fitshdu_dir* dir)
+{
+	// read a persisted directory, if there is one and it matches the current file
+
+	char* idxname;
+	hdu_dir_header header;
+	FILE* fp;
+	int status;
+
+	idxname = malloc(strlen(filename)+strlen(HDU_DIR_SUFFIX)+1);
+	if(idxname == NULL)
+	{
+		return(MEMORY_ALLOCATION);
+	}
+	sprintf(idxname,"%s%s",filename,HDU_DIR_SUFFIX);
+	fp = fopen(idxname,"rb");
+	free(idxname);
+	if(fp == NULL)
+	{
+		return(FILE_NOT_OPENED);
+	}
+
+	status = READ_ERROR;
+	if( fread(&header,sizeof(header),1,fp) == 1 && !memcmp(header.magic,HDU_DIR_MAGIC,8) && header.version == HDU_DIR_VERSION
+		&& header.file_size == file_size && header.mtime == mtime && header.nhdu > 0 )
+	{
+		dir[0].hdus = malloc(header.nhdu*sizeof(fitshdu));
+		if(dir[0].hdus != NULL && fread(dir[0].hdus,sizeof(fitshdu),header.nhdu,fp) == (size_t)(header.nhdu))
+		{
+			dir[0].nhdu = header.nhdu;
+			dir[0].file_size = file_size;
+			dir[0].mtime = mtime;
+			status = 0;
+		}
+		else
+		{
+			free(dir[0].hdus);
+			dir[0].hdus = NULL;
+		}
+	}
+	fclose(fp);
+	return(status);
+}
+
+int quickfits_build_hdu_dir(const char* filename, fitshdu_dir* dir)
+{
+/*
+	List every HDU in a FITS file (name, version, header and data offsets) by reading its header blocks.
+	If persistence is switched on with quickfits_set_hdu_dir_persist, a saved directory is used when it is
+	still up to date, and a new one is saved after scanning.
+ 
+	INPUTS:
+		const char* filename : name of the FITS file
+	OUTPUTS:
+		dir : the HDU directory. Release with quickfits_free_hdu_dir.
+ 
+	RETURN:
+		0 on success.
+*/
+	fitshdu hdu;
+	fitshdu* temp;
+	long long offset, file_size, mtime;
+	int fd, status, capacity;
+
+	dir[0].nhdu = 0;
+	dir[0].hdus = NULL;
+
+	status = file_stamp(filename, &file_size, &mtime);
+	if(status != 0)
+	{
+		return(status);
+	}
+
+	if(persist_dirs && load_hdu_dir(filename, file_size, mtime, dir) == 0)
+	{
+		return(0);
+	}
+
+	fd = open(filename, O_RDONLY);
+	if(fd < 0)
+	{
+		return(FILE_NOT_OPENED);
+	}
+
+	capacity=0;
+	offset=0;
+	while(true)
+	{
+		status = quickfits_scan_hdu(fd, offset, &hdu, NULL, NULL);
+		if(status != 0)
+		{
+			break;
+		}
+
+		if(dir[0].nhdu == capacity)
+		{
+			capacity = (capacity > 0) ? 2*capacity : 8;
+			temp = realloc(dir[0].hdus, capacity*sizeof(fitshdu));
+			if(temp == NULL)
+			{
+				status = MEMORY_ALLOCATION;
+				break;
+			}
+			dir[0].hdus = temp;
+		}
+		dir[0].hdus[dir[0].nhdu++] = hdu;
+		offset = hdu.data_offset + ((hdu.data_size+QUICKFITS_BLOCK_SIZE-1)/QUICKFITS_BLOCK_SIZE)*QUICKFITS_BLOCK_SIZE;
+	}
+	close(fd);
+
+	if(status != END_OF_FILE || dir[0].nhdu == 0)
+	{
+		quickfits_free_hdu_dir(dir);
+		return( (status == END_OF_FILE) ? NO_SIMPLE : status );
+	}
+
+	dir[0].file_size = file_size;
+	dir[0].mtime = mtime;
+
+	if(persist_dirs)
+	{
+		quickfits_save_hdu_dir(filename, dir[0]);	// not being able to save (e.g. a read-only directory) doesn't matter
+	}
+
+	return(0);
+}
+
+int quickfits_save_hdu_dir(const char* filename, fitshdu_dir dir)
+{
+/*
+	Save an HDU directory to filename.qfidx, where quickfits_build_hdu_dir will find it while persistence is on
+ 
+	RETURN:
+		0 on success.
+*/
+	char* idxname;
+	char* tmpname;
+	hdu_dir_header header;
+	FILE* fp;
+	int status;
+
+	idxname = malloc(strlen(filename)+strlen(HDU_DIR_SUFFIX)+1);
+	tmpname = malloc(strlen(filename)+strlen(HDU_DIR_SUFFIX)+32);
+	if(idxname == NULL || tmpname == NULL)
+	{
+		free(idxname);
+		free(tmpname);
+		return(MEMORY_ALLOCATION);
+	}
+	sprintf(idxname,"%s%s",filename,HDU_DIR_SUFFIX);
+	sprintf(tmpname,"%s.tmp%d",idxname,(int)(getpid()));
+
+	memset(&header,0,sizeof(header));
+	memcpy(header.magic,HDU_DIR_MAGIC,8);
+	header.version = HDU_DIR_VERSION;
+	header.nhdu = dir.nhdu;
+	header.file_size = dir.file_size;
+	header.mtime = dir.mtime;
+
+	status = FILE_NOT_CREATED;
+	fp = fopen(tmpname,"wb");
+	if(fp != NULL)
+	{
+		status = 0;
+		if( fwrite(&header,sizeof(header),1,fp) != 1 || fwrite(dir.hdus,sizeof(fitshdu),dir.nhdu,fp) != (size_t)(dir.nhdu) )
+		{
+			status = WRITE_ERROR;
+		}
+		if(fclose(fp) != 0)
+		{
+			status = WRITE_ERROR;
+		}
+		if(status == 0 && rename(tmpname,idxname) != 0)	// rename so readers never see a partial directory
+		{
+			status = WRITE_ERROR;
+		}
+		if(status != 0)
+		{
+			remove(tmpname);
+		}
+	}
+
+	free(idxname);
+	free(tmpname);
+	return(status);
+}
+
+void quickfits_free_hdu_dir(fitshdu_dir* dir)
+{
+	free(dir[0].hdus);
+	dir[0].hdus = NULL;
+	dir[0].nhdu = 0;
+}
+
+void quickfits_set_hdu_dir_persist(bool persist)
+{
+	persist_dirs = persist;
+}
+
+int quickfits_find_hdu(fitshdu_dir dir, int hdutype, const char* extname, int extver)
+{
+/*
+	Find an extension in an HDU directory, matching in the same way as fits_movnam_hdu
+ 
+	INPUTS:
+		int hdutype : IMAGE_HDU, ASCII_TBL, BINARY_TBL or ANY_HDU
+		const char* extname : EXTNAME to look for (case and trailing blanks are ignored)
+		int extver : EXTVER to look for (0 for any version)
+ 
+	RETURN:
+		HDU number (1 for the primary HDU), or 0 if there is no such extension.
+*/
+	int i, len, extlen;
+
+	len = strlen(extname);
+	while(len>0 && extname[len-1]==' ')
+	{
+		len--;
+	}
+
+	for(i=0;i<dir.nhdu;i++)
+	{
+		extlen = strlen(dir.hdus[i].extname);
+		while(extlen>0 && dir.hdus[i].extname[extlen-1]==' ')
+		{
+			extlen--;
+		}
+
+		if( (hdutype == ANY_HDU || hdutype == dir.hdus[i].hdutype) && extlen == len && !strncasecmp(dir.hdus[i].extname,extname,len)
+			&& (extver == 0 || extver == dir.hdus[i].extver) )
+		{
+			return(i+1);
+		}
+	}
+	return(0);
+}
+
+static int copy_hdu_dir(fitshdu_dir from, fitshdu_dir* to)
+{
+	to[0] = from;
+	to[0].hdus = malloc(from.nhdu*sizeof(fitshdu));
+	if(to[0].hdus == NULL)
+	{
+		to[0].nhdu = 0;
+		return(MEMORY_ALLOCATION);
+	}
+	memcpy(to[0].hdus, from.hdus, from.nhdu*sizeof(fitshdu));
+	return(0);
+}
+
+int quickfits_get_hdu_dir(const char* filename, fitshdu_dir* dir)
+{
+/*
+	As quickfits_build_hdu_dir, but the result is remembered while the file's size and modification time stay
+	the same, so later calls cost one stat. Failures (a gzip file, anything that isn't FITS) are remembered too.
+ 
+	INPUTS:
+		const char* filename : name of the FITS file
+	OUTPUTS:
+		dir : a copy of the HDU directory. Release with quickfits_free_hdu_dir.
+ 
+	RETURN:
+		0 on success, or the error quickfits_build_hdu_dir gave.
+*/
+	fitshdu_dir built;
+	long long file_size, mtime;
+	int i, status;
+
+	dir[0].nhdu = 0;
+	dir[0].hdus = NULL;
+
+	if(strlen(filename) >= FLEN_FILENAME || file_stamp(filename, &file_size, &mtime) != 0)	// extended file names, memory files etc.
+	{
+		return(FILE_NOT_OPENED);
+	}
+
+	pthread_mutex_lock(&cache_lock);
+	for(i=0;i<HDU_DIR_CACHE_SIZE;i++)
+	{
+		if(!strcmp(cache[i].filename,filename) && cache[i].file_size == file_size && cache[i].mtime == mtime)
+		{
+			status = (cache[i].status == 0) ? copy_hdu_dir(cache[i].dir, dir) : cache[i].status;
+			pthread_mutex_unlock(&cache_lock);
+			return(status);
+		}
+	}
+	pthread_mutex_unlock(&cache_lock);
+
+	status = quickfits_build_hdu_dir(filename, &built);	// not holding the lock, so other files aren't held up
+	if(status == 0 && copy_hdu_dir(built, dir) != 0)
+	{
+		quickfits_free_hdu_dir(&built);
+		return(MEMORY_ALLOCATION);
+	}
+
+	pthread_mutex_lock(&cache_lock);
+	for(i=0;i<HDU_DIR_CACHE_SIZE && strcmp(cache[i].filename,filename);i++);
+	if(i == HDU_DIR_CACHE_SIZE)
+	{
+		i = cache_next;
+		cache_next = (cache_next+1)%HDU_DIR_CACHE_SIZE;
+	}
+	quickfits_free_hdu_dir(&cache[i].dir);	// an older entry, or one another thread made at the same time
+	strcpy(cache[i].filename,filename);
+	cache[i].file_size = file_size;
+	cache[i].mtime = mtime;
+	cache[i].status = status;
+	cache[i].dir = built;
+	pthread_mutex_unlock(&cache_lock);
+
+	return(status);
+}
+
+static bool known_missing(const char* filename, int hdutype, const char* extname, int extver)
+{
+	// true only if a directory for the file is already cached, is up to date, and doesn't have the extension
+
+	long long cached_size, cached_mtime, file_size, mtime;
+	int i;
+	bool missing;
+
+	missing = false;
+	cached_size = 0;
+	cached_mtime = 0;
+	pthread_mutex_lock(&cache_lock);
+	for(i=0;i<HDU_DIR_CACHE_SIZE;i++)
+	{
+		if(cache[i].status == 0 && cache[i].dir.nhdu > 0 && !strcmp(cache[i].filename,filename))
+		{
+			missing = (quickfits_find_hdu(cache[i].dir, hdutype, extname, extver) == 0);
+			cached_size = cache[i].file_size;
+			cached_mtime = cache[i].mtime;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&cache_lock);
+
+	if(missing && (file_stamp(filename, &file_size, &mtime) != 0 || file_size != cached_size || mtime != cached_mtime))
+	{
+		missing = false;	// changed since - let cfitsio look
+	}
+	return(missing);
+}
+
+int quickfits_movnam_hdu(fitsfile* fptr, const char* filename, int hdutype, char* extname, int extver, int* status)
+{
+/*
+	Drop-in replacement for fits_movnam_hdu. Moves with fits_movnam_hdu, except that when the file's HDU directory
+	is already cached (quickfits_get_hdu_dir, as used by the prefetcher, the parallel UV reader and the checksum
+	verifier) and shows the extension isn't there, BAD_HDU_NUM is returned without cfitsio reading every header
+	in the file. cfitsio has no public way to seek straight to an HDU, so a directory can't speed up a move that
+	succeeds, and none is built here.
+ 
+	INPUTS:
+		fitsfile* fptr : open file
+		const char* filename : name fptr was opened with
+		int hdutype, char* extname, int extver : as for fits_movnam_hdu
+ 
+	RETURN:
+		status : 0 on success, BAD_HDU_NUM if there is no such extension.
+*/
+	long long start;
+
+	if(*status != 0)
+	{
+		return(*status);
+	}
+
+	start = quickfits_trace_start();
+	if(known_missing(filename, hdutype, extname, extver))
+	{
+		*status = BAD_HDU_NUM;
+	}
+	else
+	{
+		fits_movnam_hdu(fptr, hdutype, extname, extver, status);
+	}
+	quickfits_trace_phase(QUICKFITS_PHASE_HDU_MOVE, start);
+	quickfits_count_io(0, 0, 1, 0);
+
+	return(*status);
+}
@@ -0,0 +1,592 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#if defined(IORING_FEAT_CUR_PERSONALITY) && defined(__NR_io_uring_setup)	// 5.6 headers, the first with IORING_OP_READ
+#define ENGINE_IO_URING 1	// otherwise only the thread pool is built
+#endif
+
+#define ENGINE_DEFAULT_DEPTH 64
+#define ENGINE_DEFAULT_BUFFER (1<<20)
+#define ENGINE_MAX_THREADS 32	// pread workers when io_uring isn't available
+
+typedef struct io_slot_tag{
+	int fd;
+	long long offset;
+	long long nbytes;
+	long long done;	// bytes read so far (reads may complete in pieces)
+	int status;
+	unsigned char* buffer;
+	bool owned;	// buffer allocated for a read larger than the engine's buffers
+	quickfits_read_callback callback;
+	void* arg;
+}io_slot;
+
+struct quickfits_io_engine_tag{
+	bool uring;
+	bool fixed;	// buffers registered with the ring
+	int depth;
+	long long buffer_bytes;
+	unsigned char* buffers;	// depth buffers of buffer_bytes
+	io_slot* slots;
+	int* free_slots;
+	int nfree;
+	int inflight;
+	int status;	// first error since the last quickfits_io_wait
+
+#ifdef ENGINE_IO_URING
+	// io_uring
+	int ring_fd;
+	void* sq_ring;
+	size_t sq_ring_size;
+	void* cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe* sqes;
+	size_t sqes_size;
+	unsigned* sq_head;
+	unsigned* sq_tail;
+	unsigned* sq_mask;
+	unsigned* sq_array;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned* cq_mask;
+	struct io_uring_cqe* cqes;
+	unsigned to_submit;
+#endif
+
+	// thread pool
+	pthread_t* threads;
+	int nthreads;
+	int* queued;	// slots waiting to be read, a ring of depth entries
+	int nqueued;
+	int queue_head;
+	int* completed;	// slots read, waiting for their callback
+	int ncompleted;
+	bool stop;
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+};
+
+static int pread_slot(io_slot* slot)
+{
+	long long n;
+
+	while(slot[0].done < slot[0].nbytes)
+	{
+		n = pread(slot[0].fd, slot[0].buffer+slot[0].done, slot[0].nbytes-slot[0].done, slot[0].offset+slot[0].done);
+		if(n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(n < 0)
+		{
+			return(READ_ERROR);
+		}
+		if(n == 0)	// end of file, the callback gets what there is
+		{
+			break;
+		}
+		slot[0].done += n;
+	}
+	return(0);
+}
+
+static void* pool_thread(void* arg)
+{
+	quickfits_io_engine* engine = (quickfits_io_engine*)(arg);
+	int s;
+
+	pthread_mutex_lock(&engine[0].lock);
+	while(true)
+	{
+		while(engine[0].nqueued == 0 && !engine[0].stop)
+		{
+			pthread_cond_wait(&engine[0].work, &engine[0].lock);
+		}
+		if(engine[0].nqueued == 0)
+		{
+			break;
+		}
+		s = engine[0].queued[engine[0].queue_head];
+		engine[0].queue_head = (engine[0].queue_head + 1) % engine[0].depth;
+		engine[0].nqueued--;
+		pthread_mutex_unlock(&engine[0].lock);
+
+		engine[0].slots[s].status = pread_slot(&engine[0].slots[s]);
+
+		pthread_mutex_lock(&engine[0].lock);
+		engine[0].completed[engine[0].ncompleted++] = s;
+		pthread_cond_signal(&engine[0].done);
+	}
+	pthread_mutex_unlock(&engine[0].lock);
+	return(NULL);
+}
+
+static bool uring_setup(quickfits_io_engine* engine)
+{
+	// set up a ring with depth entries and register the buffers with it, false if io_uring isn't available
+
+#ifdef ENGINE_IO_URING
+	struct io_uring_params params;
+	struct iovec* iov;
+	int i;
+
+	memset(&params, 0, sizeof(params));
+	engine[0].ring_fd = syscall(__NR_io_uring_setup, engine[0].depth, &params);
+	if(engine[0].ring_fd < 0)	// old kernel, or disabled
+	{
+		return(false);
+	}
+
+	engine[0].sq_ring_size = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+	engine[0].cq_ring_size = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+	if(params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if(engine[0].cq_ring_size > engine[0].sq_ring_size)
+		{
+			engine[0].sq_ring_size = engine[0].cq_ring_size;
+		}
+		engine[0].cq_ring_size = engine[0].sq_ring_size;
+	}
+	engine[0].sq_ring = mmap(NULL, engine[0].sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, engine[0].ring_fd, IORING_OFF_SQ_RING);
+	if(engine[0].sq_ring == MAP_FAILED)
+	{
+		close(engine[0].ring_fd);
+		return(false);
+	}
+	if(params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		engine[0].cq_ring = engine[0].sq_ring;
+	}
+	else
+	{
+		engine[0].cq_ring = mmap(NULL, engine[0].cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, engine[0].ring_fd, IORING_OFF_CQ_RING);
+	}
+	engine[0].sqes_size = params.sq_entries*sizeof(struct io_uring_sqe);
+	engine[0].sqes = mmap(NULL, engine[0].sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, engine[0].ring_fd, IORING_OFF_SQES);
+	if(engine[0].cq_ring == MAP_FAILED || engine[0].sqes == MAP_FAILED)
+	{
+		if(engine[0].sqes != MAP_FAILED)
+		{
+			munmap(engine[0].sqes, engine[0].sqes_size);
+		}
+		if(engine[0].cq_ring != MAP_FAILED && engine[0].cq_ring != engine[0].sq_ring)
+		{
+			munmap(engine[0].cq_ring, engine[0].cq_ring_size);
+		}
+		munmap(engine[0].sq_ring, engine[0].sq_ring_size);
+		close(engine[0].ring_fd);
+		return(false);
+	}
+
+	engine[0].sq_head = (unsigned*)((char*)(engine[0].sq_ring) + params.sq_off.head);
+	engine[0].sq_tail = (unsigned*)((char*)(engine[0].sq_ring) + params.sq_off.tail);
+	engine[0].sq_mask = (unsigned*)((char*)(engine[0].sq_ring) + params.sq_off.ring_mask);
+	engine[0].sq_array = (unsigned*)((char*)(engine[0].sq_ring) + params.sq_off.array);
+	engine[0].cq_head = (unsigned*)((char*)(engine[0].cq_ring) + params.cq_off.head);
+	engine[0].cq_tail = (unsigned*)((char*)(engine[0].cq_ring) + params.cq_off.tail);
+	engine[0].cq_mask = (unsigned*)((char*)(engine[0].cq_ring) + params.cq_off.ring_mask);
+	engine[0].cqes = (struct io_uring_cqe*)((char*)(engine[0].cq_ring) + params.cq_off.cqes);
+	engine[0].to_submit = 0;
+
+	iov = malloc(engine[0].depth*sizeof(struct iovec));	// registered buffers save pinning the pages on every read
+	engine[0].fixed = false;
+	if(iov != NULL)
+	{
+		for(i=0;i<engine[0].depth;i++)
+		{
+			iov[i].iov_base = engine[0].buffers + i*engine[0].buffer_bytes;
+			iov[i].iov_len = engine[0].buffer_bytes;
+		}
+		engine[0].fixed = (syscall(__NR_io_uring_register, engine[0].ring_fd, IORING_REGISTER_BUFFERS, iov, engine[0].depth) == 0);	// fails over RLIMIT_MEMLOCK
+		free(iov);
+	}
+	return(true);
+#else
+	return(false);
+#endif
+}
+
+#ifdef ENGINE_IO_URING
+static void uring_queue(quickfits_io_engine* engine, int s)
+{
+	// add the rest of slot s's read to the submission queue
+
+	struct io_uring_sqe* sqe;
+	io_slot* slot = &engine[0].slots[s];
+	unsigned tail;
+
+	tail = *engine[0].sq_tail;
+	sqe = &engine[0].sqes[tail & *engine[0].sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe[0].opcode = (engine[0].fixed && !slot[0].owned) ? IORING_OP_READ_FIXED : IORING_OP_READ;
+	sqe[0].fd = slot[0].fd;
+	sqe[0].off = slot[0].offset + slot[0].done;
+	sqe[0].addr = (unsigned long)(slot[0].buffer + slot[0].done);
+	sqe[0].len = slot[0].nbytes - slot[0].done;
+	sqe[0].buf_index = (sqe[0].opcode == IORING_OP_READ_FIXED) ? s : 0;
+	sqe[0].user_data = s;
+	engine[0].sq_array[tail & *engine[0].sq_mask] = tail & *engine[0].sq_mask;
+	__atomic_store_n(engine[0].sq_tail, tail + 1, __ATOMIC_RELEASE);
+	engine[0].to_submit++;
+}
+
+#else
+static void uring_queue(quickfits_io_engine* engine, int s)
+{
+}
+#endif
+
+static void complete_slot(quickfits_io_engine* engine, int s)
+{
+	// hand a finished read to its callback and free the slot
+
+	io_slot* slot = &engine[0].slots[s];
+
+	if(slot[0].status != 0 && engine[0].status == 0)
+	{
+		engine[0].status = slot[0].status;
+	}
+	quickfits_count_io(slot[0].done, 0, 0, 0);
+	slot[0].callback(slot[0].status, slot[0].buffer, slot[0].done, slot[0].arg);
+	if(slot[0].owned)
+	{
+		free(slot[0].buffer);
+	}
+	engine[0].free_slots[engine[0].nfree++] = s;
+	engine[0].inflight--;
+}
+
+static int uring_reap(quickfits_io_engine* engine, bool wait)
+{
+	// reap, for an engine using io_uring
+
+#ifdef ENGINE_IO_URING
+	struct io_uring_cqe* cqe;
+	unsigned head;
+	int s, res, ndone;
+
+	ndone = 0;
+	do
+	{
+		if(engine[0].to_submit > 0 || wait)
+		{
+			res = syscall(__NR_io_uring_enter, engine[0].ring_fd, engine[0].to_submit, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+			if(res < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+			{
+				return(READ_ERROR);
+			}
+			if(res > 0)
+			{
+				engine[0].to_submit -= res;
+			}
+		}
+
+		head = *engine[0].cq_head;
+		while(head != __atomic_load_n(engine[0].cq_tail, __ATOMIC_ACQUIRE))
+		{
+			cqe = &engine[0].cqes[head & *engine[0].cq_mask];
+			s = cqe[0].user_data;
+			res = cqe[0].res;
+			head++;
+			__atomic_store_n(engine[0].cq_head, head, __ATOMIC_RELEASE);
+
+			if(res == -EAGAIN || res == -EINTR)
+			{
+				uring_queue(engine, s);
+				continue;
+			}
+			if(res < 0)
+			{
+				engine[0].slots[s].status = READ_ERROR;
+			}
+			else
+			{
+				engine[0].slots[s].done += res;
+				if(res > 0 && engine[0].slots[s].done < engine[0].slots[s].nbytes)	// short read, ask for the rest
+				{
+					uring_queue(engine, s);
+					continue;
+				}
+			}
+			complete_slot(engine, s);
+			ndone++;
+		}
+	}while(wait && ndone == 0);
+
+	return(0);
+#else
+	return(READ_ERROR);
+#endif
+}
+
+static void uring_close(quickfits_io_engine* engine)
+{
+#ifdef ENGINE_IO_URING
+	munmap(engine[0].sqes, engine[0].sqes_size);
+	if(engine[0].cq_ring != engine[0].sq_ring)
+	{
+		munmap(engine[0].cq_ring, engine[0].cq_ring_size);
+	}
+	munmap(engine[0].sq_ring, engine[0].sq_ring_size);
+	close(engine[0].ring_fd);	// also unregisters the buffers
+#endif
+}
+
+static int reap(quickfits_io_engine* engine, bool wait)
+{
+	// submit queued reads and run the callbacks of completed ones, waiting for at least one if wait
+
+	int s;
+
+	if(engine[0].uring)
+	{
+		return(uring_reap(engine, wait));
+	}
+
+	pthread_mutex_lock(&engine[0].lock);
+	while(wait && engine[0].ncompleted == 0)
+	{
+		pthread_cond_wait(&engine[0].done, &engine[0].lock);
+	}
+	while(engine[0].ncompleted > 0)
+	{
+		s = engine[0].completed[--engine[0].ncompleted];
+		pthread_mutex_unlock(&engine[0].lock);	// callbacks outside the lock, so they can't hold up the workers
+		complete_slot(engine, s);
+		pthread_mutex_lock(&engine[0].lock);
+	}
+	pthread_mutex_unlock(&engine[0].lock);
+	return(0);
+}
+
+int quickfits_io_engine_open(quickfits_io_engine** engine, int queue_depth, long long buffer_bytes, bool use_io_uring)
+{
+/*
+	Start an engine for many independent reads kept in flight at once (cutouts, point samples, small tables from many
+	files). Reads go through io_uring, with the engine's buffers registered with the ring, or through a pool of pread
+	threads where io_uring isn't available (or use_io_uring is false).
+	Completed reads are handed to their callbacks, in whatever order they finish, by the thread calling quickfits_io_submit
+	or quickfits_io_wait, so the callbacks need no locking. An engine should only be used by one thread at a time.
+ 
+	INPUTS:
+		int queue_depth : maximum number of reads in flight (0 for 64)
+		long long buffer_bytes : size of each of the queue_depth buffers (0 for 1 MB). Larger reads get a buffer of their own.
+		bool use_io_uring : false to always use the thread pool
+	OUTPUTS:
+		engine : the engine, for quickfits_io_engine_close
+ 
+	RETURN:
+		0 on success
+*/
+	quickfits_io_engine* e;
+	int i;
+
+	*engine = NULL;
+	e = calloc(1, sizeof(quickfits_io_engine));
+	if(e == NULL)
+	{
+		return(MEMORY_ALLOCATION);
+	}
+	e[0].depth = (queue_depth > 0) ? queue_depth : ENGINE_DEFAULT_DEPTH;
+	e[0].buffer_bytes = (buffer_bytes > 0) ? ((buffer_bytes + 4095)/4096)*4096 : ENGINE_DEFAULT_BUFFER;
+	e[0].slots = calloc(e[0].depth, sizeof(io_slot));
+	e[0].free_slots = malloc(e[0].depth*sizeof(int));
+	e[0].queued = malloc(e[0].depth*sizeof(int));
+	e[0].completed = malloc(e[0].depth*sizeof(int));
+	if(posix_memalign((void**)&e[0].buffers, 4096, e[0].depth*e[0].buffer_bytes))
+	{
+		e[0].buffers = NULL;
+	}
+	if(e[0].slots == NULL || e[0].free_slots == NULL || e[0].queued == NULL || e[0].completed == NULL || e[0].buffers == NULL)
+	{
+		quickfits_error("ERROR : quickfits_io_engine_open --> Unable to allocate %d buffers of %lld bytes\n",e[0].depth,e[0].buffer_bytes);
+		free(e[0].slots);
+		free(e[0].free_slots);
+		free(e[0].queued);
+		free(e[0].completed);
+		free(e[0].buffers);
+		free(e);
+		return(MEMORY_ALLOCATION);
+	}
+	for(i=0;i<e[0].depth;i++)
+	{
+		e[0].free_slots[i] = e[0].depth - 1 - i;
+	}
+	e[0].nfree = e[0].depth;
+
+	e[0].uring = use_io_uring && uring_setup(e);
+	if(!e[0].uring)
+	{
+		pthread_mutex_init(&e[0].lock, NULL);
+		pthread_cond_init(&e[0].work, NULL);
+		pthread_cond_init(&e[0].done, NULL);
+		e[0].nthreads = (e[0].depth < ENGINE_MAX_THREADS) ? e[0].depth : ENGINE_MAX_THREADS;
+		e[0].threads = malloc(e[0].nthreads*sizeof(pthread_t));
+		for(i=0;i<e[0].nthreads && e[0].threads!=NULL;i++)
+		{
+			if(pthread_create(&e[0].threads[i], NULL, pool_thread, e))
+			{
+				break;
+			}
+		}
+		e[0].nthreads = (e[0].threads != NULL) ? i : 0;	// with none, reads are done in quickfits_io_submit
+	}
+
+	*engine = e;
+	return(0);
+}
+
+bool quickfits_io_engine_uses_io_uring(const quickfits_io_engine* engine)
+{
+	return(engine[0].uring);
+}
+
+int quickfits_io_submit(quickfits_io_engine* engine, int fd, long long offset, long long nbytes, quickfits_read_callback callback, void* arg)
+{
+/*
+	Start reading nbytes at offset of fd. When it's done callback(status, data, nread, arg) is called from within a later
+	quickfits_io_submit or quickfits_io_wait, with nread less than nbytes at the end of the file. data is only valid
+	during the callback. If the queue is full, this first waits for a read to finish.
+ 
+	RETURN:
+		0 on success
+*/
+	io_slot* slot;
+	int s;
+
+	while(engine[0].nfree == 0)
+	{
+		if(reap(engine, true))
+		{
+			quickfits_error("ERROR : quickfits_io_submit --> io_uring_enter failed, errno = %d\n",errno);
+			return(READ_ERROR);
+		}
+	}
+	s = engine[0].free_slots[--engine[0].nfree];
+	slot = &engine[0].slots[s];
+	slot[0].fd = fd;
+	slot[0].offset = offset;
+	slot[0].nbytes = nbytes;
+	slot[0].done = 0;
+	slot[0].status = 0;
+	slot[0].callback = callback;
+	slot[0].arg = arg;
+	slot[0].owned = (nbytes > engine[0].buffer_bytes);
+	slot[0].buffer = slot[0].owned ? malloc(nbytes) : engine[0].buffers + s*engine[0].buffer_bytes;
+	engine[0].inflight++;
+	if(slot[0].buffer == NULL)
+	{
+		slot[0].owned = false;
+		slot[0].status = MEMORY_ALLOCATION;
+		complete_slot(engine, s);
+		return(MEMORY_ALLOCATION);
+	}
+
+	if(engine[0].uring)
+	{
+		uring_queue(engine, s);
+		reap(engine, false);	// submit, and collect anything already done
+	}
+	else if(engine[0].nthreads == 0)
+	{
+		slot[0].status = pread_slot(slot);
+		complete_slot(engine, s);
+	}
+	else
+	{
+		pthread_mutex_lock(&engine[0].lock);
+		engine[0].queued[(engine[0].queue_head + engine[0].nqueued) % engine[0].depth] = s;
+		engine[0].nqueued++;
+		pthread_cond_signal(&engine[0].work);
+		pthread_mutex_unlock(&engine[0].lock);
+		reap(engine, false);
+	}
+	return(0);
+}
+
+int quickfits_io_wait(quickfits_io_engine* engine)
+{
+/*
+	Wait for every read submitted so far, running their callbacks
+ 
+	RETURN:
+		0 if every read succeeded, otherwise the status of the first that failed
+*/
+	int status;
+
+	while(engine[0].inflight > 0)
+	{
+		if(reap(engine, true))	// the ring itself failed
+		{
+			quickfits_error("ERROR : quickfits_io_wait --> io_uring_enter failed, errno = %d\n",errno);
+			return(READ_ERROR);
+		}
+	}
+	status = engine[0].status;
+	engine[0].status = 0;
+	return(status);
+}
+
+void quickfits_io_engine_close(quickfits_io_engine* engine)
+{
+/*
+	Wait for any reads still in flight and free the engine
+*/
+	int i;
+
+	if(engine == NULL)
+	{
+		return;
+	}
+	quickfits_io_wait(engine);
+	if(engine[0].uring)
+	{
+		uring_close(engine);
+	}
+	else
+	{
+		pthread_mutex_lock(&engine[0].lock);
+		engine[0].stop = true;
+		pthread_cond_broadcast(&engine[0].work);
+		pthread_mutex_unlock(&engine[0].lock);
+		for(i=0;i<engine[0].nthreads;i++)
+		{
+			pthread_join(engine[0].threads[i], NULL);
+		}
+		free(engine[0].threads);
+		pthread_mutex_destroy(&engine[0].lock);
+		pthread_cond_destroy(&engine[0].work);
+		pthread_cond_destroy(&engine[0].done);
+	}
+	free(engine[0].slots);
+	free(engine[0].free_slots);
+	free(engine[0].queued);
+	free(engine[0].completed);
+	free(engine[0].buffers);
+	free(engine);
+}
@@ -0,0 +1,328 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+typedef struct stream_job_tag{	// a batch of strips, one per thread
+	int ninputs;
+	const double** inputs;	// inputs[strip*ninputs + input]
+	double** outputs;
+	long long* npix;	// pixels in each strip
+	long long* first_pixel;
+	quickfits_strip_kernel kernel;
+	void* arg;
+}stream_job;
+
+static void run_kernel(long long strip, void* arg)
+{
+	stream_job* job = (stream_job*)(arg);
+
+	job[0].kernel(job[0].ninputs, &job[0].inputs[strip*job[0].ninputs], job[0].outputs[strip], job[0].npix[strip], job[0].first_pixel[strip], job[0].arg);
+}
+
+int quickfits_map_stream(int ninputs, const char** infiles, const char* outfile, fitsinfo_map fitsi, char* history, quickfits_strip_kernel kernel, void* arg, long long strip_rows, int nthreads)
+{
+/*
+	Combine maps pixel by pixel without holding whole images in memory. The inputs are read in strips of rows,
+	a batch of strips (one per thread) at a time, the kernel is applied to the strips of a batch in parallel and
+	the output strips are written in order. Memory use is (ninputs+1)*nthreads strips whatever the map size.
+ 
+	INPUTS:
+		int ninputs : number of input maps
+		const char** infiles : input maps, each imsize_ra x imsize_dec
+		const char* outfile : map to write (replaced if it exists)
+		fitsinfo_map fitsi : header of the output map (e.g. from quickfits_read_map_header of an input), as for quickfits_write_map
+		char* history : history comments for the output
+		kernel : called as kernel(ninputs, inputs, output, npix, first_pixel, arg) for each strip, where inputs[k] are npix pixels
+			of input k starting at pixel first_pixel (0 based, row major as for quickfits_read_map). The built-in kernels are
+			quickfits_kernel_add, quickfits_kernel_subtract, quickfits_kernel_multiply, quickfits_kernel_divide and quickfits_kernel_scale.
+		void* arg : passed through to the kernel
+		long long strip_rows : rows per strip (0 for a default of about 1 MB per strip)
+		int nthreads : number of threads to use (0 to use one per processor)
+ 
+	RETURN:
+		0 on success. BAD_DIMEN if an input doesn't match the output size.
+*/
+	fitsfile** in_fptr;
+	fitsfile* out_fptr;
+	stream_job job;
+	quickfits_checksum checksum;
+	double* buffers;
+	double nullval=NAN;
+	LONGLONG naxes[2];
+	long long npix, dims[2], strip_pix, first, row;
+	int status, i, k, nstrips, naxis, anynull;
+
+	status = 0;
+	if(ninputs < 1)
+	{
+		return(BAD_DIMEN);
+	}
+
+	dims[0] = fitsi.imsize_ra;
+	dims[1] = fitsi.imsize_dec;
+	if(quickfits_element_count(2, dims, &npix))
+	{
+		quickfits_error("ERROR : quickfits_map_stream --> Image size %lld x %lld is too large\n",fitsi.imsize_ra,fitsi.imsize_dec);
+		return(NUM_OVERFLOW);
+	}
+	if(strip_rows <= 0)
+	{
+		strip_rows = (fitsi.imsize_ra < 131072) ? 131072/fitsi.imsize_ra : 1;
+	}
+	if(strip_rows > fitsi.imsize_dec)
+	{
+		strip_rows = fitsi.imsize_dec;
+	}
+	if(nthreads <= 0)
+	{
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if(nthreads < 1)
+	{
+		nthreads = 1;
+	}
+	strip_pix = strip_rows*fitsi.imsize_ra;
+	if(strip_pix > (long long)(SIZE_MAX/sizeof(double)/(ninputs+1)/nthreads))
+	{
+		return(NUM_OVERFLOW);
+	}
+
+	in_fptr = calloc(ninputs, sizeof(fitsfile*));
+	buffers = malloc((size_t)(ninputs+1)*nthreads*strip_pix*sizeof(double));
+	job.inputs = malloc(ninputs*nthreads*sizeof(double*));
+	job.outputs = malloc(nthreads*sizeof(double*));
+	job.npix = malloc(nthreads*sizeof(long long));
+	job.first_pixel = malloc(nthreads*sizeof(long long));
+	if(in_fptr == NULL || buffers == NULL || job.inputs == NULL || job.outputs == NULL || job.npix == NULL || job.first_pixel == NULL)
+	{
+		quickfits_error("ERROR : quickfits_map_stream --> Error allocating strip buffers\n");
+		free(in_fptr);
+		free(buffers);
+		free(job.inputs);
+		free(job.outputs);
+		free(job.npix);
+		free(job.first_pixel);
+		return(MEMORY_ALLOCATION);
+	}
+	job.ninputs = ninputs;
+	job.kernel = kernel;
+	job.arg = arg;
+	for(i=0;i<nthreads;i++)
+	{
+		for(k=0;k<ninputs;k++)
+		{
+			job.inputs[i*ninputs+k] = &buffers[(i*(ninputs+1)+k)*strip_pix];
+		}
+		job.outputs[i] = &buffers[(i*(ninputs+1)+ninputs)*strip_pix];
+	}
+
+	for(k=0;k<ninputs && status==0;k++)	// open the inputs and check they all match the output
+	{
+		if ( quickfits_open_file(&in_fptr[k],infiles[k], READONLY, &status) )
+		{
+			quickfits_error("ERROR : quickfits_map_stream --> Error opening FITS file %s, error = %d\n",infiles[k],status);
+			in_fptr[k] = NULL;
+			break;
+		}
+		fits_get_img_dim(in_fptr[k], &naxis, &status);
+		fits_get_img_sizell(in_fptr[k], 2, naxes, &status);
+		if(status == 0 && (naxis < 2 || naxes[0] != fitsi.imsize_ra || naxes[1] != fitsi.imsize_dec))
+		{
+			quickfits_error("ERROR : quickfits_map_stream --> %s is not %lld x %lld\n",infiles[k],fitsi.imsize_ra,fitsi.imsize_dec);
+			status = BAD_DIMEN;
+		}
+	}
+
+	out_fptr = NULL;
+	nstrips = 0;
+	quickfits_checksum_init(&checksum);
+	if(status == 0)
+	{
+		quickfits_create_file(&out_fptr,outfile, &status);
+		quickfits_create_map_hdu(out_fptr, fitsi, 1, history, &status);
+		if(status != 0)
+		{
+			quickfits_error("ERROR : quickfits_map_stream --> Error creating %s, error = %d\n",outfile,status);
+		}
+	}
+
+	for(row=0;row<fitsi.imsize_dec && status==0;row+=nstrips*strip_rows)
+	{
+		nstrips = 0;	// read a batch of strips
+		for(i=0;i<nthreads && row+i*strip_rows<fitsi.imsize_dec;i++)
+		{
+			first = (row+i*strip_rows)*fitsi.imsize_ra;
+			job.first_pixel[i] = first;
+			job.npix[i] = (npix-first < strip_pix) ? npix-first : strip_pix;
+			for(k=0;k<ninputs;k++)
+			{
+				fits_read_img(in_fptr[k], TDOUBLE, first+1, job.npix[i], &nullval, (double*) job.inputs[i*ninputs+k], &anynull, &status);
+			}
+			nstrips++;
+		}
+		if(status != 0)
+		{
+			quickfits_error("ERROR : quickfits_map_stream --> Error reading input maps, error = %d\n",status);
+			break;
+		}
+
+		quickfits_parallel_for(nstrips, nthreads, run_kernel, &job);
+
+		for(i=0;i<nstrips;i++)	// write them out in order
+		{
+			fits_write_img(out_fptr, TDOUBLE, job.first_pixel[i]+1, job.npix[i], job.outputs[i], &status);
+			if(quickfits_checksums_enabled())
+			{
+				quickfits_checksum_add_doubles(&checksum, job.outputs[i], job.npix[i]);
+			}
+		}
+		if(status != 0)
+		{
+			quickfits_error("ERROR : quickfits_map_stream --> Error writing %s, error = %d\n",outfile,status);
+		}
+	}
+
+	if(out_fptr != NULL)
+	{
+		if(quickfits_checksums_enabled() && status == 0)
+		{
+			quickfits_write_datasum(out_fptr, quickfits_checksum_finish(&checksum), &status);
+		}
+		quickfits_write_beam_table(out_fptr, outfile, fitsi, &status);
+		quickfits_close_file(out_fptr, &status);
+	}
+	for(k=0;k<ninputs;k++)
+	{
+		if(in_fptr[k] != NULL)
+		{
+			i = 0;
+			quickfits_close_file(in_fptr[k], &i);
+		}
+	}
+
+	free(in_fptr);
+	free(buffers);
+	free(job.inputs);
+	free(job.outputs);
+	free(job.npix);
+	free(job.first_pixel);
+
+	return(status);
+}
+
+void quickfits_kernel_add(int ninputs, const double** inputs, double* output, long long npix, long long first_pixel, void* arg)
+{
+	// output = sum of the inputs
+
+	long long i;
+	int k;
+	(void)first_pixel;
+	(void)arg;
+
+	for(i=0;i<npix;i++)
+	{
+		output[i] = inputs[0][i];
+	}
+	for(k=1;k<ninputs;k++)
+	{
+		for(i=0;i<npix;i++)
+		{
+			output[i] += inputs[k][i];
+		}
+	}
+}
+
+void quickfits_kernel_subtract(int ninputs, const double** inputs, double* output, long long npix, long long first_pixel, void* arg)
+{
+	// output = first input minus the rest (e.g. residual = map - model)
+
+	long long i;
+	int k;
+	(void)first_pixel;
+	(void)arg;
+
+	for(i=0;i<npix;i++)
+	{
+		output[i] = inputs[0][i];
+	}
+	for(k=1;k<ninputs;k++)
+	{
+		for(i=0;i<npix;i++)
+		{
+			output[i] -= inputs[k][i];
+		}
+	}
+}
+
+void quickfits_kernel_multiply(int ninputs, const double** inputs, double* output, long long npix, long long first_pixel, void* arg)
+{
+	// output = product of the inputs
+
+	long long i;
+	int k;
+	(void)first_pixel;
+	(void)arg;
+
+	for(i=0;i<npix;i++)
+	{
+		output[i] = inputs[0][i];
+	}
+	for(k=1;k<ninputs;k++)
+	{
+		for(i=0;i<npix;i++)
+		{
+			output[i] *= inputs[k][i];
+		}
+	}
+}
+
+void quickfits_kernel_divide(int ninputs, const double** inputs, double* output, long long npix, long long first_pixel, void* arg)
+{
+	// output = first input divided by the rest (e.g. primary beam correction). Division by zero gives NaN (blanked).
+
+	long long i;
+	int k;
+	(void)first_pixel;
+	(void)arg;
+
+	for(i=0;i<npix;i++)
+	{
+		output[i] = inputs[0][i];
+	}
+	for(k=1;k<ninputs;k++)
+	{
+		for(i=0;i<npix;i++)
+		{
+			output[i] = (inputs[k][i] != 0.0) ? output[i]/inputs[k][i] : NAN;
+		}
+	}
+}
+
+void quickfits_kernel_scale(int ninputs, const double** inputs, double* output, long long npix, long long first_pixel, void* arg)
+{
+	// output = a*input + b, with arg pointing to double[2] = {a, b}. Only the first input is used.
+
+	const double* ab = (const double*)(arg);
+	long long i;
+	(void)ninputs;
+	(void)first_pixel;
+
+	for(i=0;i<npix;i++)
+	{
+		output[i] = ab[0]*inputs[0][i] + ab[1];
+	}
+}
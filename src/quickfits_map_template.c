@@ -0,0 +1,509 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CARD_LEN 80
+#define TEMPLATE_WRITE_BLOCK (1<<22)	// bytes of pixels converted, then written, at a time
+
+enum{	// cards patched by quickfits_write_map_template
+	K_NAXIS1, K_NAXIS2, K_OBJECT, K_OBSERVER, K_TELESCOP, K_EQUINOX, K_DATE_OBS, K_OBSRA, K_OBSDEC,
+	K_CRVAL1, K_CDELT1, K_CRPIX1, K_CROTA1, K_CRVAL2, K_CDELT2, K_CRPIX2, K_CROTA2, K_CRVAL3, K_CDELT3, K_CRVAL4,
+	K_DATE, K_DATASUM, K_CHECKSUM, K_BEAM, K_NITER, K_NKEYS
+};
+
+static const char* key_prefix[K_NKEYS] = {
+	"NAXIS1  ", "NAXIS2  ", "OBJECT  ", "OBSERVER", "TELESCOP", "EQUINOX ", "DATE-OBS", "OBSRA   ", "OBSDEC  ",
+	"CRVAL1  ", "CDELT1  ", "CRPIX1  ", "CROTA1  ", "CRVAL2  ", "CDELT2  ", "CRPIX2  ", "CROTA2  ", "CRVAL3  ", "CDELT3  ", "CRVAL4  ",
+	"DATE    ", "DATASUM ", "CHECKSUM", "HISTORY AIPS   CLEAN BMAJ=", "HISTORY AIPS   CLEAN NITER="
+};
+
+struct quickfits_map_template_tag{
+	fitsinfo_map fitsi;	// values the cards hold now
+	char* history;
+	bool checksums;	// DATASUM and CHECKSUM cards are present
+	char* header;	// primary header, whole blocks of blank padded cards
+	long long header_bytes;
+	int card[K_NKEYS];	// index of each patched card in header (-1 if absent)
+	char* beam_header;	// AIPS CG extension header (NULL if no beam)
+	long long beam_header_bytes;
+	int beam_datasum;
+	int beam_checksum;
+};
+
+static int read_header(fitsfile* fptr, char** header, long long* header_bytes, int* status)
+{
+	// copy the cards of the current HDU, as cfitsio formatted them, into whole blank padded blocks ending with END
+
+	char card[FLEN_CARD];
+	int nkeys, nmore, i, len;
+
+	fits_get_hdrspace(fptr, &nkeys, &nmore, status);
+	if(*status != 0)
+	{
+		return(*status);
+	}
+	*header_bytes = ((nkeys+1)*CARD_LEN + QUICKFITS_BLOCK_SIZE - 1)/QUICKFITS_BLOCK_SIZE*QUICKFITS_BLOCK_SIZE;
+	*header = malloc(*header_bytes);
+	if(*header == NULL)
+	{
+		*status = MEMORY_ALLOCATION;
+		return(*status);
+	}
+	memset(*header, ' ', *header_bytes);
+	for(i=0;i<nkeys && *status==0;i++)
+	{
+		fits_read_record(fptr, i+1, card, status);
+		len = strlen(card);
+		memcpy(&(*header)[i*CARD_LEN], card, (len < CARD_LEN) ? len : CARD_LEN);
+	}
+	memcpy(&(*header)[nkeys*CARD_LEN], "END", 3);
+	return(*status);
+}
+
+static int find_card(const char* header, long long header_bytes, const char* prefix)
+{
+	int i, len;
+
+	len = strlen(prefix);
+	for(i=0;i<header_bytes/CARD_LEN;i++)
+	{
+		if(!memcmp(&header[i*CARD_LEN], prefix, len))
+		{
+			return(i);
+		}
+	}
+	return(-1);
+}
+
+static void set_card(char* header, int card, const char* keyword, const char* value, const char* comment, int* status)
+{
+	// replace a card with one formatted as fits_update_key would (value already formatted by ffd2e or ffs2c)
+
+	char newcard[FLEN_CARD];
+	int len;
+
+	if(card < 0 || *status != 0)
+	{
+		return;
+	}
+	fits_make_key(keyword, (char*) value, comment, newcard, status);
+	len = strlen(newcard);
+	memset(&header[card*CARD_LEN], ' ', CARD_LEN);
+	memcpy(&header[card*CARD_LEN], newcard, (len < CARD_LEN) ? len : CARD_LEN);
+}
+
+static void patch_double(char* header, const int* cards, int k, const char* keyword, double old_value, double value, int* status)
+{
+	char v[FLEN_VALUE];
+
+	if(old_value != value)
+	{
+		ffd2e(value, -15, v, status);	// as fits_update_key TDOUBLE
+		set_card(header, cards[k], keyword, v, "", status);
+	}
+}
+
+static void patch_string(char* header, const int* cards, int k, const char* keyword, const char* old_value, const char* value, int* status)
+{
+	char v[FLEN_VALUE];
+
+	if(strcmp(old_value, value))
+	{
+		ffs2c(value, v, status);
+		set_card(header, cards[k], keyword, v, "", status);
+	}
+}
+
+static void patch_history(char* header, int card, const char* text)
+{
+	int len;
+
+	if(card >= 0)
+	{
+		len = strlen(text);
+		memset(&header[card*CARD_LEN+8], ' ', CARD_LEN-8);
+		memcpy(&header[card*CARD_LEN+8], text, (len < CARD_LEN-8) ? len : CARD_LEN-8);
+	}
+}
+
+static void set_checksums(char* header, long long header_bytes, int datasum_card, int checksum_card, unsigned long datasum, const char* date, int* status)
+{
+	// DATASUM, then CHECKSUM so that the HDU (header and data) sums to -0, as fits_write_chksum does
+
+	char value[FLEN_VALUE];
+	char comment[FLEN_COMMENT];
+	char ascii[17];
+	unsigned long sum;
+
+	snprintf(comment, sizeof(comment), "data unit checksum updated %s", date);
+	sprintf(value, "'%lu'", datasum);
+	set_card(header, datasum_card, "DATASUM", value, comment, status);
+	snprintf(comment, sizeof(comment), "HDU checksum updated %s", date);
+	set_card(header, checksum_card, "CHECKSUM", "'0000000000000000'", comment, status);
+	if(*status == 0 && checksum_card >= 0)
+	{
+		sum = quickfits_checksum_merge(quickfits_checksum_blocks((unsigned char*) header, header_bytes/QUICKFITS_BLOCK_SIZE, 0), datasum);
+		fits_encode_chksum(sum, 1, ascii);	// complemented
+		memcpy(&header[checksum_card*CARD_LEN+11], ascii, 16);	// inside the quotes
+	}
+}
+
+static int write_all(int fd, const void* bytes, long long nbytes)
+{
+	const unsigned char* p = (const unsigned char*)(bytes);
+	ssize_t nwritten;
+
+	while(nbytes > 0)
+	{
+		nwritten = write(fd, p, nbytes);
+		if(nwritten <= 0)
+		{
+			return(WRITE_ERROR);
+		}
+		p += nwritten;
+		nbytes -= nwritten;
+	}
+	return(0);
+}
+
+static void to_big_endian(const double* values, long long n, unsigned char* bytes)
+{
+	uint64_t word;
+	long long i;
+
+	for(i=0;i<n;i++)
+	{
+		memcpy(&word, &values[i], 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		word = __builtin_bswap64(word);
+#endif
+		memcpy(&bytes[8*i], &word, 8);
+	}
+}
+
+static int map_template_build(quickfits_map_template** tmpl, fitsinfo_map fitsi, char* history)
+{
+	fitsfile *fptr;
+	quickfits_map_template* t;
+	char comment[]="data unit checksum";
+	char datasum[]="0";
+	char checksum[]="0000000000000000";
+	char checksum_comment[]="HDU checksum updated";
+	char memname[]="mem://";
+	int status, k;
+
+	status = 0;
+	*tmpl = NULL;
+	t = calloc(1, sizeof(quickfits_map_template));
+	if(t == NULL)
+	{
+		return(MEMORY_ALLOCATION);
+	}
+	t[0].fitsi = fitsi;
+	t[0].fitsi.imsize_ra = 1;	// the cards are made for a single pixel map, and patched for each write
+	t[0].fitsi.imsize_dec = 1;
+	t[0].history = (history != NULL) ? strdup(history) : NULL;
+	t[0].checksums = quickfits_checksums_enabled();
+	t[0].beam_datasum = -1;
+	t[0].beam_checksum = -1;
+
+	if(fits_create_file(&fptr, memname, &status))
+	{
+		quickfits_error("ERROR : quickfits_map_template_build --> Error creating memory file, error = %d\n",status);
+		free(t[0].history);
+		free(t);
+		return(status);
+	}
+	quickfits_create_map_hdu(fptr, t[0].fitsi, 1, t[0].history, &status);	// the same cards as quickfits_write_map
+	if(t[0].checksums)
+	{
+		fits_update_key(fptr, TSTRING, "DATASUM", datasum, comment, &status);
+		fits_update_key(fptr, TSTRING, "CHECKSUM", checksum, checksum_comment, &status);
+	}
+	read_header(fptr, &t[0].header, &t[0].header_bytes, &status);
+	if(fitsi.have_beam)
+	{
+		quickfits_write_beam_table(fptr, memname, t[0].fitsi, &status);
+		read_header(fptr, &t[0].beam_header, &t[0].beam_header_bytes, &status);
+	}
+	fits_close_file(fptr, &status);
+
+	if(status == 0)
+	{
+		for(k=0;k<K_NKEYS;k++)
+		{
+			t[0].card[k] = find_card(t[0].header, t[0].header_bytes, key_prefix[k]);
+		}
+		if(t[0].beam_header != NULL && t[0].checksums)
+		{
+			t[0].beam_datasum = find_card(t[0].beam_header, t[0].beam_header_bytes, key_prefix[K_DATASUM]);
+			t[0].beam_checksum = find_card(t[0].beam_header, t[0].beam_header_bytes, key_prefix[K_CHECKSUM]);
+		}
+		*tmpl = t;
+	}
+	else
+	{
+		quickfits_error("ERROR : quickfits_map_template_build --> Error formatting header, error = %d\n",status);
+		quickfits_map_template_free(t);
+	}
+
+	return(status);
+}
+
+int quickfits_map_template_build(quickfits_map_template** tmpl, fitsinfo_map fitsi, char* history)
+{
+/*
+	Format the header and beam table of a map once, as quickfits_write_map writes them, for quickfits_write_map_template
+	to reuse for many maps. Whether checksums are written (quickfits_set_checksums) is fixed when the template is built.
+ 
+	INPUTS:
+		fitsi : map information, as for quickfits_write_map. have_beam (and niter > 0 with a beam) fix the layout;
+			the other values are just the starting point for patching.
+		history : history comments, the same for every map written with the template
+	OUTPUTS:
+		tmpl : the template, free with quickfits_map_template_free. It isn't changed by writes, so one template can be
+			used by several threads at once.
+ 
+	RETURN:
+		0 on success
+*/
+	long long start;
+	int status;
+
+	start = quickfits_trace_start();
+	status = map_template_build(tmpl, fitsi, history);
+	quickfits_trace_api("quickfits_map_template_build", start);
+
+	return(status);
+}
+
+void quickfits_map_template_free(quickfits_map_template* tmpl)
+{
+	if(tmpl != NULL)
+	{
+		free(tmpl[0].history);
+		free(tmpl[0].header);
+		free(tmpl[0].beam_header);
+		free(tmpl);
+	}
+}
+
+static int patch_header(const quickfits_map_template* t, fitsinfo_map fitsi, char* header, const char* date)
+{
+	// patch the cards whose values differ from the template's, and the creation date
+
+	const int* c = t[0].card;
+	const fitsinfo_map* old = &t[0].fitsi;
+	char v[FLEN_VALUE];
+	char text[FLEN_CARD];
+	int status;
+
+	status = 0;
+	if(fitsi.imsize_ra != old[0].imsize_ra)
+	{
+		sprintf(v, "%lld", fitsi.imsize_ra);
+		set_card(header, c[K_NAXIS1], "NAXIS1", v, "length of data axis 1", &status);
+	}
+	if(fitsi.imsize_dec != old[0].imsize_dec)
+	{
+		sprintf(v, "%lld", fitsi.imsize_dec);
+		set_card(header, c[K_NAXIS2], "NAXIS2", v, "length of data axis 2", &status);
+	}
+
+	patch_string(header, c, K_OBJECT, "OBJECT", old[0].object, fitsi.object, &status);
+	patch_string(header, c, K_OBSERVER, "OBSERVER", old[0].observer, fitsi.observer, &status);
+	patch_string(header, c, K_TELESCOP, "TELESCOP", old[0].telescope, fitsi.telescope, &status);
+	patch_double(header, c, K_EQUINOX, "EQUINOX", old[0].equinox, fitsi.equinox, &status);
+	patch_string(header, c, K_DATE_OBS, "DATE-OBS", old[0].date_obs, fitsi.date_obs, &status);
+	patch_double(header, c, K_OBSRA, "OBSRA", old[0].ra, fitsi.ra, &status);
+	patch_double(header, c, K_OBSDEC, "OBSDEC", old[0].dec, fitsi.dec, &status);
+
+	patch_double(header, c, K_CRVAL1, "CRVAL1", old[0].ra, fitsi.ra, &status);
+	patch_double(header, c, K_CDELT1, "CDELT1", -old[0].cell_ra, -fitsi.cell_ra, &status);
+	patch_double(header, c, K_CRPIX1, "CRPIX1", old[0].centre_shift[0], fitsi.centre_shift[0], &status);
+	patch_double(header, c, K_CROTA1, "CROTA1", old[0].rotations[0], fitsi.rotations[0], &status);
+	patch_double(header, c, K_CRVAL2, "CRVAL2", old[0].dec, fitsi.dec, &status);
+	patch_double(header, c, K_CDELT2, "CDELT2", old[0].cell_dec, fitsi.cell_dec, &status);
+	patch_double(header, c, K_CRPIX2, "CRPIX2", old[0].centre_shift[1], fitsi.centre_shift[1], &status);
+	patch_double(header, c, K_CROTA2, "CROTA2", old[0].rotations[1], fitsi.rotations[1], &status);
+	patch_double(header, c, K_CRVAL3, "CRVAL3", old[0].freq, fitsi.freq, &status);
+	patch_double(header, c, K_CDELT3, "CDELT3", old[0].freq_delta, fitsi.freq_delta, &status);
+	patch_double(header, c, K_CRVAL4, "CRVAL4", old[0].stokes, fitsi.stokes, &status);
+
+	ffs2c(date, v, &status);
+	set_card(header, c[K_DATE], "DATE", v, "file creation date (YYYY-MM-DDThh:mm:ss UT)", &status);
+
+	if(fitsi.have_beam && (fitsi.bmaj != old[0].bmaj || fitsi.bmin != old[0].bmin || fitsi.bpa != old[0].bpa))
+	{
+		sprintf(text,"AIPS   CLEAN BMAJ=  %.8lf BMIN=  %.8lf BPA=   %.8lf" , fitsi.bmaj , fitsi.bmin , fitsi.bpa );	// as quickfits_create_map_hdu
+		patch_history(header, c[K_BEAM], text);
+	}
+	if(fitsi.have_beam && fitsi.niter > 0 && fitsi.niter != old[0].niter)
+	{
+		sprintf(text,"AIPS   CLEAN NITER=     %d PRODUCT=1",fitsi.niter);
+		patch_history(header, c[K_NITER], text);
+	}
+
+	return(status);
+}
+
+static int write_map_template(const char* filename, double* array, fitsinfo_map fitsi, const quickfits_map_template* t)
+{
+	char* header;
+	char* beam_header;
+	unsigned char* block;
+	double beam_row[4];
+	char date[FLEN_VALUE];
+	struct tm utc;
+	time_t now;
+	long long dims[2], nelements, i, n, data_bytes;
+	long long start;
+	unsigned long datasum;
+	int status, fd;
+
+	dims[0] = fitsi.imsize_ra;
+	dims[1] = fitsi.imsize_dec;
+	if(quickfits_element_count(2, dims, &nelements))
+	{
+		quickfits_error("ERROR : quickfits_write_map_template -->  Image size %lld x %lld is too large\n",fitsi.imsize_ra,fitsi.imsize_dec);
+		return(NUM_OVERFLOW);
+	}
+
+	now = time(NULL);
+	gmtime_r(&now, &utc);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &utc);
+
+	header = malloc(t[0].header_bytes);
+	beam_header = (t[0].beam_header != NULL) ? malloc(t[0].beam_header_bytes + QUICKFITS_BLOCK_SIZE) : NULL;	// header and its one row
+	block = malloc(TEMPLATE_WRITE_BLOCK);
+	if(header == NULL || block == NULL || (t[0].beam_header != NULL && beam_header == NULL))
+	{
+		free(header);
+		free(beam_header);
+		free(block);
+		return(MEMORY_ALLOCATION);
+	}
+
+	memcpy(header, t[0].header, t[0].header_bytes);
+	status = patch_header(t, fitsi, header, date);
+	if(t[0].checksums)	// summed from the array, as quickfits_write_map does
+	{
+		datasum = quickfits_checksum_doubles(array, nelements, 0);
+		set_checksums(header, t[0].header_bytes, t[0].card[K_DATASUM], t[0].card[K_CHECKSUM], datasum, date, &status);
+	}
+	if(beam_header != NULL)
+	{
+		memcpy(beam_header, t[0].beam_header, t[0].beam_header_bytes);
+		memset(beam_header + t[0].beam_header_bytes, 0, QUICKFITS_BLOCK_SIZE);
+		beam_row[0] = fitsi.freq;
+		beam_row[1] = fitsi.bmaj;
+		beam_row[2] = fitsi.bmin;
+		beam_row[3] = fitsi.bpa;
+		to_big_endian(beam_row, 4, (unsigned char*) beam_header + t[0].beam_header_bytes);
+		if(t[0].checksums)
+		{
+			datasum = quickfits_checksum_blocks((unsigned char*) beam_header + t[0].beam_header_bytes, 1, 0);
+			set_checksums(beam_header, t[0].beam_header_bytes, t[0].beam_datasum, t[0].beam_checksum, datasum, date, &status);
+		}
+	}
+	if(status != 0)
+	{
+		quickfits_error("ERROR : quickfits_write_map_template --> Error formatting header for %s, error = %d\n",filename,status);
+	}
+
+	start = quickfits_trace_start();
+	fd = -1;
+	if(status == 0)
+	{
+		fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if(fd < 0)
+		{
+			quickfits_error("ERROR : quickfits_write_map_template --> Error creating %s\n",filename);
+			status = FILE_NOT_CREATED;
+		}
+	}
+	if(status == 0)
+	{
+		status = write_all(fd, header, t[0].header_bytes);	// the whole header in one write
+	}
+	for(i=0;i<nelements && status==0;i+=n)
+	{
+		n = (nelements-i < TEMPLATE_WRITE_BLOCK/8) ? nelements-i : TEMPLATE_WRITE_BLOCK/8;
+		to_big_endian(&array[i], n, block);
+		status = write_all(fd, block, 8*n);
+	}
+	data_bytes = (8*nelements + QUICKFITS_BLOCK_SIZE - 1)/QUICKFITS_BLOCK_SIZE*QUICKFITS_BLOCK_SIZE;
+	if(status == 0 && data_bytes > 8*nelements)	// zero fill to the end of the block
+	{
+		memset(block, 0, data_bytes - 8*nelements);
+		status = write_all(fd, block, data_bytes - 8*nelements);
+	}
+	if(status == 0 && beam_header != NULL)
+	{
+		status = write_all(fd, beam_header, t[0].beam_header_bytes + QUICKFITS_BLOCK_SIZE);
+	}
+	if(fd >= 0 && close(fd) != 0 && status == 0)
+	{
+		status = WRITE_ERROR;
+	}
+	if(fd >= 0 && status != 0)
+	{
+		quickfits_error("ERROR : quickfits_write_map_template --> Error writing %s, error = %d\n",filename,status);
+	}
+	quickfits_trace_phase(QUICKFITS_PHASE_WRITE, start);
+	quickfits_count_io(0, t[0].header_bytes + data_bytes + ((beam_header != NULL) ? t[0].beam_header_bytes + QUICKFITS_BLOCK_SIZE : 0), 0, 0);
+
+	free(header);
+	free(beam_header);
+	free(block);
+	return(status);
+}
+
+int quickfits_write_map_template(const char* filename, double* array, fitsinfo_map fitsi, const quickfits_map_template* tmpl)
+{
+/*
+	Write a map with a header made by quickfits_map_template_build. Only the cards whose values differ from the
+	template's are formatted again (and DATE, DATASUM and CHECKSUM), then the header, pixels and beam table are written
+	with plain writes. The file is the same as quickfits_write_map would write.
+	Memory files, maps whose layout differs from the template's (have_beam, niter > 0) and writes after
+	quickfits_set_checksums has been changed go through quickfits_write_map.
+ 
+	INPUTS:
+		filename : name of file to write out (replaced if it exists)
+		array : image to write out
+		fitsi : map information, as for quickfits_write_map
+		tmpl : the template
+ 
+	RETURN:
+		0 if no errors occur.
+*/
+	long long start;
+	int status;
+
+	if(quickfits_memfile_lookup(filename) != NULL || fitsi.have_beam != tmpl[0].fitsi.have_beam || (fitsi.have_beam && (fitsi.niter > 0) != (tmpl[0].fitsi.niter > 0)) || quickfits_checksums_enabled() != tmpl[0].checksums)
+	{
+		return(quickfits_write_map(filename, array, fitsi, tmpl[0].history));
+	}
+
+	start = quickfits_trace_start();
+	status = write_map_template(filename, array, fitsi, tmpl);
+	quickfits_trace_api("quickfits_write_map_template", start);
+
+	return(status);
+}
@@ -0,0 +1,217 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+
+int quickfits_map_writer_open(quickfits_map_writer* writer, const char* filename, fitsinfo_map fitsi, long long nplanes, char* history)
+{
+/*
+	Start writing a map or cube a piece at a time. The header is written now, the pixels are added with
+	quickfits_map_writer_append as they are produced and the beam and clean component tables are written by
+	quickfits_map_writer_close, so only the piece being written needs to be in memory.
+ 
+	INPUTS:
+		filename : name of file to write out (replaced if it exists)
+		fitsi : map information, as for quickfits_write_map. freq and freq_delta describe the first plane and the channel spacing.
+		nplanes : number of planes (channels), or 0 if not known in advance - the cube then grows as planes are appended
+		history : history comments
+	OUTPUTS:
+		writer : the open writer
+ 
+	RETURN:
+		0 if no errors occur.
+*/
+	int status;
+	long long dims[2];
+
+	status = 0;
+	memset(writer, 0, sizeof(quickfits_map_writer));
+
+	dims[0] = fitsi.imsize_ra;
+	dims[1] = fitsi.imsize_dec;
+	if(quickfits_element_count(2, dims, &writer[0].plane_pixels) || nplanes < 0)
+	{
+		quickfits_error("ERROR : quickfits_map_writer_open --> Image size %lld x %lld is too large\n",fitsi.imsize_ra,fitsi.imsize_dec);
+		return(NUM_OVERFLOW);
+	}
+	if(strlen(filename) >= FLEN_FILENAME)
+	{
+		return(FILE_NOT_CREATED);
+	}
+
+	writer[0].fitsi = fitsi;
+	writer[0].nplanes = nplanes;
+	writer[0].planes_allocated = (nplanes > 0) ? nplanes : 1;
+	strcpy(writer[0].filename, filename);
+	quickfits_checksum_init(&writer[0].checksum);
+
+	quickfits_create_file(&writer[0].fptr, filename, &status);
+	quickfits_create_map_hdu(writer[0].fptr, fitsi, writer[0].planes_allocated, history, &status);
+	if(status != 0)
+	{
+		quickfits_error("ERROR : quickfits_map_writer_open --> Error creating %s, error = %d\n",filename,status);
+		if(writer[0].fptr != NULL)
+		{
+			quickfits_close_file(writer[0].fptr, &status);
+			writer[0].fptr = NULL;
+		}
+	}
+
+	return(status);
+}
+
+int quickfits_map_writer_append(quickfits_map_writer* writer, const double* pixels, long long npix)
+{
+/*
+	Append pixels to a map or cube opened with quickfits_map_writer_open, in the order quickfits_write_map uses.
+	Any number of pixels can be written at a time - a block of rows, a plane or several planes.
+ 
+	INPUTS:
+		pixels : npix pixel values following on from the last ones written
+ 
+	RETURN:
+		0 if no errors occur, BAD_ELEM_NUM if this would write past the number of planes given to quickfits_map_writer_open.
+*/
+	LONGLONG naxes[4];
+	long long planes_needed;
+	int status;
+
+	status = 0;
+	if(writer[0].fptr == NULL)
+	{
+		return(FILE_NOT_OPENED);
+	}
+	if(npix <= 0)
+	{
+		return(0);
+	}
+
+	planes_needed = (writer[0].pixels_written + npix + writer[0].plane_pixels - 1)/writer[0].plane_pixels;
+	if(planes_needed > writer[0].planes_allocated)
+	{
+		if(writer[0].nplanes > 0)
+		{
+			quickfits_error("ERROR : quickfits_map_writer_append --> %s only has %lld planes\n",writer[0].filename,writer[0].nplanes);
+			return(BAD_ELEM_NUM);
+		}
+		naxes[0] = writer[0].fitsi.imsize_ra;	// grow the cube - the image is the last HDU so far, so this just extends the file
+		naxes[1] = writer[0].fitsi.imsize_dec;
+		naxes[2] = planes_needed;
+		naxes[3] = 1;
+		if(fits_resize_imgll(writer[0].fptr, DOUBLE_IMG, 4, naxes, &status))
+		{
+			quickfits_error("ERROR : quickfits_map_writer_append --> Error extending %s to %lld planes, error = %d\n",writer[0].filename,planes_needed,status);
+			return(status);
+		}
+		writer[0].planes_allocated = planes_needed;
+	}
+
+	fits_write_img(writer[0].fptr, TDOUBLE, writer[0].pixels_written+1, npix, (double*) pixels, &status);
+	if(status != 0)
+	{
+		quickfits_error("ERROR : quickfits_map_writer_append --> Error writing %s, error = %d\n",writer[0].filename,status);
+		return(status);
+	}
+	writer[0].pixels_written += npix;
+	if(quickfits_checksums_enabled())
+	{
+		quickfits_checksum_add_doubles(&writer[0].checksum, pixels, npix);
+	}
+
+	return(status);
+}
+
+int quickfits_map_writer_close(quickfits_map_writer* writer, long long ncc, const double* cc_xarray, const double* cc_yarray, const double* cc_varray)
+{
+/*
+	Finish a map or cube started with quickfits_map_writer_open: blank (NaN) any pixels not written, then write the
+	AIPS CG beam table (if fitsi.have_beam) and an AIPS CC clean component table, and close the file.
+ 
+	INPUTS:
+		ncc : number of clean components (0 for no CC table)
+		cc_xarray, cc_yarray : clean component positions in degrees, as read by quickfits_read_map
+		cc_varray : clean component fluxes
+		The CC table is given EXTVER = fitsi.cc_table_version (1 if that is not positive).
+ 
+	RETURN:
+		0 if no errors occur.
+*/
+	char flux_name[] = "FLUX";
+	char x_name[] = "DELTAX";
+	char y_name[] = "DELTAY";
+	char flux_units[] = "JY";
+	char pos_units[] = "DEGREES";
+	char data_type[] = "1E";
+	char* cc_names[3] = {flux_name , x_name , y_name};
+	char* cc_units[3] = {flux_units , pos_units , pos_units};
+	char* cc_datatype[3] = {data_type , data_type , data_type};
+	char tbl_name[] = "AIPS CC ";
+	char comment[] = "";
+	unsigned char nan_bytes[QUICKFITS_BLOCK_SIZE];
+	long long nfill, i, n;
+	int status, extver;
+
+	status = 0;
+	if(writer[0].fptr == NULL)
+	{
+		return(FILE_NOT_OPENED);
+	}
+
+	nfill = writer[0].planes_allocated*writer[0].plane_pixels - writer[0].pixels_written;
+	if(nfill > 0)
+	{
+		fits_write_null_img(writer[0].fptr, writer[0].pixels_written+1, nfill, &status);	// NaN for floating point images
+		if(quickfits_checksums_enabled())
+		{
+			memset(nan_bytes, 0xFF, QUICKFITS_BLOCK_SIZE);	// cfitsio's null for floating point images has every bit set
+			for(i=0;i<8*nfill;i+=n)
+			{
+				n = (8*nfill-i < QUICKFITS_BLOCK_SIZE) ? 8*nfill-i : QUICKFITS_BLOCK_SIZE;
+				quickfits_checksum_add(&writer[0].checksum, nan_bytes, n);
+			}
+		}
+	}
+	if(quickfits_checksums_enabled())	// the primary HDU is now complete
+	{
+		quickfits_write_datasum(writer[0].fptr, quickfits_checksum_finish(&writer[0].checksum), &status);
+	}
+
+	quickfits_write_beam_table(writer[0].fptr, writer[0].filename, writer[0].fitsi, &status);
+
+	if(ncc > 0 && cc_xarray != NULL && cc_yarray != NULL && cc_varray != NULL)
+	{
+		extver = (writer[0].fitsi.cc_table_version > 0) ? writer[0].fitsi.cc_table_version : 1;
+		fits_create_tbl(writer[0].fptr , BINARY_TBL , ncc , 3 , cc_names , cc_datatype , cc_units , tbl_name , &status);
+		fits_update_key(writer[0].fptr, TINT, "EXTVER", &extver, comment, &status);
+		fits_write_col(writer[0].fptr, TDOUBLE , 1 , 1 , 1 , ncc , (double*) cc_varray , &status);
+		fits_write_col(writer[0].fptr, TDOUBLE , 2 , 1 , 1 , ncc , (double*) cc_xarray , &status);
+		fits_write_col(writer[0].fptr, TDOUBLE , 3 , 1 , 1 , ncc , (double*) cc_yarray , &status);
+		if(quickfits_checksums_enabled())
+		{
+			fits_write_chksum(writer[0].fptr, &status);
+		}
+		if(status != 0)
+		{
+			quickfits_error("ERROR : quickfits_map_writer_close --> Error writing clean components to %s, error = %d\n",writer[0].filename,status);
+		}
+	}
+
+	quickfits_close_file(writer[0].fptr, &status);
+	writer[0].fptr = NULL;
+	if(status != 0)
+	{
+		quickfits_error("ERROR : quickfits_map_writer_close --> Error closing %s, error = %d\n",writer[0].filename,status);
+	}
+
+	return(status);
+}
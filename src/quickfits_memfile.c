@@ -0,0 +1,503 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define MEMFILE_DELTA (1024*QUICKFITS_BLOCK_SIZE)	// minimum amount by which cfitsio grows a memory file
+
+typedef struct memfile_name_tag{	// a registered memory file
+	char* name;
+	quickfits_memfile* mem;
+	struct memfile_name_tag* next;
+}memfile_name;
+
+typedef struct memfile_handle_tag{	// a memory file currently open in cfitsio
+	fitsfile* fptr;
+	quickfits_memfile* mem;
+	size_t memsize;	// cfitsio keeps the size of the buffer here while the file is open
+	void* buffer;	// buffer owned by the handle and freed on closing (NULL for registered files)
+	bool writable;
+	struct memfile_handle_tag* next;
+}memfile_handle;
+
+static memfile_name* names = NULL;
+static memfile_handle* handles = NULL;
+static pthread_mutex_t memfile_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int quickfits_memfile_register(const char* name, quickfits_memfile* mem)
+{
+/*
+	Make a caller-owned memory buffer available to every quickfits function as QUICKFITS_MEMFILE_PREFIX name,
+	e.g. "qfmem://stage1". Registering an existing name replaces its buffer.
+
+	INPUTS:
+		name : name of the memory file (without the prefix)
+		mem : buffer, size of the FITS file in the buffer and a realloc-like function to grow it (NULL if the buffer is fixed).
+			A new file can start from buffer = NULL, size = 0. The structure must stay valid until it is unregistered.
+	RETURN:
+		0 on success, MEMORY_ALLOCATION on failure
+*/
+	memfile_name* entry;
+
+	pthread_mutex_lock(&memfile_lock);
+	for(entry=names;entry!=NULL;entry=entry->next)
+	{
+		if(!strcmp(entry->name,name))
+		{
+			entry->mem = mem;
+			pthread_mutex_unlock(&memfile_lock);
+			return(0);
+		}
+	}
+
+	entry = malloc(sizeof(memfile_name));
+	if(entry != NULL)
+	{
+		entry->name = strdup(name);
+	}
+	if(entry == NULL || entry->name == NULL)
+	{
+		pthread_mutex_unlock(&memfile_lock);
+		free(entry);
+		quickfits_error("ERROR : quickfits_memfile_register --> Unable to register memory file %s\n",name);
+		return(MEMORY_ALLOCATION);
+	}
+	entry->mem = mem;
+	entry->next = names;
+	names = entry;
+	pthread_mutex_unlock(&memfile_lock);
+
+	return(0);
+}
+
+int quickfits_memfile_unregister(const char* name)
+{
+/*
+	Forget a memory file. The buffer itself belongs to the caller and is not freed.
+
+	RETURN:
+		0 on success, FILE_NOT_OPENED if name was not registered
+*/
+	memfile_name** link;
+	memfile_name* entry;
+
+	pthread_mutex_lock(&memfile_lock);
+	for(link=&names;*link!=NULL;link=&(*link)->next)
+	{
+		if(!strcmp((*link)->name,name))
+		{
+			entry = *link;
+			*link = entry->next;
+			pthread_mutex_unlock(&memfile_lock);
+			free(entry->name);
+			free(entry);
+			return(0);
+		}
+	}
+	pthread_mutex_unlock(&memfile_lock);
+
+	return(FILE_NOT_OPENED);
+}
+
+quickfits_memfile* quickfits_memfile_lookup(const char* filename)
+{
+/*
+	Find the memory file a filename refers to.
+
+	RETURN:
+		the registered buffer, or NULL if filename is not QUICKFITS_MEMFILE_PREFIX followed by a registered name
+*/
+	memfile_name* entry;
+	quickfits_memfile* mem;
+	size_t prefix_len = strlen(QUICKFITS_MEMFILE_PREFIX);
+
+	if(strncmp(filename,QUICKFITS_MEMFILE_PREFIX,prefix_len))
+	{
+		return(NULL);
+	}
+
+	mem = NULL;
+	pthread_mutex_lock(&memfile_lock);
+	for(entry=names;entry!=NULL;entry=entry->next)
+	{
+		if(!strcmp(entry->name,filename+prefix_len))
+		{
+			mem = entry->mem;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&memfile_lock);
+
+	return(mem);
+}
+
+static memfile_handle* new_handle(quickfits_memfile* mem, bool writable)
+{
+	memfile_handle* handle;
+
+	handle = malloc(sizeof(memfile_handle));
+	if(handle != NULL)
+	{
+		handle->fptr = NULL;
+		handle->mem = mem;
+		handle->memsize = (mem != NULL) ? mem[0].size : 0;
+		handle->buffer = NULL;
+		handle->writable = writable;
+	}
+	return(handle);
+}
+
+static void add_handle(memfile_handle* handle)
+{
+	pthread_mutex_lock(&memfile_lock);
+	handle->next = handles;
+	handles = handle;
+	pthread_mutex_unlock(&memfile_lock);
+}
+
+static memfile_handle* remove_handle(fitsfile* fptr)
+{
+	memfile_handle** link;
+	memfile_handle* handle;
+
+	handle = NULL;
+	pthread_mutex_lock(&memfile_lock);
+	for(link=&handles;*link!=NULL;link=&(*link)->next)
+	{
+		if((*link)->fptr == fptr)
+		{
+			handle = *link;
+			*link = handle->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&memfile_lock);
+
+	return(handle);
+}
+
+static int open_file(fitsfile** fptr, const char* filename, int iomode, int* status)
+{
+	quickfits_memfile* mem;
+	memfile_handle* handle;
+	struct stat st;
+	size_t len;
+
+	if(*status)
+	{
+		return(*status);
+	}
+
+	mem = quickfits_memfile_lookup(filename);
+	if(mem == NULL)
+	{
+		len = strlen(filename);
+		if(iomode == READONLY && len > 3 && !strcmp(filename+len-3,".gz") && stat(filename,&st) == 0 && S_ISREG(st.st_mode))
+		{
+			return(quickfits_open_gz_file(fptr,filename,status));	// decompress in parallel rather than in cfitsio
+		}
+		return(fits_open_file(fptr,filename,iomode,status));
+	}
+
+	handle = new_handle(mem, iomode==READWRITE);
+	if(handle == NULL)
+	{
+		*status = MEMORY_ALLOCATION;
+		return(*status);
+	}
+
+	if(fits_open_memfile(fptr,filename,iomode,&mem[0].buffer,&handle->memsize,MEMFILE_DELTA,mem[0].mem_realloc,status))
+	{
+		free(handle);
+		return(*status);
+	}
+
+	handle->fptr = *fptr;
+	add_handle(handle);
+
+	return(*status);
+}
+
+int quickfits_open_owned_memfile(fitsfile** fptr, const char* filename, void* buffer, size_t size, int* status)
+{
+/*
+	Open a FITS file held in a malloc'd buffer read-only with cfitsio's memory driver, handing the buffer over
+	to be freed by quickfits_close_file (or here, on failure). Used for files decompressed into memory.
+
+	INPUTS:
+		filename : name of the file, for messages
+		buffer, size : the FITS file
+	OUTPUTS:
+		fptr : the open file
+	RETURN:
+		cfitsio status, as for fits_open_memfile
+*/
+	memfile_handle* handle;
+
+	if(*status)
+	{
+		free(buffer);
+		return(*status);
+	}
+
+	handle = new_handle(NULL, false);
+	if(handle == NULL)
+	{
+		free(buffer);
+		*status = MEMORY_ALLOCATION;
+		return(*status);
+	}
+	handle->buffer = buffer;
+	handle->memsize = size;
+
+	if(fits_open_memfile(fptr,filename,READONLY,&handle->buffer,&handle->memsize,0,NULL,status))
+	{
+		free(handle->buffer);
+		free(handle);
+		return(*status);
+	}
+
+	handle->fptr = *fptr;
+	add_handle(handle);
+
+	return(*status);
+}
+
+int quickfits_open_file(fitsfile** fptr, const char* filename, int iomode, int* status)
+{
+/*
+	Open a FITS file for every quickfits reader and updater. Names starting with QUICKFITS_MEMFILE_PREFIX are
+	opened from registered memory buffers with cfitsio's memory driver, gzip files (.gz) being read are decompressed
+	with quickfits_open_gz_file, and anything else is passed to fits_open_file.
+	Close with quickfits_close_file.
+
+	INPUTS:
+		filename : file to open
+		iomode : READONLY or READWRITE
+	OUTPUTS:
+		fptr : the open file
+	RETURN:
+		cfitsio status, as for fits_open_file
+*/
+	long long start;
+
+	start = quickfits_trace_start();
+	open_file(fptr, filename, iomode, status);
+	quickfits_trace_phase(QUICKFITS_PHASE_OPEN, start);
+
+	return(*status);
+}
+
+static int create_file(fitsfile** fptr, const char* filename, int* status)
+{
+	quickfits_memfile* mem;
+	memfile_handle* handle;
+	char* fname;
+
+	if(*status)
+	{
+		return(*status);
+	}
+
+	mem = quickfits_memfile_lookup(filename);
+	if(mem == NULL)
+	{
+		fname = malloc(strlen(filename)+2);
+		if(fname == NULL)
+		{
+			*status = MEMORY_ALLOCATION;
+			return(*status);
+		}
+		sprintf(fname,"!%s",filename);	// overwrite any existing file
+		fits_create_file(fptr,fname,status);
+		free(fname);
+		return(*status);
+	}
+
+	if(mem[0].buffer == NULL || mem[0].size < QUICKFITS_BLOCK_SIZE)	// give cfitsio at least one block to start with
+	{
+		if(mem[0].mem_realloc == NULL)
+		{
+			quickfits_error("ERROR : quickfits_create_file --> Memory file %s is too small and cannot grow\n",filename);
+			*status = FILE_NOT_CREATED;
+			return(*status);
+		}
+		mem[0].buffer = mem[0].mem_realloc(mem[0].buffer,QUICKFITS_BLOCK_SIZE);
+		if(mem[0].buffer == NULL)
+		{
+			mem[0].size = 0;
+			*status = MEMORY_ALLOCATION;
+			return(*status);
+		}
+		mem[0].size = QUICKFITS_BLOCK_SIZE;
+	}
+
+	handle = new_handle(mem, true);
+	if(handle == NULL)
+	{
+		*status = MEMORY_ALLOCATION;
+		return(*status);
+	}
+
+	if(fits_create_memfile(fptr,&mem[0].buffer,&handle->memsize,MEMFILE_DELTA,mem[0].mem_realloc,status))
+	{
+		free(handle);
+		return(*status);
+	}
+
+	handle->fptr = *fptr;
+	add_handle(handle);
+
+	return(*status);
+}
+
+int quickfits_create_file(fitsfile** fptr, const char* filename, int* status)
+{
+/*
+	Create a FITS file for the quickfits writers, replacing any existing file. Names starting with
+	QUICKFITS_MEMFILE_PREFIX are written into registered memory buffers, anything else goes to disk.
+	Close with quickfits_close_file, which sets the size of a memory file.
+
+	INPUTS:
+		filename : file to create
+	OUTPUTS:
+		fptr : the new file
+	RETURN:
+		cfitsio status, as for fits_create_file
+*/
+	long long start;
+
+	start = quickfits_trace_start();
+	create_file(fptr, filename, status);
+	quickfits_trace_phase(QUICKFITS_PHASE_OPEN, start);
+
+	return(*status);
+}
+
+static int close_file(fitsfile* fptr, int* status)
+{
+	memfile_handle* handle;
+	int nhdu, tstatus;
+	LONGLONG headstart, datastart, dataend;
+
+	handle = remove_handle(fptr);
+	if(handle == NULL)
+	{
+		return(fits_close_file(fptr,status));
+	}
+
+	tstatus = 0;
+	dataend = 0;
+	if(handle->writable)
+	{
+		fits_get_num_hdus(fptr,&nhdu,&tstatus);
+		fits_movabs_hdu(fptr,nhdu,NULL,&tstatus);	// flushes the current HDU, so the end of the last one is known
+		fits_get_hduaddrll(fptr,&headstart,&datastart,&dataend,&tstatus);
+	}
+
+	fits_close_file(fptr,status);
+
+	if(handle->writable)
+	{
+		if(tstatus == 0 && dataend >= 0 && (size_t)(dataend) <= handle->memsize)
+		{
+			handle->mem[0].size = dataend;
+		}
+		else
+		{
+			handle->mem[0].size = handle->memsize;
+			if(*status == 0)
+			{
+				*status = tstatus;
+			}
+		}
+	}
+	free(handle->buffer);
+	free(handle);
+
+	return(*status);
+}
+
+int quickfits_close_file(fitsfile* fptr, int* status)
+{
+/*
+	Close a file opened with quickfits_open_file or quickfits_create_file. When a memory file was opened for
+	writing, its size is set to the end of the last HDU (cfitsio only reports the size of the buffer).
+	Buffers of decompressed files are freed.
+
+	RETURN:
+		cfitsio status, as for fits_close_file
+*/
+	long long start;
+
+	start = quickfits_trace_start();
+	close_file(fptr, status);
+	quickfits_trace_phase(QUICKFITS_PHASE_CLOSE, start);
+
+	return(*status);
+}
+
+int quickfits_memfile_save(quickfits_memfile mem, const char* filename)
+{
+/*
+	Write a memory file to disk in a single pass, replacing any existing file.
+
+	INPUTS:
+		mem : the memory file
+		filename : file to write
+	RETURN:
+		0 on success, FILE_NOT_CREATED or WRITE_ERROR on failure
+*/
+	int fd;
+	size_t done;
+	ssize_t nwritten;
+
+	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+	{
+		quickfits_error("ERROR : quickfits_memfile_save --> Unable to create %s\n",filename);
+		return(FILE_NOT_CREATED);
+	}
+
+	done = 0;
+	while(done < mem.size)
+	{
+		nwritten = write(fd, (char*)mem.buffer + done, mem.size - done);
+		if(nwritten < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(nwritten <= 0)
+		{
+			quickfits_error("ERROR : quickfits_memfile_save --> Error writing %s\n",filename);
+			close(fd);
+			return(WRITE_ERROR);
+		}
+		done += nwritten;
+	}
+
+	if(close(fd) != 0)
+	{
+		quickfits_error("ERROR : quickfits_memfile_save --> Error writing %s\n",filename);
+		return(WRITE_ERROR);
+	}
+
+	return(0);
+}
@@ -0,0 +1,588 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+
+#define MERGE_MEMORY_BYTES (256<<20)	// buffers for all the inputs together
+#define MERGE_MIN_BLOCK_BYTES (64<<10)	// but at least this much per input
+#define MERGE_NPARAMS 6	// UU, VV, WW, DATE, BASELINE, INTTIM
+
+typedef struct merge_antennas_tag{	// the output antenna table, built up as the inputs are read
+	int nant;
+	int allocated;
+	int nif;
+	char** names;
+	double* xyz;
+	double* rdterm;	// nant*nif*2, as for quickfits_uv_writer_close
+	double* ldterm;
+}merge_antennas;
+
+typedef struct merge_input_tag{
+	const char* filename;
+	fitsfile* fptr;
+	fitsinfo_uv fitsi;
+	int cols[MERGE_NPARAMS+1];	// random parameter columns then VISIBILITIES (0 if missing)
+	long long row;	// next row of the file to read
+	long long block_rows;
+	long long nbuffered;
+	long long pos;	// next buffered row to write out
+	double* params[MERGE_NPARAMS];
+	double* vis;
+	int* ant_map;	// antenna number in this file -> antenna number in the output (NULL to leave them)
+	int max_ant;
+	double last_date;
+	bool warned;
+}merge_input;
+
+static int read_if_freqs(fitsfile* fptr, const char* filename, int nif, double* if_array)
+{
+	char freq_extname[]="AIPS FQ ";
+	char colname[]="IF FREQ";
+	double d_null=0;
+	int anynull, colnum, status;
+
+	status = 0;
+	if(quickfits_movnam_hdu(fptr,filename,BINARY_TBL,freq_extname,0,&status))
+	{
+		quickfits_error("ERROR : quickfits_merge_uv --> Error finding frequency table in %s, error = %d\n",filename,status);
+		return(status);
+	}
+	fits_get_colnum(fptr,CASEINSEN,colname,&colnum,&status);
+	fits_read_col(fptr, TDOUBLE, colnum, 1, 1, nif, &d_null, if_array, &anynull, &status);
+	return(status);
+}
+
+static int add_antenna(merge_antennas* ants, const char* name, const double* xyz, const double* rd, const double* ld, const char* filename)
+{
+	// output number (from 1) of the antenna with this name, adding it if it's new
+
+	int i, k, n;
+	double d;
+
+	for(i=0;i<ants[0].nant;i++)
+	{
+		if(!strcmp(ants[0].names[i], name))
+		{
+			d = 0.0;
+			for(k=0;k<3;k++)
+			{
+				d += (ants[0].xyz[3*i+k] - xyz[k])*(ants[0].xyz[3*i+k] - xyz[k]);
+			}
+			if(d > 1.0)
+			{
+				quickfits_error("WARNING : quickfits_merge_uv --> %s in %s is %g m from its position in the first file with it\n",name,filename,sqrt(d));
+			}
+			return(i+1);
+		}
+	}
+
+	if(ants[0].nant == ants[0].allocated)
+	{
+		n = (ants[0].allocated > 0) ? 2*ants[0].allocated : 32;
+		ants[0].names = realloc(ants[0].names, n*sizeof(char*));
+		ants[0].xyz = realloc(ants[0].xyz, 3LL*n*sizeof(double));
+		ants[0].rdterm = realloc(ants[0].rdterm, 2LL*ants[0].nif*n*sizeof(double));
+		ants[0].ldterm = realloc(ants[0].ldterm, 2LL*ants[0].nif*n*sizeof(double));
+		if(ants[0].names == NULL || ants[0].xyz == NULL || ants[0].rdterm == NULL || ants[0].ldterm == NULL)
+		{
+			return(0);
+		}
+		ants[0].allocated = n;
+	}
+	i = ants[0].nant;
+	ants[0].names[i] = strdup(name);
+	memcpy(&ants[0].xyz[3*i], xyz, 3*sizeof(double));
+	memcpy(&ants[0].rdterm[2LL*ants[0].nif*i], rd, 2LL*ants[0].nif*sizeof(double));	// D-terms from the first file with the antenna
+	memcpy(&ants[0].ldterm[2LL*ants[0].nif*i], ld, 2LL*ants[0].nif*sizeof(double));
+	ants[0].nant++;
+	return((ants[0].names[i] != NULL) ? i+1 : 0);
+}
+
+static int read_antennas(merge_input* in, merge_antennas* ants)
+{
+	// match the antennas of an input to the output table by name, giving the renumbering of its baselines
+
+	char anten_tab_name[]="AIPS AN ";
+	quickfits_antenna_table table;
+	double* rd;
+	double* ld;
+	long long npcal;
+	int i, row, status;
+
+	status = 0;
+	if(quickfits_movnam_hdu(in[0].fptr,in[0].filename,BINARY_TBL,anten_tab_name,0,&status))
+	{
+		quickfits_error("WARNING : quickfits_merge_uv --> No antenna table in %s, its antenna numbers are kept\n",in[0].filename);
+		return(0);
+	}
+	quickfits_read_ant_hdu(in[0].fptr, &table, &status);
+	npcal = (table.pcal_repeat < 2LL*ants[0].nif) ? table.pcal_repeat : 2LL*ants[0].nif;
+
+	rd = calloc(2LL*ants[0].nif, sizeof(double));
+	ld = calloc(2LL*ants[0].nif, sizeof(double));
+	if(status == 0 && (rd == NULL || ld == NULL))
+	{
+		status = MEMORY_ALLOCATION;
+	}
+	in[0].max_ant = 0;
+	for(row=0;row<table.nant && status==0;row++)
+	{
+		in[0].max_ant = (table.nosta[row] > in[0].max_ant) ? table.nosta[row] : in[0].max_ant;
+	}
+	in[0].ant_map = (status == 0) ? malloc((in[0].max_ant+1)*sizeof(int)) : NULL;
+	if(status == 0 && in[0].ant_map == NULL)
+	{
+		status = MEMORY_ALLOCATION;
+	}
+	for(i=0;i<=in[0].max_ant && status==0;i++)
+	{
+		in[0].ant_map[i] = i;	// antennas missing from the table keep their numbers
+	}
+
+	for(row=0;row<table.nant && status==0;row++)
+	{
+		if(npcal > 0)
+		{
+			memcpy(rd, &table.rdterm[row*table.pcal_repeat], npcal*sizeof(double));
+			memcpy(ld, &table.ldterm[row*table.pcal_repeat], npcal*sizeof(double));
+		}
+		if(table.nosta[row] >= 0)
+		{
+			in[0].ant_map[table.nosta[row]] = add_antenna(ants, table.names[row], &table.stabxyz[3*row], rd, ld, in[0].filename);
+			status = (in[0].ant_map[table.nosta[row]] == 0) ? MEMORY_ALLOCATION : 0;
+		}
+	}
+
+	free(rd);
+	free(ld);
+	quickfits_free_ant_table(&table);
+	if(status != 0)
+	{
+		quickfits_error("ERROR : quickfits_merge_uv --> Error reading antenna table of %s, error = %d\n",in[0].filename,status);
+	}
+	return(status);
+}
+
+static int open_input(merge_input* in, merge_antennas* ants, long long block_bytes)
+{
+	// open an input at the start of its UV table, with its antennas matched and its buffers ready
+
+	char extname[]="AIPS UV ";
+	char* prefixes[] = {"UU", "VV", "WW", "DATE", "BASELINE", "INTTIM", "VISIBILITIES"};
+	char comment[FLEN_VALUE];
+	char key_name[FLEN_VALUE];
+	char key_type[FLEN_VALUE];
+	long long row_elements;
+	int i, k, status;
+
+	status = 0;
+	if(quickfits_open_file(&in[0].fptr,in[0].filename,READONLY,&status))
+	{
+		quickfits_error("ERROR : quickfits_merge_uv --> Error opening %s, error = %d\n",in[0].filename,status);
+		return(status);
+	}
+	status = read_antennas(in, ants);
+	if(status == 0 && quickfits_movnam_hdu(in[0].fptr,in[0].filename,BINARY_TBL,extname,0,&status))
+	{
+		quickfits_error("ERROR : quickfits_merge_uv --> Error locating AIPS UV binary extension in %s, error = %d\n",in[0].filename,status);
+	}
+	if(status != 0)
+	{
+		return(status);
+	}
+
+	memset(in[0].cols, 0, sizeof(in[0].cols));
+	i=1;
+	while(status!=KEY_NO_EXIST)
+	{
+		sprintf(key_name,"TTYPE%d",i);
+		fits_read_key(in[0].fptr,TSTRING,key_name,key_type,comment,&status);
+		for(k=0;k<=MERGE_NPARAMS && status==0;k++)
+		{
+			if(in[0].cols[k] == 0 && !strncmp(key_type,prefixes[k],strlen(prefixes[k])))
+			{
+				in[0].cols[k] = i;
+			}
+		}
+		i++;
+	}
+	status = 0;
+	if(in[0].cols[0] == 0 || in[0].cols[1] == 0 || in[0].cols[MERGE_NPARAMS] == 0)
+	{
+		quickfits_error("ERROR : quickfits_merge_uv --> No UU, VV or VISIBILITIES column in %s\n",in[0].filename);
+		return(COL_NOT_FOUND);
+	}
+
+	row_elements = 12LL*in[0].fitsi.nif*in[0].fitsi.nchan;
+	in[0].block_rows = block_bytes/((MERGE_NPARAMS + row_elements)*sizeof(double));
+	in[0].block_rows = (in[0].block_rows < 1) ? 1 : in[0].block_rows;
+	for(k=0;k<MERGE_NPARAMS;k++)
+	{
+		in[0].params[k] = malloc(in[0].block_rows*sizeof(double));
+		status = (in[0].params[k] == NULL) ? MEMORY_ALLOCATION : status;
+	}
+	in[0].vis = malloc(in[0].block_rows*row_elements*sizeof(double));
+	status = (in[0].vis == NULL) ? MEMORY_ALLOCATION : status;
+	in[0].row = 0;
+	in[0].nbuffered = 0;
+	in[0].pos = 0;
+	in[0].last_date = -INFINITY;
+	in[0].warned = false;
+	return(status);
+}
+
+static int fill_input(merge_input* in)
+{
+	// read the next block of rows, with the baselines renumbered for the output antenna table
+
+	double d_null=0;
+	long long nrows, i, row_elements;
+	int k, a1, a2, anynull, status;
+	double bl;
+
+	status = 0;
+	row_elements = 12LL*in[0].fitsi.nif*in[0].fitsi.nchan;
+	nrows = in[0].fitsi.nvis - in[0].row;
+	nrows = (nrows < in[0].block_rows) ? nrows : in[0].block_rows;
+	for(k=0;k<MERGE_NPARAMS;k++)
+	{
+		if(in[0].cols[k] > 0)
+		{
+			fits_read_col(in[0].fptr, TDOUBLE, in[0].cols[k], in[0].row+1, 1, nrows, &d_null, in[0].params[k], &anynull, &status);
+		}
+		else
+		{
+			memset(in[0].params[k], 0, nrows*sizeof(double));
+		}
+	}
+	fits_read_col(in[0].fptr, TDOUBLE, in[0].cols[MERGE_NPARAMS], in[0].row+1, 1, nrows*row_elements, &d_null, in[0].vis, &anynull, &status);
+	if(status != 0)
+	{
+		quickfits_error("ERROR : quickfits_merge_uv --> Error reading %s, error = %d\n",in[0].filename,status);
+		return(status);
+	}
+
+	for(i=0;i<nrows && in[0].ant_map!=NULL;i++)	// 256*ant1 + ant2 + 0.01*(subarray-1)
+	{
+		bl = in[0].params[4][i];
+		a1 = (int)(bl)/256;
+		a2 = (int)(bl)%256;
+		if(a1 >= 0 && a2 >= 0 && a1 <= in[0].max_ant && a2 <= in[0].max_ant)
+		{
+			in[0].params[4][i] = 256*in[0].ant_map[a1] + in[0].ant_map[a2] + (bl - floor(bl));
+		}
+	}
+
+	in[0].row += nrows;
+	in[0].nbuffered = nrows;
+	in[0].pos = 0;
+	return(status);
+}
+
+static void close_input(merge_input* in)
+{
+	int k, status;
+
+	status = 0;
+	if(in[0].fptr != NULL)
+	{
+		quickfits_close_file(in[0].fptr, &status);
+		in[0].fptr = NULL;
+	}
+	for(k=0;k<MERGE_NPARAMS;k++)
+	{
+		free(in[0].params[k]);
+		in[0].params[k] = NULL;
+	}
+	free(in[0].vis);
+	in[0].vis = NULL;
+	free(in[0].ant_map);
+	in[0].ant_map = NULL;
+}
+
+static int append_rows(quickfits_uv_writer* writer, merge_input* in, long long nrows)
+{
+	// write nrows buffered rows from the current position of an input
+
+	long long p, row_elements;
+
+	p = in[0].pos;
+	row_elements = 12LL*in[0].fitsi.nif*in[0].fitsi.nchan;
+	in[0].pos += nrows;
+	return(quickfits_uv_writer_append(writer, nrows, &in[0].params[0][p], &in[0].params[1][p], &in[0].params[2][p], &in[0].params[3][p],
+		&in[0].params[4][p], &in[0].params[5][p], &in[0].vis[p*row_elements]));
+}
+
+static bool earlier(merge_input* inputs, int a, int b)
+{
+	// heap order : time, then input order so equal times keep the order of the files
+
+	double ta = inputs[a].params[3][inputs[a].pos];
+	double tb = inputs[b].params[3][inputs[b].pos];
+
+	return(ta < tb || (ta == tb && a < b));
+}
+
+static void sift_down(merge_input* inputs, int* heap, int n, int i)
+{
+	int child, tmp;
+
+	while(2*i+1 < n)
+	{
+		child = 2*i+1;
+		if(child+1 < n && earlier(inputs, heap[child+1], heap[child]))
+		{
+			child++;
+		}
+		if(!earlier(inputs, heap[child], heap[i]))
+		{
+			break;
+		}
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+		i = child;
+	}
+}
+
+static int merge_sorted(quickfits_uv_writer* writer, merge_input* inputs, int nfiles)
+{
+	// k-way merge on DATE of inputs that are each in time order
+
+	int* heap;
+	int i, n, status;
+	merge_input* in;
+
+	heap = malloc(nfiles*sizeof(int));
+	if(heap == NULL)
+	{
+		return(MEMORY_ALLOCATION);
+	}
+	status = 0;
+	n = 0;
+	for(i=0;i<nfiles && status==0;i++)
+	{
+		if(inputs[i].fitsi.nvis > 0)
+		{
+			status = fill_input(&inputs[i]);
+			heap[n++] = i;
+		}
+	}
+	for(i=n/2-1;i>=0;i--)
+	{
+		sift_down(inputs, heap, n, i);
+	}
+
+	while(n > 0 && status == 0)
+	{
+		in = &inputs[heap[0]];
+		if(in[0].params[3][in[0].pos] < in[0].last_date && !in[0].warned)
+		{
+			quickfits_error("WARNING : quickfits_merge_uv --> %s is not in time order, so the output will not be either\n",in[0].filename);
+			in[0].warned = true;
+		}
+		in[0].last_date = in[0].params[3][in[0].pos];
+		status = append_rows(writer, in, 1);
+		if(status == 0 && in[0].pos == in[0].nbuffered)
+		{
+			if(in[0].row < in[0].fitsi.nvis)
+			{
+				status = fill_input(in);
+			}
+			else	// this input is finished
+			{
+				heap[0] = heap[--n];
+			}
+		}
+		sift_down(inputs, heap, n, 0);
+	}
+
+	free(heap);
+	return(status);
+}
+
+static int merge_uv(int nfiles, const char** filenames, const char* outfile, bool sort_by_time)
+{
+	quickfits_uv_writer writer;
+	merge_input* inputs;
+	merge_antennas ants;
+	fitsinfo_uv out_info;
+	fitsfile* fptr;
+	double* if_array;
+	double* if_check;
+	long long block_bytes;
+	int i, k, status, err;
+	double tol;
+
+	if(nfiles < 1)
+	{
+		return(0);
+	}
+	inputs = calloc(nfiles, sizeof(merge_input));
+	if(inputs == NULL)
+	{
+		return(MEMORY_ALLOCATION);
+	}
+
+	// check every input is compatible with the first before writing anything
+
+	status = 0;
+	if_array = NULL;
+	if_check = NULL;
+	memset(&out_info, 0, sizeof(fitsinfo_uv));
+	for(i=0;i<nfiles && status==0;i++)
+	{
+		inputs[i].filename = filenames[i];
+		status = quickfits_read_uv_header(filenames[i], &inputs[i].fitsi);
+		if(status != 0)
+		{
+			break;
+		}
+		if(i == 0)
+		{
+			out_info = inputs[0].fitsi;
+			out_info.nvis = 0;
+			if_array = malloc(out_info.nif*sizeof(double));
+			if_check = malloc(out_info.nif*sizeof(double));
+			if(if_array == NULL || if_check == NULL)
+			{
+				status = MEMORY_ALLOCATION;
+				break;
+			}
+		}
+		tol = 1.0E-6*fabs((double)(out_info.chan_width));	// a millionth of a channel
+		if(inputs[i].fitsi.nif != out_info.nif || inputs[i].fitsi.nchan != out_info.nchan || inputs[i].fitsi.chan_width != out_info.chan_width
+			|| fabs(inputs[i].fitsi.freq - out_info.freq) > tol)
+		{
+			quickfits_error("ERROR : quickfits_merge_uv --> %s (%d IFs of %d channels of %d Hz at %g Hz) doesn't match %s (%d IFs of %d channels of %d Hz at %g Hz)\n",
+				filenames[i],inputs[i].fitsi.nif,inputs[i].fitsi.nchan,inputs[i].fitsi.chan_width,inputs[i].fitsi.freq,
+				filenames[0],out_info.nif,out_info.nchan,out_info.chan_width,out_info.freq);
+			status = BAD_DIMEN;
+			break;
+		}
+		if(fabs(inputs[i].fitsi.ra - out_info.ra) > 1.0E-9 || fabs(inputs[i].fitsi.dec - out_info.dec) > 1.0E-9)
+		{
+			quickfits_error("WARNING : quickfits_merge_uv --> %s has a different phase centre to %s\n",filenames[i],filenames[0]);
+		}
+
+		if(quickfits_open_file(&fptr,filenames[i],READONLY,&status) == 0)
+		{
+			status = read_if_freqs(fptr, filenames[i], out_info.nif, (i == 0) ? if_array : if_check);
+			err = 0;
+			quickfits_close_file(fptr, &err);
+		}
+		for(k=0;k<out_info.nif && i>0 && status==0;k++)
+		{
+			if(fabs(if_check[k] - if_array[k]) > tol)
+			{
+				quickfits_error("ERROR : quickfits_merge_uv --> IF %d of %s is at %g Hz, not %g Hz as in %s\n",k+1,filenames[i],out_info.freq+if_check[k],out_info.freq+if_array[k],filenames[0]);
+				status = BAD_DIMEN;
+			}
+		}
+		out_info.nvis += inputs[i].fitsi.nvis;
+	}
+
+	memset(&ants, 0, sizeof(merge_antennas));
+	ants.nif = out_info.nif;
+	if(status == 0)
+	{
+		status = quickfits_uv_writer_open(&writer, outfile, out_info, out_info.nvis);
+	}
+
+	if(status == 0)
+	{
+		if(sort_by_time)	// every input open at once, sharing the memory budget
+		{
+			block_bytes = MERGE_MEMORY_BYTES/nfiles;
+			block_bytes = (block_bytes < MERGE_MIN_BLOCK_BYTES) ? MERGE_MIN_BLOCK_BYTES : block_bytes;
+			for(i=0;i<nfiles && status==0;i++)
+			{
+				status = open_input(&inputs[i], &ants, block_bytes);
+			}
+			if(status == 0)
+			{
+				status = merge_sorted(&writer, inputs, nfiles);
+			}
+		}
+		else	// one after another
+		{
+			for(i=0;i<nfiles && status==0;i++)
+			{
+				status = open_input(&inputs[i], &ants, MERGE_MEMORY_BYTES);
+				while(status == 0 && inputs[i].row < inputs[i].fitsi.nvis)
+				{
+					status = fill_input(&inputs[i]);
+					if(status == 0)
+					{
+						status = append_rows(&writer, &inputs[i], inputs[i].nbuffered);
+					}
+				}
+				close_input(&inputs[i]);
+			}
+		}
+
+		err = quickfits_uv_writer_close(&writer, if_array, ants.nant, (const char**) ants.names, ants.xyz, ants.rdterm, ants.ldterm);
+		status = (status == 0) ? err : status;
+	}
+	if(status != 0)
+	{
+		quickfits_error("ERROR : quickfits_merge_uv --> Error merging into %s, error = %d\n",outfile,status);
+	}
+
+	for(i=0;i<nfiles;i++)
+	{
+		close_input(&inputs[i]);
+	}
+	for(i=0;i<ants.nant;i++)
+	{
+		free(ants.names[i]);
+	}
+	free(ants.names);
+	free(ants.xyz);
+	free(ants.rdterm);
+	free(ants.ldterm);
+	free(inputs);
+	free(if_array);
+	free(if_check);
+	return(status);
+}
+
+int quickfits_merge_uv(int nfiles, const char** filenames, const char* outfile, bool sort_by_time)
+{
+/*
+	Concatenate UV FITS files produced by FITAB (epochs, sessions) into a new file written with quickfits_uv_writer,
+	streaming the visibilities through fixed size buffers rather than reading any file whole.
+	Every file must have the same IFs, channels and frequencies (checked against the header and AIPS FQ table of the
+	first). Antennas are matched by name across the AIPS AN tables, the output table has each one once (with its
+	position and D-terms from the first file it appears in) and the baselines are renumbered to match.
+ 
+	INPUTS:
+		int nfiles : number of files
+		const char** filenames : the files to merge
+		const char* outfile : name of the merged file (replaced if it exists)
+		bool sort_by_time : false to write the files one after the other, true to interleave them in time order
+			(a k-way merge on DATE, so each file should already be in time order, as AIPS sorts them)
+ 
+	RETURN:
+		0 on success
+*/
+	long long start;
+	int status;
+
+	start = quickfits_trace_start();
+	status = merge_uv(nfiles, filenames, outfile, sort_by_time);
+	quickfits_trace_api("quickfits_merge_uv", start);
+
+	return(status);
+}
@@ -12,20 +12,115 @@
 */
 
 #include "quickfits.h"
+#include <stdlib.h>
 
-int quickfits_overwrite_uv_data(const char* filename, fitsinfo_uv fitsi, double* u, double* v, double* tvis)
+#define SUM_BATCH_BYTES (1<<20)	// rows written, then summed, at a time when checksums are on
+
+static bool find_written_cols(fitsfile* fptr, int viscol, long long row_elements, long long* byte_offset, char* tform_code)
+{
+	// Positions of the u, v and visibility columns in a row, if they can be encoded with quickfits_encode_column
+	// (unscaled E or D columns of the expected lengths)
+
+	char* cards;
+	char key_name[FLEN_KEYWORD];
+	double scale, zero;
+	long long repeat;
+	int ncards, colnum, c, status, tstatus;
+	bool ok;
+
+	status = 0;
+	if(fits_hdr2str(fptr, 0, NULL, 0, &cards, &ncards, &status))
+	{
+		return(false);
+	}
+
+	ok = true;
+	for(c=0;c<((viscol > 0) ? 3 : 2) && ok;c++)
+	{
+		colnum = (c < 2) ? c+1 : viscol;
+		quickfits_scan_col(cards, ncards, NULL, &colnum, &byte_offset[c], &tform_code[c], &repeat, &status);
+		scale = 1.0;
+		zero = 0.0;
+		sprintf(key_name,"TSCAL%d",colnum);
+		tstatus = 0;
+		quickfits_read_card(cards, ncards, key_name, TDOUBLE, &scale, &tstatus);
+		sprintf(key_name,"TZERO%d",colnum);
+		tstatus = 0;
+		quickfits_read_card(cards, ncards, key_name, TDOUBLE, &zero, &tstatus);
+		ok = (status == 0 && (tform_code[c] == 'E' || tform_code[c] == 'D') && repeat == ((c < 2) ? 1 : row_elements) && scale == 1.0 && zero == 0.0);
+	}
+	fits_free_memory(cards, &status);
+
+	return(ok);
+}
+
+static bool write_summed(fitsfile* fptr, long long nvis, double* u, double* v, int viscol, double* tvis, long long row_elements, unsigned long* datasum, int* status)
+{
+	// Write the u, v and visibility columns a batch of rows at a time : read the rows (for the other columns), encode
+	// the new values into them and sum them before writing them back, so the table doesn't have to be read again for
+	// DATASUM. Rows of the table after the nvis written are read and added to the sum.
+	// Returns false if the data sum couldn't be found this way (a heap, or columns that need cfitsio to convert them),
+	// in which case the columns are written with fits_write_col and cfitsio has to do it.
+
+	quickfits_checksum ck;
+	unsigned char* rows;
+	long long row_bytes, naxis2, pcount, row, nrows, batch;
+	long long byte_offset[3];
+	char tform_code[3];
+	char comment[FLEN_VALUE];
+
+	fits_read_key(fptr,TLONGLONG,"NAXIS1",&row_bytes,comment,status);
+	fits_read_key(fptr,TLONGLONG,"NAXIS2",&naxis2,comment,status);
+	fits_read_key(fptr,TLONGLONG,"PCOUNT",&pcount,comment,status);
+	if(*status != 0)
+	{
+		return(false);
+	}
+
+	batch = (row_bytes > 0 && row_bytes < SUM_BATCH_BYTES) ? SUM_BATCH_BYTES/row_bytes : 1;
+	rows = NULL;
+	if(row_bytes > 0 && pcount == 0 && nvis <= naxis2 && find_written_cols(fptr, viscol, row_elements, byte_offset, tform_code))
+	{
+		rows = malloc(batch*row_bytes);
+	}
+	if(rows == NULL)
+	{
+		fits_write_col(fptr, TDOUBLE, 1, 1, 1, nvis, u, status);
+		fits_write_col(fptr, TDOUBLE, 2, 1, 1, nvis, v, status);
+		if(viscol > 0)
+		{
+			fits_write_col(fptr, TDOUBLE, viscol, 1, 1, nvis*row_elements, tvis, status);
+		}
+		return(false);
+	}
+
+	quickfits_checksum_init(&ck);
+	for(row=0;row<naxis2 && *status==0;row+=batch)
+	{
+		nrows = (naxis2-row < batch) ? naxis2-row : batch;
+		fits_read_tblbytes(fptr, row+1, 1, nrows*row_bytes, rows, status);
+		if(row < nvis)
+		{
+			nrows = (nvis-row < batch) ? nvis-row : batch;	// the last batch written may end part way through the rows read
+			quickfits_encode_column(rows, nrows, row_bytes, byte_offset[0], tform_code[0], 1, &u[row]);
+			quickfits_encode_column(rows, nrows, row_bytes, byte_offset[1], tform_code[1], 1, &v[row]);
+			if(viscol > 0)
+			{
+				quickfits_encode_column(rows, nrows, row_bytes, byte_offset[2], tform_code[2], row_elements, &tvis[row*row_elements]);
+			}
+			fits_write_tblbytes(fptr, row+1, 1, nrows*row_bytes, rows, status);
+			nrows = (naxis2-row < batch) ? naxis2-row : batch;
+		}
+		quickfits_checksum_add(&ck, rows, nrows*row_bytes);
+	}
+	free(rows);
+
+	*datasum = quickfits_checksum_finish(&ck);
+	return(*status == 0);
+}
+
+static int overwrite_uv_data(const char* filename, fitsinfo_uv fitsi, double* u, double* v, double* tvis)
 {
-/*
-    Overwrite UV data in a UV FITS file produced by FITAB in AIPS.
- 
-	INPUTS:
-		const char* tfilename : c string = name of FITS file to be read
-		int nvis : number of visibilities to be read
-        int nchan : number of channels to be read
-        int nif : number of IFs to be read
-	OUTPUTS:
-		tvis : (nvis*12*nif*nchan) visibilities, in Jy. 12 = 4 Stokes * (Re,Im, Weight)
-*/
 	fitsfile *fptr;
 
 	int status, i, j;
@@ -35,39 +130,42 @@ int quickfits_overwrite_uv_data(const char* filename, fitsinfo_uv fitsi, double*
 	char comment[FLEN_VALUE];
 	char key_name[FLEN_VALUE];
 	char key_type[FLEN_VALUE];
-	double d_null=0;
-	int anynull;
-	double temp;
+	long long nvis_elements;
+	long long dims[4];
+	int viscol;
+	bool datasum_written;
+	unsigned long datasum;
 
 	status = 0;	// for error processing
+	datasum_written = false;
 	err=0;
 
-	if ( fits_open_file(&fptr,filename, READWRITE, &status) )	// open file and make sure it's open
+	dims[0] = fitsi.nvis;
+	dims[1] = 12;
+	dims[2] = fitsi.nif;
+	dims[3] = fitsi.nchan;
+	if(quickfits_element_count(4, dims, &nvis_elements))
 	{
-		printf("ERROR : quickfits_overwrite_uv_data --> Error opening FITS file, error = %d\n",status);
-		return(status);
+		quickfits_error("ERROR : quickfits_overwrite_uv_data --> Too many visibilities to write (%lld x 12 x %d x %d)\n",fitsi.nvis,fitsi.nif,fitsi.nchan);
+		return(NUM_OVERFLOW);
 	}
 
-	if (fits_movnam_hdu(fptr,BINARY_TBL,extname,0,&status))		// move to main AIPS UV hdu
+	if ( quickfits_open_file(&fptr,filename, READWRITE, &status) )	// open file and make sure it's open
 	{
-		printf("ERROR : quickfits_overwrite_uv_data --> Error locating AIPS UV binary extension, error = %d\n",status);
-		printf("ERROR : quickfits_overwrite_uv_data --> Did you remember to use the AIPS FITAB task instead of FITTP?\n");
+		quickfits_error("ERROR : quickfits_overwrite_uv_data --> Error opening FITS file, error = %d\n",status);
 		return(status);
 	}
 
-
-	fits_write_col(fptr, TDOUBLE, 1, 1, 1, fitsi.nvis,  u, &status);
-	err+=status;
-	if(err!=0)
+	if (quickfits_movnam_hdu(fptr,filename,BINARY_TBL,extname,0,&status))		// move to main AIPS UV hdu
 	{
-		printf("ERROR : cfits_overwrite_uvdata --> Error writing uarray, custom error = %d\n",err);
+		quickfits_error("ERROR : quickfits_overwrite_uv_data --> Error locating AIPS UV binary extension, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_overwrite_uv_data --> Did you remember to use the AIPS FITAB task instead of FITTP?\n");
+		return(status);
 	}
 
-	fits_write_col(fptr, TDOUBLE, 2, 1, 1, fitsi.nvis,  v, &status);
-	err+=status;
-
 
-	i=1;
+	i=1;	// find the visibilities
+	viscol=0;
 	status=0;
 	while(status!=KEY_NO_EXIST)
 	{
@@ -75,17 +173,41 @@ int quickfits_overwrite_uv_data(const char* filename, fitsinfo_uv fitsi, double*
 		fits_read_key(fptr,TSTRING,key_name,key_type,comment,&status);
 		if( !strncmp(key_type,"VISIBILITIES",12) )
 		{
-			fits_write_col(fptr, TDOUBLE, i, 1, 1, fitsi.nvis*12.0*fitsi.nif*fitsi.nchan,  tvis, &status);
-			err+=status;
-			if(err!=0)
-			{
-				printf("ERROR : quickfits_overwrite_uv_data --> Error writing keywords, custom error = %d\n",err);
-			}
+			viscol=i;
 		}
 
 		i++;
 	}
 	status = 0;
+
+	if(quickfits_checksums_enabled())
+	{
+		datasum_written = write_summed(fptr, fitsi.nvis, u, v, viscol, tvis, 12LL*fitsi.nif*fitsi.nchan, &datasum, &status);
+		err+=status;
+	}
+	else
+	{
+		fits_write_col(fptr, TDOUBLE, 1, 1, 1, fitsi.nvis,  u, &status);
+		err+=status;
+		if(err!=0)
+		{
+			quickfits_error("ERROR : cfits_overwrite_uvdata --> Error writing uarray, custom error = %d\n",err);
+		}
+
+		fits_write_col(fptr, TDOUBLE, 2, 1, 1, fitsi.nvis,  v, &status);
+		err+=status;
+
+		if(viscol > 0)
+		{
+			fits_write_col(fptr, TDOUBLE, viscol, 1, 1, nvis_elements,  tvis, &status);
+			err+=status;
+		}
+	}
+	if(err!=0)
+	{
+		quickfits_error("ERROR : quickfits_overwrite_uv_data --> Error writing data, custom error = %d\n",err);
+	}
+	status = 0;
 	
 	fits_update_key(fptr,TDOUBLE,"OBSRA",&fitsi.ra,comment,&status);
 	err+=status;
@@ -103,7 +225,7 @@ int quickfits_overwrite_uv_data(const char* filename, fitsinfo_uv fitsi, double*
 	
 	if(err!=0)
 	{
-		printf("ERROR : quickfits_overwrite_uv_data --> Error updating keywords, custom error = %d\n",err);
+		quickfits_error("ERROR : quickfits_overwrite_uv_data --> Error updating keywords, custom error = %d\n",err);
 	}
 	
 	j=i-2;	// set j to point to the visibility data
@@ -135,10 +257,27 @@ int quickfits_overwrite_uv_data(const char* filename, fitsinfo_uv fitsi, double*
 		i++;
 	}
 	status = 0;
+
+	if(quickfits_checksums_enabled())	// all changes to the UV table are done
+	{
+		if(datasum_written)
+		{
+			quickfits_write_datasum(fptr, datasum, &status);
+		}
+		else
+		{
+			fits_write_chksum(fptr, &status);
+		}
+		if(status != 0)
+		{
+			quickfits_error("ERROR : quickfits_overwrite_uv_data --> Error writing checksums, error = %d.\n",status);
+		}
+		status = 0;
+	}
 	
-	if (fits_movnam_hdu(fptr,BINARY_TBL,anten_tab_name,0,&status))		// move to antenna table
+	if (quickfits_movnam_hdu(fptr,filename,BINARY_TBL,anten_tab_name,0,&status))		// move to antenna table
 	{
-		printf("ERROR : quickfits_overwrite_uv_data --> Error locating AIPS antenna table extension, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_overwrite_uv_data --> Error locating AIPS antenna table extension, error = %d\n",status);
 		return(status);
 	}
 	else
@@ -146,7 +285,11 @@ int quickfits_overwrite_uv_data(const char* filename, fitsinfo_uv fitsi, double*
 		fits_update_key(fptr,TDOUBLE,"FREQ",&fitsi.freq,comment,&status);
 		if(status != 0 )
 		{
-			printf("ERROR : quickfits_overwrite_uv_data --> Error updating frequency, error = %d.\n",status);
+			quickfits_error("ERROR : quickfits_overwrite_uv_data --> Error updating frequency, error = %d.\n",status);
+		}
+		if(quickfits_checksums_enabled())
+		{
+			fits_write_chksum(fptr,&status);	// small table
 		}
 	}
 	
@@ -154,11 +297,34 @@ int quickfits_overwrite_uv_data(const char* filename, fitsinfo_uv fitsi, double*
 
 
 
-	if ( fits_close_file(fptr, &status) )
+	if ( quickfits_close_file(fptr, &status) )
 	{
-		printf("ERROR : quickfits_overwrite_uv_data --> Error closing FITS file, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_overwrite_uv_data --> Error closing FITS file, error = %d\n",status);
 		return(status);
 	}
 
 	return(status);
 }
+
+int quickfits_overwrite_uv_data(const char* filename, fitsinfo_uv fitsi, double* u, double* v, double* tvis)
+{
+/*
+    Overwrite UV data in a UV FITS file produced by FITAB in AIPS.
+ 
+	INPUTS:
+		const char* tfilename : c string = name of FITS file to be read
+		long long nvis : number of visibilities to be written
+        int nchan : number of channels to be read
+        int nif : number of IFs to be read
+	OUTPUTS:
+		tvis : (nvis*12*nif*nchan) visibilities, in Jy. 12 = 4 Stokes * (Re,Im, Weight)
+*/
+	long long start;
+	int status;
+
+	start = quickfits_trace_start();
+	status = overwrite_uv_data(filename, fitsi, u, v, tvis);
+	quickfits_trace_api("quickfits_overwrite_uv_data", start);
+
+	return(status);
+}
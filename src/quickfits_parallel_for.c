@@ -0,0 +1,123 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct parallel_job_tag{
+	long long n;
+	long long next;	// next item to be handed out, protected by lock
+	void (*body)(long long i, void* arg);
+	void* arg;
+	pthread_mutex_t lock;
+}parallel_job;
+
+static void* parallel_worker(void* arg)
+{
+	parallel_job* job = (parallel_job*)(arg);
+	long long i;
+
+	while(true)
+	{
+		pthread_mutex_lock(&job[0].lock);
+		i = job[0].next++;
+		pthread_mutex_unlock(&job[0].lock);
+		if(i >= job[0].n)
+		{
+			break;
+		}
+		job[0].body(i, job[0].arg);
+	}
+	return(NULL);
+}
+
+int quickfits_parallel_for(long long n, int nthreads, void (*body)(long long i, void* arg), void* arg)
+{
+/*
+	Call body(i, arg) for i = 0 ... n-1 on a pool of threads. Items are handed out one at a time
+	in increasing order, so each item should be a reasonable amount of work (a file, a block of rows).
+ 
+	INPUTS:
+		long long n : number of items
+		int nthreads : number of threads to use (0 to use one per processor)
+		body : function to call for each item
+		arg : passed through to body
+ 
+	RETURN:
+		0 on success. Falls back to running in the calling thread if no threads can be started.
+*/
+	parallel_job job;
+	pthread_t* threads;
+	int i, nstarted;
+
+	if(n <= 0)
+	{
+		return(0);
+	}
+	if(nthreads <= 0)
+	{
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if(nthreads > n)
+	{
+		nthreads = n;
+	}
+
+	job.n = n;
+	job.next = 0;
+	job.body = body;
+	job.arg = arg;
+	pthread_mutex_init(&job.lock, NULL);
+
+	nstarted = 0;
+	threads = NULL;
+	if(nthreads > 1)
+	{
+		threads = malloc(nthreads*sizeof(pthread_t));
+	}
+	if(threads != NULL)
+	{
+		for(i=0;i<nthreads;i++)
+		{
+			if(pthread_create(&threads[i], NULL, parallel_worker, &job))
+			{
+				break;
+			}
+			nstarted++;
+		}
+	}
+
+	if(nstarted == 0)
+	{
+		parallel_worker(&job);
+	}
+	for(i=0;i<nstarted;i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	free(threads);
+	pthread_mutex_destroy(&job.lock);
+	return(0);
+}
+
+int quickfits_cfitsio_threads(int nthreads)
+{
+/*
+	Number of threads to use for quickfits_parallel_for work that calls cfitsio : nthreads if cfitsio was built
+	reentrant (fits_is_reentrant), otherwise 1, as cfitsio's shared state isn't locked.
+*/
+	return(fits_is_reentrant() ? nthreads : 1);
+}
@@ -0,0 +1,268 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define _GNU_SOURCE	// for readahead
+#include "quickfits.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define PREFETCH_CHUNK (1<<20)	// bytes read at a time when the kernel can't be asked to read ahead
+
+typedef struct prefetch_request_tag{
+	char filename[FLEN_FILENAME];
+	int what;
+	long long first_row;
+	long long nrows;
+	struct prefetch_request_tag* next;
+}prefetch_request;
+
+static pthread_mutex_t prefetch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prefetch_work = PTHREAD_COND_INITIALIZER;	// signalled when a request is queued
+static pthread_cond_t prefetch_idle = PTHREAD_COND_INITIALIZER;	// signalled when the queue has been emptied
+static prefetch_request* queue_head = NULL;
+static prefetch_request* queue_tail = NULL;
+static bool io_thread_started = false;
+static bool io_thread_busy = false;
+
+static void load_range(int fd, long long offset, long long length, char* buffer)
+{
+	// get a byte range of a file into the page cache
+
+	long long done, n;
+
+	if(length <= 0)
+	{
+		return;
+	}
+	posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+	if(readahead(fd, offset, length) == 0)
+	{
+		return;
+	}
+
+	for(done=0;done<length && buffer!=NULL;done+=n)	// no readahead (not Linux, or a file system without it) - just read it
+	{
+		n = (length-done < PREFETCH_CHUNK) ? length-done : PREFETCH_CHUNK;
+		n = pread(fd, buffer, n, offset+done);
+		if(n <= 0)
+		{
+			break;
+		}
+	}
+}
+
+static void load_hdu(int fd, fitshdu hdu, bool header, bool data, char* buffer)
+{
+	if(header)
+	{
+		load_range(fd, hdu.header_offset, hdu.data_offset - hdu.header_offset, buffer);
+	}
+	if(data)
+	{
+		load_range(fd, hdu.data_offset, hdu.data_size, buffer);
+	}
+}
+
+static void prefetch_file(prefetch_request* request)
+{
+	// work out which parts of the file are wanted from its HDU directory, and load them
+
+	fitshdu_dir dir;
+	fitshdu hdu;
+	char* buffer;
+	char* cards;
+	long long row_bytes, first_row, nrows, nvis;
+	int fd, i, ncards, status;
+
+	if(quickfits_get_hdu_dir(request[0].filename, &dir) != 0)	// not a plain FITS file on disk - nothing to do
+	{
+		return;
+	}
+	fd = open(request[0].filename, O_RDONLY);
+	if(fd < 0)
+	{
+		quickfits_free_hdu_dir(&dir);
+		return;
+	}
+	buffer = malloc(PREFETCH_CHUNK);
+
+	if(request[0].what & QUICKFITS_PREFETCH_HEADERS)
+	{
+		for(i=0;i<dir.nhdu;i++)
+		{
+			load_hdu(fd, dir.hdus[i], true, false, buffer);
+		}
+	}
+
+	if((request[0].what & QUICKFITS_PREFETCH_IMAGE) && dir.nhdu > 0)
+	{
+		load_hdu(fd, dir.hdus[0], true, true, buffer);
+	}
+
+	if((request[0].what & QUICKFITS_PREFETCH_CC) && (i = quickfits_find_hdu(dir, BINARY_TBL, "AIPS CC", 0)) > 0)
+	{
+		load_hdu(fd, dir.hdus[i-1], true, true, buffer);
+	}
+
+	if((request[0].what & QUICKFITS_PREFETCH_UV) && (i = quickfits_find_hdu(dir, BINARY_TBL, "AIPS UV", 0)) > 0)
+	{
+		hdu = dir.hdus[i-1];
+		load_hdu(fd, hdu, true, false, buffer);
+
+		first_row = (request[0].first_row > 0) ? request[0].first_row : 0;
+		nrows = request[0].nrows;
+		row_bytes = 0;
+		nvis = 0;
+		status = 0;
+		if(quickfits_scan_hdu(fd, hdu.header_offset, &hdu, &cards, &ncards) == 0)
+		{
+			quickfits_read_card(cards, ncards, "NAXIS1", TLONGLONG, &row_bytes, &status);
+			quickfits_read_card(cards, ncards, "NAXIS2", TLONGLONG, &nvis, &status);
+			free(cards);
+		}
+		if(status != 0 || row_bytes <= 0 || first_row >= nvis)	// load the whole table
+		{
+			load_hdu(fd, hdu, false, true, buffer);
+		}
+		else
+		{
+			if(nrows <= 0 || nrows > nvis - first_row)
+			{
+				nrows = nvis - first_row;
+			}
+			load_range(fd, hdu.data_offset + first_row*row_bytes, nrows*row_bytes, buffer);
+		}
+
+		if((i = quickfits_find_hdu(dir, BINARY_TBL, "AIPS FQ", 0)) > 0)	// the reader needs the IF frequencies too
+		{
+			load_hdu(fd, dir.hdus[i-1], true, true, buffer);
+		}
+	}
+
+	free(buffer);
+	close(fd);
+	quickfits_free_hdu_dir(&dir);
+}
+
+static void* io_thread(void* arg)
+{
+	prefetch_request* request;
+	(void)arg;	// requests come from the shared queue
+
+	pthread_mutex_lock(&prefetch_lock);
+	while(true)
+	{
+		while(queue_head == NULL)
+		{
+			io_thread_busy = false;
+			pthread_cond_broadcast(&prefetch_idle);
+			pthread_cond_wait(&prefetch_work, &prefetch_lock);
+		}
+		request = queue_head;
+		queue_head = request[0].next;
+		if(queue_head == NULL)
+		{
+			queue_tail = NULL;
+		}
+		io_thread_busy = true;
+		pthread_mutex_unlock(&prefetch_lock);
+
+		prefetch_file(request);
+		free(request);
+
+		pthread_mutex_lock(&prefetch_lock);
+	}
+	return(NULL);
+}
+
+int quickfits_prefetch(const char* filename, int what, long long first_row, long long nrows)
+{
+/*
+	Start loading parts of a file that will be read soon into the page cache, on a background I/O thread, so that
+	work on one file can overlap with loading the next. Returns straight away. The byte ranges are found from
+	the file's HDU directory. Files that aren't plain FITS files on disk (memory files, gzip files) are ignored.
+ 
+	INPUTS:
+		const char* filename : c string = name of FITS file to be read soon
+		int what : QUICKFITS_PREFETCH_HEADERS, QUICKFITS_PREFETCH_IMAGE, QUICKFITS_PREFETCH_UV and/or QUICKFITS_PREFETCH_CC, or'ed together
+		long long first_row, nrows : rows of the AIPS UV table to load (0 based, nrows <= 0 for the rest of the table)
+ 
+	RETURN:
+		0 on success. If no I/O thread can be started the file is loaded before returning.
+*/
+	prefetch_request* request;
+	pthread_t thread;
+	pthread_attr_t attr;
+
+	if(strlen(filename) >= FLEN_FILENAME || quickfits_memfile_lookup(filename) != NULL)
+	{
+		return(0);
+	}
+
+	request = malloc(sizeof(prefetch_request));
+	if(request == NULL)
+	{
+		return(MEMORY_ALLOCATION);
+	}
+	strcpy(request[0].filename, filename);
+	request[0].what = what;
+	request[0].first_row = first_row;
+	request[0].nrows = nrows;
+	request[0].next = NULL;
+
+	pthread_mutex_lock(&prefetch_lock);
+	if(!io_thread_started)
+	{
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		if(pthread_create(&thread, &attr, io_thread, NULL))	// do it here instead
+		{
+			pthread_attr_destroy(&attr);
+			pthread_mutex_unlock(&prefetch_lock);
+			prefetch_file(request);
+			free(request);
+			return(0);
+		}
+		pthread_attr_destroy(&attr);
+		io_thread_started = true;
+		io_thread_busy = true;	// until it finds the queue
+	}
+	if(queue_tail == NULL)
+	{
+		queue_head = request;
+	}
+	else
+	{
+		queue_tail[0].next = request;
+	}
+	queue_tail = request;
+	pthread_cond_signal(&prefetch_work);
+	pthread_mutex_unlock(&prefetch_lock);
+
+	return(0);
+}
+
+void quickfits_prefetch_wait(void)
+{
+/*
+	Wait until every prefetch requested so far has been done
+*/
+	pthread_mutex_lock(&prefetch_lock);
+	while(io_thread_started && (queue_head != NULL || io_thread_busy))
+	{
+		pthread_cond_wait(&prefetch_idle, &prefetch_lock);
+	}
+	pthread_mutex_unlock(&prefetch_lock);
+}
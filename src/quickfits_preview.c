@@ -0,0 +1,279 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+#define PREVIEW_EXTNAME "PREVIEW"
+#define PREVIEW_BLOCK_ROWS 16	// output rows per parallel task
+
+typedef struct preview_job_tag{	// reduce one level of the pyramid by a factor of 2
+	const double* dsrc;	// source is either the full map (double) or the previous level (float)
+	const float* fsrc;
+	long long nx, ny;	// size of the source
+	float* dest;
+	long long dest_nx, dest_ny;
+	int pooling;
+}preview_job;
+
+static void pool_rows(long long task, void* arg)
+{
+	preview_job* job = (preview_job*)(arg);
+	long long x, y, sx, sy, first, last;
+	double value, total;
+	int n, dx, dy;
+
+	first = task*PREVIEW_BLOCK_ROWS;
+	last = first + PREVIEW_BLOCK_ROWS;
+	if(last > job[0].dest_ny)
+	{
+		last = job[0].dest_ny;
+	}
+
+	for(y=first;y<last;y++)
+	{
+		for(x=0;x<job[0].dest_nx;x++)
+		{
+			n = 0;
+			total = (job[0].pooling == QUICKFITS_PREVIEW_MAX) ? -INFINITY : 0.0;
+			for(dy=0;dy<2;dy++)
+			{
+				sy = 2*y+dy;
+				for(dx=0;dx<2;dx++)
+				{
+					sx = 2*x+dx;
+					if(sx >= job[0].nx || sy >= job[0].ny)	// odd sizes - the last block is partly outside the map
+					{
+						continue;
+					}
+					value = (job[0].dsrc != NULL) ? job[0].dsrc[sy*job[0].nx+sx] : job[0].fsrc[sy*job[0].nx+sx];
+					if(!isfinite(value))	// blanked pixels are left out
+					{
+						continue;
+					}
+					n++;
+					if(job[0].pooling == QUICKFITS_PREVIEW_MAX)
+					{
+						total = (value > total) ? value : total;
+					}
+					else
+					{
+						total += value;
+					}
+				}
+			}
+			if(n == 0)
+			{
+				job[0].dest[y*job[0].dest_nx+x] = NAN;
+			}
+			else
+			{
+				job[0].dest[y*job[0].dest_nx+x] = (job[0].pooling == QUICKFITS_PREVIEW_MAX) ? total : total/n;
+			}
+		}
+	}
+}
+
+static int write_preview_level(fitsfile* fptr, fitsinfo_map fitsi, int level, int pooling, float* array, long long nx, long long ny, int* status)
+{
+	LONGLONG naxes[2] = { nx , ny };
+	char comment[]="";
+	char extname[]=PREVIEW_EXTNAME;
+	char tstring[FLEN_VALUE];
+	double factor, temp;
+	long long npix;
+
+	factor = (double)(1LL << level);
+
+	fits_create_imgll(fptr, FLOAT_IMG, 2, naxes, status);
+	fits_update_key(fptr, TSTRING, "EXTNAME", extname , comment , status);
+	fits_update_key(fptr, TINT, "EXTVER", &level , comment , status);
+	fits_update_key(fptr, TDOUBLE, "FACTOR", &factor , "map pixels per preview pixel along each axis" , status);
+	sprintf(tstring, (pooling == QUICKFITS_PREVIEW_MAX) ? "MAX" : "MEAN");
+	fits_update_key(fptr, TSTRING, "POOLING", tstring , comment , status);
+
+	sprintf(tstring,"RA---SIN");	// same coordinates as the map, with bigger pixels
+	fits_update_key(fptr, TSTRING, "CTYPE1", tstring , comment , status);
+	fits_update_key(fptr, TDOUBLE, "CRVAL1", &fitsi.ra , comment , status);
+	temp = -fitsi.cell_ra*factor;
+	fits_update_key(fptr, TDOUBLE, "CDELT1", &temp , comment , status);
+	temp = (fitsi.centre_shift[0]-0.5)/factor+0.5;
+	fits_update_key(fptr, TDOUBLE, "CRPIX1", &temp , comment , status);
+
+	sprintf(tstring,"DEC--SIN");
+	fits_update_key(fptr, TSTRING, "CTYPE2", tstring , comment , status);
+	fits_update_key(fptr, TDOUBLE, "CRVAL2", &fitsi.dec , comment , status);
+	temp = fitsi.cell_dec*factor;
+	fits_update_key(fptr, TDOUBLE, "CDELT2", &temp , comment , status);
+	temp = (fitsi.centre_shift[1]-0.5)/factor+0.5;
+	fits_update_key(fptr, TDOUBLE, "CRPIX2", &temp , comment , status);
+
+	npix = nx*ny;
+	fits_write_img(fptr, TFLOAT, 1, npix, array, status);
+	if(quickfits_checksums_enabled())	// previews are small
+	{
+		fits_write_chksum(fptr, status);
+	}
+
+	return(*status);
+}
+
+int quickfits_write_map_preview(const char* filename , double* array, fitsinfo_map fitsi, char* history, int nlevels, int pooling, int nthreads)
+{
+/*
+	Write out a FITS map as quickfits_write_map does, followed by a pyramid of downsampled previews for quick-look
+	use, each an IMAGE extension called PREVIEW with EXTVER = level, reduced by 2^level along each axis.
+	Each level is pooled from the one before it in parallel, and only two levels are held in memory at once.
+	Previews are stored as 32 bit floats.
+ 
+	INPUTS:
+		filename, array, fitsi, history : as for quickfits_write_map
+		int nlevels : number of preview levels (levels stop early once the preview is a single pixel)
+		int pooling : QUICKFITS_PREVIEW_MEAN or QUICKFITS_PREVIEW_MAX. NaN pixels are ignored.
+		int nthreads : number of threads to use (0 to use one per processor)
+ 
+	RETURN:
+		0 if no errors occur.
+*/
+	fitsfile *fptr;
+	preview_job job;
+	float* previous;
+	int status, level;
+	long long dims[2], npix;
+
+	status = quickfits_write_map(filename, array, fitsi, history);
+	if(status != 0 || nlevels <= 0)
+	{
+		return(status);
+	}
+
+	if ( quickfits_open_file(&fptr,filename, READWRITE, &status) )
+	{
+		quickfits_error("ERROR : quickfits_write_map_preview --> Error opening FITS file, error = %d\n",status);
+		return(status);
+	}
+	fits_get_num_hdus(fptr, &level, &status);
+	fits_movabs_hdu(fptr, level, NULL, &status);	// previews go after everything else
+
+	job.dsrc = array;
+	job.fsrc = NULL;
+	job.nx = fitsi.imsize_ra;
+	job.ny = fitsi.imsize_dec;
+	job.pooling = pooling;
+	previous = NULL;
+
+	for(level=1;level<=nlevels && status==0 && (job.nx > 1 || job.ny > 1);level++)
+	{
+		job.dest_nx = (job.nx+1)/2;
+		job.dest_ny = (job.ny+1)/2;
+		dims[0] = job.dest_nx;
+		dims[1] = job.dest_ny;
+		if(quickfits_element_count(2, dims, &npix) || npix > (long long)(SIZE_MAX/sizeof(float)))
+		{
+			status = NUM_OVERFLOW;
+			break;
+		}
+		job.dest = malloc(npix*sizeof(float));
+		if(job.dest == NULL)
+		{
+			quickfits_error("ERROR : quickfits_write_map_preview --> Error allocating memory for preview level %d\n",level);
+			status = MEMORY_ALLOCATION;
+			break;
+		}
+
+		quickfits_parallel_for((job.dest_ny+PREVIEW_BLOCK_ROWS-1)/PREVIEW_BLOCK_ROWS, nthreads, pool_rows, &job);
+		write_preview_level(fptr, fitsi, level, pooling, job.dest, job.dest_nx, job.dest_ny, &status);
+		if(status != 0)
+		{
+			quickfits_error("ERROR : quickfits_write_map_preview --> Error writing preview level %d, error = %d\n",level,status);
+		}
+
+		free(previous);	// the next level is pooled from this one
+		previous = job.dest;
+		job.dsrc = NULL;
+		job.fsrc = job.dest;
+		job.nx = job.dest_nx;
+		job.ny = job.dest_ny;
+	}
+	free(previous);
+
+	quickfits_close_file(fptr, &status);
+
+	return(status);
+}
+
+int quickfits_read_map_preview(const char* filename, int level, long long* nx, long long* ny, double* tarr)
+{
+/*
+	Read one level of the preview pyramid written by quickfits_write_map_preview.
+	The HDU directory is used to find it, so only the headers of the file and the preview itself are read.
+ 
+	INPUTS:
+		const char* filename : c string = name of FITS file to be read
+		int level : preview level (size reduced by 2^level)
+	OUTPUTS:
+		nx, ny : size of the preview
+		tarr : nx*ny pixel values in the same order as quickfits_read_map, or NULL to just get the size
+ 
+	RETURN:
+		0 on success, BAD_HDU_NUM if the file has no preview at this level
+*/
+	fitsfile *fptr;
+	char extname[]=PREVIEW_EXTNAME;
+	double nullval=NAN;
+	int status, naxis, anynull;
+	LONGLONG naxes[2];
+	long long npix;
+
+	status = 0;
+	*nx = 0;
+	*ny = 0;
+
+	if ( quickfits_open_file(&fptr,filename, READONLY, &status) )
+	{
+		quickfits_error("ERROR : quickfits_read_map_preview --> Error opening FITS file, error = %d\n",status);
+		return(status);
+	}
+
+	if (quickfits_movnam_hdu(fptr,filename,IMAGE_HDU,extname,level,&status))
+	{
+		quickfits_close_file(fptr, &status);
+		return(BAD_HDU_NUM);
+	}
+
+	fits_get_img_dim(fptr, &naxis, &status);
+	if(status == 0 && naxis != 2)
+	{
+		status = BAD_NAXIS;
+	}
+	fits_get_img_sizell(fptr, 2, naxes, &status);
+	if(status == 0)
+	{
+		*nx = naxes[0];
+		*ny = naxes[1];
+		if(tarr != NULL)
+		{
+			quickfits_element_count(2, naxes, &npix);
+			fits_read_img(fptr, TDOUBLE, 1, npix, &nullval, tarr, &anynull, &status);
+		}
+	}
+	if(status != 0)
+	{
+		quickfits_error("ERROR : quickfits_read_map_preview --> Error reading preview level %d, error = %d\n",level,status);
+	}
+
+	quickfits_close_file(fptr, &status);
+
+	return(status);
+}
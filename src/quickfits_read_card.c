@@ -0,0 +1,246 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+#include <ctype.h>
+
+static const char* find_card(const char* cards, int ncards, const char* keyname)
+{
+	// keywords fill the first 8 characters of a card, padded with blanks and followed by "= "
+
+	char key[8];
+	int i, len;
+
+	len = strlen(keyname);
+	if(len > 8)
+	{
+		return(NULL);
+	}
+	memset(key,' ',8);
+	for(i=0;i<len;i++)
+	{
+		key[i]=toupper((unsigned char)keyname[i]);
+	}
+
+	for(i=0;i<ncards;i++)
+	{
+		if( !strncmp(&cards[80*i],key,8) && cards[80*i+8]=='=' )
+		{
+			return(&cards[80*i]);
+		}
+	}
+	return(NULL);
+}
+
+static void card_value(const char* card, char* value)
+{
+	// copy the value field of a card (quotes included for strings) without the comment
+
+	int i, j;
+
+	i=10;
+	j=0;
+	while(i<80 && card[i]==' ')
+	{
+		i++;
+	}
+
+	if(i<80 && card[i]=='\'')
+	{
+		value[j++]=card[i++];
+		while(i<80 && j<FLEN_VALUE-2)
+		{
+			if(card[i]=='\'')
+			{
+				if(i+1<80 && card[i+1]=='\'')	// '' is an escaped quote
+				{
+					value[j++]=card[i++];
+					value[j++]=card[i++];
+					continue;
+				}
+				value[j++]=card[i];
+				break;
+			}
+			value[j++]=card[i++];
+		}
+	}
+	else
+	{
+		while(i<80 && card[i]!='/' && j<FLEN_VALUE-1)
+		{
+			value[j++]=card[i++];
+		}
+		while(j>0 && value[j-1]==' ')
+		{
+			j--;
+		}
+	}
+	value[j]='\0';
+}
+
+static void unquote(const char* value, char* out)
+{
+	// remove the quotes and trailing blanks from a string value, as cfitsio does
+
+	int i, j;
+
+	if(value[0]!='\'')
+	{
+		strcpy(out,value);
+		return;
+	}
+
+	j=0;
+	for(i=1;value[i]!='\0';i++)
+	{
+		if(value[i]=='\'')
+		{
+			if(value[i+1]!='\'')
+			{
+				break;
+			}
+			i++;
+		}
+		out[j++]=value[i];
+	}
+	while(j>0 && out[j-1]==' ')
+	{
+		j--;
+	}
+	out[j]='\0';
+}
+
+int quickfits_read_card(const char* cards, int ncards, const char* keyname, int datatype, void* value, int* status)
+{
+/*
+	Read a keyword value from a block of 80 character header cards, following the conventions of fits_read_key
+ 
+	INPUTS:
+		const char* cards : ncards header cards, as returned by quickfits_scan_hdu
+		int ncards : number of cards
+		const char* keyname : name of the keyword to read
+		int datatype : TSTRING, TLOGICAL, TINT, TLONG, TLONGLONG, TFLOAT or TDOUBLE
+		int* status : nothing is done if this is already non-zero (as in cfitsio)
+	OUTPUTS:
+		value : keyword value. Left unchanged if the keyword is missing, except for strings which are cleared.
+ 
+	RETURN:
+		status : 0 on success, KEY_NO_EXIST if the keyword is missing
+*/
+	const char* card;
+	char valstring[FLEN_VALUE];
+	char numstring[FLEN_VALUE];
+	char* end;
+	double dval;
+	long long llval;
+	bool is_int;
+	int i;
+
+	if(*status != 0)
+	{
+		return(*status);
+	}
+
+	if(datatype == TSTRING)
+	{
+		((char*)(value))[0]='\0';
+	}
+
+	card = find_card(cards, ncards, keyname);
+	if(card == NULL)
+	{
+		*status = KEY_NO_EXIST;
+		return(*status);
+	}
+
+	card_value(card, valstring);
+
+	if(datatype == TSTRING)
+	{
+		unquote(valstring, (char*)(value));
+		return(*status);
+	}
+
+	if(valstring[0]=='\0')
+	{
+		*status = VALUE_UNDEFINED;
+		return(*status);
+	}
+
+	// logical values convert to 0 or 1, quoted strings are parsed as numbers
+
+	if( !strcmp(valstring,"T") || !strcmp(valstring,"F") )
+	{
+		dval = (valstring[0]=='T') ? 1.0 : 0.0;
+		llval = (long long)(dval);
+		is_int = true;
+	}
+	else
+	{
+		unquote(valstring, numstring);
+		for(i=0;numstring[i]!='\0';i++)
+		{
+			if(numstring[i]=='D' || numstring[i]=='d')	// Fortran style exponent
+			{
+				numstring[i]='E';
+			}
+		}
+
+		llval = strtoll(numstring,&end,10);
+		is_int = (end != numstring && *end == '\0');
+
+		dval = strtod(numstring,&end);
+		if(end == numstring || *end != '\0')
+		{
+			*status = BAD_C2D;
+			return(*status);
+		}
+	}
+
+	switch(datatype)
+	{
+		case TLOGICAL:
+			*(int*)(value) = (dval != 0.0);
+			break;
+		case TINT:
+			if(!is_int)
+			{
+				llval = (long long)(dval);
+			}
+			if(dval > 2147483647.0 || dval < -2147483648.0)
+			{
+				*status = NUM_OVERFLOW;
+				break;
+			}
+			*(int*)(value) = (int)(llval);
+			break;
+		case TLONG:
+			*(long*)(value) = is_int ? (long)(llval) : (long)(dval);
+			break;
+		case TLONGLONG:
+			*(long long*)(value) = is_int ? llval : (long long)(dval);
+			break;
+		case TFLOAT:
+			*(float*)(value) = (float)(dval);
+			break;
+		case TDOUBLE:
+			*(double*)(value) = dval;
+			break;
+		default:
+			*status = BAD_DATATYPE;
+			break;
+	}
+
+	return(*status);
+}
@@ -13,21 +13,8 @@
 
 #include "quickfits.h"
 
-int quickfits_read_cc_table(const char* filename , fitsinfo_map fitsi , double* cc_xarray, double* cc_yarray, double* cc_varray)
+static int read_cc_table(const char* filename , fitsinfo_map fitsi , double* cc_xarray, double* cc_yarray, double* cc_varray)
 {
-/*
-	INPUTS:
-		const char* tfilename : c string = name of FITS file to be read
-		int ncc : number of clean components to be read (0 if no cc table expected/needed)
-        int cc_table_version : Version of CC table to read
-	OUTPUTS:
-		cc_xarray : 1D fp array containing x coords of clean components in degrees
-		cc_yarray : 1D fp array containing y coords of clean components in degrees
-		cc_varray : 1D fp array containing values of clean components in degrees
- 
-    RETURN:
-        0 on success.
-*/
 	fitsfile *fptr;
 
 	int status;
@@ -47,16 +34,16 @@ int quickfits_read_cc_table(const char* filename , fitsinfo_map fitsi , double*
 	status = 0;	// for error processing
 
 
-	if ( fits_open_file(&fptr,filename, READONLY, &status) )	// open file and make sure it's open
+	if ( quickfits_open_file(&fptr,filename, READONLY, &status) )	// open file and make sure it's open
 	{
-		printf("ERROR : quickfits_read_cc_table --> Error opening FITS file, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_cc_table --> Error opening FITS file, error = %d\n",status);
 		return(status);
 	}
 
 
-	if (fits_movnam_hdu(fptr,BINARY_TBL,cchdu,fitsi.cc_table_version,&status))		// move to main AIPS image hdu
+	if (quickfits_movnam_hdu(fptr,filename,BINARY_TBL,cchdu,fitsi.cc_table_version,&status))		// move to main AIPS image hdu
 	{
-		printf("ERROR : quickfits_read_cc_table --> Error locating AIPS clean component extension, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_cc_table --> Error locating AIPS clean component extension, error = %d\n",status);
 		return(status);
 	}
 	else
@@ -64,42 +51,67 @@ int quickfits_read_cc_table(const char* filename , fitsinfo_map fitsi , double*
 		fits_get_colnum(fptr,CASEINSEN,xname,&colnum,&status);
 		if(status!=0)
 		{
-			printf("ERROR : quickfits_read_cc_table -->  Error locating CC x position information, error = %d\n",status);
+			quickfits_error("ERROR : quickfits_read_cc_table -->  Error locating CC x position information, error = %d\n",status);
 		}
 		fits_read_col(fptr,TDOUBLE,colnum,1,1,fitsi.ncc,&double_null,cc_xarray,&int_null,&status);
 		if(status!=0)
 		{
-			printf("ERROR : quickfits_read_cc_table -->  Error reading CC x position information, error = %d\n",status);
+			quickfits_error("ERROR : quickfits_read_cc_table -->  Error reading CC x position information, error = %d\n",status);
 		}
 
 		fits_get_colnum(fptr,CASEINSEN,yname,&colnum,&status);
 		if(status!=0)
 		{
-			printf("ERROR : quickfits_read_cc_table -->  Error locating CC y position information, error = %d\n",status);
+			quickfits_error("ERROR : quickfits_read_cc_table -->  Error locating CC y position information, error = %d\n",status);
 		}
 		fits_read_col(fptr,TDOUBLE,colnum,1,1,fitsi.ncc,&double_null,cc_yarray,&int_null,&status);
 		if(status!=0)
 		{
-			printf("ERROR : quickfits_read_cc_table -->  Error reading CC y position information, error = %d\n",status);
+			quickfits_error("ERROR : quickfits_read_cc_table -->  Error reading CC y position information, error = %d\n",status);
 		}
 
 		fits_get_colnum(fptr,CASEINSEN,fluxname,&colnum,&status);
 		if(status!=0)
 		{
-			printf("ERROR : quickfits_read_cc_table -->  Error locating CC flux position information, error = %d\n",status);
+			quickfits_error("ERROR : quickfits_read_cc_table -->  Error locating CC flux position information, error = %d\n",status);
 		}
 		fits_read_col(fptr,TDOUBLE,colnum,1,1,fitsi.ncc,&double_null,cc_varray,&int_null,&status);
 		if(status!=0)
 		{
-			printf("ERROR : quickfits_read_cc_table -->  Error reading CC flux position information, error = %d\n",status);
+			quickfits_error("ERROR : quickfits_read_cc_table -->  Error reading CC flux position information, error = %d\n",status);
 		}
 	}
 
-	if ( fits_close_file(fptr, &status) )
+	if ( quickfits_close_file(fptr, &status) )
 	{
-		printf("ERROR : quickfits_read_cc_table --> Error closing FITS file, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_cc_table --> Error closing FITS file, error = %d\n",status);
 		return(status);
 	}
 
 	return(status);
 }
+
+int quickfits_read_cc_table(const char* filename , fitsinfo_map fitsi , double* cc_xarray, double* cc_yarray, double* cc_varray)
+{
+/*
+	INPUTS:
+		const char* tfilename : c string = name of FITS file to be read
+		long long ncc : number of clean components to be read (0 if no cc table expected/needed)
+        int cc_table_version : Version of CC table to read
+	OUTPUTS:
+		cc_xarray : 1D fp array containing x coords of clean components in degrees
+		cc_yarray : 1D fp array containing y coords of clean components in degrees
+		cc_varray : 1D fp array containing values of clean components in degrees
+ 
+    RETURN:
+        0 on success.
+*/
+	long long start;
+	int status;
+
+	start = quickfits_trace_start();
+	status = read_cc_table(filename, fitsi, cc_xarray, cc_yarray, cc_varray);
+	quickfits_trace_api("quickfits_read_cc_table", start);
+
+	return(status);
+}
@@ -13,19 +13,92 @@
 
 #include "quickfits.h"
 
-int quickfits_read_map(const char* filename, fitsinfo_map fitsi , double* tarr , double* cc_xarray, double* cc_yarray, double* cc_varray)
+#define STATS_BLOCK 65536	// pixels read at a time when computing statistics (small enough to stay in cache)
+
+typedef struct image_decode_tag{
+	char tform_code;
+	double scale;
+	double zero;
+	double* tarr;
+	quickfits_stats* plane_stats;
+}image_decode;
+
+static int decode_pixels(const unsigned char* pixels, long long npix, long long first, void* arg)
+{
+	// decode a run of big-endian pixels as fits_read_img would (blanked floating point pixels are already NaN)
+
+	image_decode* image = (image_decode*)(arg);
+	double* out;
+	int status;
+
+	out = &image[0].tarr[first];
+	status = quickfits_decode_column(pixels, 1, npix*quickfits_tform_width(image[0].tform_code), 0, image[0].tform_code, npix, image[0].scale, image[0].zero, out);
+	if(image[0].plane_stats != NULL)
+	{
+		quickfits_stats_add(image[0].plane_stats, out, npix);
+	}
+
+	return(status);
+}
+
+static bool read_image_direct(fitsfile* fptr, const char* filename, long long npix, double* tarr, quickfits_stats* plane_stats, int* status)
+{
+	// Read the primary image in large blocks (see quickfits_set_direct_io), using cfitsio only for the header.
+	// Returns false if it can't be read this way (integer pixels with BLANK, unusual BITPIX), leaving it to fits_read_img.
+
+	image_decode image;
+	LONGLONG header_start, data_start, data_end;
+	char comment[FLEN_VALUE];
+	long long blank;
+	int bitpix, err;
+
+	err = 0;
+	fits_read_key(fptr,TINT,"BITPIX",&bitpix,comment,&err);
+	fits_get_hduaddrll(fptr,&header_start,&data_start,&data_end,&err);
+	image.scale = 1.0;
+	image.zero = 0.0;
+	fits_read_key(fptr,TDOUBLE,"BSCALE",&image.scale,comment,&err);
+	if(err == KEY_NO_EXIST)
+	{
+		err = 0;
+	}
+	fits_read_key(fptr,TDOUBLE,"BZERO",&image.zero,comment,&err);
+	if(err == KEY_NO_EXIST)
+	{
+		err = 0;
+	}
+	if(bitpix > 0)	// blanked integer pixels need the null check
+	{
+		fits_read_key(fptr,TLONGLONG,"BLANK",&blank,comment,&err);
+		err = (err == KEY_NO_EXIST) ? 0 : 1;
+	}
+	switch(bitpix)
+	{
+		case 8: image.tform_code = 'B'; break;
+		case 16: image.tform_code = 'I'; break;
+		case 32: image.tform_code = 'J'; break;
+		case 64: image.tform_code = 'K'; break;
+		case -32: image.tform_code = 'E'; break;
+		case -64: image.tform_code = 'D'; break;
+		default: err = 1;
+	}
+	if(err != 0 || data_end - data_start < npix*quickfits_tform_width(image.tform_code))
+	{
+		return(false);
+	}
+
+	image.tarr = tarr;
+	image.plane_stats = plane_stats;
+	if(plane_stats != NULL)
+	{
+		quickfits_stats_init(plane_stats);
+	}
+	*status = quickfits_read_records(filename, data_start, npix, quickfits_tform_width(image.tform_code), decode_pixels, &image);
+	return(true);
+}
+
+static int read_map_stats(const char* filename, fitsinfo_map fitsi , double* tarr , double* cc_xarray, double* cc_yarray, double* cc_varray, quickfits_stats* plane_stats)
 {
-/*
-	INPUTS:
-		const char* tfilename : c string = name of FITS file to be read
-		int dim2 : number of pixels to be read
-		int ncc : number of clean components to be read (0 if no cc table expected/needed)
-	OUTPUTS:
-		tarr : 1D floating point array containing pixel values.  ****** NB! This is in row major order, converted Fortran code ****
-		cc_xarray : 1D fp array containing x coords of clean components in degrees
-		cc_yarray : 1D fp array containing y coords of clean components in degrees
-		cc_varray : 1D fp array containing values of clean components in degrees
-*/
 	fitsfile *fptr;
 
 	int status;
@@ -33,44 +106,72 @@ int quickfits_read_map(const char* filename, fitsinfo_map fitsi , double* tarr ,
 	double nullval=NAN;
 	int int_null=0;
 	double double_null=0;
-	long fpixel=1;
+	LONGLONG fpixel=1;
+	long long npix;
+	long long dims[2];
 	char cchdu[]="AIPS CC ";
 	char fluxname[]="FLUX";
 	char xname[]="DELTAX";
 	char yname[]="DELTAY";
 	int colnum;
-	int i;
+	long long first, nread;
+	long long start;
+	bool direct;
 
 
 	status = 0;	// for error processing
 
 
-	if ( fits_open_file(&fptr,filename, READONLY, &status) )	// open file and make sure it's open
+	if ( quickfits_open_file(&fptr,filename, READONLY, &status) )	// open file and make sure it's open
 	{
-		printf("ERROR : quickfits_read_map --> Error opening FITS file, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_map --> Error opening FITS file, error = %d\n",status);
 		return(status);
 	}
 
 
 	if (fits_movabs_hdu(fptr,1,IMAGE_HDU,&status))		// move to main AIPS image hdu
 	{
-		printf("ERROR : quickfits_read_map --> Error locating AIPS primary image extension, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_map --> Error locating AIPS primary image extension, error = %d\n",status);
 		return(status);
 	}
 	// read in main image data data
 
-	i = fitsi.imsize_ra * fitsi.imsize_dec;
-	fits_read_img(fptr, TDOUBLE, fpixel, i, &nullval, tarr, &int_null, &status);
+	dims[0] = fitsi.imsize_ra;
+	dims[1] = fitsi.imsize_dec;
+	if(quickfits_element_count(2, dims, &npix))
+	{
+		quickfits_error("ERROR : quickfits_read_map --> Image size %lld x %lld is too large\n",fitsi.imsize_ra,fitsi.imsize_dec);
+		quickfits_close_file(fptr, &status);
+		return(NUM_OVERFLOW);
+	}
+	start = quickfits_trace_start();
+	direct = quickfits_direct_io_file(filename) && read_image_direct(fptr, filename, npix, tarr, plane_stats, &status);
+	if(!direct && plane_stats == NULL)
+	{
+		fits_read_img(fptr, TDOUBLE, fpixel, npix, &nullval, tarr, &int_null, &status);
+	}
+	else if(!direct)	// read a block at a time, adding each to the statistics while it's still in cache
+	{
+		quickfits_stats_init(plane_stats);
+		for(first=0;first<npix && status==0;first+=STATS_BLOCK)
+		{
+			nread = (npix-first < STATS_BLOCK) ? npix-first : STATS_BLOCK;
+			fits_read_img(fptr, TDOUBLE, fpixel+first, nread, &nullval, &tarr[first], &int_null, &status);
+			quickfits_stats_add(plane_stats, &tarr[first], nread);
+		}
+	}
+	quickfits_trace_phase(QUICKFITS_PHASE_READ, start);
+	quickfits_count_io(npix*sizeof(double), 0, 0, 0);
 	if(status!=0)
 	{
-		printf("ERROR : quickfits_read_map --> Error reading map, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_map --> Error reading map, error = %d\n",status);
 	}
 
 	if(fitsi.ncc > 0)	// read in cc data if present/required
 	{
-		if (fits_movnam_hdu(fptr,BINARY_TBL,cchdu,fitsi.cc_table_version,&status))		// move to main AIPS image hdu
+		if (quickfits_movnam_hdu(fptr,filename,BINARY_TBL,cchdu,fitsi.cc_table_version,&status))		// move to main AIPS image hdu
 		{
-			printf("ERROR : quickfits_read_map --> Error locating AIPS clean component extension, error = %d\n",status);
+			quickfits_error("ERROR : quickfits_read_map --> Error locating AIPS clean component extension, error = %d\n",status);
 			return(status);
 		}
 		else
@@ -78,43 +179,84 @@ int quickfits_read_map(const char* filename, fitsinfo_map fitsi , double* tarr ,
 			fits_get_colnum(fptr,CASEINSEN,xname,&colnum,&status);
 			if(status!=0)
 			{
-				printf("ERROR : quickfits_read_map -->  Error locating CC x position information, error = %d\n",status);
+				quickfits_error("ERROR : quickfits_read_map -->  Error locating CC x position information, error = %d\n",status);
 			}
 			fits_read_col(fptr,TDOUBLE,colnum,1,1,fitsi.ncc,&double_null,cc_xarray,&int_null,&status);
 			if(status!=0)
 			{
-				printf("ERROR : quickfits_read_map -->  Error reading CC x position information, error = %d\n",status);
+				quickfits_error("ERROR : quickfits_read_map -->  Error reading CC x position information, error = %d\n",status);
 			}
 
 			fits_get_colnum(fptr,CASEINSEN,yname,&colnum,&status);
 			if(status!=0)
 			{
-				printf("ERROR : quickfits_read_map -->  Error locating CC y position information, error = %d\n",status);
+				quickfits_error("ERROR : quickfits_read_map -->  Error locating CC y position information, error = %d\n",status);
 			}
 			fits_read_col(fptr,TDOUBLE,colnum,1,1,fitsi.ncc,&double_null,cc_yarray,&int_null,&status);
 			if(status!=0)
 			{
-				printf("ERROR : quickfits_read_map -->  Error reading CC y position information, error = %d\n",status);
+				quickfits_error("ERROR : quickfits_read_map -->  Error reading CC y position information, error = %d\n",status);
 			}
 
 			fits_get_colnum(fptr,CASEINSEN,fluxname,&colnum,&status);
 			if(status!=0)
 			{
-				printf("ERROR : quickfits_read_map -->  Error locating CC flux position information, error = %d\n",status);
+				quickfits_error("ERROR : quickfits_read_map -->  Error locating CC flux position information, error = %d\n",status);
 			}
 			fits_read_col(fptr,TDOUBLE,colnum,1,1,fitsi.ncc,&double_null,cc_varray,&int_null,&status);
 			if(status!=0)
 			{
-				printf("ERROR : quickfits_read_map -->  Error reading CC flux position information, error = %d\n",status);
+				quickfits_error("ERROR : quickfits_read_map -->  Error reading CC flux position information, error = %d\n",status);
 			}
 		}
 	}
 
-	if ( fits_close_file(fptr, &status) )
+	if ( quickfits_close_file(fptr, &status) )
 	{
-		printf("ERROR : quickfits_read_map --> Error closing FITS file, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_map --> Error closing FITS file, error = %d\n",status);
 		return(status);
 	}
 
 	return(status);
 }
+
+int quickfits_read_map_stats(const char* filename, fitsinfo_map fitsi , double* tarr , double* cc_xarray, double* cc_yarray, double* cc_varray, quickfits_stats* plane_stats)
+{
+/*
+	As quickfits_read_map, also computing statistics of the plane as it is read (NULL to skip)
+
+	OUTPUTS:
+		plane_stats : min, max, mean, RMS, standard deviation and number of NaN (blanked) pixels of the map
+*/
+	long long start;
+	int status;
+
+	start = quickfits_trace_start();
+	status = read_map_stats(filename, fitsi, tarr, cc_xarray, cc_yarray, cc_varray, plane_stats);
+	quickfits_trace_api("quickfits_read_map_stats", start);
+
+	return(status);
+}
+
+int quickfits_read_map(const char* filename, fitsinfo_map fitsi , double* tarr , double* cc_xarray, double* cc_yarray, double* cc_varray)
+{
+/*
+	INPUTS:
+		const char* tfilename : c string = name of FITS file to be read
+		long long imsize_ra, imsize_dec : size of the map to be read
+		long long ncc : number of clean components to be read (0 if no cc table expected/needed)
+	OUTPUTS:
+		tarr : 1D floating point array containing pixel values.  ****** NB! This is in row major order, converted Fortran code ****
+		cc_xarray : 1D fp array containing x coords of clean components in degrees
+		cc_yarray : 1D fp array containing y coords of clean components in degrees
+		cc_varray : 1D fp array containing values of clean components in degrees
+*/
+	long long start;
+	int status;
+
+	start = quickfits_trace_start();
+	status = read_map_stats(filename, fitsi, tarr, cc_xarray, cc_yarray, cc_varray, NULL);
+	quickfits_trace_api("quickfits_read_map", start);
+
+	return(status);
+}
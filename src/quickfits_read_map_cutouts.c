@@ -0,0 +1,317 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define CUTOUT_BATCH 256	// files open at a time
+
+typedef struct cutout_file_tag{
+	int fd;
+	char tform_code;
+	double scale;
+	double zero;
+	bool blanked;	// integer pixels equal to BLANK are NaN
+	long long blank;
+	int status;
+}cutout_file;
+
+typedef struct cutout_row_tag{
+	cutout_file* file;
+	double* out;
+	long long npix;
+}cutout_row;
+
+static void decode_row(int status, const unsigned char* data, long long nread, void* arg)
+{
+	// one row of a cutout has been read
+
+	cutout_row* row = (cutout_row*)(arg);
+	cutout_file* file = row[0].file;
+	double blank;
+	long long i;
+
+	if(status == 0 && nread < row[0].npix*quickfits_tform_width(file[0].tform_code))
+	{
+		status = READ_ERROR;	// the file is shorter than its header says
+	}
+	if(status == 0)
+	{
+		status = quickfits_decode_column(data, 1, nread, 0, file[0].tform_code, row[0].npix, file[0].scale, file[0].zero, row[0].out);
+	}
+	if(status == 0 && file[0].blanked)
+	{
+		blank = (file[0].scale == 1.0 && file[0].zero == 0.0) ? (double)(file[0].blank) : file[0].blank*file[0].scale + file[0].zero;	// as decoded
+		for(i=0;i<row[0].npix;i++)
+		{
+			if(row[0].out[i] == blank)
+			{
+				row[0].out[i] = NAN;
+			}
+		}
+	}
+	if(status != 0 && file[0].status == 0)
+	{
+		file[0].status = status;
+	}
+}
+
+static int read_cutout_cfitsio(const char* filename, long long x0, long long y0, long long nx, long long ny, double* out)
+{
+	// memory and compressed files, through cfitsio
+
+	fitsfile *fptr;
+	long long naxis1, naxis2, x, y, xa, xb, ya, yb;
+	long* blc;	// one for each axis, as fits_read_subset indexes up to NAXIS
+	long* trc;
+	long* inc;
+	double nullval=NAN;
+	double* region;
+	char comment[FLEN_VALUE];
+	int status, anynull, naxis, k;
+
+	status = 0;
+	if(quickfits_open_file(&fptr,filename,READONLY,&status))
+	{
+		return(status);
+	}
+	naxis = 0;
+	naxis2 = 1;
+	fits_read_key(fptr,TINT,"NAXIS",&naxis,comment,&status);
+	fits_read_key(fptr,TLONGLONG,"NAXIS1",&naxis1,comment,&status);
+	fits_read_key(fptr,TLONGLONG,"NAXIS2",&naxis2,comment,&status);
+	xa = (x0 > 0) ? x0 : 0;
+	xb = (x0 + nx < naxis1) ? x0 + nx : naxis1;
+	ya = (y0 > 0) ? y0 : 0;
+	yb = (y0 + ny < naxis2) ? y0 + ny : naxis2;
+	if(status == 0 && xa < xb && ya < yb)
+	{
+		region = malloc((xb-xa)*(yb-ya)*sizeof(double));
+		blc = malloc(3*(naxis+2)*sizeof(long));
+		if(region == NULL || blc == NULL)
+		{
+			free(region);
+			free(blc);
+			status = MEMORY_ALLOCATION;
+		}
+		else
+		{
+			trc = blc + (naxis+2);
+			inc = trc + (naxis+2);
+			for(k=0;k<naxis+2;k++)	// first plane of any higher axes
+			{
+				blc[k] = 1;
+				trc[k] = 1;
+				inc[k] = 1;
+			}
+			blc[0] = xa + 1;
+			blc[1] = ya + 1;
+			trc[0] = xb;
+			trc[1] = yb;
+			fits_read_subset(fptr, TDOUBLE, blc, trc, inc, &nullval, region, &anynull, &status);
+			for(y=ya;y<yb && status==0;y++)
+			{
+				for(x=xa;x<xb;x++)
+				{
+					out[(y-y0)*nx + (x-x0)] = region[(y-ya)*(xb-xa) + (x-xa)];
+				}
+			}
+			free(region);
+			free(blc);
+		}
+	}
+	quickfits_close_file(fptr, &status);
+	return(status);
+}
+
+static int submit_cutout(quickfits_io_engine* engine, const char* filename, cutout_file* file, cutout_row* rows, long long x0, long long y0, long long nx, long long ny, double* out)
+{
+	// read the header, then queue a read for each row of the cutout that overlaps the image
+
+	fitshdu hdu;
+	char* cards;
+	long long naxis1, naxis2, width, y, xa, xb, ya, yb;
+	int ncards, bitpix, status, tstatus;
+
+	file[0].fd = open(filename, O_RDONLY);
+	if(file[0].fd < 0)
+	{
+		return(FILE_NOT_OPENED);
+	}
+	status = quickfits_scan_hdu(file[0].fd, 0, &hdu, &cards, &ncards);
+	if(status != 0)
+	{
+		return(status);
+	}
+	naxis1 = 0;
+	naxis2 = 1;
+	file[0].scale = 1.0;
+	file[0].zero = 0.0;
+	quickfits_read_card(cards, ncards, "BITPIX", TINT, &bitpix, &status);
+	quickfits_read_card(cards, ncards, "NAXIS1", TLONGLONG, &naxis1, &status);
+	tstatus = 0;
+	quickfits_read_card(cards, ncards, "NAXIS2", TLONGLONG, &naxis2, &tstatus);
+	tstatus = 0;
+	quickfits_read_card(cards, ncards, "BSCALE", TDOUBLE, &file[0].scale, &tstatus);
+	tstatus = 0;
+	quickfits_read_card(cards, ncards, "BZERO", TDOUBLE, &file[0].zero, &tstatus);
+	tstatus = 0;
+	quickfits_read_card(cards, ncards, "BLANK", TLONGLONG, &file[0].blank, &tstatus);
+	file[0].blanked = (tstatus == 0 && bitpix > 0);
+	free(cards);
+
+	switch(bitpix)
+	{
+		case 8: file[0].tform_code = 'B'; break;
+		case 16: file[0].tform_code = 'I'; break;
+		case 32: file[0].tform_code = 'J'; break;
+		case 64: file[0].tform_code = 'K'; break;
+		case -32: file[0].tform_code = 'E'; break;
+		case -64: file[0].tform_code = 'D'; break;
+		default: status = (status == 0) ? BAD_BITPIX : status;
+	}
+	if(status != 0)
+	{
+		return(status);
+	}
+	width = quickfits_tform_width(file[0].tform_code);
+
+	xa = (x0 > 0) ? x0 : 0;
+	xb = (x0 + nx < naxis1) ? x0 + nx : naxis1;
+	ya = (y0 > 0) ? y0 : 0;
+	yb = (y0 + ny < naxis2) ? y0 + ny : naxis2;
+	for(y=ya;y<yb && xa<xb && status==0;y++)
+	{
+		rows[y-y0].file = file;
+		rows[y-y0].out = &out[(y-y0)*nx + (xa-x0)];
+		rows[y-y0].npix = xb - xa;
+		status = quickfits_io_submit(engine, file[0].fd, hdu.data_offset + (y*naxis1 + xa)*width, (xb-xa)*width, decode_row, &rows[y-y0]);
+	}
+	return(status);
+}
+
+static int read_map_cutouts(int nfiles, const char** filenames, const long long* x0, const long long* y0, long long nx, long long ny, double* cutouts, int* status, quickfits_io_engine* engine)
+{
+	quickfits_io_engine* own_engine;
+	cutout_file* files;
+	cutout_row* rows;
+	double* out;
+	long long i;
+	int k, first, nbatch, nfailed, err;
+	size_t len;
+
+	own_engine = NULL;
+	if(engine == NULL)
+	{
+		err = quickfits_io_engine_open(&own_engine, 0, 0, true);
+		if(err != 0)
+		{
+			return(nfiles);
+		}
+		engine = own_engine;
+	}
+	files = malloc(CUTOUT_BATCH*sizeof(cutout_file));
+	rows = malloc(CUTOUT_BATCH*ny*sizeof(cutout_row));
+	if(files == NULL || rows == NULL)
+	{
+		quickfits_error("ERROR : quickfits_read_map_cutouts --> Unable to allocate memory for %d files\n",CUTOUT_BATCH);
+		free(files);
+		free(rows);
+		quickfits_io_engine_close(own_engine);
+		return(nfiles);
+	}
+
+	nfailed = 0;
+	for(first=0;first<nfiles;first+=CUTOUT_BATCH)
+	{
+		nbatch = (nfiles-first < CUTOUT_BATCH) ? nfiles-first : CUTOUT_BATCH;
+		for(k=0;k<nbatch;k++)	// the rows of every file in the batch are in flight together
+		{
+			out = &cutouts[(first+k)*nx*ny];
+			for(i=0;i<nx*ny;i++)
+			{
+				out[i] = NAN;	// pixels off the edge of the map
+			}
+			files[k].fd = -1;
+			files[k].status = 0;
+			len = strlen(filenames[first+k]);
+			if(quickfits_memfile_lookup(filenames[first+k]) != NULL || (len > 3 && !strcmp(filenames[first+k]+len-3,".gz")))
+			{
+				files[k].status = read_cutout_cfitsio(filenames[first+k], x0[first+k], y0[first+k], nx, ny, out);
+			}
+			else
+			{
+				err = submit_cutout(engine, filenames[first+k], &files[k], &rows[k*ny], x0[first+k], y0[first+k], nx, ny, out);
+				if(err != 0 && files[k].status == 0)
+				{
+					files[k].status = err;
+				}
+			}
+		}
+		quickfits_io_wait(engine);	// failures are recorded per file by decode_row
+
+		for(k=0;k<nbatch;k++)
+		{
+			if(files[k].fd >= 0)
+			{
+				close(files[k].fd);
+			}
+			if(status != NULL)
+			{
+				status[first+k] = files[k].status;
+			}
+			if(files[k].status != 0)
+			{
+				quickfits_error("ERROR : quickfits_read_map_cutouts --> Error reading %s, error = %d\n",filenames[first+k],files[k].status);
+				nfailed++;
+			}
+		}
+	}
+
+	free(files);
+	free(rows);
+	quickfits_io_engine_close(own_engine);
+	return(nfailed);
+}
+
+int quickfits_read_map_cutouts(int nfiles, const char** filenames, const long long* x0, const long long* y0, long long nx, long long ny, double* cutouts, int* status, quickfits_io_engine* engine)
+{
+/*
+	Read the same size region of the primary image of many maps. Each row of each cutout is a separate read, and every
+	read for up to 256 files is in flight on the I/O engine at once. Point samples are 1 x 1 cutouts.
+ 
+	INPUTS:
+		int nfiles : number of files
+		const char** filenames : names of the maps
+		const long long* x0, y0 : nfiles (0-based) pixel positions of the lower left corner of each cutout
+		long long nx, ny : size of the cutouts
+		quickfits_io_engine* engine : engine to read with (NULL to start one with the default settings for this call)
+	OUTPUTS:
+		cutouts : nfiles*nx*ny pixel values, cutout i starting at cutouts[i*nx*ny] and ordered as in quickfits_read_map.
+			Pixels off the edge of the map, and blanked pixels, are NaN.
+		status : (optional, may be NULL) nfiles return values, 0 for each file read successfully
+ 
+	RETURN:
+		Number of files which could not be read (0 on success).
+*/
+	long long start;
+	int nfailed;
+
+	start = quickfits_trace_start();
+	nfailed = read_map_cutouts(nfiles, filenames, x0, y0, nx, ny, cutouts, status, engine);
+	quickfits_trace_api("quickfits_read_map_cutouts", start);
+
+	return(nfailed);
+}
@@ -13,23 +13,8 @@
 
 #include "quickfits.h"
 
-int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
+static int read_map_header(const char* filename , fitsinfo_map* fitsi)
 {
-
-/*
-    Read in map header information
- 
-	INPUTS:
-		char* tfilename : c string = name of FITS file to be read
-	OUTPUTS:
-		ra = right ascention
-		dec = declination
-		object = name of source
-		freq = frequency
-		cell =  cellsize (degrees)
-		dim = image size
-		bmaj, bmin, bpa = beam information (degrees)
-*/
 	fitsfile *fptr;
 
 	int status,i,j;
@@ -47,7 +32,6 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 	float floatbuff;
 	float float_null=0;
 	int int_null=0;
-	long longbuff;
 
 
 	status = 0;	// for error processing
@@ -55,16 +39,16 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 
 
 
-	if ( fits_open_file(&fptr,filename, READONLY, &status) )	// open file and make sure it's open
+	if ( quickfits_open_file(&fptr,filename, READONLY, &status) )	// open file and make sure it's open
 	{
-		printf("ERROR : quickfits_read_map_header --> Error opening FITS file, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_map_header --> Error opening FITS file, error = %d\n",status);
 		return(status);
 	}
 
 	if (fits_movabs_hdu(fptr,1,&i,&status))		// move to main AIPS image HDU (assuming it's the first one)
 	{
-		printf("ERROR : quickfits_read_map_header --> Error locating AIPS ACSII table extension, error = %d\n",status);
-		printf("ERROR : quickfits_read_map_header --> Did you remember to use the AIPS FITAB task instead of FITTP?\n");
+		quickfits_error("ERROR : quickfits_read_map_header --> Error locating AIPS ACSII table extension, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_map_header --> Did you remember to use the AIPS FITAB task instead of FITTP?\n");
 		return(status);
 	}
 
@@ -85,8 +69,8 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 	while(status!=KEY_NO_EXIST)
 	{
 		if(status != 0) {
-			printf("ERROR : quickfits_read_map_header -->  Error reading from %s\n", filename);
-			printf("ERROR : quickfits_read_map_header -->  FITSIO error code: %d\n", status);
+			quickfits_error("ERROR : quickfits_read_map_header -->  Error reading from %s\n", filename);
+			quickfits_error("ERROR : quickfits_read_map_header -->  FITSIO error code: %d\n", status);
 			return(1);
 		}
 		sprintf(key_name,"CTYPE%d",i);
@@ -100,7 +84,7 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 			fits_read_key(fptr,TDOUBLE,key_name,&fitsi[0].ra,comment,&status);
 			if(status==KEY_NO_EXIST)
 			{
-				printf("WARNING : quickfits_read_map_header --> Missing RA information %s\n",key_name);
+				quickfits_error("WARNING : quickfits_read_map_header --> Missing RA information %s\n",key_name);
 				status= 0;
 			}
 			
@@ -108,7 +92,7 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 			fits_read_key(fptr,TDOUBLE,key_name,&temp,comment,&status);
 			if(status==KEY_NO_EXIST)
 			{
-				printf("WARNING : quickfits_read_map_header --> Missing RA information %s\n",key_name);
+				quickfits_error("WARNING : quickfits_read_map_header --> Missing RA information %s\n",key_name);
 				status= 0;
 			}
 			else
@@ -120,7 +104,7 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 			fits_read_key(fptr,TDOUBLE,key_name,&temp,comment,&status);
 			if(status==KEY_NO_EXIST)
 			{
-				printf("WARNING : quickfits_read_map_header --> Missing RA information %s\n",key_name);
+				quickfits_error("WARNING : quickfits_read_map_header --> Missing RA information %s\n",key_name);
 				status= 0;
 			}
 			else
@@ -132,7 +116,7 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 			fits_read_key(fptr,TDOUBLE,key_name,&temp,comment,&status);
 			if(status==KEY_NO_EXIST)
 			{
-				printf("WARNING : quickfits_read_map_header --> Missing RA information %s\n",key_name);
+				quickfits_error("WARNING : quickfits_read_map_header --> Missing RA information %s\n",key_name);
 				status= 0;
 			}
 			else
@@ -149,7 +133,7 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 			fits_read_key(fptr,TDOUBLE,key_name,&fitsi[0].dec,comment,&status);
 			if(status==KEY_NO_EXIST)
 			{
-				printf("WARNING : quickfits_read_map_header --> Missing DEC information %s\n",key_name);
+				quickfits_error("WARNING : quickfits_read_map_header --> Missing DEC information %s\n",key_name);
 				status = 0;
 			}
 			
@@ -157,7 +141,7 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 			fits_read_key(fptr,TDOUBLE,key_name,&temp,comment,&status);
 			if(status==KEY_NO_EXIST)
 			{
-				printf("WARNING : quickfits_read_map_header --> Missing RA information %s\n",key_name);
+				quickfits_error("WARNING : quickfits_read_map_header --> Missing RA information %s\n",key_name);
 				status= 0;
 			}
 			else
@@ -169,7 +153,7 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 			fits_read_key(fptr,TDOUBLE,key_name,&temp,comment,&status);
 			if(status==KEY_NO_EXIST)
 			{
-				printf("WARNING : quickfits_read_map_header --> Missing DEC information %s\n",key_name);
+				quickfits_error("WARNING : quickfits_read_map_header --> Missing DEC information %s\n",key_name);
 				status = 0;
 			}
 			else
@@ -181,7 +165,7 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 			fits_read_key(fptr,TDOUBLE,key_name,&temp,comment,&status);			
 			if(status==KEY_NO_EXIST)
 			{
-				printf("WARNING : quickfits_read_map_header --> Missing DEC information %s\n",key_name);
+				quickfits_error("WARNING : quickfits_read_map_header --> Missing DEC information %s\n",key_name);
 				status = 0;
 			}
 			else
@@ -198,7 +182,7 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 			fits_read_key(fptr,TDOUBLE,key_name,&fitsi[0].freq,comment,&status);
 			if(status==KEY_NO_EXIST)
 			{
-				printf("WARNING : quickfits_read_map_header --> Missing FREQ information %s\n",key_name);
+				quickfits_error("WARNING : quickfits_read_map_header --> Missing FREQ information %s\n",key_name);
 				status = 0;
 			}
 
@@ -206,7 +190,7 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 			fits_read_key(fptr,TDOUBLE,key_name,&fitsi[0].freq_delta,comment,&status);
 			if(status==KEY_NO_EXIST)
 			{
-				printf("WARNING : quickfits_read_map_header --> Missing FREQ information %s\n",key_name);
+				quickfits_error("WARNING : quickfits_read_map_header --> Missing FREQ information %s\n",key_name);
 				status = 0;
 			}
 		}
@@ -218,7 +202,7 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 
 			if(status==KEY_NO_EXIST)
 			{
-				printf("WARNING : quickfits_read_map_header --> Missing Stokes information %s\n",key_name);
+				quickfits_error("WARNING : quickfits_read_map_header --> Missing Stokes information %s\n",key_name);
 				status = 0;
 			}
 			else
@@ -231,20 +215,17 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 	status=0;
 	if(j!=3)
 	{
-		printf("WARNING : quickfits_read_map_header --> Error reading RA, DEC, FREQ information\n");
-		printf("\t Only %d out of 3 read.\n",j);
+		quickfits_error("WARNING : quickfits_read_map_header --> Error reading RA, DEC, FREQ information\n\t Only %d out of 3 read.\n",j);
 	}
 
 
-	fits_read_key(fptr,TDOUBLE,"NAXIS1",&temp,comment,&status);
-	fitsi[0].imsize_ra=(int)(temp);	// dim is stored as a double in the FITS file
+	fits_read_key(fptr,TLONGLONG,"NAXIS1",&fitsi[0].imsize_ra,comment,&status);
 	
-	fits_read_key(fptr,TDOUBLE,"NAXIS2",&temp,comment,&status);
-	fitsi[0].imsize_dec=(int)(temp);	// dim is stored as a double in the FITS file
+	fits_read_key(fptr,TLONGLONG,"NAXIS2",&fitsi[0].imsize_dec,comment,&status);
 
 	if(status!=0)
 	{
-		printf("ERROR : quickfits_read_map_header --> Error reading image size from NAXIS1, error = %d\n",err);
+		quickfits_error("ERROR : quickfits_read_map_header --> Error reading image size from NAXIS1, error = %d\n",err);
 		return(err);
 	}
 
@@ -259,9 +240,9 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 	if(err!=0)	// if the beam information isn't in the main header, move to AIPS CG HDU for beam information
 	{
 		status=0;
-		if (fits_movnam_hdu(fptr,BINARY_TBL,beamhdu,0,&status))		// move to beam information hdu
+		if (quickfits_movnam_hdu(fptr,filename,BINARY_TBL,beamhdu,0,&status))		// move to beam information hdu
 		{
-			printf("WARNING : quickfits_read_map_header --> No beam information found.\n");
+			quickfits_error("WARNING : quickfits_read_map_header --> No beam information found.\n");
 			fitsi[0].bmaj = 0.0;
 			fitsi[0].bmin = 0.0;	// changed this because model files don't have any beam information. Should check to make sure beam info is valid in other code
 			fitsi[0].bpa = 0.0;
@@ -272,13 +253,13 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 			fits_get_colnum(fptr,CASEINSEN,bmajname,&colnum,&status);
 			if(status!=0)
 			{
-				printf("ERROR : quickfits_read_map_header -->  Error locating BMAJ information, error = %d\n",status);
+				quickfits_error("ERROR : quickfits_read_map_header -->  Error locating BMAJ information, error = %d\n",status);
 				return(err);
 			}
 			fits_read_col(fptr,TFLOAT,colnum,1,1,1,&float_null,&floatbuff,&int_null,&status);
 			if(status!=0)
 			{
-				printf("ERROR : quickfits_read_map_header -->  Error reading BMAJ information, error = %d\n",status);
+				quickfits_error("ERROR : quickfits_read_map_header -->  Error reading BMAJ information, error = %d\n",status);
 				return(err);
 			}
 			else
@@ -289,13 +270,13 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 			fits_get_colnum(fptr,CASEINSEN,bminname,&colnum,&status);
 			if(status!=0)
 			{
-				printf("ERROR : quickfits_read_map_header -->  Error locating BMIN information, error = %d\n",status);
+				quickfits_error("ERROR : quickfits_read_map_header -->  Error locating BMIN information, error = %d\n",status);
 				return(err);
 			}
 			fits_read_col(fptr,TFLOAT,colnum,1,1,1,&float_null,&floatbuff,&int_null,&status);
 			if(status!=0)
 			{
-				printf("ERROR : quickfits_read_map_header -->  Error reading BMIN information, error = %d\n",status);
+				quickfits_error("ERROR : quickfits_read_map_header -->  Error reading BMIN information, error = %d\n",status);
 				return(err);
 			}
 			else
@@ -306,13 +287,13 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 			fits_get_colnum(fptr,CASEINSEN,bpaname,&colnum,&status);
 			if(status!=0)
 			{
-				printf("ERROR : quickfits_read_map_header -->  Error locating BPA information, error = %d\n",status);
+				quickfits_error("ERROR : quickfits_read_map_header -->  Error locating BPA information, error = %d\n",status);
 				return(err);
 			}
 			fits_read_col(fptr,TFLOAT,colnum,1,1,1,&float_null,&floatbuff,&int_null,&status);
 			if(status!=0)
 			{
-				printf("ERROR : quickfits_read_map_header -->  Error reading BPA information, error = %d\n",status);
+				quickfits_error("ERROR : quickfits_read_map_header -->  Error reading BPA information, error = %d\n",status);
 				return(err);
 			}
 			else
@@ -331,20 +312,19 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 
 	if (fitsi[0].cc_table_version >=0 )
 	{
-		fits_movnam_hdu(fptr,ANY_HDU,cchdu,fitsi[0].cc_table_version,&status);
+		quickfits_movnam_hdu(fptr,filename,ANY_HDU,cchdu,fitsi[0].cc_table_version,&status);
 		if (status==0)		// move to main AIPS UV hdu
 		{
-			fits_get_num_rows(fptr,&longbuff,&status);
-			fitsi[0].ncc=longbuff;
+			fits_get_num_rowsll(fptr,&fitsi[0].ncc,&status);
 			if(status!=0)
 			{
-				printf("ERROR : quickfits_read_map_header -->  Error reading number of clean components, error = %d\n",status);
+				quickfits_error("ERROR : quickfits_read_map_header -->  Error reading number of clean components, error = %d\n",status);
 				return(status);
 			}
 		}
 		else
 		{
-			printf("WARNING : quickfits_read_map_header -->  No clean component table detected.\n");
+			quickfits_error("WARNING : quickfits_read_map_header -->  No clean component table detected.\n");
 			fitsi[0].ncc=0;
 			return(status);
 		}
@@ -358,11 +338,38 @@ int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
 	
 
 	status=0;
-	if ( fits_close_file(fptr, &status) )
+	if ( quickfits_close_file(fptr, &status) )
 	{
-		printf("ERROR : quickfits_read_map_header --> Error closing FITS file, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_map_header --> Error closing FITS file, error = %d\n",status);
 		return(status);
 	}
 
 	return(status);
 }
+
+int quickfits_read_map_header(const char* filename , fitsinfo_map* fitsi)
+{
+
+/*
+    Read in map header information
+ 
+	INPUTS:
+		char* tfilename : c string = name of FITS file to be read
+	OUTPUTS:
+		ra = right ascention
+		dec = declination
+		object = name of source
+		freq = frequency
+		cell =  cellsize (degrees)
+		dim = image size
+		bmaj, bmin, bpa = beam information (degrees)
+*/
+	long long start;
+	int status;
+
+	start = quickfits_trace_start();
+	status = read_map_header(filename, fitsi);
+	quickfits_trace_api("quickfits_read_map_header", start);
+
+	return(status);
+}
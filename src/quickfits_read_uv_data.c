@@ -13,17 +13,10 @@
 
 #include "quickfits.h"
 
-int quickfits_read_uv_data(const char* filename, fitsinfo_uv fitsi, double* u_array, double* v_array, double* tvis, double* if_array)
+#define STATS_BLOCK 65536	// visibility values read at a time when computing statistics (small enough to stay in cache)
+
+static int read_uv_data_stats(const char* filename, fitsinfo_uv fitsi, double* u_array, double* v_array, double* tvis, double* if_array, quickfits_stats* amp_stats, quickfits_stats* weight_stats)
 {
-/*
-	INPUTS:
-		char* tfilename : c string = name of FITS file to be read
-		int nvis : number of visibilities to be read
-	OUTPUTS:
-		u_array : nvis u coords, converted to physical units by fitsio
-		v_array : nvis v coords, converted to physical units by fitsio
-		tvis : (nvis*12 nvis*4(Stokes)*3(Re,Im,weight)*nif*nchan) visibilities, in Jy
-*/
 	fitsfile *fptr;
 
 	int status, i, j;
@@ -36,25 +29,44 @@ int quickfits_read_uv_data(const char* filename, fitsinfo_uv fitsi, double* u_ar
 	double d_null=0;
 	int anynull;
 	double temp;
+	long long nvis_elements;
+	long long dims[4];
+	long long row, nrows, block_rows, row_elements;
+	long long start;
+	int ucol, vcol, viscol;
 
 	status = 0;	// for error processing
 	err=0;
 
-	if ( fits_open_file(&fptr,filename, READONLY, &status) )	// open file and make sure it's open
+	dims[0] = fitsi.nvis;
+	dims[1] = 12;
+	dims[2] = fitsi.nif;
+	dims[3] = fitsi.nchan;
+	if(quickfits_element_count(4, dims, &nvis_elements))
 	{
-		printf("ERROR : quickfits_read_uv_data --> Error opening FITS file, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_uv_data --> Too many visibilities to read (%lld x 12 x %d x %d)\n",fitsi.nvis,fitsi.nif,fitsi.nchan);
+		return(NUM_OVERFLOW);
+	}
+
+	if ( quickfits_open_file(&fptr,filename, READONLY, &status) )	// open file and make sure it's open
+	{
+		quickfits_error("ERROR : quickfits_read_uv_data --> Error opening FITS file, error = %d\n",status);
 		return(status);
 	}
 
-	if (fits_movnam_hdu(fptr,BINARY_TBL,extname,0,&status))		// move to main AIPS UV hdu
+	if (quickfits_movnam_hdu(fptr,filename,BINARY_TBL,extname,0,&status))		// move to main AIPS UV hdu
 	{
-		printf("ERROR : quickfits_read_uv_data --> Error locating AIPS UV binary extension, error = %d\n",status);
-		printf("ERROR : quickfits_read_uv_data --> Did you remember to use the AIPS FITAB task instead of FITTP?\n");
+		quickfits_error("ERROR : quickfits_read_uv_data --> Error locating AIPS UV binary extension, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_uv_data --> Did you remember to use the AIPS FITAB task instead of FITTP?\n");
 	}
 	
 	
 	// read in data - first find where U, V and visibility columns are - then read them in
 	
+	start = quickfits_trace_start();
+	ucol = 0;
+	vcol = 0;
+	viscol = 0;
 	i=1;
 	status=0;
 	while(status!=KEY_NO_EXIST)
@@ -64,36 +76,79 @@ int quickfits_read_uv_data(const char* filename, fitsinfo_uv fitsi, double* u_ar
 		
 		if( !strncmp(key_type,"UU",2) )
 		{
-			fits_read_col(fptr, TDOUBLE, i, 1, 1, fitsi.nvis, &d_null,  u_array, &anynull, &status);
-			err+=status;
+			ucol = i;
 		}
 		if( !strncmp(key_type,"VV",2) )
 		{
-			fits_read_col(fptr, TDOUBLE, i, 1, 1, fitsi.nvis, &d_null,  v_array, &anynull, &status);
-			err+=status;
+			vcol = i;
 		}
 		if( !strncmp(key_type,"VISIBILITIES",12) )
 		{
-			fits_read_col(fptr, TDOUBLE, i, 1, 1, fitsi.nvis*12.0*fitsi.nif*fitsi.nchan, &d_null,  tvis, &anynull, &status);
-			err+=status;
+			viscol = i;
 		}
 
 		i++;
 	}
+	status=0;
+	quickfits_trace_phase(QUICKFITS_PHASE_KEYWORDS, start);
+	quickfits_count_io(0, 0, 0, i-1);
+
+	start = quickfits_trace_start();
+	if(ucol > 0)
+	{
+		fits_read_col(fptr, TDOUBLE, ucol, 1, 1, fitsi.nvis, &d_null,  u_array, &anynull, &status);
+		err+=status;
+	}
+	if(vcol > 0)
+	{
+		fits_read_col(fptr, TDOUBLE, vcol, 1, 1, fitsi.nvis, &d_null,  v_array, &anynull, &status);
+		err+=status;
+	}
+	if(viscol > 0)
+	{
+		if(amp_stats == NULL || weight_stats == NULL)
+		{
+			fits_read_col(fptr, TDOUBLE, viscol, 1, 1, nvis_elements, &d_null,  tvis, &anynull, &status);
+		}
+		else	// read a block of rows at a time, adding each to the statistics while it's still in cache
+		{
+			for(j=0;j<4*fitsi.nif;j++)
+			{
+				quickfits_stats_init(&amp_stats[j]);
+				quickfits_stats_init(&weight_stats[j]);
+			}
+			row_elements = 12LL*fitsi.nif*fitsi.nchan;
+			block_rows = (row_elements < STATS_BLOCK) ? STATS_BLOCK/row_elements : 1;
+			for(row=0;row<fitsi.nvis && status==0;row+=block_rows)
+			{
+				nrows = (fitsi.nvis-row < block_rows) ? fitsi.nvis-row : block_rows;
+				fits_read_col(fptr, TDOUBLE, viscol, row+1, 1, nrows*row_elements, &d_null,  &tvis[row*row_elements], &anynull, &status);
+				quickfits_trace_phase(QUICKFITS_PHASE_READ, start);
+				start = quickfits_trace_start();
+				quickfits_stats_add_vis(amp_stats, weight_stats, &tvis[row*row_elements], nrows, fitsi.nif, fitsi.nchan);
+				quickfits_trace_phase(QUICKFITS_PHASE_CONVERT, start);
+				start = quickfits_trace_start();
+			}
+		}
+		err+=status;
+	}
+	quickfits_trace_phase(QUICKFITS_PHASE_READ, start);
+	quickfits_count_io(((ucol > 0) + (vcol > 0))*fitsi.nvis*sizeof(double) + ((viscol > 0) ? nvis_elements*sizeof(double) : 0), 0, 0, 0);
 
 	if(err!=0)
 	{
-		printf("ERROR : quickfits_read_uv_data --> Error reading keywords, custom error = %d\n",err);
+		quickfits_error("ERROR : quickfits_read_uv_data --> Error reading keywords, custom error = %d\n",err);
 	}
 	
 
 	status=0;
-	if (fits_movnam_hdu(fptr,BINARY_TBL,freq_extname,0,&status))		// move to frequency information hdu
+	if (quickfits_movnam_hdu(fptr,filename,BINARY_TBL,freq_extname,0,&status))		// move to frequency information hdu
 	{
-		printf("ERROR : quickfits_read_uv_data --> Error finding frequency table, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_uv_data --> Error finding frequency table, error = %d\n",status);
 	}
 	else
 	{
+		start = quickfits_trace_start();
 		i=1;
 		status=0;
 		while(status!=KEY_NO_EXIST)
@@ -109,15 +164,100 @@ int quickfits_read_uv_data(const char* filename, fitsinfo_uv fitsi, double* u_ar
 
 			i++;
 		}
+		quickfits_trace_phase(QUICKFITS_PHASE_KEYWORDS, start);
+		quickfits_count_io(fitsi.nif*sizeof(double), 0, 0, i-1);
 	}
 	status=0;
 	
 	
-	if ( fits_close_file(fptr, &status) )
+	if ( quickfits_close_file(fptr, &status) )
 	{
-		printf("ERROR : quickfits_read_uv_data --> Error closing FITS file, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_uv_data --> Error closing FITS file, error = %d\n",status);
 		return(status);
 	}
 
 	return(status);
 }
+
+int quickfits_read_uv_data_stats(const char* filename, fitsinfo_uv fitsi, double* u_array, double* v_array, double* tvis, double* if_array, quickfits_stats* amp_stats, quickfits_stats* weight_stats)
+{
+/*
+	As quickfits_read_uv_data, also computing per-IF/Stokes statistics as the visibilities are read (NULL to skip)
+
+	OUTPUTS:
+		amp_stats : nif*4 (index if*4 + Stokes) amplitude statistics of visibilities with positive weight, as from quickfits_stats_add_vis
+		weight_stats : nif*4 weight statistics. weight_stats[].sum is the total weight.
+*/
+	long long start;
+	int status;
+
+	start = quickfits_trace_start();
+	status = read_uv_data_stats(filename, fitsi, u_array, v_array, tvis, if_array, amp_stats, weight_stats);
+	quickfits_trace_api("quickfits_read_uv_data_stats", start);
+
+	return(status);
+}
+
+int quickfits_read_uv_data(const char* filename, fitsinfo_uv fitsi, double* u_array, double* v_array, double* tvis, double* if_array)
+{
+/*
+	INPUTS:
+		char* tfilename : c string = name of FITS file to be read
+		long long nvis : number of visibilities to be read
+	OUTPUTS:
+		u_array : nvis u coords, converted to physical units by fitsio
+		v_array : nvis v coords, converted to physical units by fitsio
+		tvis : (nvis*12 nvis*4(Stokes)*3(Re,Im,weight)*nif*nchan) visibilities, in Jy
+		if_array : nif IF frequency offsets, from the AIPS FQ table
+*/
+	long long start;
+	int status;
+	bool fallback;
+
+	start = quickfits_trace_start();
+	fallback = true;
+	if(quickfits_direct_io_file(filename))	// large block reads, on this thread
+	{
+		status = quickfits_read_uv_rows(filename, fitsi, u_array, v_array, tvis, if_array, 1, &fallback);
+	}
+	if(fallback)
+	{
+		status = read_uv_data_stats(filename, fitsi, u_array, v_array, tvis, if_array, NULL, NULL);
+	}
+	quickfits_trace_api("quickfits_read_uv_data", start);
+
+	return(status);
+}
+
+int quickfits_read_uv_data_parallel(const char* filename, fitsinfo_uv fitsi, double* u_array, double* v_array, double* tvis, double* if_array, int nthreads)
+{
+/*
+	quickfits_read_uv_data split across threads. The AIPS UV table is divided into ranges of rows, and each worker reads its
+	rows from the data unit with pread (or in large blocks, as set by quickfits_set_direct_io) and decodes them into its own
+	part of u_array, v_array and tvis.
+	The values are identical to those from quickfits_read_uv_data. Files that can't be read this way (memory files,
+	compressed files, unusual column types or layouts) are read with quickfits_read_uv_data.
+ 
+	INPUTS:
+		filename, fitsi : as for quickfits_read_uv_data
+		int nthreads : number of threads to use (0 to use one per processor)
+	OUTPUTS:
+		u_array, v_array, tvis, if_array : as for quickfits_read_uv_data
+ 
+	RETURN:
+		0 on success
+*/
+	long long start;
+	int status;
+	bool fallback;
+
+	start = quickfits_trace_start();
+	status = quickfits_read_uv_rows(filename, fitsi, u_array, v_array, tvis, if_array, nthreads, &fallback);
+	if(fallback)
+	{
+		status = read_uv_data_stats(filename, fitsi, u_array, v_array, tvis, if_array, NULL, NULL);
+	}
+	quickfits_trace_api("quickfits_read_uv_data_parallel", start);
+
+	return(status);
+}
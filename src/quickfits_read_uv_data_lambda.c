@@ -0,0 +1,259 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+
+#define LAMBDA_BLOCK 65536	// visibility values read and processed at a time (small enough to stay in cache)
+
+static void scale_and_fold(long long nrows, const double* u, const double* v, const double* freqs, int nfreq, bool fold, double* u_lambda, double* v_lambda, double* tvis)
+{
+	// u,v in wavelengths for every (IF, channel) of a block of rows, conjugating rows with v < 0 into the upper half plane
+
+	long long row;
+	int k;
+	double su, sv, temp;
+	double* vis;
+
+	for(row=0;row<nrows;row++)
+	{
+		su = u[row];
+		sv = v[row];
+		if(fold && sv < 0)
+		{
+			su = -su;
+			sv = -sv;
+
+			vis = &tvis[row*nfreq*12];
+			for(k=0;k<nfreq;k++)	// V(-u,-v) = V*(u,v), and the cross hands swap (RL <-> LR) as the baseline is reversed
+			{
+				vis[k*12+1] = -vis[k*12+1];
+				vis[k*12+4] = -vis[k*12+4];
+
+				temp = vis[k*12+6];
+				vis[k*12+6] = vis[k*12+9];
+				vis[k*12+9] = temp;
+				temp = -vis[k*12+7];
+				vis[k*12+7] = -vis[k*12+10];
+				vis[k*12+10] = temp;
+				temp = vis[k*12+8];
+				vis[k*12+8] = vis[k*12+11];
+				vis[k*12+11] = temp;
+			}
+		}
+
+		for(k=0;k<nfreq;k++)	// contiguous, so this vectorises
+		{
+			u_lambda[row*nfreq+k] = su*freqs[k];
+			v_lambda[row*nfreq+k] = sv*freqs[k];
+		}
+	}
+}
+
+static int read_uv_data_lambda(const char* filename, fitsinfo_uv fitsi, bool fold, double* u_lambda, double* v_lambda, double* tvis, double* if_array)
+{
+	fitsfile *fptr;
+
+	int status, i, j;
+	int ucol, vcol, viscol, nfreq, anynull;
+	char extname[]="AIPS UV ";
+	char freq_extname[]="AIPS FQ ";
+	char comment[FLEN_VALUE];
+	char key_name[FLEN_VALUE];
+	char key_type[FLEN_VALUE];
+	double d_null=0;
+	double* freqs;
+	double* ublock;
+	double* vblock;
+	long long nvis_elements, row_elements, block_rows, row, nrows;
+	long long dims[4];
+	long long start;
+
+	status = 0;	// for error processing
+
+	dims[0] = fitsi.nvis;
+	dims[1] = 12;
+	dims[2] = fitsi.nif;
+	dims[3] = fitsi.nchan;
+	if(quickfits_element_count(4, dims, &nvis_elements) || fitsi.nif < 1 || fitsi.nchan < 1)
+	{
+		quickfits_error("ERROR : quickfits_read_uv_data_lambda --> Too many visibilities to read (%lld x 12 x %d x %d)\n",fitsi.nvis,fitsi.nif,fitsi.nchan);
+		return(NUM_OVERFLOW);
+	}
+	nfreq = fitsi.nif*fitsi.nchan;
+	row_elements = 12LL*nfreq;
+	block_rows = (row_elements < LAMBDA_BLOCK) ? LAMBDA_BLOCK/row_elements : 1;
+
+	freqs = malloc(nfreq*sizeof(double));
+	ublock = malloc(block_rows*sizeof(double));
+	vblock = malloc(block_rows*sizeof(double));
+	if(freqs == NULL || ublock == NULL || vblock == NULL)
+	{
+		quickfits_error("ERROR : quickfits_read_uv_data_lambda --> Error allocating memory\n");
+		free(freqs);
+		free(ublock);
+		free(vblock);
+		return(MEMORY_ALLOCATION);
+	}
+
+	if ( quickfits_open_file(&fptr,filename, READONLY, &status) )	// open file and make sure it's open
+	{
+		quickfits_error("ERROR : quickfits_read_uv_data_lambda --> Error opening FITS file, error = %d\n",status);
+		free(freqs);
+		free(ublock);
+		free(vblock);
+		return(status);
+	}
+
+	// the IF offsets are needed first, to build the channel frequencies
+
+	for(i=0;i<fitsi.nif;i++)
+	{
+		if_array[i] = 0.0;
+	}
+	if (quickfits_movnam_hdu(fptr,filename,BINARY_TBL,freq_extname,0,&status))		// move to frequency information hdu
+	{
+		quickfits_error("ERROR : quickfits_read_uv_data_lambda --> Error finding frequency table, error = %d\n",status);
+	}
+	else
+	{
+		i=1;
+		while(status!=KEY_NO_EXIST)
+		{
+			sprintf(key_name,"TTYPE%d",i);
+			fits_read_key(fptr,TSTRING,key_name,key_type,comment,&status);	// read in IF frequency offsets
+		
+			if( !strncmp(key_type,"IF FREQ",7) )
+			{
+				fits_read_col(fptr, TDOUBLE, i, 1, 1, fitsi.nif, &d_null,  if_array, &anynull, &status);
+			}
+
+			i++;
+		}
+	}
+	status=0;
+
+	for(i=0;i<fitsi.nif;i++)
+	{
+		for(j=0;j<fitsi.nchan;j++)
+		{
+			freqs[i*fitsi.nchan+j] = fitsi.freq + if_array[i] + (double)(j + 1 - fitsi.central_chan)*fitsi.chan_width;
+		}
+	}
+
+	if (quickfits_movnam_hdu(fptr,filename,BINARY_TBL,extname,0,&status))		// move to main AIPS UV hdu
+	{
+		quickfits_error("ERROR : quickfits_read_uv_data_lambda --> Error locating AIPS UV binary extension, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_uv_data_lambda --> Did you remember to use the AIPS FITAB task instead of FITTP?\n");
+		quickfits_close_file(fptr, &status);
+		free(freqs);
+		free(ublock);
+		free(vblock);
+		return(BAD_HDU_NUM);
+	}
+
+	ucol = 0;	// find the U, V and visibility columns
+	vcol = 0;
+	viscol = 0;
+	i=1;
+	while(status!=KEY_NO_EXIST)
+	{
+		sprintf(key_name,"TTYPE%d",i);
+		fits_read_key(fptr,TSTRING,key_name,key_type,comment,&status);
+
+		if( !strncmp(key_type,"UU",2) )
+		{
+			ucol = i;
+		}
+		if( !strncmp(key_type,"VV",2) )
+		{
+			vcol = i;
+		}
+		if( !strncmp(key_type,"VISIBILITIES",12) )
+		{
+			viscol = i;
+		}
+
+		i++;
+	}
+	status=0;
+
+	if(ucol == 0 || vcol == 0 || viscol == 0)
+	{
+		quickfits_error("ERROR : quickfits_read_uv_data_lambda --> Error locating UU, VV and VISIBILITIES columns\n");
+		status = COL_NOT_FOUND;
+	}
+
+	for(row=0;row<fitsi.nvis && status==0;row+=block_rows)	// read a block of rows, then scale and fold it while it's in cache
+	{
+		nrows = (fitsi.nvis-row < block_rows) ? fitsi.nvis-row : block_rows;
+		start = quickfits_trace_start();
+		fits_read_col(fptr, TDOUBLE, ucol, row+1, 1, nrows, &d_null,  ublock, &anynull, &status);
+		fits_read_col(fptr, TDOUBLE, vcol, row+1, 1, nrows, &d_null,  vblock, &anynull, &status);
+		fits_read_col(fptr, TDOUBLE, viscol, row+1, 1, nrows*row_elements, &d_null,  &tvis[row*row_elements], &anynull, &status);
+		if(status != 0)
+		{
+			quickfits_error("ERROR : quickfits_read_uv_data_lambda --> Error reading visibilities, error = %d\n",status);
+			break;
+		}
+		quickfits_trace_phase(QUICKFITS_PHASE_READ, start);
+		quickfits_count_io((2+row_elements)*nrows*sizeof(double), 0, 0, 0);
+
+		start = quickfits_trace_start();
+		scale_and_fold(nrows, ublock, vblock, freqs, nfreq, fold, &u_lambda[row*nfreq], &v_lambda[row*nfreq], &tvis[row*row_elements]);
+		quickfits_trace_phase(QUICKFITS_PHASE_CONVERT, start);
+	}
+
+	free(freqs);
+	free(ublock);
+	free(vblock);
+
+	if ( quickfits_close_file(fptr, &status) )
+	{
+		quickfits_error("ERROR : quickfits_read_uv_data_lambda --> Error closing FITS file, error = %d\n",status);
+		return(status);
+	}
+
+	return(status);
+}
+
+int quickfits_read_uv_data_lambda(const char* filename, fitsinfo_uv fitsi, bool fold, double* u_lambda, double* v_lambda, double* tvis, double* if_array)
+{
+/*
+	Read UV data as quickfits_read_uv_data does, but return u and v in wavelengths for every IF and channel,
+	optionally folding the visibilities into the v >= 0 half plane. Both are done a block of rows at a time as the
+	data are read, rather than in further passes over the arrays.
+	The frequency of channel c (0 based) of IF i is freq + if_array[i] + (c + 1 - central_chan)*chan_width.
+ 
+	INPUTS:
+		const char* filename : c string = name of FITS file to be read
+		fitsinfo_uv fitsi : header information from quickfits_read_uv_header
+		bool fold : if true, visibilities with v < 0 are replaced by their conjugates at (-u,-v). The RL and LR
+			correlations (Stokes axis positions 3 and 4) are swapped as well as conjugated.
+	OUTPUTS:
+		u_lambda, v_lambda : nvis*nif*nchan u and v in wavelengths, index (vis*nif + if)*nchan + chan
+		tvis : nvis*12*nif*nchan visibilities, as for quickfits_read_uv_data (folded if fold is set)
+		if_array : nif IF frequency offsets
+ 
+	RETURN:
+		0 on success
+*/
+	long long start;
+	int status;
+
+	start = quickfits_trace_start();
+	status = read_uv_data_lambda(filename, fitsi, fold, u_lambda, v_lambda, tvis, if_array);
+	quickfits_trace_api("quickfits_read_uv_data_lambda", start);
+
+	return(status);
+}
@@ -13,24 +13,8 @@
 
 #include "quickfits.h"
 
-int quickfits_read_uv_header(const char* filename, fitsinfo_uv* fitsi)
+static int read_uv_header(const char* filename, fitsinfo_uv* fitsi)
 {
-/*
-    Read useful keywords from the header of a UV FITS file produced by FITAB in AIPS.
- 
-	INPUTS:
-		char* tfilename : c string = name of FITS file to be read
-	OUTPUTS:
-		ra = right ascention
-		dec = declination
-		object = name of source
-		freq = frequency
-		nvis = number of visibilities
-        nchan = number of channels
-        central_chan = central channel
-        chan_width = channel width
-        nif = number of IFs
-*/
 	fitsfile *fptr;
 
 	int status, i, j;
@@ -48,16 +32,16 @@ int quickfits_read_uv_header(const char* filename, fitsinfo_uv* fitsi)
 	status = 0;	// for error processing
 	err=0;
 
-	if ( fits_open_file(&fptr,filename, READONLY, &status) )	// open file and make sure it's open
+	if ( quickfits_open_file(&fptr,filename, READONLY, &status) )	// open file and make sure it's open
 	{
-		printf("ERROR : quickfits_read_uv_header --> Error opening FITS file, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_uv_header --> Error opening FITS file, error = %d\n",status);
 		return(status);
 	}
 
-	if (fits_movnam_hdu(fptr,BINARY_TBL,extname,0,&status))		// move to main AIPS UV hdu
+	if (quickfits_movnam_hdu(fptr,filename,BINARY_TBL,extname,0,&status))		// move to main AIPS UV hdu
 	{
-		printf("ERROR : quickfits_read_uv_header --> Error locating AIPS UV binary extension, error = %d\n",status);
-		printf("ERROR : quickfits_read_uv_header --> Did you remember to use the AIPS FITAB task instead of FITTP?\n");
+		quickfits_error("ERROR : quickfits_read_uv_header --> Error locating AIPS UV binary extension, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_uv_header --> Did you remember to use the AIPS FITAB task instead of FITTP?\n");
 		return(status);
 	}
 
@@ -78,12 +62,11 @@ int quickfits_read_uv_header(const char* filename, fitsinfo_uv* fitsi)
 	fits_read_key(fptr,TDOUBLE,"OBSDEC",&fitsi[0].dec,comment,&status);
 	err+=status;
 	
-	fits_read_key(fptr,TDOUBLE,"NAXIS2",&temp,comment,&status);
+	fits_read_key(fptr,TLONGLONG,"NAXIS2",&fitsi[0].nvis,comment,&status);
 	err+=status;
-	fitsi[0].nvis=(int)(temp);	// nvis is stored as a double in the FITS file
 	if(err!=0)
 	{
-		printf("ERROR : quickfits_read_uv_header --> Error reading keywords, custom error = %d\n",err);
+		quickfits_error("ERROR : quickfits_read_uv_header --> Error reading keywords, custom error = %d\n",err);
 	}
 	
 	i=1;
@@ -115,7 +98,8 @@ int quickfits_read_uv_header(const char* filename, fitsinfo_uv* fitsi)
 			sprintf(key_name,"%dCRVL%d",i,j);
 			fits_read_key(fptr,TDOUBLE,key_name,&fitsi[0].freq,comment,&status);
 			sprintf(key_name,"%dCDLT%d",i,j);
-			fits_read_key(fptr,TDOUBLE,key_name,&fitsi[0].chan_width,comment,&status);
+			fits_read_key(fptr,TDOUBLE,key_name,&temp,comment,&status);
+			fitsi[0].chan_width = temp;	// chan_width is an int - don't read a double straight into it
 			sprintf(key_name,"%dCRPX%d",i,j);
 			fits_read_key(fptr,TDOUBLE,key_name,&temp,comment,&status);
 			fitsi[0].central_chan = temp; // central channel stored as double in data
@@ -132,11 +116,39 @@ int quickfits_read_uv_header(const char* filename, fitsinfo_uv* fitsi)
 	status=0;
 
 
-	if ( fits_close_file(fptr, &status) )
+	if ( quickfits_close_file(fptr, &status) )
 	{
-		printf("ERROR : quickfits_read_uv_header --> Error closing FITS file, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_read_uv_header --> Error closing FITS file, error = %d\n",status);
 		return(status);
 	}
 
 	return(status);
 }
+
+int quickfits_read_uv_header(const char* filename, fitsinfo_uv* fitsi)
+{
+/*
+    Read useful keywords from the header of a UV FITS file produced by FITAB in AIPS.
+ 
+	INPUTS:
+		char* tfilename : c string = name of FITS file to be read
+	OUTPUTS:
+		ra = right ascention
+		dec = declination
+		object = name of source
+		freq = frequency
+		nvis = number of visibilities
+        nchan = number of channels
+        central_chan = central channel
+        chan_width = channel width
+        nif = number of IFs
+*/
+	long long start;
+	int status;
+
+	start = quickfits_trace_start();
+	status = read_uv_header(filename, fitsi);
+	quickfits_trace_api("quickfits_read_uv_header", start);
+
+	return(status);
+}
@@ -0,0 +1,369 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define PARALLEL_TASK_BYTES (16<<20)	// rows handed to a worker at a time
+#define PARALLEL_CHUNK_BYTES (4<<20)	// rows read and decoded at a time by a worker
+
+typedef struct uv_column_tag{
+	int colnum;
+	long long byte_offset;
+	char tform_code;
+	long long repeat;
+	double scale;
+	double zero;
+}uv_column;
+
+typedef struct uv_read_job_tag{
+	const char* filename;
+	bool direct;	// stream each range with quickfits_read_records
+	int fd;
+	long long data_offset;
+	long long row_bytes;
+	long long nvis;
+	long long task_rows;
+	uv_column cols[3];	// u, v and visibilities
+	double* outputs[3];
+	int* status;	// per task
+}uv_read_job;
+
+static int find_column(const char* cards, int ncards, const char* prefix, uv_column* col)
+{
+	// last column whose name starts with prefix, as the serial reader matches them
+
+	char key_name[FLEN_VALUE];
+	char key_type[FLEN_VALUE];
+	char found_type[FLEN_VALUE];
+	int i, tfields, found, status;
+
+	status = 0;
+	found = 0;
+	quickfits_read_card(cards, ncards, "TFIELDS", TINT, &tfields, &status);
+	for(i=1;i<=tfields && status==0;i++)
+	{
+		sprintf(key_name,"TTYPE%d",i);
+		key_type[0] = '\0';
+		quickfits_read_card(cards, ncards, key_name, TSTRING, key_type, &status);
+		status = 0;
+		if(!strncmp(key_type, prefix, strlen(prefix)))
+		{
+			found = i;
+			strcpy(found_type, key_type);
+		}
+	}
+	if(status != 0 || found == 0)
+	{
+		return(COL_NOT_FOUND);
+	}
+
+	quickfits_scan_col(cards, ncards, found_type, &col[0].colnum, &col[0].byte_offset, &col[0].tform_code, &col[0].repeat, &status);
+	if(status == 0 && col[0].colnum != found)	// an earlier column with the same name once trailing blanks are ignored
+	{
+		status = COL_NOT_FOUND;
+	}
+	col[0].scale = 1.0;
+	col[0].zero = 0.0;
+	sprintf(key_name,"TSCAL%d",found);
+	quickfits_read_card(cards, ncards, key_name, TDOUBLE, &col[0].scale, &status);
+	if(status == KEY_NO_EXIST)
+	{
+		status = 0;
+	}
+	sprintf(key_name,"TZERO%d",found);
+	quickfits_read_card(cards, ncards, key_name, TDOUBLE, &col[0].zero, &status);
+	if(status == KEY_NO_EXIST)
+	{
+		status = 0;
+	}
+	if(status == 0 && quickfits_tform_width(col[0].tform_code) == 0)
+	{
+		status = BAD_TFORM;
+	}
+	return(status);
+}
+
+static int pread_all(int fd, unsigned char* buffer, long long nbytes, long long offset)
+{
+	long long done, n;
+
+	for(done=0;done<nbytes;done+=n)
+	{
+		n = pread(fd, buffer+done, nbytes-done, offset+done);
+		if(n <= 0)
+		{
+			return(READ_ERROR);
+		}
+	}
+	return(0);
+}
+
+static int decode_rows(const unsigned char* rows, long long nrows, long long first_row, void* arg)
+{
+	// decode u, v and the visibilities of rows that start at row first_row of the table
+
+	uv_read_job* job = (uv_read_job*)(arg);
+	long long start;
+	int c, status;
+
+	start = quickfits_trace_start();
+	status = 0;
+	for(c=0;c<3 && status==0;c++)
+	{
+		status = quickfits_decode_column(rows, nrows, job[0].row_bytes, job[0].cols[c].byte_offset, job[0].cols[c].tform_code, job[0].cols[c].repeat,
+			job[0].cols[c].scale, job[0].cols[c].zero, &job[0].outputs[c][first_row*job[0].cols[c].repeat]);
+	}
+	quickfits_trace_phase(QUICKFITS_PHASE_CONVERT, start);
+	quickfits_count_io(nrows*job[0].row_bytes, 0, 0, 0);
+
+	return(status);
+}
+
+typedef struct uv_range_tag{
+	uv_read_job* job;
+	long long first;
+}uv_range;
+
+static int decode_range_rows(const unsigned char* rows, long long nrows, long long first_record, void* arg)
+{
+	uv_range* range = (uv_range*)(arg);
+
+	return(decode_rows(rows, nrows, range[0].first + first_record, range[0].job));
+}
+
+static void read_task(long long task, void* arg)
+{
+	// read and decode one range of rows into its own part of the output arrays
+
+	uv_read_job* job = (uv_read_job*)(arg);
+	uv_range range;
+	unsigned char* buffer;
+	long long first, last, row, nrows, chunk_rows, start;
+	int status;
+
+	first = task*job[0].task_rows;
+	last = first + job[0].task_rows;
+	if(last > job[0].nvis)
+	{
+		last = job[0].nvis;
+	}
+	if(job[0].direct)	// large blocks, the next read on a second thread while the last is decoded
+	{
+		range.job = job;
+		range.first = first;
+		job[0].status[task] = quickfits_read_records(job[0].filename, job[0].data_offset + first*job[0].row_bytes, last - first, job[0].row_bytes, decode_range_rows, &range);
+		return;
+	}
+	chunk_rows = PARALLEL_CHUNK_BYTES/job[0].row_bytes;
+	if(chunk_rows < 1)
+	{
+		chunk_rows = 1;
+	}
+	if(chunk_rows > last - first)
+	{
+		chunk_rows = last - first;
+	}
+
+	buffer = malloc(chunk_rows*job[0].row_bytes);
+	status = (buffer == NULL) ? MEMORY_ALLOCATION : 0;
+	for(row=first;row<last && status==0;row+=nrows)
+	{
+		nrows = (last-row < chunk_rows) ? last-row : chunk_rows;
+
+		start = quickfits_trace_start();
+		status = pread_all(job[0].fd, buffer, nrows*job[0].row_bytes, job[0].data_offset + row*job[0].row_bytes);
+		quickfits_trace_phase(QUICKFITS_PHASE_READ, start);
+
+		if(status == 0)
+		{
+			status = decode_rows(buffer, nrows, row, job);
+		}
+	}
+
+	free(buffer);
+	job[0].status[task] = status;
+}
+
+static int read_if_freqs(int fd, fitshdu_dir dir, int nif, double* if_array)
+{
+	// IF frequency offsets from the first row of the AIPS FQ table
+
+	fitshdu hdu;
+	uv_column col;
+	unsigned char* row;
+	char* cards;
+	long long row_bytes;
+	int i, ncards, status;
+
+	i = quickfits_find_hdu(dir, BINARY_TBL, "AIPS FQ", 0);
+	if(i == 0)
+	{
+		quickfits_error("ERROR : quickfits_read_uv_data_parallel --> Error finding frequency table, error = %d\n",BAD_HDU_NUM);
+		return(0);	// as the serial reader, which carries on without it
+	}
+	status = quickfits_scan_hdu(fd, dir.hdus[i-1].header_offset, &hdu, &cards, &ncards);
+	if(status != 0)
+	{
+		return(status);
+	}
+	row_bytes = 0;
+	quickfits_read_card(cards, ncards, "NAXIS1", TLONGLONG, &row_bytes, &status);
+	if(status == 0 && find_column(cards, ncards, "IF FREQ", &col) == 0 && row_bytes > 0)
+	{
+		if(col.repeat < nif)
+		{
+			status = BAD_ELEM_NUM;
+		}
+		row = malloc(row_bytes);
+		if(status == 0 && row == NULL)
+		{
+			status = MEMORY_ALLOCATION;
+		}
+		if(status == 0)
+		{
+			status = pread_all(fd, row, row_bytes, hdu.data_offset);
+		}
+		if(status == 0)
+		{
+			col.repeat = nif;	// only the first nif are wanted, as from fits_read_col
+			status = quickfits_decode_column(row, 1, row_bytes, col.byte_offset, col.tform_code, col.repeat, col.scale, col.zero, if_array);
+		}
+		free(row);
+	}
+	free(cards);
+	return(status);
+}
+
+int quickfits_read_uv_rows(const char* filename, fitsinfo_uv fitsi, double* u_array, double* v_array, double* tvis, double* if_array, int nthreads, bool* fallback)
+{
+/*
+	The work of quickfits_read_uv_data_parallel, without the tracing. Reads nothing and sets fallback if the file
+	has to be read with cfitsio instead.
+ 
+	RETURN:
+		0 on success
+*/
+	uv_read_job job;
+	fitshdu_dir dir;
+	fitshdu hdu;
+	char* cards;
+	long long nvis_elements, naxis2, ntasks, t;
+	long long dims[4];
+	int i, ncards, status;
+
+	*fallback = true;
+	dims[0] = fitsi.nvis;
+	dims[1] = 12;
+	dims[2] = fitsi.nif;
+	dims[3] = fitsi.nchan;
+	if(quickfits_element_count(4, dims, &nvis_elements) || fitsi.nvis <= 0)
+	{
+		return(0);	// the serial reader reports it
+	}
+	if(quickfits_memfile_lookup(filename) != NULL || quickfits_get_hdu_dir(filename, &dir) != 0)	// not a plain FITS file on disk
+	{
+		return(0);
+	}
+
+	i = quickfits_find_hdu(dir, BINARY_TBL, "AIPS UV", 0);
+	job.fd = (i > 0) ? open(filename, O_RDONLY) : -1;
+	if(job.fd < 0)
+	{
+		quickfits_free_hdu_dir(&dir);
+		return(0);
+	}
+
+	status = quickfits_scan_hdu(job.fd, dir.hdus[i-1].header_offset, &hdu, &cards, &ncards);
+	if(status == 0)
+	{
+		job.row_bytes = 0;
+		naxis2 = 0;
+		quickfits_read_card(cards, ncards, "NAXIS1", TLONGLONG, &job.row_bytes, &status);
+		quickfits_read_card(cards, ncards, "NAXIS2", TLONGLONG, &naxis2, &status);
+		status = (status == 0) ? find_column(cards, ncards, "UU", &job.cols[0]) : status;
+		status = (status == 0) ? find_column(cards, ncards, "VV", &job.cols[1]) : status;
+		status = (status == 0) ? find_column(cards, ncards, "VISIBILITIES", &job.cols[2]) : status;
+		free(cards);
+
+		// anything the row by row decode wouldn't reproduce exactly goes to the serial reader
+		if(status != 0 || job.row_bytes <= 0 || naxis2 < fitsi.nvis || job.cols[0].repeat != 1 || job.cols[1].repeat != 1 || job.cols[2].repeat != 12LL*fitsi.nif*fitsi.nchan)
+		{
+			close(job.fd);
+			quickfits_free_hdu_dir(&dir);
+			return(0);
+		}
+	}
+	else
+	{
+		close(job.fd);
+		quickfits_free_hdu_dir(&dir);
+		return(0);
+	}
+	*fallback = false;
+
+	job.filename = filename;
+	job.direct = quickfits_direct_io_file(filename);
+	job.data_offset = hdu.data_offset;
+	job.nvis = fitsi.nvis;
+	job.outputs[0] = u_array;
+	job.outputs[1] = v_array;
+	job.outputs[2] = tvis;
+	job.task_rows = PARALLEL_TASK_BYTES/job.row_bytes;
+	if(job.direct)	// one long range per thread, so each stream stays sequential
+	{
+		if(nthreads <= 0)
+		{
+			nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+		}
+		job.task_rows = (nthreads > 1) ? (fitsi.nvis + nthreads - 1)/nthreads : fitsi.nvis;
+	}
+	if(job.task_rows < 1)
+	{
+		job.task_rows = 1;
+	}
+	ntasks = (fitsi.nvis + job.task_rows - 1)/job.task_rows;
+	job.status = malloc(ntasks*sizeof(int));
+	if(job.status == NULL)
+	{
+		*fallback = true;
+		close(job.fd);
+		quickfits_free_hdu_dir(&dir);
+		return(0);
+	}
+
+	posix_fadvise(job.fd, job.data_offset, fitsi.nvis*job.row_bytes, POSIX_FADV_SEQUENTIAL);
+	quickfits_parallel_for(ntasks, nthreads, read_task, &job);
+
+	status = 0;
+	for(t=0;t<ntasks && status==0;t++)
+	{
+		status = job.status[t];
+	}
+	if(status != 0)
+	{
+		quickfits_error("ERROR : quickfits_read_uv_data_parallel --> Error reading visibilities, error = %d\n",status);
+	}
+
+	if(status == 0)
+	{
+		status = read_if_freqs(job.fd, dir, fitsi.nif, if_array);
+	}
+
+	free(job.status);
+	close(job.fd);
+	quickfits_free_hdu_dir(&dir);
+	return(status);
+}
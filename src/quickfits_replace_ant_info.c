@@ -13,83 +13,100 @@
 
 #include "quickfits.h"
 
-int quickfits_replace_ant_info(const char* filename, double* rdterm, double* ldterm)
+static int replace_ant_info(const char* filename, double* rdterm, double* ldterm)
 {
-/*
-    Replace antenna d term info in a UV FITS file produced by FITAB in AIPS.
- 
-	INPUTS:
-		const char* tfilename : c string = name of FITS file to be read
-        double* rdterm : Right D terms of antennas
-        double* ldterm : Left D term of antennas
-*/
 	fitsfile *fptr;
 
-	int status, i, j;
+	int status;
 	char extname[]="AIPS AN ";
-//	char comment[FLEN_VALUE];
+	char key_comment[FLEN_VALUE];
 	char comment[]="UVFILL";
 	char poltype[]="VLBI    ";
 	char rdtermname[]="POLCALA";	// assumes column a is the r term and column b is the l term
 	char ldtermname[]="POLCALB";
-	double d_null=0;
-	int colnum;
-	double temp;
+	int colnum, typecode;
+	long long nant, repeat, width, nvalues;
 
 	status = 0;	// for error processing
 
-	if ( fits_open_file(&fptr,filename, READWRITE, &status) )	// open file and make sure it's open
+	if ( quickfits_open_file(&fptr,filename, READWRITE, &status) )	// open file and make sure it's open
 	{
-		printf("ERROR : quickfits_replace_ant_info --> Error opening FITS file, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_replace_ant_info --> Error opening FITS file, error = %d\n",status);
 		return(status);
 	}
 
-	if (fits_movnam_hdu(fptr,BINARY_TBL,extname,0,&status))		// move to main AIPS UV hdu
+	if (quickfits_movnam_hdu(fptr,filename,BINARY_TBL,extname,0,&status))		// move to AIPS AN hdu
 	{
-		printf("ERROR : quickfits_replace_ant_info --> Error locating AIPS UV binary extension, error = %d\n",status);
-		printf("ERROR : quickfits_replace_ant_info --> Did you remember to use the AIPS FITAB task instead of FITTP?\n");
+		quickfits_error("ERROR : quickfits_replace_ant_info --> Error locating AIPS antenna table extension, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_replace_ant_info --> Did you remember to use the AIPS FITAB task instead of FITTP?\n");
 		return(status);
 	}
-	// write out d-term data to correct columns
+	// write out d-term data to correct columns - the first 10*2 values, as always, or fewer for a smaller table
+
+	fits_read_key(fptr,TLONGLONG,"NAXIS2",&nant,key_comment,&status);
 
 	fits_get_colnum(fptr,CASEINSEN,rdtermname,&colnum,&status);
 	if(status!=0)
 	{
-		printf("ERROR : quickfits_replace_ant_info --> Error finding r dterm column to write to, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_replace_ant_info --> Error finding r dterm column to write to, error = %d\n",status);
 	}
+	fits_get_coltypell(fptr, colnum, &typecode, &repeat, &width, &status);	// NO_IF*NOPCAL values per antenna
+	nvalues = (nant*repeat < 10*2) ? nant*repeat : 10*2;
 
 
-	fits_write_col(fptr, TDOUBLE, colnum, 1, 1, 10*2,  rdterm, &status);
+	fits_write_col(fptr, TDOUBLE, colnum, 1, 1, nvalues,  rdterm, &status);
 	if(status!=0)
 	{
-		printf("ERROR : quickfits_replace_ant_info --> Error writing keywords, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_replace_ant_info --> Error writing keywords, error = %d\n",status);
 	}
 
 	fits_get_colnum(fptr,CASEINSEN,ldtermname,&colnum,&status);
 	if(status!=0)
 	{
-		printf("ERROR : quickfits_replace_ant_info --> Error finding l dterm column to write to, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_replace_ant_info --> Error finding l dterm column to write to, error = %d\n",status);
 	}
 
-	fits_write_col(fptr, TDOUBLE, colnum, 1, 1, 10*2,  ldterm, &status);
+	fits_write_col(fptr, TDOUBLE, colnum, 1, 1, nvalues,  ldterm, &status);
 	if(status!=0)
 	{
-		printf("ERROR : quickfits_replace_ant_info --> Error writing new antenna information, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_replace_ant_info --> Error writing new antenna information, error = %d\n",status);
 	}
 
 	fits_update_key(fptr, TSTRING, "POLTYPE", &poltype,comment, &status);
 	if(status!=0)
 	{
-		printf("ERROR : quickfits_replace_ant_info --> Error writing polarisation type to header file, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_replace_ant_info --> Error writing polarisation type to header file, error = %d\n",status);
 	}
 
 
 
-	if ( fits_close_file(fptr, &status) )
+	if ( quickfits_close_file(fptr, &status) )
 	{
-		printf("ERROR : quickfits_replace_ant_info --> Error closing FITS file, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_replace_ant_info --> Error closing FITS file, error = %d\n",status);
 		return(status);
 	}
 
 	return(status);
 }
+
+int quickfits_replace_ant_info(const char* filename, double* rdterm, double* ldterm)
+{
+/*
+    Replace antenna d term info in a UV FITS file produced by FITAB in AIPS.
+ 
+	INPUTS:
+		const char* tfilename : c string = name of FITS file to be read
+        double* rdterm : Right D terms of antennas (10*2 values - the start of POLCALA : Re and Im for each IF of each antenna in turn)
+        double* ldterm : Left D term of antennas (10*2 values of POLCALB, as rdterm)
+	Only the first 10*2 values of each column are written. For tables of any size use quickfits_read_ant_table and
+	quickfits_write_ant_table, and quickfits_apply_dterms to change single antennas and IFs across many files.
+*/
+	long long start;
+	int status;
+
+	start = quickfits_trace_start();
+	status = replace_ant_info(filename, rdterm, ldterm);
+	quickfits_trace_api("quickfits_replace_ant_info", start);
+
+	return(status);
+}
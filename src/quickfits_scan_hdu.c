@@ -0,0 +1,385 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+
+static long long read_block(int fd, long long offset, char* buff)
+{
+	// read one 2880 byte block, returning the number of bytes actually read
+
+	long long nread;
+	ssize_t n;
+
+	nread=0;
+	while(nread<QUICKFITS_BLOCK_SIZE)
+	{
+		n = pread(fd, buff+nread, QUICKFITS_BLOCK_SIZE-nread, offset+nread);
+		if(n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(n <= 0)
+		{
+			break;
+		}
+		nread+=n;
+	}
+	return(nread);
+}
+
+int quickfits_scan_hdu(int fd, long long offset, fitshdu* hdu, char** cards, int* ncards)
+{
+/*
+	Read the header of the HDU starting at offset directly with pread, without going through cfitsio
+ 
+	INPUTS:
+		int fd : file descriptor of a FITS file open for reading
+		long long offset : byte offset of the HDU (0 for the primary HDU)
+	OUTPUTS:
+		hdu : type, name, version and layout of the HDU
+		cards : (optional, may be NULL) header cards, 80 characters each. Must be freed by the caller.
+		ncards : (optional, may be NULL) number of cards before the END card
+ 
+	RETURN:
+		0 on success, END_OF_FILE if there is no HDU at offset, NO_SIMPLE if the file does not start with a FITS primary header.
+*/
+	char* buff;
+	char* temp;
+	char xtension[FLEN_VALUE];
+	int nblocks, capacity, n, i, status, tstatus;
+	int bitpix, naxis, first_axis, groups;
+	long long naxisn, nelements, pcount, gcount;
+	char key_name[FLEN_VALUE];
+	bool found_end;
+
+	capacity = 4;
+	buff = malloc(capacity*QUICKFITS_BLOCK_SIZE);
+	if(buff == NULL)
+	{
+		return(MEMORY_ALLOCATION);
+	}
+
+	// read header blocks until the END card turns up
+
+	nblocks=0;
+	n=0;
+	found_end=false;
+	while(!found_end)
+	{
+		if(nblocks == capacity)
+		{
+			capacity*=2;
+			temp = realloc(buff,capacity*QUICKFITS_BLOCK_SIZE);
+			if(temp == NULL)
+			{
+				free(buff);
+				return(MEMORY_ALLOCATION);
+			}
+			buff = temp;
+		}
+
+		if( read_block(fd, offset+(long long)(nblocks)*QUICKFITS_BLOCK_SIZE, &buff[nblocks*QUICKFITS_BLOCK_SIZE]) != QUICKFITS_BLOCK_SIZE )
+		{
+			free(buff);
+			if(nblocks == 0)	// a file shorter than one block can't be FITS
+			{
+				return( (offset==0) ? NO_SIMPLE : END_OF_FILE );
+			}
+			return(NO_END);
+		}
+
+		if(nblocks == 0)
+		{
+			if(offset == 0 && strncmp(buff,"SIMPLE  =",9))
+			{
+				free(buff);
+				return(NO_SIMPLE);
+			}
+			if(offset != 0 && strncmp(buff,"XTENSION=",9))	// anything after the last HDU is ignored, as in cfitsio
+			{
+				free(buff);
+				return(END_OF_FILE);
+			}
+		}
+
+		for(i=0;i<QUICKFITS_BLOCK_SIZE/80;i++)
+		{
+			if( !strncmp(&buff[nblocks*QUICKFITS_BLOCK_SIZE+80*i],"END     ",8) )
+			{
+				found_end=true;
+				break;
+			}
+			n++;
+		}
+		nblocks++;
+	}
+
+	hdu[0].header_offset = offset;
+	hdu[0].data_offset = offset + (long long)(nblocks)*QUICKFITS_BLOCK_SIZE;
+
+	// work out the HDU type and size of the data unit from the mandatory keywords
+
+	status=0;
+	quickfits_read_card(buff,n,"BITPIX",TINT,&bitpix,&status);
+	quickfits_read_card(buff,n,"NAXIS",TINT,&naxis,&status);
+	if(status!=0)
+	{
+		free(buff);
+		return(status);
+	}
+
+	if(offset == 0)
+	{
+		hdu[0].hdutype = IMAGE_HDU;
+	}
+	else
+	{
+		quickfits_read_card(buff,n,"XTENSION",TSTRING,xtension,&status);
+		if( !strcmp(xtension,"BINTABLE") || !strcmp(xtension,"A3DTABLE") )
+		{
+			hdu[0].hdutype = BINARY_TBL;
+		}
+		else if( !strcmp(xtension,"TABLE") )
+		{
+			hdu[0].hdutype = ASCII_TBL;
+		}
+		else
+		{
+			hdu[0].hdutype = IMAGE_HDU;
+		}
+	}
+
+	tstatus=0;
+	pcount=0;
+	quickfits_read_card(buff,n,"PCOUNT",TLONGLONG,&pcount,&tstatus);
+	tstatus=0;
+	gcount=1;
+	quickfits_read_card(buff,n,"GCOUNT",TLONGLONG,&gcount,&tstatus);
+	tstatus=0;
+	groups=0;
+	quickfits_read_card(buff,n,"GROUPS",TLOGICAL,&groups,&tstatus);
+
+	first_axis=1;
+	if(offset == 0 && groups)	// random groups: NAXIS1 = 0 and doesn't count towards the size
+	{
+		first_axis=2;
+	}
+
+	nelements = (naxis > 0) ? 1 : 0;
+	for(i=first_axis;i<=naxis;i++)
+	{
+		sprintf(key_name,"NAXIS%d",i);
+		quickfits_read_card(buff,n,key_name,TLONGLONG,&naxisn,&status);
+		nelements*=naxisn;
+	}
+	if(status!=0)
+	{
+		free(buff);
+		return(status);
+	}
+
+	hdu[0].data_size = (naxis > 0) ? (long long)(abs(bitpix)/8) * gcount * (pcount + nelements) : 0;
+
+	tstatus=0;
+	quickfits_read_card(buff,n,"EXTNAME",TSTRING,hdu[0].extname,&tstatus);
+	tstatus=0;
+	hdu[0].extver=1;
+	quickfits_read_card(buff,n,"EXTVER",TINT,&hdu[0].extver,&tstatus);
+
+	if(ncards != NULL)
+	{
+		*ncards = n;
+	}
+	if(cards != NULL)
+	{
+		*cards = buff;
+	}
+	else
+	{
+		free(buff);
+	}
+
+	return(0);
+}
+
+static bool name_match(const char* a, const char* b)
+{
+	// case insensitive comparison, ignoring trailing blanks
+
+	int la, lb;
+
+	la = strlen(a);
+	lb = strlen(b);
+	while(la>0 && a[la-1]==' ')
+	{
+		la--;
+	}
+	while(lb>0 && b[lb-1]==' ')
+	{
+		lb--;
+	}
+	return( la==lb && !strncasecmp(a,b,la) );
+}
+
+int quickfits_scan_ext(int fd, int hdutype, const char* extname, int extver, fitshdu* hdu, char** cards, int* ncards)
+{
+/*
+	Find an extension by name with pread, matching in the same way as fits_movnam_hdu
+ 
+	INPUTS:
+		int fd : file descriptor of a FITS file open for reading
+		int hdutype : IMAGE_HDU, ASCII_TBL, BINARY_TBL or ANY_HDU
+		const char* extname : EXTNAME to look for (case and trailing blanks are ignored)
+		int extver : EXTVER to look for (0 for any version)
+	OUTPUTS:
+		hdu, cards, ncards : as for quickfits_scan_hdu
+ 
+	RETURN:
+		0 on success, BAD_HDU_NUM if no matching extension exists.
+*/
+	long long offset;
+	char* hdu_cards;
+	int n, status;
+
+	offset=0;
+	while(true)
+	{
+		status = quickfits_scan_hdu(fd, offset, hdu, &hdu_cards, &n);
+		if(status == END_OF_FILE)
+		{
+			return(BAD_HDU_NUM);
+		}
+		if(status != 0)
+		{
+			return(status);
+		}
+
+		if( (hdutype == ANY_HDU || hdutype == hdu[0].hdutype) && name_match(hdu[0].extname,extname) && (extver == 0 || extver == hdu[0].extver) )
+		{
+			if(ncards != NULL)
+			{
+				*ncards = n;
+			}
+			if(cards != NULL)
+			{
+				*cards = hdu_cards;
+			}
+			else
+			{
+				free(hdu_cards);
+			}
+			return(0);
+		}
+
+		free(hdu_cards);
+		offset = hdu[0].data_offset + ((hdu[0].data_size+QUICKFITS_BLOCK_SIZE-1)/QUICKFITS_BLOCK_SIZE)*QUICKFITS_BLOCK_SIZE;
+	}
+}
+
+int quickfits_scan_col(const char* cards, int ncards, const char* colname, int* colnum, long long* byte_offset, char* tform_code, long long* repeat, int* status)
+{
+/*
+	Locate a binary table column from the TTYPEn and TFORMn cards of its header
+ 
+	INPUTS:
+		const char* cards : ncards header cards of a BINTABLE extension
+		const char* colname : name of the column (case insensitive), or NULL to locate column *colnum
+	OUTPUTS:
+		colnum : column number (from 1)
+		byte_offset : offset of the column within a row, in bytes
+		tform_code : TFORM data type letter (L, X, B, I, J, K, A, E, D, C, M, P or Q)
+		repeat : number of elements in the column
+ 
+	RETURN:
+		status : 0 on success, COL_NOT_FOUND if there is no such column
+*/
+	char key_name[FLEN_VALUE];
+	char key_type[FLEN_VALUE];
+	char tform[FLEN_VALUE];
+	int tfields, i, j;
+	long long offset, rpt, width;
+	char code;
+
+	if(*status != 0)
+	{
+		return(*status);
+	}
+
+	quickfits_read_card(cards,ncards,"TFIELDS",TINT,&tfields,status);
+	if(*status != 0)
+	{
+		return(*status);
+	}
+
+	offset=0;
+	for(i=1;i<=tfields;i++)
+	{
+		sprintf(key_name,"TFORM%d",i);
+		quickfits_read_card(cards,ncards,key_name,TSTRING,tform,status);
+		if(*status != 0)
+		{
+			*status = BAD_TFORM;
+			return(*status);
+		}
+
+		j=0;
+		while(tform[j]==' ')
+		{
+			j++;
+		}
+		rpt = isdigit((unsigned char)tform[j]) ? strtoll(&tform[j],NULL,10) : 1;
+		while(isdigit((unsigned char)tform[j]))
+		{
+			j++;
+		}
+		code = toupper((unsigned char)tform[j]);
+
+		switch(code)
+		{
+			case 'L': case 'B': case 'A': width = rpt; break;
+			case 'X': width = (rpt+7)/8; break;
+			case 'I': width = 2*rpt; break;
+			case 'J': case 'E': width = 4*rpt; break;
+			case 'K': case 'D': case 'C': width = 8*rpt; break;
+			case 'M': width = 16*rpt; break;
+			case 'P': width = 8; break;	// array descriptors
+			case 'Q': width = 16; break;
+			default:
+				*status = BAD_TFORM;
+				return(*status);
+		}
+
+		sprintf(key_name,"TTYPE%d",i);
+		key_type[0]='\0';
+		quickfits_read_card(cards,ncards,key_name,TSTRING,key_type,status);
+		*status = 0;	// unnamed columns are allowed
+
+		if( (colname == NULL) ? (i == *colnum) : name_match(key_type,colname) )
+		{
+			*colnum = i;
+			*byte_offset = offset;
+			*tform_code = code;
+			*repeat = rpt;
+			return(*status);
+		}
+		offset += width;
+	}
+
+	*status = COL_NOT_FOUND;
+	return(*status);
+}
@@ -0,0 +1,132 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+
+typedef struct scan_job_tag{
+	const char** filenames;
+	fitsinfo_map* map_info;	// one of these is NULL
+	fitsinfo_uv* uv_info;
+	int* status;
+	int* file_status;	// return value for each file
+}scan_job;
+
+static void scan_file(long long i, void* arg)
+{
+	// pread only - files that need cfitsio are left (with NO_SIMPLE) for scan_files to read on its own thread
+
+	scan_job* job = (scan_job*)(arg);
+
+	if(job[0].map_info != NULL)
+	{
+		job[0].file_status[i] = quickfits_pread_map_header(job[0].filenames[i], &job[0].map_info[i]);
+	}
+	else
+	{
+		job[0].file_status[i] = quickfits_pread_uv_header(job[0].filenames[i], &job[0].uv_info[i]);
+	}
+}
+
+static int scan_files(int nfiles, scan_job* job, int nthreads)
+{
+	int i, nfailed;
+
+	job[0].file_status = malloc((nfiles+1)*sizeof(int));
+	if(job[0].file_status == NULL)
+	{
+		quickfits_error("ERROR : quickfits_scan_headers --> Unable to allocate memory for %d files\n",nfiles);
+		for(i=0;i<nfiles && job[0].status!=NULL;i++)
+		{
+			job[0].status[i] = MEMORY_ALLOCATION;
+		}
+		return(nfiles);
+	}
+	quickfits_parallel_for(nfiles, nthreads, scan_file, job);
+
+	nfailed = 0;
+	for(i=0;i<nfiles;i++)
+	{
+		if(job[0].file_status[i] == NO_SIMPLE)	// memory files and anything else that isn't FITS or gzip compressed FITS, through cfitsio on this thread
+		{
+			if(job[0].map_info != NULL)
+			{
+				job[0].file_status[i] = quickfits_read_map_header(job[0].filenames[i], &job[0].map_info[i]);
+			}
+			else
+			{
+				job[0].file_status[i] = quickfits_read_uv_header(job[0].filenames[i], &job[0].uv_info[i]);
+			}
+		}
+		if(job[0].status != NULL)
+		{
+			job[0].status[i] = job[0].file_status[i];
+		}
+		nfailed += (job[0].file_status[i] != 0);
+	}
+	free(job[0].file_status);
+	return(nfailed);
+}
+
+int quickfits_scan_map_headers(int nfiles, const char** filenames, fitsinfo_map* fitsi, int* status, int nthreads)
+{
+/*
+	Read the headers of many FITS maps in parallel with quickfits_scan_map_header
+ 
+	INPUTS:
+		int nfiles : number of files
+		const char** filenames : names of the files to be read
+		fitsi[i].cc_table_version : Version of CC table to count for each file (negative to skip)
+		int nthreads : number of threads to use (0 to use one per processor)
+	OUTPUTS:
+		fitsi : nfiles header structures
+		status : (optional, may be NULL) nfiles return values of quickfits_scan_map_header
+ 
+	RETURN:
+		Number of files which could not be read (0 on success).
+*/
+	scan_job job;
+
+	job.filenames = filenames;
+	job.map_info = fitsi;
+	job.uv_info = NULL;
+	job.status = status;
+
+	return(scan_files(nfiles, &job, nthreads));
+}
+
+int quickfits_scan_uv_headers(int nfiles, const char** filenames, fitsinfo_uv* fitsi, int* status, int nthreads)
+{
+/*
+	Read the headers of many UV FITS files in parallel with quickfits_scan_uv_header
+ 
+	INPUTS:
+		int nfiles : number of files
+		const char** filenames : names of the files to be read
+		int nthreads : number of threads to use (0 to use one per processor)
+	OUTPUTS:
+		fitsi : nfiles header structures
+		status : (optional, may be NULL) nfiles return values of quickfits_scan_uv_header
+ 
+	RETURN:
+		Number of files which could not be read (0 on success).
+*/
+	scan_job job;
+
+	job.filenames = filenames;
+	job.map_info = NULL;
+	job.uv_info = fitsi;
+	job.status = status;
+
+	return(scan_files(nfiles, &job, nthreads));
+}
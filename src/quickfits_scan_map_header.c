@@ -0,0 +1,451 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static int read_first_float(int fd, fitshdu hdu, const char* cards, int ncards, const char* colname, float* value, int* status)
+{
+	// read the first element of a binary table column as a float, applying TSCALn and TZEROn
+
+	unsigned char buff[8];
+	char key_name[FLEN_VALUE];
+	long long offset, repeat;
+	int colnum, tstatus, width, i;
+	char code;
+	double scale, zero, dval;
+	union { unsigned int i; float f; } f32;
+	union { unsigned long long i; double d; } f64;
+
+	if(quickfits_scan_col(cards,ncards,colname,&colnum,&offset,&code,&repeat,status))
+	{
+		return(*status);
+	}
+
+	switch(code)
+	{
+		case 'B': width=1; break;
+		case 'I': width=2; break;
+		case 'J': case 'E': width=4; break;
+		case 'K': case 'D': width=8; break;
+		default:
+			*status = BAD_DATATYPE;
+			return(*status);
+	}
+
+	if(repeat < 1 || offset+width > hdu.data_size || pread(fd, buff, width, hdu.data_offset+offset) != width)
+	{
+		*status = BAD_ROW_NUM;
+		return(*status);
+	}
+
+	f64.i=0;
+	for(i=0;i<width;i++)	// FITS data are big endian
+	{
+		f64.i = (f64.i << 8) | buff[i];
+	}
+
+	switch(code)
+	{
+		case 'B': dval = (double)(f64.i); break;
+		case 'I': dval = (double)((short)(f64.i)); break;
+		case 'J': dval = (double)((int)(f64.i)); break;
+		case 'K': dval = (double)((long long)(f64.i)); break;
+		case 'E': f32.i = (unsigned int)(f64.i); dval = (double)(f32.f); break;
+		default: dval = f64.d; break;
+	}
+
+	scale=1.0;
+	zero=0.0;
+	tstatus=0;
+	sprintf(key_name,"TSCAL%d",colnum);
+	quickfits_read_card(cards,ncards,key_name,TDOUBLE,&scale,&tstatus);
+	tstatus=0;
+	sprintf(key_name,"TZERO%d",colnum);
+	quickfits_read_card(cards,ncards,key_name,TDOUBLE,&zero,&tstatus);
+
+	*value = (float)(dval*scale + zero);
+	return(*status);
+}
+
+int quickfits_pread_map_header(const char* filename, fitsinfo_map* fitsi)
+{
+/*
+	quickfits_scan_map_header without the cfitsio fallback, so it can be run on any thread. Returns NO_SIMPLE for
+	memory files and files that aren't FITS or gzip compressed FITS, which are left for quickfits_read_map_header.
+*/
+	int fd, gz_fd;
+	bool gz;
+	fitshdu hdu;
+	char* cards;
+	int ncards;
+
+	int status,i,j;
+	int err;
+	char key_name[FLEN_VALUE];
+	char key_type[FLEN_VALUE];
+	char beamhdu[]="AIPS CG ";
+	char cchdu[]="AIPS CC ";
+	char bmajname[]="BMAJ";
+	char bminname[]="BMIN";
+	char bpaname[]="BPA";
+	double temp;
+	float floatbuff;
+
+
+	status = 0;	// for error processing
+	err=0;
+
+	if(quickfits_memfile_lookup(filename) != NULL)	// memory files have no descriptor to read from
+	{
+		return(NO_SIMPLE);
+	}
+
+	fd = open(filename, O_RDONLY);
+	if ( fd < 0 )
+	{
+		quickfits_error("ERROR : quickfits_scan_map_header --> Error opening FITS file, error = %d\n",FILE_NOT_OPENED);
+		return(FILE_NOT_OPENED);
+	}
+
+	status = quickfits_scan_hdu(fd, 0, &hdu, &cards, &ncards);	// main AIPS image HDU (assuming it's the first one)
+	gz = false;
+	if (status == NO_SIMPLE && quickfits_gz_headers(fd, 1, NULL, &gz_fd) == 0)	// gzip compressed - inflate just the primary header for now
+	{
+		close(fd);
+		fd = gz_fd;
+		gz = true;
+		status = quickfits_scan_hdu(fd, 0, &hdu, &cards, &ncards);
+	}
+	if (status == NO_SIMPLE)	// not FITS
+	{
+		close(fd);
+		return(NO_SIMPLE);
+	}
+	if (status)
+	{
+		quickfits_error("ERROR : quickfits_scan_map_header --> Error reading primary header, error = %d\n",status);
+		close(fd);
+		return(status);
+	}
+
+	// read in some optional keys (these may fail on strange files - but are not that important)
+
+	quickfits_read_card(cards,ncards,"OBJECT",TSTRING,fitsi[0].object,&status);
+	quickfits_read_card(cards,ncards,"OBSERVER",TSTRING,fitsi[0].observer,&status);
+	quickfits_read_card(cards,ncards,"TELESCOP",TSTRING,fitsi[0].telescope,&status);
+	quickfits_read_card(cards,ncards,"EQUINOX",TDOUBLE,&fitsi[0].equinox,&status);
+	quickfits_read_card(cards,ncards,"DATE-OBS",TSTRING,fitsi[0].date_obs,&status);
+
+	//	Now iterate through CTYPE coords to get important information about RA, DEC, cellsize etc.
+
+	i=1;
+	status=0;
+	j=0;
+	while(status!=KEY_NO_EXIST)
+	{
+		if(status != 0) {
+			quickfits_error("ERROR : quickfits_scan_map_header -->  Error reading from %s\n", filename);
+			quickfits_error("ERROR : quickfits_scan_map_header -->  Error code: %d\n", status);
+			free(cards);
+			close(fd);
+			return(1);
+		}
+		sprintf(key_name,"CTYPE%d",i);
+		quickfits_read_card(cards,ncards,key_name,TSTRING,key_type,&status);
+
+		if( !strncmp(key_type,"RA---SIN",8) )
+		{
+			j++;
+
+			sprintf(key_name,"CRVAL%d",i);
+			quickfits_read_card(cards,ncards,key_name,TDOUBLE,&fitsi[0].ra,&status);
+			if(status==KEY_NO_EXIST)
+			{
+				quickfits_error("WARNING : quickfits_scan_map_header --> Missing RA information %s\n",key_name);
+				status= 0;
+			}
+
+			sprintf(key_name,"CDELT%d",i);
+			quickfits_read_card(cards,ncards,key_name,TDOUBLE,&temp,&status);
+			if(status==KEY_NO_EXIST)
+			{
+				quickfits_error("WARNING : quickfits_scan_map_header --> Missing RA information %s\n",key_name);
+				status= 0;
+			}
+			else
+			{
+				fitsi[0].cell_ra=fabs(temp);
+			}
+
+			sprintf(key_name,"CRPIX%d",i);
+			quickfits_read_card(cards,ncards,key_name,TDOUBLE,&temp,&status);
+			if(status==KEY_NO_EXIST)
+			{
+				quickfits_error("WARNING : quickfits_scan_map_header --> Missing RA information %s\n",key_name);
+				status= 0;
+			}
+			else
+			{
+				fitsi[0].centre_shift[0]=temp;
+			}
+
+			sprintf(key_name,"CROTA%d",i);
+			quickfits_read_card(cards,ncards,key_name,TDOUBLE,&temp,&status);
+			if(status==KEY_NO_EXIST)
+			{
+				quickfits_error("WARNING : quickfits_scan_map_header --> Missing RA information %s\n",key_name);
+				status= 0;
+			}
+			else
+			{
+				fitsi[0].rotations[0]=temp;
+			}
+		}
+
+		if( !strncmp(key_type,"DEC--SIN",8) )
+		{
+			j++;
+
+			sprintf(key_name,"CRVAL%d",i);
+			quickfits_read_card(cards,ncards,key_name,TDOUBLE,&fitsi[0].dec,&status);
+			if(status==KEY_NO_EXIST)
+			{
+				quickfits_error("WARNING : quickfits_scan_map_header --> Missing DEC information %s\n",key_name);
+				status = 0;
+			}
+
+			sprintf(key_name,"CDELT%d",i);
+			quickfits_read_card(cards,ncards,key_name,TDOUBLE,&temp,&status);
+			if(status==KEY_NO_EXIST)
+			{
+				quickfits_error("WARNING : quickfits_scan_map_header --> Missing DEC information %s\n",key_name);
+				status= 0;
+			}
+			else
+			{
+				fitsi[0].cell_dec=fabs(temp);
+			}
+
+			sprintf(key_name,"CRPIX%d",i);
+			quickfits_read_card(cards,ncards,key_name,TDOUBLE,&temp,&status);
+			if(status==KEY_NO_EXIST)
+			{
+				quickfits_error("WARNING : quickfits_scan_map_header --> Missing DEC information %s\n",key_name);
+				status = 0;
+			}
+			else
+			{
+				fitsi[0].centre_shift[1]=temp;
+			}
+
+			sprintf(key_name,"CROTA%d",i);
+			quickfits_read_card(cards,ncards,key_name,TDOUBLE,&temp,&status);
+			if(status==KEY_NO_EXIST)
+			{
+				quickfits_error("WARNING : quickfits_scan_map_header --> Missing DEC information %s\n",key_name);
+				status = 0;
+			}
+			else
+			{
+				fitsi[0].rotations[1]=temp;
+			}
+		}
+
+		if( !strncmp(key_type,"FREQ",4) )
+		{
+			j++;
+
+			sprintf(key_name,"CRVAL%d",i);
+			quickfits_read_card(cards,ncards,key_name,TDOUBLE,&fitsi[0].freq,&status);
+			if(status==KEY_NO_EXIST)
+			{
+				quickfits_error("WARNING : quickfits_scan_map_header --> Missing FREQ information %s\n",key_name);
+				status = 0;
+			}
+
+			sprintf(key_name,"CDELT%d",i);
+			quickfits_read_card(cards,ncards,key_name,TDOUBLE,&fitsi[0].freq_delta,&status);
+			if(status==KEY_NO_EXIST)
+			{
+				quickfits_error("WARNING : quickfits_scan_map_header --> Missing FREQ information %s\n",key_name);
+				status = 0;
+			}
+		}
+
+		if( !strncmp(key_type,"STOKES",6) )
+		{
+			sprintf(key_name,"CRVAL%d",i);
+			quickfits_read_card(cards,ncards,key_name,TDOUBLE,&temp,&status);
+
+			if(status==KEY_NO_EXIST)
+			{
+				quickfits_error("WARNING : quickfits_scan_map_header --> Missing Stokes information %s\n",key_name);
+				status = 0;
+			}
+			else
+			{
+				fitsi[0].stokes=(int)(temp);
+			}
+		}
+		i++;
+	}
+	status=0;
+	if(j!=3)
+	{
+		quickfits_error("WARNING : quickfits_scan_map_header --> Error reading RA, DEC, FREQ information\n\t Only %d out of 3 read.\n",j);
+	}
+
+
+	quickfits_read_card(cards,ncards,"NAXIS1",TLONGLONG,&fitsi[0].imsize_ra,&status);
+
+	quickfits_read_card(cards,ncards,"NAXIS2",TLONGLONG,&fitsi[0].imsize_dec,&status);
+
+	if(status!=0)
+	{
+		quickfits_error("ERROR : quickfits_scan_map_header --> Error reading image size from NAXIS1, error = %d\n",err);
+		free(cards);
+		close(fd);
+		return(err);
+	}
+
+	fitsi[0].have_beam = true; 	// assume true until proved otherwise
+	quickfits_read_card(cards,ncards,"BMAJ",TDOUBLE,&fitsi[0].bmaj,&status);
+	err += status;
+	quickfits_read_card(cards,ncards,"BMIN",TDOUBLE,&fitsi[0].bmin,&status);
+	err += status;
+	quickfits_read_card(cards,ncards,"BPA",TDOUBLE,&fitsi[0].bpa,&status);
+	err += status;
+	free(cards);
+
+	if(gz && (err != 0 || fitsi[0].cc_table_version >= 0))	// the extension headers are wanted too
+	{
+		close(fd);
+		fd = open(filename, O_RDONLY);
+		status = (fd < 0) ? FILE_NOT_OPENED : quickfits_gz_headers(fd, 0, (fitsi[0].cc_table_version >= 0) ? NULL : beamhdu, &gz_fd);
+		if(fd >= 0)
+		{
+			close(fd);
+		}
+		if(status != 0)
+		{
+			quickfits_error("ERROR : quickfits_scan_map_header --> Error decompressing the headers of %s, error = %d\n",filename,status);
+			return(status);
+		}
+		fd = gz_fd;
+	}
+
+	if(err!=0)	// if the beam information isn't in the main header, look in the AIPS CG HDU for beam information
+	{
+		status=0;
+		if (quickfits_scan_ext(fd,BINARY_TBL,beamhdu,0,&hdu,&cards,&ncards))
+		{
+			quickfits_error("WARNING : quickfits_scan_map_header --> No beam information found.\n");
+			fitsi[0].bmaj = 0.0;
+			fitsi[0].bmin = 0.0;
+			fitsi[0].bpa = 0.0;
+			fitsi[0].have_beam = false;
+		}
+		else
+		{
+			read_first_float(fd,hdu,cards,ncards,bmajname,&floatbuff,&status);
+			if(status!=0)
+			{
+				quickfits_error("ERROR : quickfits_scan_map_header -->  Error reading BMAJ information, error = %d\n",status);
+				free(cards);
+				close(fd);
+				return(err);
+			}
+			fitsi[0].bmaj=(double)(floatbuff);
+
+			read_first_float(fd,hdu,cards,ncards,bminname,&floatbuff,&status);
+			if(status!=0)
+			{
+				quickfits_error("ERROR : quickfits_scan_map_header -->  Error reading BMIN information, error = %d\n",status);
+				free(cards);
+				close(fd);
+				return(err);
+			}
+			fitsi[0].bmin=(double)(floatbuff);
+
+			read_first_float(fd,hdu,cards,ncards,bpaname,&floatbuff,&status);
+			if(status!=0)
+			{
+				quickfits_error("ERROR : quickfits_scan_map_header -->  Error reading BPA information, error = %d\n",status);
+				free(cards);
+				close(fd);
+				return(err);
+			}
+			fitsi[0].bpa=(double)(floatbuff);
+			free(cards);
+		}
+	}
+
+
+	// count clean components if requested. Allow for the outdated "A3DTABLE" table type as well as normal BINARY_TBL
+
+	if (fitsi[0].cc_table_version >=0 )
+	{
+		status = quickfits_scan_ext(fd,ANY_HDU,cchdu,fitsi[0].cc_table_version,&hdu,&cards,&ncards);
+		if (status==0)
+		{
+			quickfits_read_card(cards,ncards,"NAXIS2",TLONGLONG,&fitsi[0].ncc,&status);
+			free(cards);
+			if(status!=0)
+			{
+				quickfits_error("ERROR : quickfits_scan_map_header -->  Error reading number of clean components, error = %d\n",status);
+				close(fd);
+				return(status);
+			}
+		}
+		else
+		{
+			quickfits_error("WARNING : quickfits_scan_map_header -->  No clean component table detected.\n");
+			fitsi[0].ncc=0;
+			close(fd);
+			return(status);
+		}
+	}
+	else
+	{
+		fitsi[0].ncc=0;
+	}
+
+	close(fd);
+	return(0);
+}
+
+int quickfits_scan_map_header(const char* filename, fitsinfo_map* fitsi)
+{
+/*
+    Read in map header information without cfitsio, reading only the header blocks that are needed.
+    Gzip compressed files are inflated only as far as the headers needed (quickfits_gz_headers).
+    Gives the same results as quickfits_read_map_header.
+ 
+	INPUTS:
+		char* tfilename : c string = name of FITS file to be read
+		fitsi[0].cc_table_version : Version of CC table to count (negative to skip)
+	OUTPUTS:
+		As for quickfits_read_map_header
+*/
+	int status;
+
+	status = quickfits_pread_map_header(filename, fitsi);
+	if(status == NO_SIMPLE)	// memory file, or not FITS - let cfitsio do it (and report it)
+	{
+		status = quickfits_read_map_header(filename, fitsi);
+	}
+	return(status);
+}
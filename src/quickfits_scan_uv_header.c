@@ -0,0 +1,246 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static int read_tdim(const char* cards, int ncards, int colnum, int maxdim, int* naxis, long* naxes, int* status)
+{
+	// parse TDIMn = '(n1,n2,...)' in the same way as fits_read_tdim
+
+	char key_name[FLEN_VALUE];
+	char tdim[FLEN_VALUE];
+	char* p;
+	char* end;
+	long long offset, repeat;
+	char code;
+	int tstatus, colfound;
+
+	if(*status != 0)
+	{
+		return(*status);
+	}
+
+	tstatus=0;
+	sprintf(key_name,"TDIM%d",colnum);
+	quickfits_read_card(cards,ncards,key_name,TSTRING,tdim,&tstatus);
+
+	p = strchr(tdim,'(');
+	if(tstatus != 0 || p == NULL)	// no TDIM : a 1D array with the TFORM repeat count
+	{
+		sprintf(key_name,"TTYPE%d",colnum);
+		quickfits_read_card(cards,ncards,key_name,TSTRING,tdim,status);
+		quickfits_scan_col(cards,ncards,tdim,&colfound,&offset,&code,&repeat,status);
+		*naxis = 1;
+		if(maxdim > 0)
+		{
+			naxes[0] = repeat;
+		}
+		return(*status);
+	}
+
+	*naxis=0;
+	p++;
+	while(true)
+	{
+		while(isspace((unsigned char)*p))
+		{
+			p++;
+		}
+		if(*p == ')' || *p == '\0')
+		{
+			break;
+		}
+		if(*naxis < maxdim)
+		{
+			naxes[*naxis] = strtol(p,&end,10);
+		}
+		else
+		{
+			strtol(p,&end,10);
+		}
+		if(end == p)
+		{
+			*status = BAD_TDIM;
+			return(*status);
+		}
+		(*naxis)++;
+		p = end;
+		while(isspace((unsigned char)*p) || *p == ',')
+		{
+			p++;
+		}
+	}
+
+	return(*status);
+}
+
+int quickfits_pread_uv_header(const char* filename, fitsinfo_uv* fitsi)
+{
+/*
+	quickfits_scan_uv_header without the cfitsio fallback, so it can be run on any thread. Returns NO_SIMPLE for
+	memory files and files that aren't FITS or gzip compressed FITS, which are left for quickfits_read_uv_header.
+*/
+	int fd, gz_fd;
+	fitshdu hdu;
+	char* cards;
+	int ncards;
+
+	int status, i, j;
+	int err;
+	char extname[]="AIPS UV ";
+	char key_name[FLEN_VALUE];
+	char key_type[FLEN_VALUE];
+	double temp;
+	int num_vis_axes;
+	long vis_axes[8];
+
+	status = 0;	// for error processing
+	err=0;
+	temp=0;
+
+	if(quickfits_memfile_lookup(filename) != NULL)	// memory files have no descriptor to read from
+	{
+		return(NO_SIMPLE);
+	}
+
+	fd = open(filename, O_RDONLY);
+	if ( fd < 0 )
+	{
+		quickfits_error("ERROR : quickfits_scan_uv_header --> Error opening FITS file, error = %d\n",FILE_NOT_OPENED);
+		return(FILE_NOT_OPENED);
+	}
+
+	status = quickfits_scan_ext(fd,BINARY_TBL,extname,0,&hdu,&cards,&ncards);
+	if (status == NO_SIMPLE && quickfits_gz_headers(fd,0,extname,&gz_fd) == 0)	// gzip compressed - inflate just the headers up to the UV table
+	{
+		status = quickfits_scan_ext(gz_fd,BINARY_TBL,extname,0,&hdu,&cards,&ncards);
+		close(gz_fd);
+	}
+	close(fd);
+	if (status == NO_SIMPLE)	// not FITS
+	{
+		return(NO_SIMPLE);
+	}
+	if (status)
+	{
+		quickfits_error("ERROR : quickfits_scan_uv_header --> Error locating AIPS UV binary extension, error = %d\n",status);
+		quickfits_error("ERROR : quickfits_scan_uv_header --> Did you remember to use the AIPS FITAB task instead of FITTP?\n");
+		return(status);
+	}
+
+	// read in some keys
+
+	quickfits_read_card(cards,ncards,"OBJECT",TSTRING,fitsi[0].object,&status);
+	err+=status;
+	quickfits_read_card(cards,ncards,"OBSERVER",TSTRING,fitsi[0].observer,&status);
+	err+=status;
+	quickfits_read_card(cards,ncards,"TELESCOP",TSTRING,fitsi[0].telescope,&status);
+	err+=status;
+	quickfits_read_card(cards,ncards,"DATE-OBS",TSTRING,fitsi[0].date_obs,&status);
+	err+=status;
+	quickfits_read_card(cards,ncards,"EQUINOX",TDOUBLE,&fitsi[0].equinox,&status);
+	err+=status;
+	quickfits_read_card(cards,ncards,"OBSRA",TDOUBLE,&fitsi[0].ra,&status);
+	err+=status;
+	quickfits_read_card(cards,ncards,"OBSDEC",TDOUBLE,&fitsi[0].dec,&status);
+	err+=status;
+
+	quickfits_read_card(cards,ncards,"NAXIS2",TLONGLONG,&fitsi[0].nvis,&status);
+	err+=status;
+	if(err!=0)
+	{
+		quickfits_error("ERROR : quickfits_scan_uv_header --> Error reading keywords, custom error = %d\n",err);
+	}
+
+	i=1;
+	status=0;
+	while(status!=KEY_NO_EXIST)
+	{
+		sprintf(key_name,"TTYPE%d",i);
+		quickfits_read_card(cards,ncards,key_name,TSTRING,key_type,&status);
+
+		if( !strncmp(key_type,"VISIBILITIES",12) )
+		{
+			read_tdim(cards,ncards,i,8,&num_vis_axes,vis_axes,&status);	// note maxdim = size of vis_axes
+		}
+
+		if(status!=0 && status!=KEY_NO_EXIST)
+		{
+			break;
+		}
+		i++;
+	}
+
+	status=0;
+	j=i-2;	// set j to point to the visibility data
+	i=1;
+	while(status!=KEY_NO_EXIST)
+	{
+		sprintf(key_name,"%dCTYP%d",i,j);
+		quickfits_read_card(cards,ncards,key_name,TSTRING,key_type,&status);
+
+		if( !strncmp(key_type,"FREQ",4) )
+		{
+			sprintf(key_name,"%dCRVL%d",i,j);
+			quickfits_read_card(cards,ncards,key_name,TDOUBLE,&fitsi[0].freq,&status);
+			sprintf(key_name,"%dCDLT%d",i,j);
+			quickfits_read_card(cards,ncards,key_name,TDOUBLE,&temp,&status);
+			fitsi[0].chan_width = temp;
+			sprintf(key_name,"%dCRPX%d",i,j);
+			quickfits_read_card(cards,ncards,key_name,TDOUBLE,&temp,&status);
+			fitsi[0].central_chan = temp; // central channel stored as double in data
+			fitsi[0].nchan = vis_axes[i-1];
+		}
+
+		if( !strncmp(key_type,"IF",2) )
+		{
+			fitsi[0].nif = vis_axes[i-1];
+		}
+
+		if(status!=0 && status!=KEY_NO_EXIST)
+		{
+			break;
+		}
+		i++;
+	}
+	free(cards);
+
+	return(0);
+}
+
+int quickfits_scan_uv_header(const char* filename, fitsinfo_uv* fitsi)
+{
+/*
+    Read useful keywords from the header of a UV FITS file produced by FITAB in AIPS, without cfitsio.
+    Only the primary header and the extension headers up to the AIPS UV table are read (and, for gzip
+    compressed files, inflated).
+    Gives the same results as quickfits_read_uv_header.
+ 
+	INPUTS:
+		char* tfilename : c string = name of FITS file to be read
+	OUTPUTS:
+		As for quickfits_read_uv_header
+*/
+	int status;
+
+	status = quickfits_pread_uv_header(filename, fitsi);
+	if(status == NO_SIMPLE)	// memory file, or not FITS - let cfitsio do it (and report it)
+	{
+		status = quickfits_read_uv_header(filename, fitsi);
+	}
+	return(status);
+}
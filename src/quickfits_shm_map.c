@@ -0,0 +1,295 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SHM_MAP_MAGIC "QFITSSHM"
+#define SHM_MAP_VERSION 1
+
+typedef struct shm_map_control_tag{	// first page of a segment, the only part attached processes can write to
+	char magic[8];
+	int version;
+	int ready;	// set once the publisher has finished reading the map
+	long long refcount;	// number of attached processes, including the publisher
+	fitsinfo_map fitsi;
+	size_t data_offset;	// page aligned offset of the arrays
+	size_t data_size;
+	size_t cc_offset;	// offset of the CC arrays from the start of the data
+}shm_map_control;
+
+static void shm_map_name(const char* shmname, char* name)
+{
+	// POSIX shared memory names start with a single slash
+
+	if(shmname[0] == '/')
+	{
+		snprintf(name, FLEN_FILENAME, "%s", shmname);
+	}
+	else
+	{
+		snprintf(name, FLEN_FILENAME, "/%s", shmname);
+	}
+}
+
+static void set_arrays(quickfits_shm_map* shm, const shm_map_control* control)
+{
+	const char* data = shm[0].data;
+	long long ncc = control[0].fitsi.ncc;
+
+	shm[0].fitsi = control[0].fitsi;
+	shm[0].tarr = (const double*) data;
+	if(ncc > 0)
+	{
+		shm[0].cc_xarray = (const double*) (data + control[0].cc_offset);
+		shm[0].cc_yarray = shm[0].cc_xarray + ncc;
+		shm[0].cc_varray = shm[0].cc_yarray + ncc;
+	}
+	else
+	{
+		shm[0].cc_xarray = NULL;
+		shm[0].cc_yarray = NULL;
+		shm[0].cc_varray = NULL;
+	}
+}
+
+int quickfits_shm_publish_map(const char* shmname, const char* filename, int cc_table_version, quickfits_shm_map* shm)
+{
+/*
+	Read a FITS map (pixels, header information and clean components) straight into a named POSIX shared memory
+	segment, so that other processes on the node can use it with quickfits_shm_attach_map instead of reading their own copy.
+	The publisher counts as an attached process and releases its reference with quickfits_shm_detach_map.
+	The segment is removed when the last process detaches.
+ 
+	INPUTS:
+		const char* shmname : name of the segment (e.g. "restored_map")
+		const char* filename : c string = name of FITS file to be read
+		int cc_table_version : Version of CC table to read (negative for none)
+	OUTPUTS:
+		shm : header information and read-only pointers to the arrays in the segment
+ 
+	RETURN:
+		0 on success, FILE_NOT_CREATED if the segment already exists
+*/
+	char name[FLEN_FILENAME];
+	fitsinfo_map fitsi;
+	shm_map_control* control;
+	long long npix, dims[2];
+	size_t page, pix_size, cc_size, total;
+	char* data;
+	int fd, status;
+
+	memset(shm, 0, sizeof(quickfits_shm_map));
+
+	fitsi.cc_table_version = cc_table_version;
+	status = quickfits_read_map_header(filename, &fitsi);
+	if(status == BAD_HDU_NUM && fitsi.ncc == 0)	// no CC table, which is fine for a map
+	{
+		status = 0;
+	}
+	if(status != 0)
+	{
+		return(status);
+	}
+
+	page = sysconf(_SC_PAGESIZE);
+	dims[0] = fitsi.imsize_ra;
+	dims[1] = fitsi.imsize_dec;
+	if(quickfits_element_count(2, dims, &npix) || npix > (long long)(SIZE_MAX/sizeof(double)/4) || fitsi.ncc > (long long)(SIZE_MAX/sizeof(double)/4))
+	{
+		quickfits_error("ERROR : quickfits_shm_publish_map --> Image size %lld x %lld is too large\n",fitsi.imsize_ra,fitsi.imsize_dec);
+		return(NUM_OVERFLOW);
+	}
+	pix_size = npix*sizeof(double);
+	pix_size = (pix_size + QUICKFITS_ALIGNMENT - 1) & ~(size_t)(QUICKFITS_ALIGNMENT - 1);
+	if(pix_size == 0)	// keep the data mapping non-empty
+	{
+		pix_size = QUICKFITS_ALIGNMENT;
+	}
+	cc_size = 3*fitsi.ncc*sizeof(double);
+	total = page + pix_size + cc_size;
+
+	shm_map_name(shmname, name);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if(fd < 0)
+	{
+		quickfits_error("ERROR : quickfits_shm_publish_map --> Unable to create shared memory segment %s\n",name);
+		return(FILE_NOT_CREATED);
+	}
+	if(ftruncate(fd, total) != 0)
+	{
+		quickfits_error("ERROR : quickfits_shm_publish_map --> Unable to size shared memory segment %s\n",name);
+		close(fd);
+		shm_unlink(name);
+		return(MEMORY_ALLOCATION);
+	}
+
+	control = mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	data = mmap(NULL, total - page, PROT_READ | PROT_WRITE, MAP_SHARED, fd, page);
+	close(fd);
+	if(control == MAP_FAILED || data == MAP_FAILED)
+	{
+		quickfits_error("ERROR : quickfits_shm_publish_map --> Unable to map shared memory segment %s\n",name);
+		if(control != MAP_FAILED)
+		{
+			munmap(control, page);
+		}
+		if(data != MAP_FAILED)
+		{
+			munmap(data, total - page);
+		}
+		shm_unlink(name);
+		return(MEMORY_ALLOCATION);
+	}
+
+	memcpy(control[0].magic, SHM_MAP_MAGIC, 8);
+	control[0].version = SHM_MAP_VERSION;
+	control[0].refcount = 1;
+	control[0].fitsi = fitsi;
+	control[0].data_offset = page;
+	control[0].data_size = total - page;
+	control[0].cc_offset = pix_size;
+
+	snprintf(shm[0].name, FLEN_FILENAME, "%s", name);
+	shm[0].control = control;
+	shm[0].control_size = page;
+	shm[0].data = data;
+	shm[0].data_size = total - page;
+	set_arrays(shm, control);
+
+	status = quickfits_read_map(filename, fitsi, (double*) shm[0].tarr, (double*) shm[0].cc_xarray, (double*) shm[0].cc_yarray, (double*) shm[0].cc_varray);
+	if(status != 0)
+	{
+		quickfits_shm_detach_map(shm);
+		return(status);
+	}
+
+	mprotect(data, total - page, PROT_READ);	// consumers only ever see read-only data
+	__atomic_store_n(&control[0].ready, 1, __ATOMIC_RELEASE);
+
+	return(0);
+}
+
+int quickfits_shm_attach_map(const char* shmname, quickfits_shm_map* shm)
+{
+/*
+	Attach to a map published with quickfits_shm_publish_map. The arrays are mapped read-only and are not copied.
+	Release with quickfits_shm_detach_map.
+ 
+	INPUTS:
+		const char* shmname : name the map was published under
+	OUTPUTS:
+		shm : header information and read-only pointers to the arrays in the segment
+ 
+	RETURN:
+		0 on success, FILE_NOT_OPENED if there is no such map or it is still being published
+*/
+	char name[FLEN_FILENAME];
+	shm_map_control* control;
+	struct stat st;
+	size_t page;
+	void* data;
+	long long refcount;
+	int fd;
+
+	memset(shm, 0, sizeof(quickfits_shm_map));
+	shm_map_name(shmname, name);
+	page = sysconf(_SC_PAGESIZE);
+
+	fd = shm_open(name, O_RDWR, 0);
+	if(fd < 0)
+	{
+		return(FILE_NOT_OPENED);
+	}
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < page)
+	{
+		close(fd);
+		return(FILE_NOT_OPENED);
+	}
+
+	control = mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(control == MAP_FAILED)
+	{
+		close(fd);
+		return(FILE_NOT_OPENED);
+	}
+	if(memcmp(control[0].magic, SHM_MAP_MAGIC, 8) || control[0].version != SHM_MAP_VERSION || !__atomic_load_n(&control[0].ready, __ATOMIC_ACQUIRE)
+		|| control[0].data_offset != page || control[0].data_offset + control[0].data_size != (size_t)st.st_size)
+	{
+		munmap(control, page);
+		close(fd);
+		return(FILE_NOT_OPENED);
+	}
+
+	refcount = __atomic_load_n(&control[0].refcount, __ATOMIC_ACQUIRE);	// never revive a segment whose last user has gone
+	do
+	{
+		if(refcount <= 0)
+		{
+			munmap(control, page);
+			close(fd);
+			return(FILE_NOT_OPENED);
+		}
+	}while(!__atomic_compare_exchange_n(&control[0].refcount, &refcount, refcount+1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	data = mmap(NULL, control[0].data_size, PROT_READ, MAP_SHARED, fd, page);
+	close(fd);
+
+	snprintf(shm[0].name, FLEN_FILENAME, "%s", name);
+	shm[0].control = control;
+	shm[0].control_size = page;
+	if(data == MAP_FAILED)
+	{
+		quickfits_shm_detach_map(shm);
+		return(MEMORY_ALLOCATION);
+	}
+	shm[0].data = data;
+	shm[0].data_size = control[0].data_size;
+	set_arrays(shm, control);
+
+	return(0);
+}
+
+int quickfits_shm_detach_map(quickfits_shm_map* shm)
+{
+/*
+	Release a map from quickfits_shm_publish_map or quickfits_shm_attach_map.
+	The segment is removed once every process has detached.
+ 
+	RETURN:
+		0
+*/
+	shm_map_control* control = shm[0].control;
+
+	if(shm[0].data != NULL)
+	{
+		munmap(shm[0].data, shm[0].data_size);
+	}
+	if(control != NULL)
+	{
+		if(__atomic_sub_fetch(&control[0].refcount, 1, __ATOMIC_ACQ_REL) == 0)
+		{
+			shm_unlink(shm[0].name);
+		}
+		munmap(control, shm[0].control_size);
+	}
+
+	memset(shm, 0, sizeof(quickfits_shm_map));
+	return(0);
+}
@@ -0,0 +1,218 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+
+void quickfits_stats_init(quickfits_stats* stats)
+{
+/*
+	Empty a set of statistics, ready for quickfits_stats_add or quickfits_stats_merge
+*/
+	stats[0].n = 0;
+	stats[0].nnan = 0;
+	stats[0].min = INFINITY;
+	stats[0].max = -INFINITY;
+	stats[0].sum = 0.0;
+	stats[0].mean = 0.0;
+	stats[0].m2 = 0.0;
+	stats[0].rms = 0.0;
+	stats[0].sigma = 0.0;
+}
+
+void quickfits_stats_merge(quickfits_stats* stats, quickfits_stats part)
+{
+/*
+	Combine the statistics of another set of values into stats (Chan et al. pairwise update, so the
+	variance doesn't suffer from cancellation however many parts there are).
+*/
+	long long n;
+	double delta;
+
+	stats[0].nnan += part.nnan;
+	if(part.n == 0)
+	{
+		return;
+	}
+
+	n = stats[0].n + part.n;
+	delta = part.mean - stats[0].mean;
+	stats[0].mean += delta*((double)(part.n)/n);
+	stats[0].m2 += part.m2 + delta*delta*((double)(stats[0].n)*part.n/n);
+	stats[0].n = n;
+	stats[0].sum += part.sum;
+	if(part.min < stats[0].min)
+	{
+		stats[0].min = part.min;
+	}
+	if(part.max > stats[0].max)
+	{
+		stats[0].max = part.max;
+	}
+
+	stats[0].sigma = sqrt(stats[0].m2/n);
+	stats[0].rms = sqrt(stats[0].m2/n + stats[0].mean*stats[0].mean);
+}
+
+void quickfits_stats_add(quickfits_stats* stats, const double* values, long long n)
+{
+/*
+	Add n values to a set of statistics. NaNs and infinities are counted in nnan and otherwise ignored.
+	Meant to be called on blocks small enough to still be in cache (the values are looked at twice).
+ 
+	INPUTS:
+		values : n values
+	OUTPUTS:
+		stats : updated statistics
+*/
+	quickfits_stats part;
+	long long i;
+	double x, min, max, sum, m2;
+
+	quickfits_stats_init(&part);
+
+	min = INFINITY;
+	max = -INFINITY;
+	sum = 0.0;
+	for(i=0;i<n;i++)
+	{
+		x = values[i];
+		if(isfinite(x))
+		{
+			part.n++;
+			sum += x;
+			min = (x < min) ? x : min;
+			max = (x > max) ? x : max;
+		}
+	}
+	part.nnan = n - part.n;
+
+	if(part.n > 0)
+	{
+		part.mean = sum/part.n;
+		m2 = 0.0;
+		for(i=0;i<n;i++)
+		{
+			x = values[i];
+			if(isfinite(x))
+			{
+				m2 += (x-part.mean)*(x-part.mean);
+			}
+		}
+		part.min = min;
+		part.max = max;
+		part.sum = sum;
+		part.m2 = m2;
+	}
+
+	quickfits_stats_merge(stats, part);
+}
+
+void quickfits_stats_add_vis(quickfits_stats* amp_stats, quickfits_stats* weight_stats, const double* tvis, long long nvis, int nif, int nchan)
+{
+/*
+	Add a block of visibilities, laid out as read by quickfits_read_uv_data, to per-IF/Stokes statistics.
+	Amplitudes only include visibilities with positive weight - the others are counted in amp_stats[].nnan.
+	Weights include every finite weight, so weight_stats[].sum is the total weight.
+ 
+	INPUTS:
+		tvis : nvis*12*nif*nchan visibilities (Re, Im, Weight for each Stokes, channel and IF)
+	OUTPUTS:
+		amp_stats, weight_stats : nif*4 statistics each, index if*4 + stokes
+*/
+	quickfits_stats amp[nif*4];
+	quickfits_stats weight[nif*4];
+	long long vis;
+	int i, chan, s, k;
+	const double* row;
+	double re, im, w, a;
+
+	for(k=0;k<nif*4;k++)
+	{
+		quickfits_stats_init(&amp[k]);
+		quickfits_stats_init(&weight[k]);
+	}
+
+	for(vis=0;vis<nvis;vis++)	// first pass - counts, sums and limits
+	{
+		row = &tvis[vis*12*nif*nchan];
+		for(i=0;i<nif;i++)
+		{
+			for(chan=0;chan<nchan;chan++)
+			{
+				for(s=0;s<4;s++)
+				{
+					k = i*4+s;
+					re = row[((i*nchan+chan)*4+s)*3];
+					im = row[((i*nchan+chan)*4+s)*3+1];
+					w = row[((i*nchan+chan)*4+s)*3+2];
+					if(isfinite(w))
+					{
+						weight[k].n++;
+						weight[k].sum += w;
+						weight[k].min = (w < weight[k].min) ? w : weight[k].min;
+						weight[k].max = (w > weight[k].max) ? w : weight[k].max;
+					}
+					a = sqrt(re*re+im*im);
+					if(w > 0 && isfinite(a))
+					{
+						amp[k].n++;
+						amp[k].sum += a;
+						amp[k].min = (a < amp[k].min) ? a : amp[k].min;
+						amp[k].max = (a > amp[k].max) ? a : amp[k].max;
+					}
+				}
+			}
+		}
+	}
+
+	for(k=0;k<nif*4;k++)
+	{
+		amp[k].nnan = nvis*nchan - amp[k].n;
+		weight[k].nnan = nvis*nchan - weight[k].n;
+		amp[k].mean = (amp[k].n > 0) ? amp[k].sum/amp[k].n : 0.0;
+		weight[k].mean = (weight[k].n > 0) ? weight[k].sum/weight[k].n : 0.0;
+	}
+
+	for(vis=0;vis<nvis;vis++)	// second pass (block still in cache) - squared deviations
+	{
+		row = &tvis[vis*12*nif*nchan];
+		for(i=0;i<nif;i++)
+		{
+			for(chan=0;chan<nchan;chan++)
+			{
+				for(s=0;s<4;s++)
+				{
+					k = i*4+s;
+					re = row[((i*nchan+chan)*4+s)*3];
+					im = row[((i*nchan+chan)*4+s)*3+1];
+					w = row[((i*nchan+chan)*4+s)*3+2];
+					if(isfinite(w))
+					{
+						weight[k].m2 += (w-weight[k].mean)*(w-weight[k].mean);
+					}
+					a = sqrt(re*re+im*im);
+					if(w > 0 && isfinite(a))
+					{
+						amp[k].m2 += (a-amp[k].mean)*(a-amp[k].mean);
+					}
+				}
+			}
+		}
+	}
+
+	for(k=0;k<nif*4;k++)
+	{
+		quickfits_stats_merge(&amp_stats[k], amp[k]);
+		quickfits_stats_merge(&weight_stats[k], weight[k]);
+	}
+}
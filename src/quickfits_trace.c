@@ -0,0 +1,517 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACE_BUFFER 256	// trace events held by each thread before they are written out
+#define ERROR_MESSAGE_SIZE 1024
+
+typedef struct trace_event_tag{
+	const char* name;
+	const char* cat;
+	long long start;	// ns
+	long long duration;
+}trace_event;
+
+typedef struct thread_counters_tag{	// written only by the thread that owns it, read by anyone
+	quickfits_io_stats io;
+	int napis;
+	const char* api_names[QUICKFITS_MAX_APIS];
+	long long api_calls[QUICKFITS_MAX_APIS];
+	long long api_ns[QUICKFITS_MAX_APIS];
+	int tid;
+	int nevents;
+	trace_event events[TRACE_BUFFER];
+	struct thread_counters_tag* next;
+}thread_counters;
+
+static const char* phase_names[QUICKFITS_NPHASES] = {"open", "hdu_move", "keywords", "read", "write", "convert", "close"};
+
+static bool instrumentation = false;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;	// for threads, retired and baseline - never held while counting
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t counters_key;
+static __thread thread_counters* local = NULL;
+static thread_counters* threads = NULL;
+static int next_tid = 1;
+
+static quickfits_io_stats retired;	// counts from threads that have exited
+static int nretired_apis = 0;
+static quickfits_api_stats retired_apis[QUICKFITS_MAX_APIS];
+static quickfits_io_stats baseline;	// totals at the last quickfits_reset_io_stats
+static int nbaseline_apis = 0;
+static quickfits_api_stats baseline_apis[QUICKFITS_MAX_APIS];
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE* trace_file = NULL;
+static bool trace_first_event;
+static long long trace_epoch;
+
+static quickfits_error_handler error_handler = NULL;
+static void* error_arg = NULL;
+static __thread char last_error[ERROR_MESSAGE_SIZE];
+
+static long long now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return((long long)(t.tv_sec)*1000000000LL + t.tv_nsec);
+}
+
+static void bump(long long* counter, long long n)
+{
+	// only the owning thread writes, so no read-modify-write atomic is needed - just no torn values for readers
+	__atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static long long peek(long long* counter)
+{
+	return(__atomic_load_n(counter, __ATOMIC_RELAXED));
+}
+
+static void add_io(quickfits_io_stats* total, quickfits_io_stats* part, long long sign)
+{
+	int i;
+
+	for(i=0;i<QUICKFITS_NPHASES;i++)
+	{
+		total[0].phase_calls[i] += sign*peek(&part[0].phase_calls[i]);
+		total[0].phase_ns[i] += sign*peek(&part[0].phase_ns[i]);
+	}
+	total[0].bytes_read += sign*peek(&part[0].bytes_read);
+	total[0].bytes_written += sign*peek(&part[0].bytes_written);
+	total[0].hdu_moves += sign*peek(&part[0].hdu_moves);
+	total[0].keyword_reads += sign*peek(&part[0].keyword_reads);
+}
+
+static void add_api(quickfits_api_stats* apis, int* napis, int maxapis, const char* name, long long calls, long long ns)
+{
+	int i;
+
+	for(i=0;i<*napis;i++)
+	{
+		if(!strcmp(apis[i].name, name))
+		{
+			break;
+		}
+	}
+	if(i == *napis)
+	{
+		if(i >= maxapis)
+		{
+			return;
+		}
+		memset(&apis[i], 0, sizeof(quickfits_api_stats));
+		snprintf(apis[i].name, FLEN_VALUE, "%s", name);
+		(*napis)++;
+	}
+	apis[i].calls += calls;
+	apis[i].ns += ns;
+}
+
+static void flush_events(thread_counters* counters)
+{
+	// write out a thread's buffered trace events (trace_lock held)
+
+	int i;
+
+	for(i=0;i<counters[0].nevents && trace_file!=NULL;i++)
+	{
+		fprintf(trace_file, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+			trace_first_event ? "" : ",", counters[0].events[i].name, counters[0].events[i].cat,
+			1.0E-3*(counters[0].events[i].start - trace_epoch), 1.0E-3*counters[0].events[i].duration, (int)(getpid()), counters[0].tid);
+		trace_first_event = false;
+	}
+	counters[0].nevents = 0;
+}
+
+static void retire_thread(void* arg)
+{
+	// a thread with counters is exiting - keep its counts and trace events, and forget it
+
+	thread_counters* counters = (thread_counters*)(arg);
+	thread_counters** link;
+	int i;
+
+	pthread_mutex_lock(&trace_lock);
+	flush_events(counters);
+	pthread_mutex_unlock(&trace_lock);
+
+	pthread_mutex_lock(&registry_lock);
+	add_io(&retired, &counters[0].io, 1);
+	for(i=0;i<counters[0].napis;i++)
+	{
+		add_api(retired_apis, &nretired_apis, QUICKFITS_MAX_APIS, counters[0].api_names[i], counters[0].api_calls[i], counters[0].api_ns[i]);
+	}
+	for(link=&threads;*link!=NULL;link=&(*link)->next)
+	{
+		if(*link == counters)
+		{
+			*link = counters[0].next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&registry_lock);
+
+	free(counters);
+}
+
+static void make_key(void)
+{
+	pthread_key_create(&counters_key, retire_thread);
+}
+
+static thread_counters* get_counters(void)
+{
+	// this thread's counters, made the first time it records anything
+
+	if(local == NULL)
+	{
+		pthread_once(&key_once, make_key);
+		local = calloc(1, sizeof(thread_counters));
+		if(local == NULL)
+		{
+			return(NULL);
+		}
+		pthread_mutex_lock(&registry_lock);
+		local[0].tid = next_tid++;
+		local[0].next = threads;
+		threads = local;
+		pthread_mutex_unlock(&registry_lock);
+		pthread_setspecific(counters_key, local);
+	}
+	return(local);
+}
+
+static void record_event(thread_counters* counters, const char* name, const char* cat, long long start, long long end)
+{
+	if(__atomic_load_n(&trace_file, __ATOMIC_RELAXED) == NULL)
+	{
+		return;
+	}
+	if(counters[0].nevents == TRACE_BUFFER)
+	{
+		pthread_mutex_lock(&trace_lock);
+		flush_events(counters);
+		pthread_mutex_unlock(&trace_lock);
+	}
+	counters[0].events[counters[0].nevents].name = name;
+	counters[0].events[counters[0].nevents].cat = cat;
+	counters[0].events[counters[0].nevents].start = start;
+	counters[0].events[counters[0].nevents].duration = end - start;
+	counters[0].nevents++;
+}
+
+void quickfits_set_instrumentation(bool enable)
+{
+/*
+	Turn on (or off) timing and counting of quickfits calls. Off by default, when the hooks cost one test of a flag.
+	Counts are kept per thread without locks, and summed when they are read with quickfits_get_io_stats and quickfits_get_api_stats.
+*/
+	__atomic_store_n(&instrumentation, enable, __ATOMIC_RELAXED);
+}
+
+bool quickfits_instrumentation_enabled(void)
+{
+	return(__atomic_load_n(&instrumentation, __ATOMIC_RELAXED));
+}
+
+long long quickfits_trace_start(void)
+{
+/*
+	Start of a timed API call or phase, to be passed to quickfits_trace_api or quickfits_trace_phase. 0 if instrumentation is off.
+*/
+	if(!quickfits_instrumentation_enabled())
+	{
+		return(0);
+	}
+	return(now_ns());
+}
+
+void quickfits_trace_api(const char* name, long long start)
+{
+/*
+	Count a call of a public function (name must be a string constant) that started at start
+*/
+	thread_counters* counters;
+	long long end;
+	int i;
+
+	if(start == 0 || (counters = get_counters()) == NULL)
+	{
+		return;
+	}
+	end = now_ns();
+
+	for(i=0;i<counters[0].napis;i++)
+	{
+		if(counters[0].api_names[i] == name)
+		{
+			break;
+		}
+	}
+	if(i == counters[0].napis)
+	{
+		if(i == QUICKFITS_MAX_APIS)
+		{
+			return;
+		}
+		counters[0].api_names[i] = name;
+		__atomic_store_n(&counters[0].napis, i+1, __ATOMIC_RELEASE);	// the name is set before readers can see it
+	}
+	bump(&counters[0].api_calls[i], 1);
+	bump(&counters[0].api_ns[i], end - start);
+	record_event(counters, name, "api", start, end);
+}
+
+void quickfits_trace_phase(int phase, long long start)
+{
+/*
+	Add the time since start to a phase (QUICKFITS_PHASE_OPEN etc.) of the current call
+*/
+	thread_counters* counters;
+	long long end;
+
+	if(start == 0 || phase < 0 || phase >= QUICKFITS_NPHASES || (counters = get_counters()) == NULL)
+	{
+		return;
+	}
+	end = now_ns();
+
+	bump(&counters[0].io.phase_calls[phase], 1);
+	bump(&counters[0].io.phase_ns[phase], end - start);
+	record_event(counters, phase_names[phase], "phase", start, end);
+}
+
+void quickfits_count_io(long long bytes_read, long long bytes_written, long long hdu_moves, long long keyword_reads)
+{
+/*
+	Add to the data read and written (bytes of values passed to or from cfitsio), HDU moves and keyword reads
+*/
+	thread_counters* counters;
+
+	if(!quickfits_instrumentation_enabled() || (counters = get_counters()) == NULL)
+	{
+		return;
+	}
+	bump(&counters[0].io.bytes_read, bytes_read);
+	bump(&counters[0].io.bytes_written, bytes_written);
+	bump(&counters[0].io.hdu_moves, hdu_moves);
+	bump(&counters[0].io.keyword_reads, keyword_reads);
+}
+
+void quickfits_get_io_stats(quickfits_io_stats* stats)
+{
+/*
+	Totals over all threads since the last quickfits_reset_io_stats.
+	Counts being made while this runs may or may not be included.
+*/
+	thread_counters* counters;
+
+	memset(stats, 0, sizeof(quickfits_io_stats));
+	pthread_mutex_lock(&registry_lock);
+	for(counters=threads;counters!=NULL;counters=counters[0].next)
+	{
+		add_io(stats, &counters[0].io, 1);
+	}
+	add_io(stats, &retired, 1);
+	add_io(stats, &baseline, -1);
+	pthread_mutex_unlock(&registry_lock);
+}
+
+static int all_apis(quickfits_api_stats* apis, int maxapis)
+{
+	// per-function totals over all threads, ignoring the baseline (registry_lock held)
+
+	thread_counters* counters;
+	int i, n, napis;
+
+	napis = 0;
+	for(counters=threads;counters!=NULL;counters=counters[0].next)
+	{
+		n = __atomic_load_n(&counters[0].napis, __ATOMIC_ACQUIRE);
+		for(i=0;i<n;i++)
+		{
+			add_api(apis, &napis, maxapis, counters[0].api_names[i], peek(&counters[0].api_calls[i]), peek(&counters[0].api_ns[i]));
+		}
+	}
+	for(i=0;i<nretired_apis;i++)
+	{
+		add_api(apis, &napis, maxapis, retired_apis[i].name, retired_apis[i].calls, retired_apis[i].ns);
+	}
+	return(napis);
+}
+
+int quickfits_get_api_stats(quickfits_api_stats* apis, int maxapis)
+{
+/*
+	Number of calls and total time of each public function called since the last quickfits_reset_io_stats.
+ 
+	INPUTS:
+		int maxapis : size of apis (QUICKFITS_MAX_APIS is always enough)
+	OUTPUTS:
+		apis : one entry per function
+ 
+	RETURN:
+		number of entries filled in
+*/
+	quickfits_api_stats all[QUICKFITS_MAX_APIS];
+	int i, n, napis;
+
+	pthread_mutex_lock(&registry_lock);
+	memset(all, 0, sizeof(all));
+	napis = all_apis(all, QUICKFITS_MAX_APIS);
+	for(i=0;i<nbaseline_apis;i++)
+	{
+		add_api(all, &napis, QUICKFITS_MAX_APIS, baseline_apis[i].name, -baseline_apis[i].calls, -baseline_apis[i].ns);
+	}
+	pthread_mutex_unlock(&registry_lock);
+
+	n = 0;
+	for(i=0;i<napis && n<maxapis;i++)
+	{
+		if(all[i].calls != 0)
+		{
+			apis[n++] = all[i];
+		}
+	}
+	return(n);
+}
+
+void quickfits_reset_io_stats(void)
+{
+/*
+	Start counting again from zero. Other threads' counters are never written here - the current totals become the
+	baseline that later totals are measured from.
+*/
+	thread_counters* counters;
+
+	pthread_mutex_lock(&registry_lock);
+	memset(&baseline, 0, sizeof(quickfits_io_stats));
+	for(counters=threads;counters!=NULL;counters=counters[0].next)
+	{
+		add_io(&baseline, &counters[0].io, 1);
+	}
+	add_io(&baseline, &retired, 1);
+	memset(baseline_apis, 0, sizeof(baseline_apis));
+	nbaseline_apis = all_apis(baseline_apis, QUICKFITS_MAX_APIS);
+	pthread_mutex_unlock(&registry_lock);
+}
+
+int quickfits_trace_open(const char* filename)
+{
+/*
+	Write a trace of every instrumented call and phase to filename as Chrome trace event JSON (chrome://tracing, Perfetto).
+	Turns instrumentation on. Events are buffered by each thread and written out in batches.
+ 
+	RETURN:
+		0 on success, FILE_NOT_CREATED if the file can't be written or a trace is already open
+*/
+	FILE* file;
+
+	pthread_mutex_lock(&trace_lock);
+	if(trace_file != NULL || (file = fopen(filename, "w")) == NULL)
+	{
+		pthread_mutex_unlock(&trace_lock);
+		quickfits_error("ERROR : quickfits_trace_open --> Error opening trace file %s\n",filename);
+		return(FILE_NOT_CREATED);
+	}
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	trace_first_event = true;
+	trace_epoch = now_ns();
+	__atomic_store_n(&trace_file, file, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&trace_lock);
+
+	quickfits_set_instrumentation(true);
+	return(0);
+}
+
+int quickfits_trace_close(void)
+{
+/*
+	Write out the remaining events and close the trace file. Call when no quickfits calls are in progress.
+*/
+	thread_counters* counters;
+	FILE* file;
+
+	pthread_mutex_lock(&registry_lock);
+	pthread_mutex_lock(&trace_lock);
+	for(counters=threads;counters!=NULL;counters=counters[0].next)
+	{
+		flush_events(counters);
+	}
+	file = trace_file;
+	__atomic_store_n(&trace_file, NULL, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&trace_lock);
+	pthread_mutex_unlock(&registry_lock);
+
+	if(file == NULL)
+	{
+		return(0);
+	}
+	fprintf(file, "\n]}\n");
+	if(fclose(file))
+	{
+		return(WRITE_ERROR);
+	}
+	return(0);
+}
+
+void quickfits_set_error_handler(quickfits_error_handler handler, void* arg)
+{
+/*
+	Send quickfits error and warning messages to handler(message, arg) instead of printing them on stdout (NULL to print them again).
+	The handler can be called from any thread that is running a quickfits function.
+*/
+	pthread_mutex_lock(&registry_lock);
+	error_arg = arg;
+	__atomic_store_n(&error_handler, handler, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&registry_lock);
+}
+
+void quickfits_error(const char* format, ...)
+{
+/*
+	Report an error or warning (printf style) through the error handler. The message is also kept as this thread's last error.
+*/
+	quickfits_error_handler handler;
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(last_error, ERROR_MESSAGE_SIZE, format, args);
+	va_end(args);
+
+	handler = __atomic_load_n(&error_handler, __ATOMIC_ACQUIRE);
+	if(handler != NULL)
+	{
+		handler(last_error, error_arg);
+	}
+	else
+	{
+		fputs(last_error, stdout);
+	}
+}
+
+const char* quickfits_last_error(void)
+{
+/*
+	The last message reported by quickfits in this thread (empty if there has been none)
+*/
+	return(last_error);
+}
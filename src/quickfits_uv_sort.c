@@ -0,0 +1,340 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1<<RADIX_BITS)
+
+typedef struct radix_job_tag{
+	long long n;
+	int nchunks;
+	int shift;	// of the digit being sorted on this pass
+	const uint64_t* keys_in;
+	const long long* index_in;
+	uint64_t* keys_out;
+	long long* index_out;
+	long long* counts;	// nchunks*RADIX_BUCKETS, turned into output offsets before scattering
+}radix_job;
+
+static uint64_t spread_bits(uint64_t x)
+{
+	// move bit k of a 32 bit number to bit 2k
+
+	x &= 0xFFFFFFFF;
+	x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+	x = (x | (x << 8)) & 0x00FF00FF00FF00FFULL;
+	x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	x = (x | (x << 2)) & 0x3333333333333333ULL;
+	x = (x | (x << 1)) & 0x5555555555555555ULL;
+	return(x);
+}
+
+static uint64_t grid_cell(double x, double cell_size, int grid_size)
+{
+	// cell of a coordinate on a grid centred on zero, clamped to the edges
+
+	double cell;
+
+	cell = x/cell_size + grid_size/2;
+	if(!(cell >= 0))	// also catches NaN
+	{
+		return(0);
+	}
+	if(cell >= grid_size)
+	{
+		return(grid_size-1);
+	}
+	return((uint64_t)cell);
+}
+
+static void chunk_range(long long n, int nchunks, long long chunk, long long* first, long long* last)
+{
+	*first = n*chunk/nchunks;
+	*last = n*(chunk+1)/nchunks;
+}
+
+static void radix_count(long long chunk, void* arg)
+{
+	radix_job* job = (radix_job*)(arg);
+	long long* counts;
+	long long i, first, last;
+
+	counts = &job[0].counts[chunk*RADIX_BUCKETS];
+	memset(counts, 0, RADIX_BUCKETS*sizeof(long long));
+	chunk_range(job[0].n, job[0].nchunks, chunk, &first, &last);
+	for(i=first;i<last;i++)
+	{
+		counts[(job[0].keys_in[i] >> job[0].shift) & (RADIX_BUCKETS-1)]++;
+	}
+}
+
+static void radix_scatter(long long chunk, void* arg)
+{
+	radix_job* job = (radix_job*)(arg);
+	long long* offsets;
+	long long i, first, last, dest;
+
+	offsets = &job[0].counts[chunk*RADIX_BUCKETS];
+	chunk_range(job[0].n, job[0].nchunks, chunk, &first, &last);
+	for(i=first;i<last;i++)	// in order, so each pass is stable
+	{
+		dest = offsets[(job[0].keys_in[i] >> job[0].shift) & (RADIX_BUCKETS-1)]++;
+		job[0].keys_out[dest] = job[0].keys_in[i];
+		job[0].index_out[dest] = job[0].index_in[i];
+	}
+}
+
+static void swap_values(double* a, double* b)
+{
+	double temp;
+
+	temp = *a;
+	*a = *b;
+	*b = temp;
+}
+
+static void permute_rows(long long nvis, const long long* perm, bool inverse, double* u_array, double* v_array, double* tvis, long long row_elements, double* row, unsigned char* done)
+{
+	// Put row perm[i] at i (or, if inverse, row i at perm[i]) by following cycles, so only one row of extra space is needed
+
+	long long start, j, k;
+	double tu, tv;
+
+	memset(done, 0, nvis);
+	for(start=0;start<nvis;start++)
+	{
+		if(done[start] || perm[start] == start)
+		{
+			continue;
+		}
+
+		tu = u_array[start];
+		tv = v_array[start];
+		memcpy(row, &tvis[start*row_elements], row_elements*sizeof(double));
+		done[start] = 1;
+
+		if(!inverse)
+		{
+			j = start;
+			k = perm[j];
+			while(k != start)
+			{
+				u_array[j] = u_array[k];
+				v_array[j] = v_array[k];
+				memcpy(&tvis[j*row_elements], &tvis[k*row_elements], row_elements*sizeof(double));
+				done[k] = 1;
+				j = k;
+				k = perm[j];
+			}
+			u_array[j] = tu;
+			v_array[j] = tv;
+			memcpy(&tvis[j*row_elements], row, row_elements*sizeof(double));
+		}
+		else
+		{
+			k = perm[start];
+			while(k != start)	// the row held belongs at k, so swap it with the one there and carry on with that
+			{
+				swap_values(&tu, &u_array[k]);
+				swap_values(&tv, &v_array[k]);
+				for(j=0;j<row_elements;j++)
+				{
+					swap_values(&row[j], &tvis[k*row_elements+j]);
+				}
+				done[k] = 1;
+				k = perm[k];
+			}
+			u_array[start] = tu;
+			v_array[start] = tv;
+			memcpy(&tvis[start*row_elements], row, row_elements*sizeof(double));
+		}
+	}
+}
+
+int quickfits_sort_uv_cells(fitsinfo_uv fitsi, double cell_size, int grid_size, int nthreads, double* u_array, double* v_array, double* tvis, long long* perm)
+{
+/*
+	Reorder visibilities (in place) by the Morton (Z order) index of the (u,v) cell they grid to, so that visibilities
+	falling in nearby cells are nearby in memory. The order within a cell is kept. Uses a parallel radix sort.
+ 
+	INPUTS:
+		fitsinfo_uv fitsi : nvis, nif and nchan are used
+		double cell_size : size of a grid cell, in the same units as u_array and v_array
+		int grid_size : grid is grid_size x grid_size cells, centred on (0,0). Visibilities off the grid sort with the edge cells.
+		int nthreads : number of threads to use (0 to use one per processor)
+		u_array, v_array, tvis : as from quickfits_read_uv_data
+	OUTPUTS:
+		u_array, v_array, tvis : sorted
+		perm : nvis row indices, perm[i] = original position of sorted row i. Pass to quickfits_unsort_uv to get the original order back.
+ 
+	RETURN:
+		0 on success
+*/
+	radix_job job;
+	uint64_t* keys[2];
+	long long* index[2];
+	long long i, b, t, offset, count, row_elements;
+	int pass, npasses, nbits, cur;
+	double* row;
+	unsigned char* done;
+
+	if(cell_size <= 0 || grid_size < 1)
+	{
+		quickfits_error("ERROR : quickfits_sort_uv_cells --> Invalid grid (%d cells of %g)\n",grid_size,cell_size);
+		return(BAD_DIMEN);
+	}
+	if(fitsi.nvis <= 0)
+	{
+		return(0);
+	}
+	if(nthreads <= 0)
+	{
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+
+	nbits = 0;	// key bits actually used, to skip passes over digits that are always zero
+	while(nbits < 32 && ((uint64_t)(grid_size-1) >> nbits) != 0)
+	{
+		nbits++;
+	}
+	npasses = (2*nbits + RADIX_BITS - 1)/RADIX_BITS;
+	row_elements = 12LL*fitsi.nif*fitsi.nchan;
+
+	job.n = fitsi.nvis;
+	job.nchunks = (fitsi.nvis < nthreads) ? fitsi.nvis : nthreads;
+	keys[0] = malloc(fitsi.nvis*sizeof(uint64_t));
+	keys[1] = malloc(fitsi.nvis*sizeof(uint64_t));
+	index[0] = perm;
+	index[1] = malloc(fitsi.nvis*sizeof(long long));
+	job.counts = malloc(job.nchunks*RADIX_BUCKETS*sizeof(long long));
+	row = malloc(row_elements*sizeof(double));
+	done = malloc(fitsi.nvis);
+	if(keys[0] == NULL || keys[1] == NULL || index[1] == NULL || job.counts == NULL || row == NULL || done == NULL)
+	{
+		quickfits_error("ERROR : quickfits_sort_uv_cells --> Error allocating memory\n");
+		free(keys[0]);
+		free(keys[1]);
+		free(index[1]);
+		free(job.counts);
+		free(row);
+		free(done);
+		return(MEMORY_ALLOCATION);
+	}
+
+	for(i=0;i<fitsi.nvis;i++)
+	{
+		keys[0][i] = spread_bits(grid_cell(u_array[i], cell_size, grid_size)) | (spread_bits(grid_cell(v_array[i], cell_size, grid_size)) << 1);
+		perm[i] = i;
+	}
+
+	cur = 0;
+	for(pass=0;pass<npasses;pass++)	// least significant digit first
+	{
+		job.shift = pass*RADIX_BITS;
+		job.keys_in = keys[cur];
+		job.index_in = index[cur];
+		job.keys_out = keys[1-cur];
+		job.index_out = index[1-cur];
+
+		quickfits_parallel_for(job.nchunks, nthreads, radix_count, &job);
+
+		offset = 0;	// each chunk writes its part of each bucket after the same bucket of earlier chunks
+		for(b=0;b<RADIX_BUCKETS;b++)
+		{
+			for(t=0;t<job.nchunks;t++)
+			{
+				count = job.counts[t*RADIX_BUCKETS+b];
+				job.counts[t*RADIX_BUCKETS+b] = offset;
+				offset += count;
+			}
+		}
+
+		quickfits_parallel_for(job.nchunks, nthreads, radix_scatter, &job);
+		cur = 1-cur;
+	}
+	if(cur != 0)
+	{
+		memcpy(perm, index[cur], fitsi.nvis*sizeof(long long));
+	}
+
+	permute_rows(fitsi.nvis, perm, false, u_array, v_array, tvis, row_elements, row, done);
+
+	free(keys[0]);
+	free(keys[1]);
+	free(index[1]);
+	free(job.counts);
+	free(row);
+	free(done);
+
+	return(0);
+}
+
+int quickfits_unsort_uv(fitsinfo_uv fitsi, const long long* perm, double* u_array, double* v_array, double* tvis)
+{
+/*
+	Undo quickfits_sort_uv_cells (in place), e.g. before quickfits_overwrite_uv_data.
+ 
+	INPUTS:
+		fitsinfo_uv fitsi : nvis, nif and nchan are used
+		perm : permutation from quickfits_sort_uv_cells
+		u_array, v_array, tvis : in sorted order
+	OUTPUTS:
+		u_array, v_array, tvis : in the original order
+ 
+	RETURN:
+		0 on success
+*/
+	double* row;
+	unsigned char* done;
+
+	if(fitsi.nvis <= 0)
+	{
+		return(0);
+	}
+
+	row = malloc(12LL*fitsi.nif*fitsi.nchan*sizeof(double));
+	done = malloc(fitsi.nvis);
+	if(row == NULL || done == NULL)
+	{
+		quickfits_error("ERROR : quickfits_unsort_uv --> Error allocating memory\n");
+		free(row);
+		free(done);
+		return(MEMORY_ALLOCATION);
+	}
+
+	permute_rows(fitsi.nvis, perm, true, u_array, v_array, tvis, 12LL*fitsi.nif*fitsi.nchan, row, done);
+
+	free(row);
+	free(done);
+	return(0);
+}
+
+int quickfits_read_uv_data_sorted(const char* filename, fitsinfo_uv fitsi, double cell_size, int grid_size, int nthreads, double* u_array, double* v_array, double* tvis, double* if_array, long long* perm)
+{
+/*
+	quickfits_read_uv_data followed by quickfits_sort_uv_cells. See those for the arguments.
+*/
+	int status;
+
+	status = quickfits_read_uv_data(filename, fitsi, u_array, v_array, tvis, if_array);
+	if(status != 0)
+	{
+		return(status);
+	}
+
+	return(quickfits_sort_uv_cells(fitsi, cell_size, grid_size, nthreads, u_array, v_array, tvis, perm));
+}
@@ -0,0 +1,513 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdlib.h>
+
+#define UV_WRITER_BLOCK_BYTES (8<<20)	// rows encoded, then written in one go
+#define UV_WRITER_NPARAMS 6	// random parameter columns before VISIBILITIES
+
+static void put_be64(unsigned char* p, double value)
+{
+	union { unsigned long long i; double d; } u;
+	int k;
+
+	u.d = value;
+	for(k=7;k>=0;k--)
+	{
+		p[k] = (unsigned char)(u.i);
+		u.i >>= 8;
+	}
+}
+
+static void put_be32(unsigned char* p, float value)
+{
+	union { unsigned int i; float f; } u;
+	int k;
+
+	u.f = value;
+	for(k=3;k>=0;k--)
+	{
+		p[k] = (unsigned char)(u.i);
+		u.i >>= 8;
+	}
+}
+
+static void create_uv_table(fitsfile* fptr, fitsinfo_uv fitsi, long long nvis, int* status)
+{
+	// FITAB layout: an empty primary HDU, then the AIPS UV table with its nCTYPm family of keywords for the visibility axes
+
+	char* names[] = {"UU---SIN", "VV---SIN", "WW---SIN", "DATE", "BASELINE", "INTTIM", "VISIBILITIES"};
+	char* units[] = {"SECONDS", "SECONDS", "SECONDS", "DAYS", "", "SECONDS", "JY"};
+	char vis_form[FLEN_VALUE];
+	char* formats[] = {"1D", "1D", "1D", "1D", "1E", "1E", vis_form};
+	char* ctype[] = {"COMPLEX", "STOKES", "FREQ", "IF", "RA", "DEC"};
+	char extname[] = "AIPS UV ";
+	char comment[] = "";
+	char key_name[FLEN_KEYWORD];
+	double crval[6];
+	double cdelt[6];
+	double crpix[6];
+	long naxes[6];
+	int k, one, viscol;
+
+	sprintf(vis_form,"%lldE",12LL*fitsi.nif*fitsi.nchan);
+	viscol = UV_WRITER_NPARAMS + 1;
+
+	fits_create_img(fptr, BYTE_IMG, 0, NULL, status);
+	fits_update_key(fptr, TSTRING, "OBJECT", fitsi.object, comment, status);
+	fits_update_key(fptr, TSTRING, "TELESCOP", fitsi.telescope, comment, status);
+
+	fits_create_tbl(fptr, BINARY_TBL, nvis, viscol, names, formats, units, extname, status);
+	naxes[0] = 3;	// Re, Im, weight
+	naxes[1] = 4;
+	naxes[2] = fitsi.nchan;
+	naxes[3] = fitsi.nif;
+	naxes[4] = 1;
+	naxes[5] = 1;
+	fits_write_tdim(fptr, viscol, 6, naxes, status);
+	for(k=0;k<6;k++)
+	{
+		crval[k] = 1.0;
+		cdelt[k] = 1.0;
+		crpix[k] = 1.0;
+	}
+	crval[1] = -1.0;	// RR, LL, RL, LR
+	cdelt[1] = -1.0;
+	crval[2] = fitsi.freq;
+	cdelt[2] = fitsi.chan_width;
+	crpix[2] = fitsi.central_chan;
+	crval[4] = fitsi.ra;
+	crval[5] = fitsi.dec;
+	for(k=0;k<6;k++)
+	{
+		sprintf(key_name,"%dCTYP%d",k+1,viscol);
+		fits_update_key(fptr, TSTRING, key_name, ctype[k], comment, status);
+		sprintf(key_name,"%dCRVL%d",k+1,viscol);
+		fits_update_key(fptr, TDOUBLE, key_name, &crval[k], comment, status);
+		sprintf(key_name,"%dCDLT%d",k+1,viscol);
+		fits_update_key(fptr, TDOUBLE, key_name, &cdelt[k], comment, status);
+		sprintf(key_name,"%dCRPX%d",k+1,viscol);
+		fits_update_key(fptr, TDOUBLE, key_name, &crpix[k], comment, status);
+	}
+	fits_update_key(fptr, TSTRING, "OBJECT", fitsi.object, comment, status);
+	fits_update_key(fptr, TSTRING, "OBSERVER", fitsi.observer, comment, status);
+	fits_update_key(fptr, TSTRING, "TELESCOP", fitsi.telescope, comment, status);
+	fits_update_key(fptr, TSTRING, "DATE-OBS", fitsi.date_obs, comment, status);
+	fits_update_key(fptr, TDOUBLE, "EQUINOX", &fitsi.equinox, comment, status);
+	fits_update_key(fptr, TDOUBLE, "OBSRA", &fitsi.ra, comment, status);
+	fits_update_key(fptr, TDOUBLE, "OBSDEC", &fitsi.dec, comment, status);
+	one = 1;
+	fits_update_key(fptr, TINT, "NO_IF", &fitsi.nif, comment, status);
+	fits_update_key(fptr, TINT, "EXTVER", &one, comment, status);
+}
+
+static int uv_writer_open(quickfits_uv_writer* writer, const char* filename, fitsinfo_uv fitsi, long long nvis)
+{
+	int status;
+	long long dims[3];
+
+	status = 0;
+	memset(writer, 0, sizeof(quickfits_uv_writer));
+
+	dims[0] = 12;
+	dims[1] = fitsi.nif;
+	dims[2] = fitsi.nchan;
+	if(quickfits_element_count(3, dims, &writer[0].row_elements) || nvis < 0 || fitsi.nif < 1 || fitsi.nchan < 1)
+	{
+		quickfits_error("ERROR : quickfits_uv_writer_open --> Bad visibility size (12 x %d x %d)\n",fitsi.nif,fitsi.nchan);
+		return(NUM_OVERFLOW);
+	}
+	if(strlen(filename) >= FLEN_FILENAME)
+	{
+		return(FILE_NOT_CREATED);
+	}
+
+	writer[0].fitsi = fitsi;
+	writer[0].nvis = nvis;
+	writer[0].rows_allocated = nvis;
+	writer[0].row_bytes = 4*sizeof(double) + 2*sizeof(float) + writer[0].row_elements*sizeof(float);
+	writer[0].buffer_rows = (writer[0].row_bytes < UV_WRITER_BLOCK_BYTES) ? UV_WRITER_BLOCK_BYTES/writer[0].row_bytes : 1;
+	writer[0].rows = malloc(writer[0].buffer_rows*writer[0].row_bytes);
+	if(writer[0].rows == NULL)
+	{
+		quickfits_error("ERROR : quickfits_uv_writer_open --> Unable to allocate %lld bytes\n",writer[0].buffer_rows*writer[0].row_bytes);
+		return(MEMORY_ALLOCATION);
+	}
+	strcpy(writer[0].filename, filename);
+	quickfits_checksum_init(&writer[0].checksum);
+
+	quickfits_create_file(&writer[0].fptr, filename, &status);
+	create_uv_table(writer[0].fptr, fitsi, nvis, &status);
+	if(status != 0)
+	{
+		quickfits_error("ERROR : quickfits_uv_writer_open --> Error creating %s, error = %d\n",filename,status);
+		if(writer[0].fptr != NULL)
+		{
+			quickfits_close_file(writer[0].fptr, &status);
+			writer[0].fptr = NULL;
+		}
+		free(writer[0].rows);
+		writer[0].rows = NULL;
+	}
+
+	return(status);
+}
+
+int quickfits_uv_writer_open(quickfits_uv_writer* writer, const char* filename, fitsinfo_uv fitsi, long long nvis)
+{
+/*
+	Start writing a new UV FITS file in the layout FITAB produces, so it can be loaded into AIPS and read with the
+	quickfits_read_uv functions. The primary HDU and the AIPS UV table header are written now, the visibilities are added
+	with quickfits_uv_writer_append in large blocks, and the AIPS FQ and AN tables are written by quickfits_uv_writer_close.
+ 
+	INPUTS:
+		filename : name of file to write out (replaced if it exists)
+		fitsi : header information, as from quickfits_read_uv_header (nif, nchan, freq, chan_width, central_chan, ra, dec, ...)
+		nvis : number of visibilities, or 0 if not known in advance - the table then grows as rows are appended
+	OUTPUTS:
+		writer : the open writer
+ 
+	RETURN:
+		0 if no errors occur.
+*/
+	long long start;
+	int status;
+
+	start = quickfits_trace_start();
+	status = uv_writer_open(writer, filename, fitsi, nvis);
+	quickfits_trace_api("quickfits_uv_writer_open", start);
+
+	return(status);
+}
+
+static int flush_rows(quickfits_uv_writer* writer)
+{
+	// write the buffered rows to the table with one call
+
+	int status;
+	long long nrows;
+
+	status = 0;
+	nrows = writer[0].rows_buffered;
+	if(nrows == 0)
+	{
+		return(0);
+	}
+	if(writer[0].rows_written + nrows > writer[0].rows_allocated)	// the table is the last HDU so far, so this just extends the file
+	{
+		fits_insert_rows(writer[0].fptr, writer[0].rows_allocated, writer[0].rows_written + nrows - writer[0].rows_allocated, &status);
+		writer[0].rows_allocated = writer[0].rows_written + nrows;
+	}
+	fits_write_tblbytes(writer[0].fptr, writer[0].rows_written+1, 1, nrows*writer[0].row_bytes, writer[0].rows, &status);
+	if(status != 0)
+	{
+		quickfits_error("ERROR : quickfits_uv_writer_append --> Error writing %s, error = %d\n",writer[0].filename,status);
+		return(status);
+	}
+	if(quickfits_checksums_enabled())
+	{
+		quickfits_checksum_add(&writer[0].checksum, writer[0].rows, nrows*writer[0].row_bytes);
+	}
+	quickfits_count_io(0, nrows*writer[0].row_bytes, 0, 0);
+	writer[0].rows_written += nrows;
+	writer[0].rows_buffered = 0;
+
+	return(status);
+}
+
+static int uv_writer_append(quickfits_uv_writer* writer, long long nrows, const double* u, const double* v, const double* w, const double* date, const double* baseline, const double* inttim, const double* tvis)
+{
+	unsigned char* p;
+	long long row, k;
+	int status;
+
+	status = 0;
+	if(writer[0].fptr == NULL)
+	{
+		return(FILE_NOT_OPENED);
+	}
+	if(writer[0].nvis > 0 && writer[0].rows_written + writer[0].rows_buffered + nrows > writer[0].nvis)
+	{
+		quickfits_error("ERROR : quickfits_uv_writer_append --> %s only has %lld visibilities\n",writer[0].filename,writer[0].nvis);
+		return(BAD_ROW_NUM);
+	}
+
+	for(row=0;row<nrows && status==0;row++)
+	{
+		p = writer[0].rows + writer[0].rows_buffered*writer[0].row_bytes;
+		put_be64(p, u[row]);
+		put_be64(p+8, v[row]);
+		put_be64(p+16, (w != NULL) ? w[row] : 0.0);
+		put_be64(p+24, (date != NULL) ? date[row] : 0.0);
+		put_be32(p+32, (baseline != NULL) ? baseline[row] : 0.0);
+		put_be32(p+36, (inttim != NULL) ? inttim[row] : 0.0);
+		p += 40;
+		for(k=0;k<writer[0].row_elements;k++)
+		{
+			put_be32(p+4*k, tvis[row*writer[0].row_elements+k]);
+		}
+		writer[0].rows_buffered++;
+		if(writer[0].rows_buffered == writer[0].buffer_rows)
+		{
+			status = flush_rows(writer);
+		}
+	}
+
+	return(status);
+}
+
+int quickfits_uv_writer_append(quickfits_uv_writer* writer, long long nrows, const double* u, const double* v, const double* w, const double* date, const double* baseline, const double* inttim, const double* tvis)
+{
+/*
+	Append visibilities to a file opened with quickfits_uv_writer_open. Rows are encoded into a large buffer that is
+	written whenever it fills, so any number of rows can be given at a time.
+ 
+	INPUTS:
+		nrows : number of visibilities following on from the last ones written
+		u, v : nrows u and v coordinates, in seconds (as read by quickfits_read_uv_data)
+		w, date, baseline, inttim : nrows w (seconds), Julian date, AIPS baseline number (256*ant1 + ant2) and integration time (seconds).
+			Any of these may be NULL to write zeros.
+		tvis : nrows*12*nif*nchan visibilities, in the order quickfits_read_uv_data uses
+ 
+	RETURN:
+		0 if no errors occur, BAD_ROW_NUM if this would write past the number of visibilities given to quickfits_uv_writer_open.
+*/
+	long long start;
+	int status;
+
+	start = quickfits_trace_start();
+	status = uv_writer_append(writer, nrows, u, v, w, date, baseline, inttim, tvis);
+	quickfits_trace_api("quickfits_uv_writer_append", start);
+
+	return(status);
+}
+
+static void write_fq_table(fitsfile* fptr, fitsinfo_uv fitsi, const double* if_array, int* status)
+{
+	char* names[] = {"FRQSEL", "IF FREQ", "CH WIDTH", "TOTAL BANDWIDTH", "SIDEBAND"};
+	char* units[] = {"", "HZ", "HZ", "HZ", ""};
+	char forms[5][FLEN_VALUE];
+	char* formats[5];
+	char extname[] = "AIPS FQ ";
+	char comment[] = "";
+	double* if_freq;
+	double* widths;
+	int* sideband;
+	int i, frqsel;
+
+	for(i=0;i<5;i++)
+	{
+		formats[i] = forms[i];
+	}
+	sprintf(forms[0],"1J");
+	sprintf(forms[1],"%dD",fitsi.nif);
+	sprintf(forms[2],"%dE",fitsi.nif);
+	sprintf(forms[3],"%dE",fitsi.nif);
+	sprintf(forms[4],"%dJ",fitsi.nif);
+
+	if_freq = malloc(fitsi.nif*sizeof(double));
+	widths = malloc(fitsi.nif*sizeof(double));
+	sideband = malloc(fitsi.nif*sizeof(int));
+	if(if_freq == NULL || widths == NULL || sideband == NULL)
+	{
+		*status = MEMORY_ALLOCATION;
+	}
+	else
+	{
+		for(i=0;i<fitsi.nif;i++)
+		{
+			if_freq[i] = (if_array != NULL) ? if_array[i] : (double)(i)*fitsi.nchan*fitsi.chan_width;	// contiguous IFs by default
+			widths[i] = fitsi.chan_width;
+			sideband[i] = 1;
+		}
+		frqsel = 1;
+
+		fits_create_tbl(fptr, BINARY_TBL, 1, 5, names, formats, units, extname, status);
+		fits_update_key(fptr, TINT, "EXTVER", &frqsel, comment, status);
+		fits_update_key(fptr, TINT, "NO_IF", &fitsi.nif, comment, status);
+		fits_write_col(fptr, TINT, 1, 1, 1, 1, &frqsel, status);
+		fits_write_col(fptr, TDOUBLE, 2, 1, 1, fitsi.nif, if_freq, status);
+		fits_write_col(fptr, TDOUBLE, 3, 1, 1, fitsi.nif, widths, status);
+		for(i=0;i<fitsi.nif;i++)
+		{
+			widths[i] = (double)(fitsi.nchan)*fitsi.chan_width;
+		}
+		fits_write_col(fptr, TDOUBLE, 4, 1, 1, fitsi.nif, widths, status);
+		fits_write_col(fptr, TINT, 5, 1, 1, fitsi.nif, sideband, status);
+		if(quickfits_checksums_enabled())
+		{
+			fits_write_chksum(fptr, status);
+		}
+	}
+
+	free(if_freq);
+	free(widths);
+	free(sideband);
+}
+
+static void write_an_table(fitsfile* fptr, fitsinfo_uv fitsi, int nant, const char** annames, const double* stabxyz, const double* rdterm, const double* ldterm, int* status)
+{
+	char* names[] = {"ANNAME", "STABXYZ", "NOSTA", "MNTSTA", "STAXOF", "POLTYA", "POLAA", "POLCALA", "POLTYB", "POLAB", "POLCALB"};
+	char* units[] = {"", "METERS", "", "", "METERS", "", "DEGREES", "", "", "DEGREES", ""};
+	char polcal_form[FLEN_VALUE];
+	char* formats[] = {"8A", "3D", "1J", "1J", "1E", "1A", "1E", polcal_form, "1A", "1E", polcal_form};
+	char extname[] = "AIPS AN ";
+	char comment[] = "";
+	char vlbi[] = "VLBI    ";	// as quickfits_replace_ant_info
+	char approx[] = "APPROX  ";
+	char pol_r[] = "R";
+	char pol_l[] = "L";
+	char* name_buffer;
+	char** pnames;
+	char** ppol_r;
+	char** ppol_l;
+	double* xyz;
+	int* nosta;
+	int i, one, npcal;
+
+	sprintf(polcal_form,"%dE",2*fitsi.nif);
+
+	fits_create_tbl(fptr, BINARY_TBL, nant, 11, names, formats, units, extname, status);
+	one = 1;
+	npcal = 2;
+	fits_update_key(fptr, TINT, "EXTVER", &one, comment, status);
+	fits_update_key(fptr, TSTRING, "ARRNAM", fitsi.telescope, comment, status);
+	fits_update_key(fptr, TSTRING, "RDATE", fitsi.date_obs, comment, status);
+	fits_update_key(fptr, TDOUBLE, "FREQ", &fitsi.freq, comment, status);
+	fits_update_key(fptr, TINT, "NO_IF", &fitsi.nif, comment, status);
+	fits_update_key(fptr, TINT, "NOPCAL", &npcal, comment, status);
+	fits_update_key(fptr, TSTRING, "POLTYPE", (rdterm != NULL || ldterm != NULL) ? vlbi : approx, comment, status);
+
+	// each column is filled for every antenna, then written in one call
+
+	name_buffer = malloc(nant*FLEN_VALUE + 1);
+	pnames = malloc(nant*sizeof(char*) + 1);
+	ppol_r = malloc(nant*sizeof(char*) + 1);
+	ppol_l = malloc(nant*sizeof(char*) + 1);
+	xyz = calloc(3*nant + 1, sizeof(double));
+	nosta = malloc(nant*sizeof(int) + 1);
+	if(name_buffer == NULL || pnames == NULL || ppol_r == NULL || ppol_l == NULL || xyz == NULL || nosta == NULL)
+	{
+		if(*status == 0)
+		{
+			*status = MEMORY_ALLOCATION;
+		}
+	}
+	else if(nant > 0)
+	{
+		for(i=0;i<nant;i++)
+		{
+			pnames[i] = &name_buffer[i*FLEN_VALUE];
+			if(annames != NULL)
+			{
+				snprintf(pnames[i],FLEN_VALUE,"%s",annames[i]);
+			}
+			else
+			{
+				snprintf(pnames[i],FLEN_VALUE,"AN%02d",i+1);
+			}
+			ppol_r[i] = pol_r;
+			ppol_l[i] = pol_l;
+			nosta[i] = i+1;
+		}
+		if(stabxyz != NULL)
+		{
+			memcpy(xyz, stabxyz, 3*nant*sizeof(double));
+		}
+		fits_write_col(fptr, TSTRING, 1, 1, 1, nant, pnames, status);
+		fits_write_col(fptr, TDOUBLE, 2, 1, 1, 3LL*nant, xyz, status);
+		fits_write_col(fptr, TINT, 3, 1, 1, nant, nosta, status);
+		fits_write_col(fptr, TSTRING, 6, 1, 1, nant, ppol_r, status);
+		fits_write_col(fptr, TSTRING, 9, 1, 1, nant, ppol_l, status);
+	}
+	free(name_buffer);
+	free(pnames);
+	free(ppol_r);
+	free(ppol_l);
+	free(xyz);
+	free(nosta);
+
+	if(nant > 0 && rdterm != NULL)	// (Re, Im) for each IF, for each antenna in turn
+	{
+		fits_write_col(fptr, TDOUBLE, 8, 1, 1, 2LL*fitsi.nif*nant, (double*) rdterm, status);
+	}
+	if(nant > 0 && ldterm != NULL)
+	{
+		fits_write_col(fptr, TDOUBLE, 11, 1, 1, 2LL*fitsi.nif*nant, (double*) ldterm, status);
+	}
+	if(quickfits_checksums_enabled())
+	{
+		fits_write_chksum(fptr, status);
+	}
+}
+
+static int uv_writer_close(quickfits_uv_writer* writer, const double* if_array, int nant, const char** annames, const double* stabxyz, const double* rdterm, const double* ldterm)
+{
+	int status;
+
+	if(writer[0].fptr == NULL)
+	{
+		return(FILE_NOT_OPENED);
+	}
+
+	status = flush_rows(writer);
+	free(writer[0].rows);
+	writer[0].rows = NULL;
+	if(quickfits_checksums_enabled())	// the UV table is now complete (rows never written are zeros, which don't change the sum)
+	{
+		quickfits_write_datasum(writer[0].fptr, quickfits_checksum_finish(&writer[0].checksum), &status);
+	}
+
+	write_fq_table(writer[0].fptr, writer[0].fitsi, if_array, &status);
+	write_an_table(writer[0].fptr, writer[0].fitsi, nant, annames, stabxyz, rdterm, ldterm, &status);
+	if(status != 0)
+	{
+		quickfits_error("ERROR : quickfits_uv_writer_close --> Error writing frequency and antenna tables to %s, error = %d\n",writer[0].filename,status);
+	}
+
+	quickfits_close_file(writer[0].fptr, &status);
+	writer[0].fptr = NULL;
+	if(status != 0)
+	{
+		quickfits_error("ERROR : quickfits_uv_writer_close --> Error closing %s, error = %d\n",writer[0].filename,status);
+	}
+
+	return(status);
+}
+
+int quickfits_uv_writer_close(quickfits_uv_writer* writer, const double* if_array, int nant, const char** annames, const double* stabxyz, const double* rdterm, const double* ldterm)
+{
+/*
+	Finish a file started with quickfits_uv_writer_open: write any buffered visibilities, then the AIPS FQ and AIPS AN
+	tables, and close the file. Rows of a table of known size that were never appended are left as zeros (zero weight).
+ 
+	INPUTS:
+		if_array : nif IF frequency offsets from fitsi.freq, in Hz, as read by quickfits_read_uv_data (NULL for contiguous IFs)
+		nant : number of antennas
+		annames : nant antenna names (NULL for AN01, AN02, ...)
+		stabxyz : nant*3 station coordinates in metres (NULL for zeros)
+		rdterm, ldterm : nant*nif*2 (Re, Im) R and L D-terms of each antenna, as for quickfits_replace_ant_info (NULL for zeros)
+ 
+	RETURN:
+		0 if no errors occur.
+*/
+	long long start;
+	int status;
+
+	start = quickfits_trace_start();
+	status = uv_writer_close(writer, if_array, nant, annames, stabxyz, rdterm, ldterm);
+	quickfits_trace_api("quickfits_uv_writer_close", start);
+
+	return(status);
+}
@@ -14,169 +14,167 @@
 #include "quickfits.h"
 
 
-int quickfits_write_map(const char* filename , double* array, fitsinfo_map fitsi, char* history)
+int quickfits_create_map_hdu(fitsfile* fptr, fitsinfo_map fitsi, long long nplanes, char* history, int* status)
 {
     /*
-     Write out FITS map.
+     Create the primary image of a map, with the keywords written by quickfits_write_map, ready for the pixels.
      
-     inputs: (contained in fisinfo_map structure)
-        filename = name of file to write out
-        array = image to write out
-        imsize = dimension of image
-        cell = cellsize
-        ra,dec = Right ascension and declination
-        centre_shift = any shift applied to the centre of the map
-        rotations = any rotation to be applied to the map
-        freq = frequency of map
-        freq_delta = change in frequency
-        stokes = Stokes parameter of map
-        object = name of object in map
-        observer = observer name
-        telescope = observing telescope
-        equinox = Equinox
-        data_obs = observing date
+     inputs:
+        fptr = new, empty file
+        fitsi = map information, as for quickfits_write_map
+        nplanes = length of the frequency axis (1 for a single map)
         history = history comments
-        bmaj = restoring beam major axis (degrees)
-        bmin = restoring beam minor axis (degrees)
-        bpa = restoring beam angle (degrees)
-        niter = number of iterations
-        jy_per_beam = boolean - are the units Jy/Beam or Jy?
      
      returns:
-        0 if no errors occur.
+        status, as for cfitsio
      */
 
-	fitsfile *fptr;	// pointer to fits file
-	int status, i, j;
-	long fpixel = 1, naxis = 4, nelements;	// fpixel is the coordinate of the first pixel to be read
-	long naxes[4] = { fitsi.imsize_ra, fitsi.imsize_dec , 1 , 1 };
+	int naxis = 4;
+	LONGLONG naxes[4] = { fitsi.imsize_ra, fitsi.imsize_dec , nplanes , 1 };
 	double temp;
 	char comment[]="";
 	char tstring[FLEN_VALUE];
-	char fname[strlen(filename)+1];
-
-	strcpy(fname,"!");
-	strcat(fname,filename);
-
-
-
-	status = 0;
-	// status is an error variable
-
-	fits_create_file(&fptr,fname, &status);
-
-	// create new file
 
 	// Create the primary array image (64-bit floating point pixels)
-	fits_create_img(fptr, DOUBLE_IMG, naxis, naxes, &status);
+	fits_create_imgll(fptr, DOUBLE_IMG, naxis, naxes, status);
 
 
-	fits_update_key(fptr, TSTRING, "OBJECT", fitsi.object , comment , &status);
-	fits_update_key(fptr, TSTRING, "OBSERVER", fitsi.observer , comment , &status);	// write out information about the source
-	fits_update_key(fptr, TSTRING, "TELESCOP", fitsi.telescope , comment , &status);
-	fits_update_key(fptr, TDOUBLE, "EQUINOX", &fitsi.equinox , comment, &status);
-	fits_update_key(fptr, TSTRING, "DATE-OBS", fitsi.date_obs , comment , &status);
-	fits_update_key(fptr, TDOUBLE, "OBSRA", &fitsi.ra , comment , &status);
-	fits_update_key(fptr, TDOUBLE, "OBSDEC", &fitsi.dec , comment , &status);
+	fits_update_key(fptr, TSTRING, "OBJECT", fitsi.object , comment , status);
+	fits_update_key(fptr, TSTRING, "OBSERVER", fitsi.observer , comment , status);	// write out information about the source
+	fits_update_key(fptr, TSTRING, "TELESCOP", fitsi.telescope , comment , status);
+	fits_update_key(fptr, TDOUBLE, "EQUINOX", &fitsi.equinox , comment, status);
+	fits_update_key(fptr, TSTRING, "DATE-OBS", fitsi.date_obs , comment , status);
+	fits_update_key(fptr, TDOUBLE, "OBSRA", &fitsi.ra , comment , status);
+	fits_update_key(fptr, TDOUBLE, "OBSDEC", &fitsi.dec , comment , status);
 
 	temp=1.0;
-	fits_update_key(fptr, TDOUBLE, "BSCALE", &temp,comment, &status);
+	fits_update_key(fptr, TDOUBLE, "BSCALE", &temp,comment, status);
 
 	temp=0.0;
-	fits_update_key(fptr, TDOUBLE, "BZERO", &temp,comment, &status);
+	fits_update_key(fptr, TDOUBLE, "BZERO", &temp,comment, status);
 
 
 	if(fitsi.have_beam)
 	{
 		sprintf(tstring,"JY/BEAM");
-		fits_update_key(fptr, TSTRING, "BUNIT", tstring , comment , &status);
+		fits_update_key(fptr, TSTRING, "BUNIT", tstring , comment , status);
 	}
 	else
 	{
 		sprintf(tstring,"JY/PIXEL");
-		fits_update_key(fptr, TSTRING, "BUNIT", tstring , comment , &status);
+		fits_update_key(fptr, TSTRING, "BUNIT", tstring , comment , status);
 	}
 
 
 
 	sprintf(tstring,"RA---SIN");
-	fits_update_key(fptr, TSTRING, "CTYPE1", tstring , comment , &status);	// write out information about the first axis, Right Ascention
+	fits_update_key(fptr, TSTRING, "CTYPE1", tstring , comment , status);	// write out information about the first axis, Right Ascention
 
-	fits_update_key(fptr, TDOUBLE, "CRVAL1", &fitsi.ra , comment , &status);
+	fits_update_key(fptr, TDOUBLE, "CRVAL1", &fitsi.ra , comment , status);
 
 	temp = -fitsi.cell_ra;
-	fits_update_key(fptr, TDOUBLE, "CDELT1", &temp , comment , &status);
+	fits_update_key(fptr, TDOUBLE, "CDELT1", &temp , comment , status);
 
 	temp = fitsi.centre_shift[0];
-	fits_update_key(fptr, TDOUBLE, "CRPIX1", &temp , comment , &status);
+	fits_update_key(fptr, TDOUBLE, "CRPIX1", &temp , comment , status);
 
 	temp = fitsi.rotations[0];
-	fits_update_key(fptr, TDOUBLE, "CROTA1", &temp , comment , &status);
+	fits_update_key(fptr, TDOUBLE, "CROTA1", &temp , comment , status);
 
 
 
 
 
 	sprintf(tstring,"DEC--SIN");
-	fits_update_key(fptr, TSTRING, "CTYPE2", tstring , comment , &status);	// write out information about the second axis, Declination
+	fits_update_key(fptr, TSTRING, "CTYPE2", tstring , comment , status);	// write out information about the second axis, Declination
 
-	fits_update_key(fptr, TDOUBLE, "CRVAL2", &fitsi.dec , comment , &status);
+	fits_update_key(fptr, TDOUBLE, "CRVAL2", &fitsi.dec , comment , status);
 
-	fits_update_key(fptr, TDOUBLE, "CDELT2", &fitsi.cell_dec , comment , &status);
+	fits_update_key(fptr, TDOUBLE, "CDELT2", &fitsi.cell_dec , comment , status);
 
 	temp = fitsi.centre_shift[1];
-	fits_update_key(fptr, TDOUBLE, "CRPIX2", &temp , comment , &status);
+	fits_update_key(fptr, TDOUBLE, "CRPIX2", &temp , comment , status);
 
 	temp = fitsi.rotations[1];
-	fits_update_key(fptr, TDOUBLE, "CROTA2", &temp , comment , &status);
+	fits_update_key(fptr, TDOUBLE, "CROTA2", &temp , comment , status);
 
 
 
 
 
 	sprintf(tstring,"FREQ");
-	fits_update_key(fptr, TSTRING, "CTYPE3", tstring , comment , &status);	// write out information about the third axis, Frequency
+	fits_update_key(fptr, TSTRING, "CTYPE3", tstring , comment , status);	// write out information about the third axis, Frequency
 
-	fits_update_key(fptr, TDOUBLE, "CRVAL3", &fitsi.freq , comment , &status);
+	fits_update_key(fptr, TDOUBLE, "CRVAL3", &fitsi.freq , comment , status);
 
-	fits_update_key(fptr, TDOUBLE, "CDELT3", &fitsi.freq_delta , comment , &status);
+	fits_update_key(fptr, TDOUBLE, "CDELT3", &fitsi.freq_delta , comment , status);
 
 	temp=1.0;
-	fits_update_key(fptr, TDOUBLE, "CRPIX3", &temp , comment , &status);
+	fits_update_key(fptr, TDOUBLE, "CRPIX3", &temp , comment , status);
 
 	temp=0.0;
-	fits_update_key(fptr, TDOUBLE, "CROTA3", &temp , comment , &status);
+	fits_update_key(fptr, TDOUBLE, "CROTA3", &temp , comment , status);
 
 
 
 	sprintf(tstring,"STOKES");
-	fits_update_key(fptr, TSTRING, "CTYPE4" , tstring , comment , &status);	// write out information about the fourth axis, Stokes parameter
+	fits_update_key(fptr, TSTRING, "CTYPE4" , tstring , comment , status);	// write out information about the fourth axis, Stokes parameter
 
 	temp = (double)(fitsi.stokes);
-	fits_update_key(fptr, TDOUBLE, "CRVAL4", &temp , comment , &status);
+	fits_update_key(fptr, TDOUBLE, "CRVAL4", &temp , comment , status);
 
 	temp=1.0;
-	fits_update_key(fptr, TDOUBLE, "CDELT4", &temp , comment , &status);
+	fits_update_key(fptr, TDOUBLE, "CDELT4", &temp , comment , status);
 
-	fits_update_key(fptr, TDOUBLE, "CRPIX4", &temp , comment , &status);
+	fits_update_key(fptr, TDOUBLE, "CRPIX4", &temp , comment , status);
 
 	temp=0.0;
-	fits_update_key(fptr, TDOUBLE, "CROTA4", &temp , comment , &status);
+	fits_update_key(fptr, TDOUBLE, "CROTA4", &temp , comment , status);
 
 
-	fits_write_history(fptr , history , &status);	// write history and date
+	fits_write_history(fptr , history , status);	// write history and date
 
-	fits_write_date(fptr , &status);
+	fits_write_date(fptr , status);
+
+	if(fitsi.have_beam)	// note the beam in the history in AIPS fashion - the table itself is written by quickfits_write_beam_table
+	{
+		sprintf(tstring,"COMMENT : WRITING OUT BEAM IN AIPS FASHION (NOT REALLY FROM AIPS)");	// write beam as AIPS-style note
+		fits_write_history(fptr , tstring , status);
 
+		// NB - do no use more than 8 places here. Make sure to use the same accuracy for BMAJ and BMIN
+		sprintf(tstring,"AIPS   CLEAN BMAJ=  %.8lf BMIN=  %.8lf BPA=   %.8lf" , fitsi.bmaj , fitsi.bmin , fitsi.bpa );
+		fits_write_history(fptr , tstring , status);
 
+		if(fitsi.niter>0)
+		{
+			sprintf(tstring,"COMMENT : NITER BELOW NOT NECESSARILY FROM CLEAN");	// write beam as AIPS-style note
+			fits_write_history(fptr , tstring , status);
 
-	nelements = naxes[0] * naxes[1];
-	// number of pixels to write
 
-	// Write the array of double size floating point to the image
-	fits_write_img(fptr, TDOUBLE, fpixel, nelements, array, &status);
+			sprintf(tstring,"AIPS   CLEAN NITER=     %d PRODUCT=1",fitsi.niter);
+			fits_write_history(fptr , tstring , status);
+		}
+	}
 
-	if(fitsi.have_beam)	// write out beam information for AIPS if necessary. note AIPS CG --> AIPS CLEAN gaussian, which is not true in this case, but is used for compatability with AIPS
+	return(*status);
+}
+
+int quickfits_write_beam_table(fitsfile* fptr, const char* filename, fitsinfo_map fitsi, int* status)
+{
+    /*
+     Append the AIPS CG table holding the restoring beam, if fitsi.have_beam is set.
+     note AIPS CG --> AIPS CLEAN gaussian, which is not true in this case, but is used for compatability with AIPS
+     
+     inputs:
+        fptr = file with the map already written
+        filename = name of the file (for messages)
+        fitsi = map information (freq, bmaj, bmin, bpa in degrees)
+     
+     returns:
+        status, as for cfitsio
+     */
+
+	if(fitsi.have_beam)
 	{
 		char bmaj_name[] = "BMAJ";
 		char bmin_name[] = "BMIN";
@@ -190,48 +188,115 @@ int quickfits_write_map(const char* filename , double* array, fitsinfo_map fitsi
 		char* beaminfo_datatype[4] = {data_type , data_type , data_type , data_type};
 		char tbl_name[] = "AIPS CG ";
 
-		sprintf(tstring,"COMMENT : WRITING OUT BEAM IN AIPS FASHION (NOT REALLY FROM AIPS)");	// write beam as AIPS-style note
-		fits_write_history(fptr , tstring , &status);
-
-		// NB - do no use more than 8 places here. Make sure to use the same accuracy for BMAJ and BMIN
-		sprintf(tstring,"AIPS   CLEAN BMAJ=  %.8lf BMIN=  %.8lf BPA=   %.8lf" , fitsi.bmaj , fitsi.bmin , fitsi.bpa );
-		fits_write_history(fptr , tstring , &status);
-
-		if(fitsi.niter>0)
+		fits_create_tbl(fptr , BINARY_TBL , 1 , 4 , beaminfo_names , beaminfo_datatype , beaminfo_units , tbl_name , status);	// make beam table
+		if(*status!=0)
 		{
-			sprintf(tstring,"COMMENT : NITER BELOW NOT NECESSARILY FROM CLEAN");	// write beam as AIPS-style note
-			fits_write_history(fptr , tstring , &status);
-
-
-			sprintf(tstring,"AIPS   CLEAN NITER=     %d PRODUCT=1",fitsi.niter);
-			fits_write_history(fptr , tstring , &status);
+			quickfits_error("quickfits_write_map -->  Error creating beam information table for %s, error code %i\n",filename,*status);
 		}
 
-		fits_create_tbl(fptr , BINARY_TBL , 1 , 4 , beaminfo_names , beaminfo_datatype , beaminfo_units , tbl_name , &status);	// make beam table
-		if(status!=0)
+		if(fits_movnam_hdu(fptr , BINARY_TBL , tbl_name , 0 , status))
 		{
-			printf("quickfits_write_map -->  Error creating beam information table for %s, error code %i\n",filename,status);
+			quickfits_error("quickfits_write_map -->  Error writing beam information to %s, error code %i\n",filename,*status);
 		}
 
-		if(fits_movnam_hdu(fptr , BINARY_TBL , tbl_name , 0 , &status))
+		fits_write_col(fptr, TDOUBLE , 1 , 1 , 1 , 1 , &fitsi.freq , status);
+		fits_write_col(fptr, TDOUBLE , 2 , 1 , 1 , 1 , &fitsi.bmaj , status);	// write out values (beam info in degrees)
+		fits_write_col(fptr, TDOUBLE , 3 , 1 , 1 , 1 , &fitsi.bmin , status);
+		fits_write_col(fptr, TDOUBLE , 4 , 1 , 1 , 1 , &fitsi.bpa , status);
+
+		if(quickfits_checksums_enabled())	// one row - not worth summing as it's written
 		{
-			printf("quickfits_write_map -->  Error writing beam information to %s, error code %i\n",filename,status);
+			fits_write_chksum(fptr, status);
 		}
+	}
+
+	return(*status);
+}
+
+static int write_map(const char* filename , double* array, fitsinfo_map fitsi, char* history)
+{
+	fitsfile *fptr;	// pointer to fits file
+	int status;
+	LONGLONG fpixel = 1, nelements;	// fpixel is the coordinate of the first pixel to be read
+	LONGLONG naxes[2] = { fitsi.imsize_ra, fitsi.imsize_dec };
+	long long start;
+
+
+
+	status = 0;
+	// status is an error variable
 
-		fits_write_col(fptr, TDOUBLE , 1 , 1 , 1 , 1 , &fitsi.freq , &status);
-		fits_write_col(fptr, TDOUBLE , 2 , 1 , 1 , 1 , &fitsi.bmaj , &status);	// write out values (beam info in degrees)
-		fits_write_col(fptr, TDOUBLE , 3 , 1 , 1 , 1 , &fitsi.bmin , &status);
-		fits_write_col(fptr, TDOUBLE , 4 , 1 , 1 , 1 , &fitsi.bpa , &status);
+	quickfits_create_file(&fptr,filename, &status);
 
+	// create new file (overwriting any existing one), either on disk or in a registered memory file
+
+	quickfits_create_map_hdu(fptr, fitsi, 1, history, &status);
+
+
+
+	if(quickfits_element_count(2, naxes, &nelements))	// number of pixels to write
+	{
+		quickfits_error("quickfits_write_map -->  Image size %lld x %lld is too large\n",fitsi.imsize_ra,fitsi.imsize_dec);
+		status = NUM_OVERFLOW;
 	}
 
-	fits_close_file(fptr, &status);
+	// Write the array of double size floating point to the image
+	start = quickfits_trace_start();
+	fits_write_img(fptr, TDOUBLE, fpixel, nelements, array, &status);
+	quickfits_trace_phase(QUICKFITS_PHASE_WRITE, start);
+	quickfits_count_io(0, nelements*sizeof(double), 0, 0);
+
+	if(quickfits_checksums_enabled())	// sum the data from the array rather than reading the file back
+	{
+		quickfits_write_datasum(fptr, quickfits_checksum_doubles(array, nelements, 0), &status);
+	}
+
+	quickfits_write_beam_table(fptr, filename, fitsi, &status);	// write out beam information for AIPS if necessary
+
+	quickfits_close_file(fptr, &status);
 	fits_report_error(stderr, status);
 
 	return(status);
+}
 
-	fits_close_file(fptr, &status);
-	fits_report_error(stderr, status);
+int quickfits_write_map(const char* filename , double* array, fitsinfo_map fitsi, char* history)
+{
+    /*
+     Write out FITS map.
+     Filenames starting with QUICKFITS_MEMFILE_PREFIX are written into a registered memory file.
+     
+     inputs: (contained in fisinfo_map structure)
+        filename = name of file to write out
+        array = image to write out
+        imsize = dimension of image
+        cell = cellsize
+        ra,dec = Right ascension and declination
+        centre_shift = any shift applied to the centre of the map
+        rotations = any rotation to be applied to the map
+        freq = frequency of map
+        freq_delta = change in frequency
+        stokes = Stokes parameter of map
+        object = name of object in map
+        observer = observer name
+        telescope = observing telescope
+        equinox = Equinox
+        data_obs = observing date
+        history = history comments
+        bmaj = restoring beam major axis (degrees)
+        bmin = restoring beam minor axis (degrees)
+        bpa = restoring beam angle (degrees)
+        niter = number of iterations
+        jy_per_beam = boolean - are the units Jy/Beam or Jy?
+     
+     returns:
+        0 if no errors occur.
+     */
+	long long start;
+	int status;
+
+	start = quickfits_trace_start();
+	status = write_map(filename, array, fitsi, history);
+	quickfits_trace_api("quickfits_write_map", start);
 
 	return(status);
 }
@@ -0,0 +1,124 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+	Build and query quickfits header catalogues from the command line.
+
+	quickfits_catalogue build <catalogue> <directory> [nthreads]
+		Create or refresh a catalogue of the maps and UV files below directory
+
+	quickfits_catalogue query <catalogue> [-type map|uv] [-object name] [-telescope name]
+		[-cone ra dec radius] [-freq min max] [-date min max]
+		Print the names of the matching files, one per line
+*/
+
+static int usage()
+{
+	printf("Usage : quickfits_catalogue build <catalogue> <directory> [nthreads]\n");
+	printf("        quickfits_catalogue query <catalogue> [-type map|uv] [-object name] [-telescope name]\n");
+	printf("                                  [-cone ra dec radius] [-freq min max] [-date min max]\n");
+	return(1);
+}
+
+int main(int argc, char** argv)
+{
+	fitscat cat;
+	fitscat_query query;
+	long long* matches;
+	long long nmatches, i;
+	int status, arg;
+
+	if(argc < 3)
+	{
+		return(usage());
+	}
+
+	if(!strcmp(argv[1],"build"))
+	{
+		if(argc < 4)
+		{
+			return(usage());
+		}
+		status = quickfits_catalogue_build(argv[2], argv[3], (argc > 4) ? atoi(argv[4]) : 0);
+		return(status != 0);
+	}
+
+	if(strcmp(argv[1],"query"))
+	{
+		return(usage());
+	}
+
+	quickfits_catalogue_query_init(&query);
+	for(arg=3;arg<argc;arg++)
+	{
+		if(!strcmp(argv[arg],"-type") && arg+1 < argc)
+		{
+			query.type = strcmp(argv[++arg],"uv") ? QUICKFITS_CAT_MAP : QUICKFITS_CAT_UV;
+		}
+		else if(!strcmp(argv[arg],"-object") && arg+1 < argc)
+		{
+			snprintf(query.object,FLEN_VALUE,"%s",argv[++arg]);
+		}
+		else if(!strcmp(argv[arg],"-telescope") && arg+1 < argc)
+		{
+			snprintf(query.telescope,FLEN_VALUE,"%s",argv[++arg]);
+		}
+		else if(!strcmp(argv[arg],"-cone") && arg+3 < argc)
+		{
+			query.ra = atof(argv[++arg]);
+			query.dec = atof(argv[++arg]);
+			query.radius = atof(argv[++arg]);
+		}
+		else if(!strcmp(argv[arg],"-freq") && arg+2 < argc)
+		{
+			query.freq_min = atof(argv[++arg]);
+			query.freq_max = atof(argv[++arg]);
+		}
+		else if(!strcmp(argv[arg],"-date") && arg+2 < argc)
+		{
+			snprintf(query.date_min,FLEN_VALUE,"%s",argv[++arg]);
+			snprintf(query.date_max,FLEN_VALUE,"%s",argv[++arg]);
+		}
+		else
+		{
+			return(usage());
+		}
+	}
+
+	if(quickfits_catalogue_open(argv[2], &cat))
+	{
+		return(1);
+	}
+
+	nmatches = quickfits_catalogue_query(cat, query, NULL, 0);
+	matches = malloc((nmatches+1)*sizeof(long long));
+	if(matches == NULL)
+	{
+		quickfits_catalogue_close(&cat);
+		return(1);
+	}
+	quickfits_catalogue_query(cat, query, matches, nmatches);
+
+	for(i=0;i<nmatches;i++)
+	{
+		printf("%s\n",quickfits_catalogue_filename(cat,matches[i]));
+	}
+
+	free(matches);
+	quickfits_catalogue_close(&cat);
+	return(0);
+}
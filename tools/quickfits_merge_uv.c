@@ -0,0 +1,44 @@
+/*
+ Copyright (c) 2014, Colm Coughlan
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickfits.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+	Merge UV FITS files from the command line.
+
+	quickfits_merge_uv [-sort] <output> <input> [<input> ...]
+		Write the visibilities of every input into output, one file after another, or in time order with -sort
+*/
+
+static int usage()
+{
+	printf("Usage : quickfits_merge_uv [-sort] <output> <input> [<input> ...]\n");
+	return(1);
+}
+
+int main(int argc, char** argv)
+{
+	bool sort_by_time;
+	int first;
+
+	sort_by_time = (argc > 1 && !strcmp(argv[1],"-sort"));
+	first = sort_by_time ? 2 : 1;
+	if(argc < first + 2)
+	{
+		return(usage());
+	}
+
+	return(quickfits_merge_uv(argc - first - 1, (const char**) &argv[first+1], argv[first], sort_by_time) != 0);
+}